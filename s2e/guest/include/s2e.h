@@ -242,7 +242,8 @@ static inline int s2e_get_ram_object_bits()
 /** Declare a merge point: S2E will try to merge
  *  all states when they reach this point.
  *
- * NOTE: This requires merge searcher to be enabled. */
+ * NOTE: This requires merge searcher (-use-merge) or the
+ * StateMerger plugin to be enabled. */
 static inline void s2e_merge_point()
 {
     __asm__ __volatile__(
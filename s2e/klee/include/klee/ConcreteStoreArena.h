@@ -0,0 +1,99 @@
+//===-- ConcreteStoreArena.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONCRETESTOREARENA_H
+#define KLEE_CONCRETESTOREARENA_H
+
+#include <stdint.h>
+#include <map>
+
+namespace klee {
+
+  /// Allocator for the concrete stores of ObjectStates.
+  ///
+  /// When enabled (-concrete-store-arena), stores are carved out of large
+  /// mmap'ed chunks backed by huge pages (MAP_HUGETLB, or transparent huge
+  /// pages as a fallback), optionally bound to the NUMA node of the process
+  /// that maps them. Small stores are grouped in power-of-two size classes
+  /// with per-class free lists, so that the thousands of 128-byte RAM objects
+  /// owned by the states end up densely packed on few host pages.
+  /// Regions allocated elsewhere (e.g., the shared-concrete guest RAM)
+  /// can be given the same huge page and NUMA policy with adviseRegion.
+  /// When disabled, this is a thin wrapper around new[]/delete[].
+  class ConcreteStoreArena {
+  public:
+    struct Footprint {
+      /// Bytes mapped for the arena chunks
+      uint64_t mappedBytes;
+      /// Part of mappedBytes that is backed by MAP_HUGETLB pages
+      uint64_t hugeTlbBytes;
+      /// Bytes currently handed out to live stores (rounded to size class)
+      uint64_t liveBytes;
+      /// Bytes sitting in the free lists
+      uint64_t freeBytes;
+      /// Bytes of stores too large for the arena, allocated with new[]
+      uint64_t heapBytes;
+      /// Bytes of external regions passed to adviseRegion
+      uint64_t externalBytes;
+      uint64_t liveStores;
+      uint64_t chunkCount;
+    };
+
+  private:
+    enum {
+      MIN_CLASS_BITS = 4,
+      MAX_CLASS_BITS = 12,
+      CLASS_COUNT = MAX_CLASS_BITS - MIN_CLASS_BITS + 1
+    };
+
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    bool m_enabled;
+    bool m_useHugeTlb;
+    int m_numaNode;
+    uint64_t m_chunkSize;
+
+    typedef std::map<uint8_t*, uint64_t> Chunks;
+
+    uint8_t *m_chunkCur;
+    uint8_t *m_chunkEnd;
+    Chunks m_chunks;
+    unsigned m_fallbackStores;
+
+    FreeBlock *m_freeLists[CLASS_COUNT];
+    Footprint m_footprint;
+
+    ConcreteStoreArena();
+    ~ConcreteStoreArena();
+
+    static unsigned getSizeClass(unsigned size);
+    bool mapChunk();
+    bool isInArena(const uint8_t *store) const;
+    void bindToNode(uint8_t *start, uint64_t size);
+
+  public:
+    static ConcreteStoreArena &get();
+
+    uint8_t *allocate(unsigned size);
+    void deallocate(uint8_t *store, unsigned size);
+
+    /// Applies the huge page and NUMA settings of the arena to a region
+    /// that the arena does not own. The region must be page-aligned.
+    void adviseRegion(uint8_t *start, uint64_t size);
+
+    bool isEnabled() const { return m_enabled; }
+    int getNumaNode() const { return m_numaNode; }
+    const Footprint &getFootprint() const { return m_footprint; }
+  };
+
+} // End klee namespace
+
+#endif
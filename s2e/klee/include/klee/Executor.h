@@ -493,6 +493,25 @@ public:
                                    std::vector<unsigned char> > >
                                    &res);
 
+  /// Everything getSymbolicSolution needs from a state. It remains
+  /// valid after the state is destroyed, so that the inputs can be
+  /// computed later or in another process.
+  struct SymbolicSolutionQuery {
+    std::vector< ref<Expr> > constraints;
+    std::vector< std::pair<std::string, const Array*> > symbolics;
+    /// Counterexample preferences of all the symbolic objects, in order
+    std::vector< ref<Expr> > cexPreferences;
+  };
+
+  void getSymbolicSolutionQuery(const ExecutionState &state,
+                                SymbolicSolutionQuery &query);
+
+  bool getSymbolicSolution(const SymbolicSolutionQuery &query,
+                           std::vector< 
+                           std::pair<std::string,
+                           std::vector<unsigned char> > >
+                           &res);
+
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res);
 
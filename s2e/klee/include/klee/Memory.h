@@ -183,6 +183,11 @@ public:
 
   bool readOnly;
 
+private:
+  /// Set while concreteStore lives in a buffer that does not belong
+  /// to the object (see spillConcreteStore)
+  bool storeSpilled;
+
 public:
   /// Create a new object state for the given memory object with concrete
   /// contents. The initial contents are undefined, it is the callers
@@ -220,6 +225,14 @@ public:
     }
   }
 
+  /// Copies the concrete bytes of [offset, offset+size) into buf,
+  /// stopping at the first symbolic byte.
+  /// \return The number of bytes copied.
+  unsigned readConcrete(unsigned offset, uint8_t *buf, unsigned size) const;
+
+  /// Concrete counterpart of write8 for a whole range of bytes.
+  void writeConcrete(unsigned offset, const uint8_t *buf, unsigned size);
+
   // return bytes written.
   void write(unsigned offset, ref<Expr> value);
   void write(ref<Expr> offset, ref<Expr> value);
@@ -246,6 +259,17 @@ public:
   const uint8_t *getConcreteStore(bool allowSymbolic = false) const;
   uint8_t *getConcreteStore(bool allowSymolic = false);
 
+  /// Moves the concrete store into \a buffer, which must be at least
+  /// size bytes long and stays owned by the caller. Used to page out
+  /// the contents of inactive states.
+  void spillConcreteStore(uint8_t *buffer);
+
+  /// Brings a spilled concrete store back into private memory.
+  /// \return The buffer passed to spillConcreteStore.
+  uint8_t *fillConcreteStore();
+
+  bool isConcreteStoreSpilled() const { return storeSpilled; }
+
 private:
   const UpdateList &getUpdates() const;
 
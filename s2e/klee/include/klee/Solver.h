@@ -148,6 +148,22 @@ namespace klee {
     //
     // FIXME: This should go into a helper class, and should handle failure.
     virtual std::pair< ref<Expr>, ref<Expr> > getRange(const Query&);
+
+    /// getBounds - Compute the smallest and largest values of a given
+    /// expression, searching outwards from \arg example, a value the
+    /// expression is known to take.
+    ///
+    /// Unlike getRange, the number of queries grows with the logarithm of
+    /// the distance between the bounds and the example instead of with the
+    /// width of the expression, and failures are reported.
+    ///
+    /// \return True on success.
+    ///
+    /// \post(mustBeTrue(min <= e <= max) &&
+    ///       mayBeTrue(min == e) &&
+    ///       mayBeTrue(max == e))
+    bool getBounds(const Query&, uint64_t example,
+                   uint64_t &min, uint64_t &max);
   };
 
   /// STPSolver - A complete solver based on STP.
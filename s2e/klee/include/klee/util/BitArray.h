@@ -53,6 +53,42 @@ public:
     uint32_t mask = (1 << (size&0x1F)) - 1;
     return (bits[size/32] & mask) == mask;
   }
+
+  /// Number of consecutive set bits starting at idx, at most count.
+  /// Whole words are checked at once.
+  unsigned countOnes(unsigned idx, unsigned count) {
+    unsigned n = 0;
+    while (n < count) {
+      unsigned bit = (idx + n) & 0x1F;
+      uint32_t word = bits[(idx + n)/32] >> bit;
+      unsigned avail = 32 - bit;
+      if (bit == 0 && word == 0xffffffff) {
+        n += 32;
+        continue;
+      }
+      unsigned ones = 0;
+      while (ones < avail && (word & 1)) {
+        word >>= 1;
+        ++ones;
+      }
+      n += ones;
+      if (ones < avail)
+        break;
+    }
+    return n < count ? n : count;
+  }
+
+  /// Sets count bits starting at idx
+  void setRange(unsigned idx, unsigned count) {
+    while (count > 0) {
+      unsigned bit = idx & 0x1F;
+      unsigned n = 32 - bit < count ? 32 - bit : count;
+      uint32_t mask = n == 32 ? 0xffffffff : ((1u << n) - 1) << bit;
+      bits[idx/32] |= mask;
+      idx += n;
+      count -= n;
+    }
+  }
 };
 
 } // End klee namespace
@@ -16,7 +16,18 @@
 #include "klee/TimerStatIncrementer.h"
 #include "klee/ExecutionState.h"
 
+#include "llvm/Support/CommandLine.h"
+
 using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<bool>
+  ResolveWithBounds("resolve-with-bounds",
+                    cl::desc("Resolve symbolic pointers by scanning the objects "
+                             "between the solver bounds of the address"),
+                    cl::init(true));
+}
 
 ///
 
@@ -74,6 +85,18 @@ bool AddressSpace::isOwnedByUs(const ObjectState *os) const
     return cowKey==os->copyOnWriteOwner;
 }
 
+void AddressSpace::shareObject(const MemoryObject *mo, const ObjectState *os) {
+  assert(state);
+  const ObjectState *oldOS = findObject(mo);
+  assert(oldOS && oldOS != os && oldOS->size == os->size);
+
+  ObjectState *sharedOS = const_cast<ObjectState*>(os);
+  sharedOS->copyOnWriteOwner = 0;
+
+  state->addressSpaceChange(mo, oldOS, sharedOS);
+  objects = objects.replace(std::make_pair(mo, sharedOS));
+}
+
 /// 
 
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
@@ -217,6 +240,11 @@ bool AddressSpace::resolve(ExecutionState &state,
     if (!solver->getValue(state, p, cex))
       return true;
     uint64_t example = cex->getZExtValue();
+
+    if (ResolveWithBounds)
+      return resolveInBounds(state, solver, p, example, rl,
+                             maxResolutions, timeout_us, timer);
+
     MemoryObject hack(example);
     
     MemoryMap::iterator oi = objects.upper_bound(&hack);
@@ -308,6 +336,57 @@ bool AddressSpace::resolve(ExecutionState &state,
   return false;
 }
 
+bool AddressSpace::resolveInBounds(ExecutionState &state,
+                                   TimingSolver *solver,
+                                   ref<Expr> p,
+                                   uint64_t example,
+                                   ResolutionList &rl,
+                                   unsigned maxResolutions,
+                                   uint64_t timeout_us,
+                                   TimerStatIncrementer &timer) {
+  // The address can only point to the objects that intersect [min, max],
+  // which a single ordered scan of the map enumerates.
+  uint64_t min, max;
+  if (!solver->getBounds(state, p, example, min, max))
+    return true;
+
+  MemoryObject hack(min);
+  MemoryMap::iterator oi = objects.upper_bound(&hack);
+  MemoryMap::iterator begin = objects.begin();
+  MemoryMap::iterator end = objects.end();
+
+  // The object just below min may still contain it
+  if (oi != begin) {
+    --oi;
+    const MemoryObject *mo = oi->first;
+    if (mo->address != min && min - mo->address >= mo->size)
+      ++oi;
+  }
+
+  for (; oi != end && oi->first->address <= max; ++oi) {
+    const MemoryObject *mo = oi->first;
+    if (timeout_us && timeout_us < timer.check())
+      return true;
+
+    // Whole range within one object, no query needed
+    if (mo->address <= min && max - mo->address < mo->size) {
+      rl.push_back(*oi);
+      return false;
+    }
+
+    bool mayBeTrue;
+    if (!solver->mayBeTrue(state, mo->getBoundsCheckPointer(p), mayBeTrue))
+      return true;
+    if (mayBeTrue) {
+      rl.push_back(*oi);
+      if (rl.size() == maxResolutions)
+        return true;
+    }
+  }
+
+  return false;
+}
+
 // These two are pretty big hack so we can sort of pass memory back
 // and forth to externals. They work by abusing the concrete cache
 // store inside of the object states, which allows them to
@@ -19,6 +19,7 @@ namespace klee {
   class ExecutionState;
   class MemoryObject;
   class ObjectState;
+  class TimerStatIncrementer;
   class TimingSolver;
 
   template<class T> class ref;
@@ -40,6 +41,17 @@ namespace klee {
 
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace&); 
+
+    /// Resolve \a p by scanning the objects between the solver bounds
+    /// of the address, \a example being one of its feasible values.
+    bool resolveInBounds(ExecutionState &state,
+                         TimingSolver *solver,
+                         ref<Expr> p,
+                         uint64_t example,
+                         ResolutionList &rl,
+                         unsigned maxResolutions,
+                         uint64_t timeout_us,
+                         TimerStatIncrementer &timer);
     
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
@@ -121,6 +133,11 @@ namespace klee {
 
     bool isOwnedByUs(const ObjectState *os) const;
 
+    /// Replace the binding of \a mo by \a os, an identical object that
+    /// belongs to another address space. The object loses its owner, so
+    /// that both address spaces copy it on the next write.
+    void shareObject(const MemoryObject *mo, const ObjectState *os);
+
     /// Copy the concrete values of all managed ObjectStates into the
     /// actual system memory location they were allocated at.
     void copyOutConcretes();
@@ -0,0 +1,278 @@
+//===-- ConcreteStoreArena.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/ConcreteStoreArena.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cassert>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::opt<bool>
+  UseConcreteStoreArena("concrete-store-arena",
+                        cl::desc("Allocate concrete stores of memory objects "
+                                 "from a huge-page backed arena"),
+                        cl::init(false));
+
+  cl::opt<bool>
+  ConcreteStoreHugeTlb("concrete-store-hugetlb",
+                       cl::desc("Back the concrete store arena with "
+                                "MAP_HUGETLB pages (falls back to "
+                                "transparent huge pages)"),
+                       cl::init(true));
+
+  cl::opt<unsigned>
+  ConcreteStoreChunkSize("concrete-store-chunk-size",
+                         cl::desc("Size of the concrete store arena chunks "
+                                  "in MB"),
+                         cl::init(2));
+
+  cl::opt<bool>
+  ConcreteStoreNumaBind("concrete-store-numa",
+                        cl::desc("Prefer the NUMA node of the allocating "
+                                 "process for the concrete store arena"),
+                        cl::init(false));
+
+  cl::opt<int>
+  ConcreteStoreNumaNode("concrete-store-numa-node",
+                        cl::desc("NUMA node for the concrete store arena "
+                                 "(-1 = node of the allocating process)"),
+                        cl::init(-1));
+}
+
+// Values from linux/mempolicy.h, which is not always installed
+#define ARENA_MPOL_PREFERRED 1
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/***/
+
+ConcreteStoreArena &ConcreteStoreArena::get() {
+  static ConcreteStoreArena s_arena;
+  return s_arena;
+}
+
+ConcreteStoreArena::ConcreteStoreArena()
+  : m_enabled(UseConcreteStoreArena),
+    m_useHugeTlb(ConcreteStoreHugeTlb),
+    m_numaNode(-1),
+    m_chunkSize((uint64_t) ConcreteStoreChunkSize * 1024 * 1024),
+    m_chunkCur(0),
+    m_chunkEnd(0),
+    m_fallbackStores(0) {
+#if defined(_WIN32)
+  m_enabled = false;
+#endif
+  memset(m_freeLists, 0, sizeof(m_freeLists));
+  memset(&m_footprint, 0, sizeof(m_footprint));
+
+  if (m_chunkSize < ARENA_HUGE_PAGE_SIZE)
+    m_chunkSize = ARENA_HUGE_PAGE_SIZE;
+  m_chunkSize &= ~(uint64_t) (ARENA_HUGE_PAGE_SIZE - 1);
+}
+
+ConcreteStoreArena::~ConcreteStoreArena() {
+  // The chunks are shared with the stores of objects that may still be
+  // alive during static destruction, leave them to the OS.
+}
+
+unsigned ConcreteStoreArena::getSizeClass(unsigned size) {
+  unsigned c = 0;
+  unsigned blockSize = 1 << MIN_CLASS_BITS;
+  while (blockSize < size) {
+    blockSize <<= 1;
+    ++c;
+  }
+  return c;
+}
+
+bool ConcreteStoreArena::isInArena(const uint8_t *store) const {
+  Chunks::const_iterator it = m_chunks.upper_bound(const_cast<uint8_t*>(store));
+  if (it == m_chunks.begin())
+    return false;
+  --it;
+  return store < it->first + it->second;
+}
+
+void ConcreteStoreArena::bindToNode(uint8_t *start, uint64_t size) {
+#if defined(__linux__) && defined(SYS_mbind)
+  int node = ConcreteStoreNumaNode;
+#if defined(SYS_getcpu)
+  if (node < 0) {
+    // The node is looked up at each chunk mapping, so that S2E processes
+    // forked on another socket bind their new chunks locally.
+    unsigned cpu = 0, cpuNode = 0;
+    if (syscall(SYS_getcpu, &cpu, &cpuNode, 0) == 0)
+      node = cpuNode;
+  }
+#endif
+  if (node < 0 || node >= (int) (sizeof(unsigned long) * 8))
+    return;
+
+  // Preferred rather than strict binding: running out of pages on
+  // the local node must not kill the run.
+  unsigned long nodeMask = 1UL << node;
+  if (syscall(SYS_mbind, start, size, ARENA_MPOL_PREFERRED,
+              &nodeMask, sizeof(nodeMask) * 8, 0) == 0) {
+    m_numaNode = node;
+  }
+#endif
+}
+
+bool ConcreteStoreArena::mapChunk() {
+#if defined(_WIN32)
+  return false;
+#else
+  uint8_t *chunk = 0;
+  bool hugeTlb = false;
+
+#if defined(MAP_HUGETLB)
+  if (m_useHugeTlb) {
+    void *p = mmap(0, m_chunkSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      chunk = (uint8_t*) p;
+      hugeTlb = true;
+    } else {
+      // No huge pages reserved on this host, stop trying
+      m_useHugeTlb = false;
+    }
+  }
+#endif
+
+  if (!chunk) {
+    // Over-allocate to align the chunk on a huge page boundary,
+    // which transparent huge pages require.
+    uint64_t mapSize = m_chunkSize + ARENA_HUGE_PAGE_SIZE;
+    void *p = mmap(0, mapSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      return false;
+
+    uintptr_t start = (uintptr_t) p;
+    uintptr_t aligned = (start + ARENA_HUGE_PAGE_SIZE - 1) &
+                        ~(uintptr_t) (ARENA_HUGE_PAGE_SIZE - 1);
+    if (aligned > start)
+      munmap(p, aligned - start);
+    if (aligned + m_chunkSize < start + mapSize)
+      munmap((void*) (aligned + m_chunkSize),
+             start + mapSize - (aligned + m_chunkSize));
+
+    chunk = (uint8_t*) aligned;
+#if defined(MADV_HUGEPAGE)
+    madvise(chunk, m_chunkSize, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (ConcreteStoreNumaBind)
+    bindToNode(chunk, m_chunkSize);
+
+  m_chunks[chunk] = m_chunkSize;
+  m_chunkCur = chunk;
+  m_chunkEnd = chunk + m_chunkSize;
+
+  m_footprint.mappedBytes += m_chunkSize;
+  if (hugeTlb)
+    m_footprint.hugeTlbBytes += m_chunkSize;
+  ++m_footprint.chunkCount;
+  return true;
+#endif
+}
+
+uint8_t *ConcreteStoreArena::allocate(unsigned size) {
+  if (!m_enabled || size > (1u << MAX_CLASS_BITS)) {
+    if (m_enabled)
+      m_footprint.heapBytes += size;
+    return new uint8_t[size];
+  }
+
+  unsigned c = getSizeClass(size);
+  uint64_t blockSize = 1ULL << (c + MIN_CLASS_BITS);
+
+  ++m_footprint.liveStores;
+  m_footprint.liveBytes += blockSize;
+
+  if (FreeBlock *b = m_freeLists[c]) {
+    m_freeLists[c] = b->next;
+    m_footprint.freeBytes -= blockSize;
+    return (uint8_t*) b;
+  }
+
+  // Blocks are naturally aligned, so that a store never straddles
+  // more host pages than it has to.
+  uintptr_t cur = ((uintptr_t) m_chunkCur + blockSize - 1) & ~(blockSize - 1);
+  if (!m_chunkCur || cur + blockSize > (uintptr_t) m_chunkEnd) {
+    if (!mapChunk()) {
+      --m_footprint.liveStores;
+      m_footprint.liveBytes -= blockSize;
+      m_footprint.heapBytes += size;
+      ++m_fallbackStores;
+      return new uint8_t[size];
+    }
+    cur = (uintptr_t) m_chunkCur;
+  }
+
+  m_chunkCur = (uint8_t*) (cur + blockSize);
+  return (uint8_t*) cur;
+}
+
+void ConcreteStoreArena::deallocate(uint8_t *store, unsigned size) {
+  if (!m_enabled || size > (1u << MAX_CLASS_BITS)) {
+    if (m_enabled)
+      m_footprint.heapBytes -= size;
+    delete[] store;
+    return;
+  }
+
+  // Stores that fell back to new[] when mapping a chunk failed
+  if (m_fallbackStores && !isInArena(store)) {
+    --m_fallbackStores;
+    m_footprint.heapBytes -= size;
+    delete[] store;
+    return;
+  }
+
+  unsigned c = getSizeClass(size);
+  uint64_t blockSize = 1ULL << (c + MIN_CLASS_BITS);
+
+  FreeBlock *b = (FreeBlock*) store;
+  b->next = m_freeLists[c];
+  m_freeLists[c] = b;
+
+  --m_footprint.liveStores;
+  m_footprint.liveBytes -= blockSize;
+  m_footprint.freeBytes += blockSize;
+}
+
+void ConcreteStoreArena::adviseRegion(uint8_t *start, uint64_t size) {
+  if (!m_enabled)
+    return;
+
+#if !defined(_WIN32)
+  // The region is already mapped and possibly populated, MAP_HUGETLB
+  // does not apply. Transparent huge pages only back its 2MB-aligned parts.
+#if defined(MADV_HUGEPAGE)
+  madvise(start, size, MADV_HUGEPAGE);
+#endif
+
+  if (ConcreteStoreNumaBind)
+    bindToNode(start, size);
+
+  m_footprint.externalBytes += size;
+#endif
+}
@@ -3370,42 +3370,61 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
                                    std::pair<std::string,
                                    std::vector<unsigned char> > >
                                    &res) {
+  SymbolicSolutionQuery query;
+  getSymbolicSolutionQuery(state, query);
+  return getSymbolicSolution(query, res);
+}
+
+void Executor::getSymbolicSolutionQuery(const ExecutionState &state,
+                                        SymbolicSolutionQuery &query) {
+  query.constraints.assign(state.constraints.begin(), state.constraints.end());
+
+  for (unsigned i = 0; i != state.symbolics.size(); ++i) {
+    const MemoryObject *mo = state.symbolics[i].first;
+    query.symbolics.push_back(std::make_pair(mo->name, state.symbolics[i].second));
+    if (!NoPreferCex)
+      query.cexPreferences.insert(query.cexPreferences.end(),
+                                  mo->cexPreferences.begin(),
+                                  mo->cexPreferences.end());
+  }
+}
+
+bool Executor::getSymbolicSolution(const SymbolicSolutionQuery &query,
+                                   std::vector< 
+                                   std::pair<std::string,
+                                   std::vector<unsigned char> > >
+                                   &res) {
   solver->setTimeout(stpTimeout);
 
-  ExecutionState tmp(state);
-  tmp.addressSpace.state = &tmp;
-  if (!NoPreferCex) {
-    for (unsigned i = 0; i != state.symbolics.size(); ++i) {
-      const MemoryObject *mo = state.symbolics[i].first;
-      std::vector< ref<Expr> >::const_iterator pi = 
-        mo->cexPreferences.begin(), pie = mo->cexPreferences.end();
-      for (; pi != pie; ++pi) {
-        bool mustBeTrue;
-        bool success = solver->mustBeTrue(tmp, Expr::createIsZero(*pi), 
-                                          mustBeTrue);
-        if (!success) break;
-        if (!mustBeTrue) tmp.addConstraint(*pi);
-      }
-      if (pi!=pie) break;
-    }
+  // Only the constraints matter to the solver, no need to copy the
+  // whole state.
+  ExecutionState tmp(query.constraints);
+  std::vector< ref<Expr> >::const_iterator pi = 
+    query.cexPreferences.begin(), pie = query.cexPreferences.end();
+  for (; pi != pie; ++pi) {
+    bool mustBeTrue;
+    bool success = solver->mustBeTrue(tmp, Expr::createIsZero(*pi), 
+                                      mustBeTrue);
+    if (!success) break;
+    if (!mustBeTrue) tmp.addConstraint(*pi);
   }
 
   std::vector< std::vector<unsigned char> > values;
   std::vector<const Array*> objects;
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    objects.push_back(state.symbolics[i].second);
+  for (unsigned i = 0; i != query.symbolics.size(); ++i)
+    objects.push_back(query.symbolics[i].second);
   bool success = solver->getInitialValues(tmp, objects, values);
   solver->setTimeout(0);
   if (!success) {
     klee_warning("unable to compute initial values (invalid constraints?)!");
     ExprPPrinter::printQuery(std::cerr,
-                             state.constraints, 
+                             ConstraintManager(query.constraints), 
                              ConstantExpr::alloc(0, Expr::Bool));
     return false;
   }
   
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    res.push_back(std::make_pair(state.symbolics[i].first->name, values[i]));
+  for (unsigned i = 0; i != query.symbolics.size(); ++i)
+    res.push_back(std::make_pair(query.symbolics[i].first, values[i]));
   return true;
 }
 
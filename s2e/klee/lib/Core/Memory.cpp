@@ -11,6 +11,8 @@
 
 #include "klee/Memory.h"
 
+#include "klee/ConcreteStoreArena.h"
+
 #include "klee/Context.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
@@ -94,12 +96,13 @@ ObjectState::ObjectState(const MemoryObject *mo)
     copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(ConcreteStoreArena::get().allocate(mo->size)),
     flushMask(0),
     knownSymbolics(0),
     updates(0, 0),
     size(mo->size),
-    readOnly(false)
+    readOnly(false),
+    storeSpilled(false)
      {
   if (!UseConstantArrays) {
     // FIXME: Leaked.
@@ -115,12 +118,13 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
     copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteStore(ConcreteStoreArena::get().allocate(mo->size)),
     flushMask(0),
     knownSymbolics(0),
     updates(array, 0),
     size(mo->size),
-    readOnly(false)
+    readOnly(false),
+    storeSpilled(false)
  {
   makeSymbolic();
 }
@@ -130,12 +134,13 @@ ObjectState::ObjectState(const ObjectState &os)
     copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
+    concreteStore(ConcreteStoreArena::get().allocate(os.size)),
     flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
     knownSymbolics(0),
     updates(os.updates),
     size(os.size),
-    readOnly(false)
+    readOnly(false),
+    storeSpilled(false)
      {
   assert(!os.readOnly && "no need to copy read only object?");
 
@@ -152,7 +157,25 @@ ObjectState::~ObjectState() {
   if (concreteMask) delete concreteMask;
   if (flushMask) delete flushMask;
   if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  if (!storeSpilled)
+    ConcreteStoreArena::get().deallocate(concreteStore, size);
+}
+
+void ObjectState::spillConcreteStore(uint8_t *buffer) {
+  assert(!storeSpilled && "concrete store is already spilled");
+  memcpy(buffer, concreteStore, size);
+  ConcreteStoreArena::get().deallocate(concreteStore, size);
+  concreteStore = buffer;
+  storeSpilled = true;
+}
+
+uint8_t *ObjectState::fillConcreteStore() {
+  assert(storeSpilled && "concrete store is not spilled");
+  uint8_t *buffer = concreteStore;
+  concreteStore = ConcreteStoreArena::get().allocate(size);
+  memcpy(concreteStore, buffer, size);
+  storeSpilled = false;
+  return buffer;
 }
 
 /***/
@@ -413,6 +436,37 @@ void ObjectState::write8(unsigned offset, uint8_t value) {
   }
 }
 
+unsigned ObjectState::readConcrete(unsigned offset, uint8_t *buf,
+                                   unsigned size) const {
+  assert(offset + size <= this->size && "concrete read out of bounds");
+  const uint8_t *src = object->isSharedConcrete ?
+                       (const uint8_t*) object->address : concreteStore;
+  unsigned n = size;
+  if (!object->isSharedConcrete && concreteMask)
+    n = concreteMask->countOnes(offset, size);
+  memcpy(buf, src + offset, n);
+  return n;
+}
+
+void ObjectState::writeConcrete(unsigned offset, const uint8_t *buf,
+                                unsigned size) {
+  assert(offset + size <= this->size && "concrete write out of bounds");
+  if (object->isSharedConcrete) {
+    memcpy((uint8_t*) object->address + offset, buf, size);
+    return;
+  }
+
+  memcpy(concreteStore + offset, buf, size);
+  if (knownSymbolics) {
+    for (unsigned i = 0; i < size; ++i)
+      knownSymbolics[offset + i] = 0;
+  }
+  if (concreteMask)
+    concreteMask->setRange(offset, size);
+  if (flushMask)
+    flushMask->setRange(offset, size);
+}
+
 void ObjectState::write8(unsigned offset, ref<Expr> value) {
   // can happen when ExtractExpr special cases
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
@@ -64,6 +64,9 @@ namespace klee {
 
     std::pair< ref<Expr>, ref<Expr> >
     getRange(const ExecutionState&, ref<Expr> query);
+
+    bool getBounds(const ExecutionState&, ref<Expr> expr, uint64_t example,
+                   uint64_t &min, uint64_t &max);
   };
 
 }
@@ -265,6 +265,82 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
                         ConstantExpr::create(max, width));
 }
 
+bool Solver::getBounds(const Query& query, uint64_t example,
+                       uint64_t &min, uint64_t &max) {
+  ref<Expr> e = query.expr;
+  Expr::Width width = e->getWidth();
+  assert(width <= 64 && "unsupported expression width");
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    min = max = CE->getZExtValue();
+    return true;
+  }
+
+  uint64_t maxValue = bits64::maxValueOfNBits(width);
+  uint64_t lo, hi, step;
+
+  // Gallop downwards from the example until e <= probe becomes
+  // infeasible, then binary search between the last two probes.
+  lo = 0, hi = example, step = 1;
+  while (hi > 0) {
+    uint64_t probe = step > hi ? 0 : hi - step;
+    bool res;
+    if (!mayBeTrue(query.withExpr(UleExpr::create(e,
+                                   ConstantExpr::create(probe, width))), res))
+      return false;
+    if (!res) {
+      lo = probe + 1;
+      break;
+    }
+    hi = probe;
+    step <<= 1;
+  }
+
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo)/2;
+    bool res;
+    if (!mayBeTrue(query.withExpr(UleExpr::create(e,
+                                   ConstantExpr::create(mid, width))), res))
+      return false;
+    if (res)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  min = lo;
+
+  // Same thing upwards
+  lo = example, hi = maxValue, step = 1;
+  while (lo < maxValue) {
+    uint64_t probe = step > maxValue - lo ? maxValue : lo + step;
+    bool res;
+    if (!mayBeTrue(query.withExpr(UgeExpr::create(e,
+                                   ConstantExpr::create(probe, width))), res))
+      return false;
+    if (!res) {
+      hi = probe - 1;
+      break;
+    }
+    lo = probe;
+    step <<= 1;
+  }
+
+  while (lo < hi) {
+    uint64_t mid = hi - (hi - lo)/2;
+    bool res;
+    if (!mayBeTrue(query.withExpr(UgeExpr::create(e,
+                                   ConstantExpr::create(mid, width))), res))
+      return false;
+    if (res)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  max = lo;
+
+  return true;
+}
+
 /***/
 
 class ValidatingSolver : public SolverImpl {
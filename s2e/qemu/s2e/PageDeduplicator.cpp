@@ -0,0 +1,183 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "PageDeduplicator.h"
+
+#include <s2e/S2E.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/Utils.h>
+#include <s2e/s2e_config.h>
+
+#include <klee/Memory.h>
+
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <string.h>
+
+using namespace klee;
+
+namespace s2e {
+
+namespace {
+/* Only plain guest RAM is considered. The CPU state and the dirty mask
+   are cached as writable objects by the states. */
+bool isCandidate(const MemoryObject *mo, const ObjectState *os)
+{
+    return mo->size == S2E_RAM_OBJECT_SIZE && !mo->isSharedConcrete &&
+           !os->readOnly && !os->isConcreteStoreSpilled() &&
+           os->isAllConcrete();
+}
+
+struct CanonicalObject {
+    const ObjectState *objectState;
+    /* State that owns the object, NULL once it is shared */
+    S2EExecutionState *owner;
+};
+
+struct DuplicateObject {
+    const MemoryObject *memoryObject;
+    const ObjectState *objectState;
+    uint64_t hash;
+};
+
+typedef std::pair<const MemoryObject*, uint64_t> ContentKey;
+typedef std::map<ContentKey, CanonicalObject> ContentIndex;
+}
+
+PageDeduplicator::PageDeduplicator(S2E *s2e)
+{
+    m_s2e = s2e;
+    m_passes = 0;
+    m_sharedObjects = 0;
+}
+
+unsigned PageDeduplicator::deduplicate(const std::vector<S2EExecutionState*> &states)
+{
+    ContentIndex index;
+    std::set<const MemoryObject*> lookedUp;
+    std::set<S2EExecutionState*> disownedStates;
+    unsigned shared = 0;
+
+    foreach2(sit, states.begin(), states.end()) {
+        S2EExecutionState *state = *sit;
+        assert(!state->isActive());
+
+        std::vector<DuplicateObject> duplicates;
+
+        const MemoryMap &objects = state->addressSpace.objects;
+        foreach2(it, objects.begin(), objects.end()) {
+            const MemoryObject *mo = (*it).first;
+            const ObjectState *os = (*it).second;
+
+            if (!state->addressSpace.isOwnedByUs(os) || !isCandidate(mo, os)) {
+                continue;
+            }
+
+            const uint8_t *store = os->getConcreteStore();
+            uint64_t hash = hashBuffer(store, os->size);
+            ContentKey key(mo, hash);
+
+            ContentIndex::iterator cit = index.find(key);
+
+            //A reverted write leaves a private copy identical to the object
+            //that is still shared by the other states: look it up once.
+            if (cit == index.end() && lookedUp.insert(mo).second) {
+                foreach2(oit, states.begin(), states.end()) {
+                    if (*oit == state) {
+                        continue;
+                    }
+                    const ObjectState *other = (*oit)->addressSpace.findObject(mo);
+                    if (other && !(*oit)->addressSpace.isOwnedByUs(other) &&
+                        isCandidate(mo, other)) {
+                        CanonicalObject co = {other, NULL};
+                        ContentKey otherKey(mo, hashBuffer(other->getConcreteStore(),
+                                                           other->size));
+                        index.insert(std::make_pair(otherKey, co));
+                        cit = index.find(key);
+                        break;
+                    }
+                }
+            }
+
+            if (cit == index.end()) {
+                CanonicalObject co = {os, state};
+                index.insert(std::make_pair(key, co));
+                continue;
+            }
+
+            const ObjectState *canonical = (*cit).second.objectState;
+            if (canonical == os ||
+                memcmp(canonical->getConcreteStore(), store, os->size)) {
+                continue;
+            }
+
+            DuplicateObject d = {mo, os, hash};
+            duplicates.push_back(d);
+        }
+
+        //The address space can't be modified while iterating over it
+        foreach2(dit, duplicates.begin(), duplicates.end()) {
+            CanonicalObject &co = index[ContentKey((*dit).memoryObject, (*dit).hash)];
+            if (co.owner) {
+                disownedStates.insert(co.owner);
+                co.owner = NULL;
+            }
+            state->addressSpace.shareObject((*dit).memoryObject, co.objectState);
+            ++shared;
+        }
+    }
+
+    //The saved TLBs of the former owners still map the objects as writable
+    foreach2(it, disownedStates.begin(), disownedStates.end()) {
+        (*it)->flushTlb();
+    }
+
+    ++m_passes;
+    m_sharedObjects += shared;
+
+    if (shared) {
+        m_s2e->getDebugStream() << "PageDeduplicator: shared " << shared
+                << " objects (" << ((shared * S2E_RAM_OBJECT_SIZE) >> 10) << " KB) in "
+                << states.size() << " states, " << m_sharedObjects
+                << " objects shared in " << m_passes << " passes" << std::endl;
+    }
+
+    return shared;
+}
+
+} // namespace s2e
@@ -0,0 +1,79 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PAGEDEDUPLICATOR_H
+#define S2E_PAGEDEDUPLICATOR_H
+
+#include <inttypes.h>
+#include <vector>
+
+namespace s2e {
+
+class S2E;
+class S2EExecutionState;
+
+/**
+ *  Collapses identical concrete RAM objects of inactive states back
+ *  into shared copies, in the spirit of KSM.
+ *
+ *  Writing the same value to a page, or reverting a write, leaves a
+ *  state with a private copy that is byte-for-byte identical to the one
+ *  of another state. The pass hashes the concrete stores of the objects
+ *  owned by each state and makes the duplicates point to a single
+ *  ObjectState, which loses its owner and is copied again on the next
+ *  write.
+ */
+class PageDeduplicator
+{
+private:
+    S2E *m_s2e;
+
+    uint64_t m_passes;
+    uint64_t m_sharedObjects;
+
+public:
+    PageDeduplicator(S2E *s2e);
+
+    /** Runs a pass over the given states, which must all be inactive.
+        Returns the number of objects that were collapsed. */
+    unsigned deduplicate(const std::vector<S2EExecutionState*> &states);
+
+    uint64_t getSharedObjects() const { return m_sharedObjects; }
+};
+
+} // namespace s2e
+
+#endif // S2E_PAGEDEDUPLICATOR_H
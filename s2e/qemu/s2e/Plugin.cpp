@@ -57,10 +57,13 @@
 #include <s2e/Plugins/ExecutionTracers/MemoryTracer.h>
 #include <s2e/Plugins/ExecutionTracers/InstructionCounter.h>
 #include <s2e/Plugins/ExecutionTracers/TranslationBlockTracer.h>
+#include <s2e/Plugins/ExecutionTracers/TranslationBlockCoverage.h>
 #include <s2e/Plugins/CacheSim.h>
 #include <s2e/Plugins/Debugger.h>
 #include <s2e/Plugins/SymbolicHardware.h>
 #include <s2e/Plugins/EdgeKiller.h>
+#include <s2e/Plugins/ForkProfiler.h>
+#include <s2e/Plugins/SignalProfiler.h>
 #include <s2e/Plugins/StateManager.h>
 #include <s2e/Plugins/Annotation.h>
 #include <s2e/Plugins/X86ExceptionInterceptor.h>
@@ -72,6 +75,9 @@
 #include <s2e/Plugins/WindowsApi/WindowsDriverExerciser.h>
 #include <s2e/Plugins/Searchers/MaxTbSearcher.h>
 #include <s2e/Plugins/Searchers/CooperativeSearcher.h>
+#include <s2e/Plugins/Searchers/CoverageSearcher.h>
+#include <s2e/Plugins/Searchers/SwitchCostSearcher.h>
+#include <s2e/Plugins/Searchers/StateMerger.h>
 
 #include <algorithm>
 #include <assert.h>
@@ -84,6 +90,8 @@ void Plugin::initialize()
 {
 }
 
+unsigned Plugin::s_PluginCount = 0;
+
 PluginState *Plugin::getPluginState(S2EExecutionState *s, PluginStateFactory f) const
 {
     if (m_CachedPluginS2EState == s) {
@@ -94,6 +102,14 @@ PluginState *Plugin::getPluginState(S2EExecutionState *s, PluginStateFactory f)
     return m_CachedPluginState;
 }
 
+const PluginState *Plugin::getConstPluginState(S2EExecutionState *s, PluginStateFactory f) const
+{
+    if (m_CachedPluginS2EState == s) {
+        return m_CachedPluginState;
+    }
+    return s->getConstPluginState(const_cast<Plugin*>(this), f);
+}
+
 PluginsFactory::PluginsFactory()
 {
 #define __S2E_REGISTER_PLUGIN(className) \
@@ -119,9 +135,12 @@ PluginsFactory::PluginsFactory()
     __S2E_REGISTER_PLUGIN(plugins::MemoryTracer);
     __S2E_REGISTER_PLUGIN(plugins::InstructionCounter);
     __S2E_REGISTER_PLUGIN(plugins::TranslationBlockTracer);
+    __S2E_REGISTER_PLUGIN(plugins::TranslationBlockCoverage);
 
     __S2E_REGISTER_PLUGIN(plugins::SymbolicHardware);
     __S2E_REGISTER_PLUGIN(plugins::EdgeKiller);
+    __S2E_REGISTER_PLUGIN(plugins::ForkProfiler);
+    __S2E_REGISTER_PLUGIN(plugins::SignalProfiler);
     __S2E_REGISTER_PLUGIN(plugins::Annotation);
     __S2E_REGISTER_PLUGIN(plugins::X86ExceptionInterceptor);
 
@@ -134,6 +153,9 @@ PluginsFactory::PluginsFactory()
 
     __S2E_REGISTER_PLUGIN(plugins::MaxTbSearcher);
     __S2E_REGISTER_PLUGIN(plugins::CooperativeSearcher);
+    __S2E_REGISTER_PLUGIN(plugins::CoverageSearcher);
+    __S2E_REGISTER_PLUGIN(plugins::SwitchCostSearcher);
+    __S2E_REGISTER_PLUGIN(plugins::StateMerger);
 
     __S2E_REGISTER_PLUGIN(plugins::HostFiles);
 
@@ -86,13 +86,18 @@ class S2EExecutionState;
 class Plugin : public sigc::trackable{
 private:
     S2E* m_s2e;
+
+    /** Slot of the plugin state in the execution states */
+    unsigned m_PluginIndex;
+    static unsigned s_PluginCount;
+
 protected:
     mutable PluginState *m_CachedPluginState;
     mutable S2EExecutionState *m_CachedPluginS2EState;
 
 public:
-    Plugin(S2E* s2e) : m_s2e(s2e),m_CachedPluginState(NULL),
-        m_CachedPluginS2EState(NULL) {}
+    Plugin(S2E* s2e) : m_s2e(s2e), m_PluginIndex(s_PluginCount++),
+        m_CachedPluginState(NULL), m_CachedPluginS2EState(NULL) {}
 
     virtual ~Plugin() {}
 
@@ -110,8 +115,18 @@ public:
     /** Return configuration key for this plugin */
     const std::string& getConfigKey() const;
 
+    unsigned getPluginIndex() const { return m_PluginIndex; }
+
+    /** Returns the plugin state of s, creating it with f if needed.
+        Plugin states are shared between forked execution states until
+        one of them asks for its state, which then gets its own copy.
+        The returned pointer must not be kept across forks, unless the
+        state is copied eagerly (see PluginState::isClonedOnFork). */
     PluginState *getPluginState(S2EExecutionState *s, PluginState* (*f)(Plugin *, S2EExecutionState *)) const;
 
+    /** Same as getPluginState, but does not copy a shared state */
+    const PluginState *getConstPluginState(S2EExecutionState *s, PluginState* (*f)(Plugin *, S2EExecutionState *)) const;
+
     void refresh() {
         m_CachedPluginS2EState = NULL;
         m_CachedPluginState = NULL;
@@ -128,16 +143,33 @@ public:
     c *name = static_cast<c*>(getPluginState(execstate, &c::factory))
 
 #define DECLARE_PLUGINSTATE_CONST(c, execstate) \
-    const c *plgState = static_cast<c*>(getPluginState(execstate, &c::factory))
+    const c *plgState = static_cast<const c*>(getConstPluginState(execstate, &c::factory))
 
 #define DECLARE_PLUGINSTATE_NCONST(c, name, execstate) \
-    const c *name = static_cast<c*>(getPluginState(execstate, &c::factory))
+    const c *name = static_cast<const c*>(getConstPluginState(execstate, &c::factory))
 
 class PluginState
 {
+private:
+    /** Number of execution states sharing this plugin state */
+    unsigned m_RefCount;
+
+    friend class S2EExecutionState;
+
 public:
+    PluginState() : m_RefCount(1) {}
+    PluginState(const PluginState &) : m_RefCount(1) {}
+    PluginState &operator=(const PluginState &) { return *this; }
+
     virtual ~PluginState() {};
     virtual PluginState *clone() const = 0;
+
+    /** Returns true if the new states of a fork must get their own copy
+        right away instead of sharing this one. Plugins that keep using
+        a state pointer across code that may fork (e.g., signal handlers)
+        override this, so that the forking state keeps writing to its own
+        object. */
+    virtual bool isClonedOnFork() const { return false; }
 };
 
 
@@ -50,10 +50,13 @@ extern "C" {
 #include <llvm/System/TimeValue.h>
 
 #include <iostream>
+#include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define CACHESIM_LOG_SIZE 4096
+#define CACHESIM_BATCH_SIZE 1024
 
 namespace s2e {
 namespace plugins {
@@ -76,6 +79,19 @@ uint64_t floorLog2(uint64_t n) {
 /* Model of n-way accosiative write-through LRU cache */
 class Cache {
 protected:
+    /** The tags of consecutive sets, shared copy-on-write between
+        the clones of the cache. */
+    struct TagBlock {
+        unsigned refCount;
+        uint64_t tags[1];
+    };
+
+    /** Number of ways compared at once by findWay() */
+    static const unsigned SCAN_WIDTH = 4;
+
+    /** Minimum number of tags per block (one 4KB page) */
+    static const unsigned MIN_BLOCK_TAGS = 512;
+
     uint64_t m_size;
     uint64_t m_associativity;
     uint64_t m_lineSize;
@@ -85,13 +101,64 @@ protected:
 
     uint64_t m_tagShift;   // m_indexShift + log2(setsCount)
 
-    std::vector<uint64_t> m_lines;
+    uint64_t m_blockShift; // log2(tags per block)
+    uint64_t m_blockMask;
+
+    //Each set lies within a single block, MRU way first
+    std::vector<TagBlock*> m_blocks;
 
     std::string m_name;
     uint8_t m_cacheId;
 
     Cache* m_upperCache;
 
+    static TagBlock *allocateBlock(uint64_t tagCount) {
+        TagBlock *b = (TagBlock*) malloc(sizeof(TagBlock) +
+                                         (tagCount - 1) * sizeof(uint64_t));
+        b->refCount = 1;
+        return b;
+    }
+
+    static void releaseBlock(TagBlock *b) {
+        if (--b->refCount == 0) {
+            free(b);
+        }
+    }
+
+    /** Returns the tags of the set starting at line l */
+    const uint64_t *getSet(uint64_t l) const {
+        return m_blocks[l >> m_blockShift]->tags + (l & m_blockMask);
+    }
+
+    /** Same as getSet, but first unshares the block of the set */
+    uint64_t *getWritableSet(uint64_t l) {
+        TagBlock *&b = m_blocks[l >> m_blockShift];
+        if (b->refCount > 1) {
+            TagBlock *copy = allocateBlock(m_blockMask + 1);
+            memcpy(copy->tags, b->tags, (m_blockMask + 1) * sizeof(uint64_t));
+            --b->refCount;
+            b = copy;
+        }
+        return b->tags + (l & m_blockMask);
+    }
+
+    /** Returns the way that holds tag, m_associativity if none.
+        The ways are compared SCAN_WIDTH at a time without branches,
+        which the compiler can turn into vector compares. */
+    unsigned findWay(const uint64_t *set, uint64_t tag) const {
+        unsigned width = m_associativity < SCAN_WIDTH ? m_associativity : SCAN_WIDTH;
+        for (unsigned base = 0; base < m_associativity; base += width) {
+            unsigned hits = 0;
+            for (unsigned i = 0; i < width; ++i) {
+                hits |= (unsigned) (set[base + i] == tag) << i;
+            }
+            if (hits) {
+                return base + __builtin_ctz(hits);
+            }
+        }
+        return m_associativity;
+    }
+
 public:
     uint64_t getSize() const {
         return m_size;
@@ -118,7 +185,7 @@ public:
           uint64_t size, uint64_t associativity,
           uint64_t lineSize, uint64_t cost = 1, Cache* upperCache = NULL)
         : m_size(size), m_associativity(associativity), m_lineSize(lineSize),
-          m_name(name), m_upperCache(upperCache)
+          m_name(name), m_cacheId(0), m_upperCache(upperCache)
     {
         assert(size && associativity && lineSize);
 
@@ -133,7 +200,40 @@ public:
 
         m_tagShift = floorLog2(setsCount) + m_indexShift;
 
-        m_lines.resize(setsCount * associativity, (uint64_t) -1);
+        //Blocks hold whole sets, the line count is a power of two
+        uint64_t linesCount = setsCount * associativity;
+        uint64_t blockTags = std::max<uint64_t>(MIN_BLOCK_TAGS, associativity);
+        blockTags = std::min(blockTags, linesCount);
+
+        m_blockShift = floorLog2(blockTags);
+        m_blockMask = blockTags - 1;
+
+        //All the blocks start as the same empty block,
+        //they are allocated when first written.
+        TagBlock *empty = allocateBlock(blockTags);
+        std::fill(empty->tags, empty->tags + blockTags, (uint64_t) -1);
+        empty->refCount = linesCount / blockTags;
+        m_blocks.resize(linesCount / blockTags, empty);
+    }
+
+    /** Shares the tags with the original cache */
+    Cache(const Cache &other)
+        : m_size(other.m_size), m_associativity(other.m_associativity),
+          m_lineSize(other.m_lineSize), m_indexShift(other.m_indexShift),
+          m_indexMask(other.m_indexMask), m_tagShift(other.m_tagShift),
+          m_blockShift(other.m_blockShift), m_blockMask(other.m_blockMask),
+          m_blocks(other.m_blocks), m_name(other.m_name),
+          m_cacheId(other.m_cacheId), m_upperCache(other.m_upperCache)
+    {
+        foreach(TagBlock *b, m_blocks) {
+            ++b->refCount;
+        }
+    }
+
+    ~Cache() {
+        foreach(TagBlock *b, m_blocks) {
+            releaseBlock(b);
+        }
     }
 
     const std::string& getName() const { return m_name; }
@@ -164,22 +264,28 @@ public:
         uint64_t l = set * m_associativity;
         uint64_t tag = address >> m_tagShift;
 
-        for(unsigned i = 0; i < m_associativity; ++i) {
-            if(m_lines[l + i] == tag) {
-                /* Cache hit. Move line to MRU. */
-                for(unsigned j = i; j > 0; --j)
-                    m_lines[l + j] = m_lines[l + j - 1];
-                m_lines[l] = tag;
-                return;
-            }
-        }
+        const uint64_t *lines = getSet(l);
+
+        /* Hit on the MRU line, nothing to update */
+        if(lines[0] == tag)
+            return;
+
+        unsigned way = findWay(lines, tag);
+        bool miss = way == m_associativity;
+
+        /* Move the line to MRU. On a miss, the LRU line is evicted. */
+        if(miss)
+            way = m_associativity - 1;
+
+        uint64_t *wlines = getWritableSet(l);
+        memmove(wlines + 1, wlines, way * sizeof(uint64_t));
+        wlines[0] = tag;
+
+        if(!miss)
+            return;
 
         //g_s2e->getDebugStream() << "Miss at 0x" << std::hex << address << std::endl;
-        /* Cache miss. Install new tag as MRU */
         misCount[0] += 1;
-        for(unsigned j = m_associativity-1; j > 0; --j)
-            m_lines[l + j] = m_lines[l + j - 1];
-        m_lines[l] = tag;
 
         if(m_upperCache) {
             assert(misCountSize > 1);
@@ -187,6 +293,9 @@ public:
                                  misCount+1, misCountSize-1);
         }
     }
+
+private:
+    void operator=(const Cache&);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -227,13 +336,15 @@ CacheSimState::CacheSimState(S2EExecutionState *s, Plugin *p)
                                  conf->getInt(key + ".associativity"),
                                  conf->getInt(key + ".lineSize"));
 
-        m_caches.insert(make_pair(cacheName, cache));
+        //The id is also the index of the cache in the trace
+        cache->setId(m_caches.size());
+        m_caches.push_back(cache);
     }
 
-    foreach(const CachesMap::value_type& ci, m_caches) {
-        string key = cfgKey + ".caches." + ci.first + ".upper";
+    foreach(Cache *cache, m_caches) {
+        string key = cfgKey + ".caches." + cache->getName() + ".upper";
         if(conf->hasKey(key))
-            ci.second->setUpperCache(getCache(conf->getString(key)));
+            cache->setUpperCache(getCache(conf->getString(key)));
     }
 
     if(conf->hasKey(cfgKey + ".i1"))
@@ -268,9 +379,11 @@ CacheSimState::CacheSimState(S2EExecutionState *s, Plugin *p)
 
     }else {
         if(m_d1) {
-            s2e->getDebugStream()  << "CacheSim: connecting to onDataMemoryAccess" << std::endl;
-            s2e->getCorePlugin()->onDataMemoryAccess.connect(
-                sigc::mem_fun(*csp, &CacheSim::onDataMemoryAccess));
+            s2e->getDebugStream()  << "CacheSim: connecting to onConcreteDataMemoryAccess" << std::endl;
+            s2e->getCorePlugin()->onConcreteDataMemoryAccess(csp).connect(
+                sigc::mem_fun(*csp, &CacheSim::onConcreteDataMemoryAccess));
+            s2e->getCorePlugin()->onSymbolicDataMemoryAccess.connect(
+                sigc::mem_fun(*csp, &CacheSim::onSymbolicDataMemoryAccess));
         }
 
         if(m_i1) {
@@ -288,8 +401,8 @@ CacheSimState::CacheSimState(S2EExecutionState *s, Plugin *p)
 
 CacheSimState::~CacheSimState()
 {
-    foreach(const CachesMap::value_type& ci, m_caches)
-        delete ci.second;
+    foreach(Cache *cache, m_caches)
+        delete cache;
 }
 
 PluginState *CacheSimState::factory(Plugin *p, S2EExecutionState *s)
@@ -304,42 +417,35 @@ PluginState *CacheSimState::clone() const
 {
     CacheSimState *ret = new CacheSimState(*this);
 
-    //Clone the caches first
-    CachesMap::iterator newCaches;
-    for (newCaches = ret->m_caches.begin(); newCaches != ret->m_caches.end(); ++newCaches) {
-        (*newCaches).second = new Cache(*(*newCaches).second);
+    //Clone the caches first, they share their tags with the original ones
+    for (unsigned i = 0; i < m_caches.size(); ++i) {
+        ret->m_caches[i] = new Cache(*m_caches[i]);
     }
 
     //Update the upper cache mappings
-    CachesMap::const_iterator oldCaches;
-    for (oldCaches = m_caches.begin(); oldCaches != m_caches.end(); ++oldCaches) {
-        Cache *u;
-        if (!(u = (*oldCaches).second->getUpperCache())) {
-            continue;
+    foreach(Cache *cache, ret->m_caches) {
+        Cache *u = cache->getUpperCache();
+        if (u) {
+            cache->setUpperCache(ret->m_caches[u->getId()]);
         }
-
-        CachesMap::iterator newCache = ret->m_caches.find(u->getName());
-        assert(newCache != ret->m_caches.end());
-        (*newCache).second->setUpperCache((*newCache).second);
     }
 
-    ret->m_d1 = ret->m_caches[m_d1->getName()];
-    assert(ret->m_d1);
-
-    ret->m_i1 = ret->m_caches[m_i1->getName()];
-    assert(ret->m_i1);
+    ret->m_d1 = m_d1 ? ret->m_caches[m_d1->getId()] : NULL;
+    ret->m_i1 = m_i1 ? ret->m_caches[m_i1->getId()] : NULL;
 
     return ret;
 }
 
 inline Cache* CacheSimState::getCache(const std::string& name)
 {
-    CachesMap::iterator it = m_caches.find(name);
-    if(it == m_caches.end()) {
-        cerr << "ERROR: cache " << name << " undefined" << endl;
-        exit(1);
+    foreach(Cache *cache, m_caches) {
+        if (cache->getName() == name) {
+            return cache;
+        }
     }
-    return it->second;
+
+    cerr << "ERROR: cache " << name << " undefined" << endl;
+    exit(1);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -351,8 +457,14 @@ S2E_DEFINE_PLUGIN(CacheSim, "Cache simulator", "",);
 
 CacheSim::~CacheSim()
 {
+    //ExecutionTracer may be destroyed before or after this plugin.
+    //If it closed the trace first, the accesses were flushed then.
+    if (!m_useBinaryLogFile || !m_traceClosed) {
+        flushPendingAccesses();
+    }
     flushLogEntries();
 
+    delete m_sampler;
 }
 
 
@@ -385,20 +497,49 @@ void CacheSim::initialize()
     //Determines whether to address the cache physically of virtually
     m_physAddress = conf->getBool(getConfigKey() + ".physicalAddressing");
 
+    //Number of accesses buffered before they are simulated
+    m_batchSize = conf->getInt(getConfigKey() + ".batchSize", CACHESIM_BATCH_SIZE);
+    if (m_batchSize == 0) {
+        m_batchSize = 1;
+    }
+
     m_cacheStructureWrittenToLog = false;
     if (m_useBinaryLogFile && !m_Tracer) {
         s2e()->getWarningsStream() << "ExecutionTracer is required when useBinaryLogFile is set!" << std::endl;
         exit(-1);
     }
 
+    if (m_useBinaryLogFile) {
+        //Connected before the sampler, which must get the last accesses
+        //before it flushes its own pending items
+        m_Tracer->onFlushPendingItems.connect(
+                sigc::mem_fun(*this, &CacheSim::flushPendingAccesses));
+        m_Tracer->onClose.connect(
+                sigc::mem_fun(*this, &CacheSim::onTraceClose));
+
+        //The simulation itself is not sampled, only the entries written to the trace
+        m_sampler = new TraceSampler(s2e(), m_Tracer, getConfigKey(), m_execDetector);
+    }
+
+    //The simulated caches see all the concrete data accesses
+    s2e()->getCorePlugin()->watchDataMemory(this, 0, (uint64_t) -1);
+
     ////////////////////
     //XXX: trick to force the initialization of the cache upon first memory access.
-    m_d1_connection = s2e()->getCorePlugin()->onDataMemoryAccess.connect(
-         sigc::mem_fun(*this, &CacheSim::onDataMemoryAccess));
+    m_d1_connection = s2e()->getCorePlugin()->onConcreteDataMemoryAccess(this).connect(
+         sigc::mem_fun(*this, &CacheSim::onConcreteDataMemoryAccess));
 
     m_i1_connection = s2e()->getCorePlugin()->onTranslateBlockStart.connect(
          sigc::mem_fun(*this, &CacheSim::onTranslateBlockStart));
 
+    //The buffered accesses belong to the state that made them
+    s2e()->getCorePlugin()->onStateFork.connect(
+            sigc::mem_fun(*this, &CacheSim::onStateFork));
+    s2e()->getCorePlugin()->onStateKill.connect(
+            sigc::mem_fun(*this, &CacheSim::onStateKill));
+    s2e()->getCorePlugin()->onProcessFork.connect(
+            sigc::mem_fun(*this, &CacheSim::onProcessFork));
+
     ////////////////////
     const char *query = "create table CacheSim("
           "'timestamp' unsigned big int, "
@@ -415,6 +556,8 @@ void CacheSim::initialize()
     assert(ok && "create table failed");
 
     m_cacheLog.reserve(CACHESIM_LOG_SIZE);
+    m_pendingAccesses.reserve(m_batchSize);
+    m_pendingState = NULL;
 
 
 }
@@ -425,15 +568,13 @@ void CacheSim::writeCacheDescriptionToLog(S2EExecutionState *state)
         return;
     }
 
-    DECLARE_PLUGINSTATE(CacheSimState, state);
+    DECLARE_PLUGINSTATE_CONST(CacheSimState, state);
 
     //Output the names of the caches
-    uint8_t cacheId = 0;
     foreach2(it, plgState->m_caches.begin(), plgState->m_caches.end()) {
-        (*it).second->setId(cacheId++);
         uint32_t retsize;
-        ExecutionTraceCacheSimName *n = ExecutionTraceCacheSimName::allocate((*it).second->getId(),
-                                                                             (*it).first, &retsize);
+        ExecutionTraceCacheSimName *n = ExecutionTraceCacheSimName::allocate((*it)->getId(),
+                                                                             (*it)->getName(), &retsize);
 
         m_Tracer->writeData(state, n, retsize, TRACE_CACHESIM);
         ExecutionTraceCacheSimName::deallocate(n);
@@ -444,17 +585,17 @@ void CacheSim::writeCacheDescriptionToLog(S2EExecutionState *state)
     foreach2(it, plgState->m_caches.begin(), plgState->m_caches.end()) {
         ExecutionTraceCacheSimParams p;
         p.type = CACHE_PARAMS;
-        p.size = (*it).second->getSize();
-        p.associativity = (*it).second->getAssociativity();
-        p.lineSize = (*it).second->getLineSize();
+        p.size = (*it)->getSize();
+        p.associativity = (*it)->getAssociativity();
+        p.lineSize = (*it)->getLineSize();
 
-        if ((*it).second->getUpperCache()) {
-            p.upperCacheId = (*it).second->getUpperCache()->getId();
+        if ((*it)->getUpperCache()) {
+            p.upperCacheId = (*it)->getUpperCache()->getId();
         }else {
             p.upperCacheId = (unsigned)-1;
         }
 
-        p.cacheId = (*it).second->getId();
+        p.cacheId = (*it)->getId();
         m_Tracer->writeData(state, &p, sizeof(p), TRACE_CACHESIM);
         m_Tracer->flush();
     }
@@ -476,9 +617,12 @@ void CacheSim::onModuleTranslateBlockStart(
     s2e()->getDebugStream() << "Module translation CacheSim " << desc.Name << "  " <<
         pc <<std::endl;
 
-    if(plgState->m_d1)
-        s2e()->getCorePlugin()->onDataMemoryAccess.connect(
-            sigc::mem_fun(*this, &CacheSim::onDataMemoryAccess));
+    if(plgState->m_d1) {
+        s2e()->getCorePlugin()->onConcreteDataMemoryAccess(this).connect(
+            sigc::mem_fun(*this, &CacheSim::onConcreteDataMemoryAccess));
+        s2e()->getCorePlugin()->onSymbolicDataMemoryAccess.connect(
+            sigc::mem_fun(*this, &CacheSim::onSymbolicDataMemoryAccess));
+    }
 
     if(plgState->m_i1)
         s2e()->getCorePlugin()->onTranslateBlockStart.connect(
@@ -492,9 +636,54 @@ void CacheSim::onModuleTranslateBlockStart(
 //Periodically flush the cache
 void CacheSim::onTimer()
 {
+    flushPendingAccesses();
     flushLogEntries();
 }
 
+void CacheSim::onStateFork(S2EExecutionState *state,
+                           const std::vector<S2EExecutionState*> &newStates,
+                           const std::vector<klee::ref<klee::Expr> > &newConditions)
+{
+    if (m_pendingState != state) {
+        flushPendingAccesses();
+        return;
+    }
+
+    //The buffered accesses predate the fork, all the new states
+    //must see them. They are logged only once, for the original state.
+    foreach2(it, newStates.begin(), newStates.end()) {
+        if (*it != state) {
+            simulateAccesses(*it, false);
+        }
+    }
+
+    flushPendingAccesses();
+}
+
+void CacheSim::onStateKill(S2EExecutionState *state)
+{
+    if (m_pendingState == state) {
+        flushPendingAccesses();
+        m_pendingState = NULL;
+    }
+}
+
+void CacheSim::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    //The states may be split between the processes
+    if (preFork) {
+        flushPendingAccesses();
+        flushLogEntries();
+    }
+}
+
+void CacheSim::onTraceClose()
+{
+    //The trace gets the pending accesses from onFlushPendingItems,
+    //emitted right after this
+    m_traceClosed = true;
+}
+
 void CacheSim::flushLogEntries()
 {
     if (m_useBinaryLogFile) {
@@ -554,69 +743,136 @@ void CacheSim::onMemoryAccess(S2EExecutionState *state,
     if(isIO) /* this is only an estimation - should look at registers! */
         return;
 
-    DECLARE_PLUGINSTATE(CacheSimState, state);
-
     if (!profileAccess(state)) {
         return;
     }
 
+    if (state != m_pendingState) {
+        flushPendingAccesses();
+        m_pendingState = state;
 
-    Cache* cache = isCode ? plgState->m_i1 : plgState->m_d1;
-    if(!cache)
+        //Creates the caches upon the first access
+        DECLARE_PLUGINSTATE_CONST(CacheSimState, state);
+        m_pendingI1 = plgState->m_i1 != NULL;
+        m_pendingD1 = plgState->m_d1 != NULL;
+    }
+
+    if (!(isCode ? m_pendingI1 : m_pendingD1)) {
         return;
+    }
 
-    //Done only on the first invocation
-    writeCacheDescriptionToLog(state);
+    //Whether to log the access depends on the current module,
+    //it must be decided now.
+    bool report = reportAccess(state);
 
-    unsigned missCountLength = isCode ? plgState->m_i1_length : plgState->m_d1_length;
-    unsigned missCount[missCountLength];
-    memset(missCount, 0, sizeof(missCount));
-    cache->access(address, size, isWrite, missCount, missCountLength);
+    //All the levels of an access are kept or dropped together
+    if (report && m_useBinaryLogFile) {
+        report = m_sampler->shouldTrace(state, state->getPc(), TRACE_CACHESIM);
+    }
+
+    m_pendingAccesses.resize(m_pendingAccesses.size() + 1);
+    PendingAccess &a = m_pendingAccesses.back();
+    a.pc = report ? state->getPc() : 0;
+    a.address = address;
+    a.size = size;
+    a.isWrite = isWrite;
+    a.isCode = isCode;
+    a.report = report;
 
-    //Decide whether to log the access in the database
-    if (!reportAccess(state)) {
+    if (m_pendingAccesses.size() >= m_batchSize) {
+        flushPendingAccesses();
+    }
+}
+
+void CacheSim::flushPendingAccesses()
+{
+    if (m_pendingAccesses.empty()) {
         return;
     }
 
-    unsigned i = 0;
-    for(Cache* c = cache; c != NULL; c = c->getUpperCache(), ++i) {
-        if(m_cacheLog.size() == CACHESIM_LOG_SIZE)
-            flushLogEntries();
-
-       // std::cout << state->getPc() << " "  << c->getName() << ": " << missCount[i] << std::endl;
-
-        if (m_reportZeroMisses || missCount[i]) {
-            if (m_useBinaryLogFile) {
-                ExecutionTraceCacheSimEntry e;
-                e.type = CACHE_ENTRY;
-                e.cacheId = c->getId();
-                e.pc = state->getPc();
-                e.address = address;
-                e.size = size;
-                e.isWrite = isWrite;
-                e.isCode = isCode;
-                e.missCount = missCount[i];
-                m_Tracer->writeData(state, &e, sizeof(e), TRACE_CACHESIM);
-            }else {
-                m_cacheLog.resize(m_cacheLog.size()+1);
-                CacheLogEntry& ce = m_cacheLog.back();
-                ce.timestamp = llvm::sys::TimeValue::now().usec();
-                ce.pc = state->getPc();
-                ce.address = address;
-                ce.size = size;
-                ce.isWrite = isWrite;
-                ce.isCode = false;
-                ce.cacheName = c->getName().c_str();
-                ce.missCount = missCount[i];
-            }
+    simulateAccesses(m_pendingState, true);
+    m_pendingAccesses.clear();
+}
+
+void CacheSim::simulateAccesses(S2EExecutionState *state, bool log)
+{
+    DECLARE_PLUGINSTATE(CacheSimState, state);
+
+    if (log) {
+        //Done only on the first invocation
+        writeCacheDescriptionToLog(state);
+    }
+
+    //All the accesses of the batch share the same timestamp
+    uint64_t timestamp = 0;
+    if (log && !m_useBinaryLogFile) {
+        timestamp = llvm::sys::TimeValue::now().usec();
+    }
+
+    unsigned missCount[plgState->m_caches.size()];
+
+    foreach2(it, m_pendingAccesses.begin(), m_pendingAccesses.end()) {
+        const PendingAccess &a = *it;
+
+        Cache* cache = a.isCode ? plgState->m_i1 : plgState->m_d1;
+        unsigned missCountLength = a.isCode ? plgState->m_i1_length : plgState->m_d1_length;
+        memset(missCount, 0, missCountLength * sizeof(unsigned));
+        cache->access(a.address, a.size, a.isWrite, missCount, missCountLength);
+
+        //Decide whether to log the access in the database
+        if (!log || !a.report) {
+            continue;
         }
 
-        if(missCount[i] == 0)
-            break;
+        unsigned i = 0;
+        for(Cache* c = cache; c != NULL; c = c->getUpperCache(), ++i) {
+            if(m_cacheLog.size() == CACHESIM_LOG_SIZE)
+                flushLogEntries();
+
+           // std::cout << a.pc << " "  << c->getName() << ": " << missCount[i] << std::endl;
+
+            if (m_reportZeroMisses || missCount[i]) {
+                if (m_useBinaryLogFile) {
+                    ExecutionTraceCacheSimEntry e;
+                    e.type = CACHE_ENTRY;
+                    e.cacheId = c->getId();
+                    e.pc = a.pc;
+                    e.address = a.address;
+                    e.size = a.size;
+                    e.isWrite = a.isWrite;
+                    e.isCode = a.isCode;
+                    e.missCount = missCount[i];
+                    m_sampler->write(state, &e, sizeof(e), TRACE_CACHESIM);
+                }else {
+                    m_cacheLog.resize(m_cacheLog.size()+1);
+                    CacheLogEntry& ce = m_cacheLog.back();
+                    ce.timestamp = timestamp;
+                    ce.pc = a.pc;
+                    ce.address = a.address;
+                    ce.size = a.size;
+                    ce.isWrite = a.isWrite;
+                    ce.isCode = false;
+                    ce.cacheName = c->getName().c_str();
+                    ce.missCount = missCount[i];
+                }
+            }
+
+            if(missCount[i] == 0)
+                break;
+        }
     }
 }
 
-void CacheSim::onDataMemoryAccess(S2EExecutionState *state,
+void CacheSim::onConcreteDataMemoryAccess(S2EExecutionState *state,
+                              uint64_t address, uint64_t hostAddress,
+                              uint64_t value, unsigned size,
+                              bool isWrite, bool isIO)
+{
+    uint64_t constAddress = m_physAddress ? hostAddress : address;
+    onMemoryAccess(state, constAddress, size, isWrite, isIO, false);
+}
+
+void CacheSim::onSymbolicDataMemoryAccess(S2EExecutionState *state,
                               klee::ref<klee::Expr> address,
                               klee::ref<klee::Expr> hostAddress,
                               klee::ref<klee::Expr> value,
@@ -634,7 +890,6 @@ void CacheSim::onDataMemoryAccess(S2EExecutionState *state,
 
     if (m_physAddress) {
         constAddress = cast<ConstantExpr>(hostAddress)->getZExtValue(64);
-  //      s2e()->getDebugStream() << "acc pc=" << std::hex << state->getPc() << " ha=" << constAddress << std::endl;
     }else {
         constAddress = cast<ConstantExpr>(address)->getZExtValue(64);
     }
@@ -43,11 +43,12 @@
 #include "ModuleExecutionDetector.h"
 
 #include <s2e/Plugins/ExecutionTracers/ExecutionTracer.h>
+#include <s2e/Plugins/ExecutionTracers/TraceSampler.h>
 
 #include <klee/Expr.h>
 
 #include <string>
-#include <map>
+#include <vector>
 #include <inttypes.h>
 
 namespace s2e {
@@ -79,9 +80,28 @@ protected:
 
     std::vector<CacheLogEntry> m_cacheLog;
 
+    /** An access that is yet to go through the simulated caches */
+    struct PendingAccess
+    {
+        uint64_t pc;
+        uint64_t address;
+        unsigned size;
+        bool     isWrite;
+        bool     isCode;
+        bool     report;
+    };
+
+    //Accesses of m_pendingState, simulated in batches of m_batchSize
+    std::vector<PendingAccess> m_pendingAccesses;
+    S2EExecutionState *m_pendingState;
+    bool m_pendingI1;
+    bool m_pendingD1;
+    unsigned m_batchSize;
 
     ModuleExecutionDetector *m_execDetector;
     ExecutionTracer *m_Tracer;
+    TraceSampler *m_sampler;
+    bool m_traceClosed;
 
     bool m_reportWholeSystem;
     bool m_reportZeroMisses;
@@ -96,6 +116,8 @@ protected:
     sigc::connection m_i1_connection;
 
     void flushLogEntries();
+    void flushPendingAccesses();
+    void simulateAccesses(S2EExecutionState *state, bool log);
 
     void onModuleTranslateBlockStart(
         ExecutionSignal* signal,
@@ -108,7 +130,12 @@ protected:
                         uint64_t address, unsigned size,
                         bool isWrite, bool isIO, bool isCode);
 
-    void onDataMemoryAccess(S2EExecutionState* state,
+    void onConcreteDataMemoryAccess(S2EExecutionState* state,
+                        uint64_t address, uint64_t hostAddress,
+                        uint64_t value, unsigned size,
+                        bool isWrite, bool isIO);
+
+    void onSymbolicDataMemoryAccess(S2EExecutionState* state,
                         klee::ref<klee::Expr> address,
                         klee::ref<klee::Expr> hostAddress,
                         klee::ref<klee::Expr> value,
@@ -124,12 +151,22 @@ protected:
 
     void onTimer();
 
+    void onStateFork(S2EExecutionState *state,
+                     const std::vector<S2EExecutionState*> &newStates,
+                     const std::vector<klee::ref<klee::Expr> > &newConditions);
+
+    void onStateKill(S2EExecutionState *state);
+
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+    void onTraceClose();
+
     void writeCacheDescriptionToLog(S2EExecutionState *state);
 
     bool profileAccess(S2EExecutionState *state) const;
     bool reportAccess(S2EExecutionState *state) const;
 public:
-    CacheSim(S2E* s2e): Plugin(s2e) {}
+    CacheSim(S2E* s2e): Plugin(s2e), m_pendingState(NULL), m_sampler(NULL),
+        m_traceClosed(false) {}
     ~CacheSim();
 
     void initialize();
@@ -140,8 +177,9 @@ public:
 class CacheSimState: public PluginState
 {
 private:
-    typedef std::map<std::string, Cache*> CachesMap;
-    CachesMap m_caches;
+    //Indexed by cache id
+    typedef std::vector<Cache*> Caches;
+    Caches m_caches;
 
     unsigned m_i1_length;
     unsigned m_d1_length;
@@ -52,6 +52,8 @@ extern struct CPUX86State *env;
 
 #include <s2e/s2e_qemu.h>
 
+#include <algorithm>
+
 using namespace std;
 
 namespace s2e {
@@ -60,6 +62,12 @@ namespace s2e {
 
 using namespace s2e;
 
+/* Until CorePlugin is initialized, all accesses go to S2E */
+static const unsigned s_traceAllMemory = 1;
+const unsigned *g_s2e_data_memory_listeners = &s_traceAllMemory;
+const S2EMemoryRange *g_s2e_memory_ranges = NULL;
+unsigned g_s2e_memory_range_count = 0;
+
 
 
 static void s2e_timer_cb(void *opaque)
@@ -80,9 +88,309 @@ void CorePlugin::initializeTimers()
     qemu_mod_timer(m_Timer, qemu_get_clock(rt_clock) + 1000);
 }
 
+#define NAME_SIGNAL(signal) S2E_NAME_SIGNAL(signal, #signal)
+
+static void nameTranslationSignals(CorePlugin::TranslationSignals &signals)
+{
+    S2E_NAME_SIGNAL(signals.onTranslateBlockStart, "onTranslateBlockStart");
+    S2E_NAME_SIGNAL(signals.onTranslateBlockEnd, "onTranslateBlockEnd");
+    S2E_NAME_SIGNAL(signals.onTranslateInstructionStart, "onTranslateInstructionStart");
+    S2E_NAME_SIGNAL(signals.onTranslateInstructionEnd, "onTranslateInstructionEnd");
+    S2E_NAME_SIGNAL(signals.onTranslateJumpStart, "onTranslateJumpStart");
+}
+
 void CorePlugin::initialize()
 {
+#ifdef S2E_USE_FAST_SIGNALS
+    //Lets the softmmu helpers skip the call into S2E when nobody
+    //listens to all accesses
+    g_s2e_data_memory_listeners = &onDataMemoryAccess.m_activeSignals;
+#endif
+
+    NAME_SIGNAL(onTranslateBlockStart);
+    NAME_SIGNAL(onTranslateBlockEnd);
+    NAME_SIGNAL(onTranslateInstructionStart);
+    NAME_SIGNAL(onTranslateInstructionEnd);
+    NAME_SIGNAL(onTranslateJumpStart);
+    NAME_SIGNAL(onException);
+    NAME_SIGNAL(onCustomInstruction);
+    NAME_SIGNAL(onDataMemoryAccess);
+    NAME_SIGNAL(onSymbolicDataMemoryAccess);
+    NAME_SIGNAL(onPortAccess);
+    NAME_SIGNAL(onTimer);
+    NAME_SIGNAL(onStateFork);
+    NAME_SIGNAL(onBranchDecision);
+    NAME_SIGNAL(onStateKill);
+    NAME_SIGNAL(onProcessFork);
+    NAME_SIGNAL(onTlbMiss);
+    NAME_SIGNAL(onPageFault);
+    NAME_SIGNAL(onDeviceRegistration);
+    NAME_SIGNAL(onDeviceActivation);
+}
+
+#undef NAME_SIGNAL
+
+CorePlugin::~CorePlugin()
+{
+    g_s2e_data_memory_listeners = &s_traceAllMemory;
+    g_s2e_memory_range_count = 0;
+    g_s2e_memory_ranges = NULL;
+
+    foreach2(it, m_memoryWatches.begin(), m_memoryWatches.end()) {
+        delete *it;
+    }
+
+    foreach2(it, m_translationSignals.begin(), m_translationSignals.end()) {
+        delete (*it).second;
+    }
+}
+
+/*****************************************************************/
+/* Translation subscriptions                                     */
+
+CorePlugin::TranslationSignals &CorePlugin::getTranslationSignals(Plugin *plugin)
+{
+    foreach2(it, m_translationSignals.begin(), m_translationSignals.end()) {
+        if ((*it).first == plugin) {
+            return *(*it).second;
+        }
+    }
+
+    TranslationSignals *signals = new TranslationSignals();
+    nameTranslationSignals(*signals);
+    m_translationSignals.push_back(std::make_pair(plugin, signals));
+    return *signals;
+}
+
+void CorePlugin::subscribeTranslation(Plugin *plugin, uint64_t start, uint64_t end,
+                                      unsigned events)
+{
+    assert(start <= end);
+    assert(!(events & ~TRANSLATE_ALL));
+
+    getTranslationSignals(plugin);
+
+    TranslationSubscription sub = {plugin, start, end, events};
+    m_translationSubscriptions.push_back(sub);
+    compileTranslationIndex();
+}
+
+void CorePlugin::unsubscribeTranslation(Plugin *plugin, uint64_t start, uint64_t end)
+{
+    foreach2(it, m_translationSubscriptions.begin(), m_translationSubscriptions.end()) {
+        if ((*it).plugin == plugin && (*it).start == start && (*it).end == end) {
+            m_translationSubscriptions.erase(it);
+            compileTranslationIndex();
+            return;
+        }
+    }
+}
+
+static bool sameSubscribers(const CorePlugin::TranslationInterval &i1,
+                            const CorePlugin::TranslationInterval &i2)
+{
+    if (i1.subscribers.size() != i2.subscribers.size()) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < i1.subscribers.size(); ++i) {
+        if (i1.subscribers[i].signals != i2.subscribers[i].signals ||
+            i1.subscribers[i].events != i2.subscribers[i].events) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Splits the address space at the boundaries of all subscriptions
+//and records, for each piece, which plugins want which events.
+//Subscriptions change on module loads, which is rare compared to
+//translations, so the index is simply rebuilt from scratch.
+void CorePlugin::compileTranslationIndex()
+{
+    std::vector<uint64_t> boundaries;
+    foreach2(it, m_translationSubscriptions.begin(), m_translationSubscriptions.end()) {
+        boundaries.push_back((*it).start);
+        if ((*it).end != (uint64_t)-1) {
+            boundaries.push_back((*it).end + 1);
+        }
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    std::vector<TranslationInterval> index;
+    unsigned allEvents = 0;
+
+    for (unsigned i = 0; i < boundaries.size(); ++i) {
+        TranslationInterval interval;
+        interval.start = boundaries[i];
+        interval.end = i + 1 < boundaries.size() ? boundaries[i + 1] - 1 : (uint64_t)-1;
+        interval.events = 0;
+
+        //Subscribers keep the order in which the plugins requested their
+        //signals, so that the order of the instrumentation is deterministic
+        foreach2(pit, m_translationSignals.begin(), m_translationSignals.end()) {
+            unsigned events = 0;
+            foreach2(it, m_translationSubscriptions.begin(), m_translationSubscriptions.end()) {
+                const TranslationSubscription &sub = *it;
+                if (sub.plugin == (*pit).first &&
+                    sub.start <= interval.start && interval.end <= sub.end) {
+                    events |= sub.events;
+                }
+            }
+
+            if (events) {
+                TranslationSubscriber subscriber = {(*pit).second, events};
+                interval.subscribers.push_back(subscriber);
+                interval.events |= events;
+            }
+        }
+
+        if (!interval.events) {
+            continue;
+        }
+
+        TranslationInterval *prev = index.empty() ? NULL : &index.back();
+        if (prev && prev->end + 1 == interval.start && sameSubscribers(*prev, interval)) {
+            prev->end = interval.end;
+        } else {
+            index.push_back(interval);
+        }
+        allEvents |= interval.events;
+    }
+
+    m_translationEvents = 0;
+    m_lastInterval = 0;
+    m_translationIndex = index;
+    m_translationEvents = allEvents;
+}
+
+const CorePlugin::TranslationInterval *CorePlugin::findTranslationInterval(uint64_t pc) const
+{
+    unsigned low = 0, high = m_translationIndex.size();
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        const TranslationInterval &interval = m_translationIndex[mid];
+        if (pc < interval.start) {
+            high = mid;
+        } else if (pc > interval.end) {
+            low = mid + 1;
+        } else {
+            m_lastInterval = mid;
+            return &interval;
+        }
+    }
+    return NULL;
+}
+
+static bool rangeStartLess(const S2EMemoryRange &r1, const S2EMemoryRange &r2)
+{
+    return r1.start < r2.start;
+}
+
+/** Sorts the ranges and merges those that overlap or touch */
+static void normalizeRanges(std::vector<S2EMemoryRange> &ranges)
+{
+    if (ranges.empty()) {
+        return;
+    }
 
+    std::sort(ranges.begin(), ranges.end(), rangeStartLess);
+
+    unsigned last = 0;
+    for (unsigned i = 1; i < ranges.size(); ++i) {
+        S2EMemoryRange &cur = ranges[last];
+        if (cur.end == (uint64_t) -1 || ranges[i].start <= cur.end + 1) {
+            if (ranges[i].end > cur.end) {
+                cur.end = ranges[i].end;
+            }
+        } else {
+            ranges[++last] = ranges[i];
+        }
+    }
+    ranges.resize(last + 1);
+}
+
+static bool rangesOverlap(const std::vector<S2EMemoryRange> &ranges,
+                          uint64_t first, uint64_t last)
+{
+    unsigned lo = 0, hi = ranges.size();
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (ranges[mid].end < first) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < ranges.size() && ranges[lo].start <= last;
+}
+
+CorePlugin::DataMemoryWatch *CorePlugin::getMemoryWatch(Plugin *plugin)
+{
+    foreach2(it, m_memoryWatches.begin(), m_memoryWatches.end()) {
+        if ((*it)->plugin == plugin) {
+            return *it;
+        }
+    }
+
+    DataMemoryWatch *watch = new DataMemoryWatch();
+    watch->plugin = plugin;
+    S2E_NAME_SIGNAL(watch->signal, "onConcreteDataMemoryAccess");
+    m_memoryWatches.push_back(watch);
+    return watch;
+}
+
+void CorePlugin::updateMemoryRanges()
+{
+    std::vector<S2EMemoryRange> ranges;
+    foreach2(it, m_memoryWatches.begin(), m_memoryWatches.end()) {
+        ranges.insert(ranges.end(), (*it)->ranges.begin(), (*it)->ranges.end());
+    }
+    normalizeRanges(ranges);
+
+    g_s2e_memory_range_count = 0;
+    m_memoryRanges = ranges;
+    g_s2e_memory_ranges = m_memoryRanges.empty() ? NULL : &m_memoryRanges[0];
+    g_s2e_memory_range_count = m_memoryRanges.size();
+}
+
+void CorePlugin::watchDataMemory(Plugin *plugin, uint64_t start, uint64_t end)
+{
+    assert(start <= end);
+
+    DataMemoryWatch *watch = getMemoryWatch(plugin);
+    S2EMemoryRange range = {start, end};
+    watch->ranges.push_back(range);
+    normalizeRanges(watch->ranges);
+
+    updateMemoryRanges();
+}
+
+void CorePlugin::unwatchDataMemory(Plugin *plugin)
+{
+    getMemoryWatch(plugin)->ranges.clear();
+    updateMemoryRanges();
+}
+
+void CorePlugin::notifyConcreteDataMemoryAccess(S2EExecutionState *state,
+                                                uint64_t virtualAddress,
+                                                uint64_t hostAddress,
+                                                uint64_t value, unsigned size,
+                                                bool isWrite, bool isIO)
+{
+    uint64_t last = virtualAddress + size - 1;
+
+    foreach2(it, m_memoryWatches.begin(), m_memoryWatches.end()) {
+        DataMemoryWatch *watch = *it;
+        if (watch->signal.empty() ||
+            !rangesOverlap(watch->ranges, virtualAddress, last)) {
+            continue;
+        }
+
+        watch->signal.emit(state, virtualAddress, hostAddress,
+                           value, size, isWrite, isIO);
+    }
 }
 
 /******************************/
@@ -174,9 +482,22 @@ void s2e_on_translate_block_start(
     ExecutionSignal *signal = static_cast<ExecutionSignal*>(
                                     tb->s2e_tb->executionSignals.back());
     assert(signal->empty());
+    S2E_NAME_SIGNAL(*signal, "onExecuteBlockStart");
 
     try {
-        s2e->getCorePlugin()->onTranslateBlockStart.emit(signal, state, tb, pc);
+        CorePlugin *core = s2e->getCorePlugin();
+        core->onTranslateBlockStart.emit(signal, state, tb, pc);
+
+        const CorePlugin::TranslationInterval *interval =
+                core->getTranslationInterval(pc, CorePlugin::TRANSLATE_BLOCK_START);
+        if (interval) {
+            foreach2(it, interval->subscribers.begin(), interval->subscribers.end()) {
+                if ((*it).events & CorePlugin::TRANSLATE_BLOCK_START) {
+                    (*it).signals->onTranslateBlockStart.emit(signal, state, tb, pc);
+                }
+            }
+        }
+
         if(!signal->empty()) {
             s2e_tcg_instrument_code(s2e, signal, pc);
             tb->s2e_tb->executionSignals.push_back(new ExecutionSignal);
@@ -196,11 +517,25 @@ void s2e_on_translate_block_end(
     ExecutionSignal *signal = static_cast<ExecutionSignal*>(
                                     tb->s2e_tb->executionSignals.back());
     assert(signal->empty());
+    S2E_NAME_SIGNAL(*signal, "onExecuteBlockEnd");
 
     try {
-        s2e->getCorePlugin()->onTranslateBlockEnd.emit(
+        CorePlugin *core = s2e->getCorePlugin();
+        core->onTranslateBlockEnd.emit(
                 signal, state, tb, insPc,
                 staticTarget, targetPc);
+
+        const CorePlugin::TranslationInterval *interval =
+                core->getTranslationInterval(insPc, CorePlugin::TRANSLATE_BLOCK_END);
+        if (interval) {
+            foreach2(it, interval->subscribers.begin(), interval->subscribers.end()) {
+                if ((*it).events & CorePlugin::TRANSLATE_BLOCK_END) {
+                    (*it).signals->onTranslateBlockEnd.emit(
+                            signal, state, tb, insPc,
+                            staticTarget, targetPc);
+                }
+            }
+        }
     } catch(s2e::CpuExitException&) {
         longjmp(env->jmp_env, 1);
     }
@@ -220,9 +555,22 @@ void s2e_on_translate_instruction_start(
     ExecutionSignal *signal = static_cast<ExecutionSignal*>(
                                     tb->s2e_tb->executionSignals.back());
     assert(signal->empty());
+    S2E_NAME_SIGNAL(*signal, "onExecuteInstructionStart");
 
     try {
-        s2e->getCorePlugin()->onTranslateInstructionStart.emit(signal, state, tb, pc);
+        CorePlugin *core = s2e->getCorePlugin();
+        core->onTranslateInstructionStart.emit(signal, state, tb, pc);
+
+        const CorePlugin::TranslationInterval *interval =
+                core->getTranslationInterval(pc, CorePlugin::TRANSLATE_INSTRUCTION_START);
+        if (interval) {
+            foreach2(it, interval->subscribers.begin(), interval->subscribers.end()) {
+                if ((*it).events & CorePlugin::TRANSLATE_INSTRUCTION_START) {
+                    (*it).signals->onTranslateInstructionStart.emit(signal, state, tb, pc);
+                }
+            }
+        }
+
         if(!signal->empty()) {
             s2e_tcg_instrument_code(s2e, signal, pc);
             tb->s2e_tb->executionSignals.push_back(new ExecutionSignal);
@@ -241,10 +589,23 @@ void s2e_on_translate_jump_start(
     ExecutionSignal *signal = static_cast<ExecutionSignal*>(
                                     tb->s2e_tb->executionSignals.back());
     assert(signal->empty());
+    S2E_NAME_SIGNAL(*signal, "onExecuteJumpStart");
 
     try {
-        s2e->getCorePlugin()->onTranslateJumpStart.emit(signal, state, tb,
-                                                        pc, jump_type);
+        CorePlugin *core = s2e->getCorePlugin();
+        core->onTranslateJumpStart.emit(signal, state, tb, pc, jump_type);
+
+        const CorePlugin::TranslationInterval *interval =
+                core->getTranslationInterval(pc, CorePlugin::TRANSLATE_JUMP_START);
+        if (interval) {
+            foreach2(it, interval->subscribers.begin(), interval->subscribers.end()) {
+                if ((*it).events & CorePlugin::TRANSLATE_JUMP_START) {
+                    (*it).signals->onTranslateJumpStart.emit(signal, state, tb,
+                                                             pc, jump_type);
+                }
+            }
+        }
+
         if(!signal->empty()) {
             s2e_tcg_instrument_code(s2e, signal, pc);
             tb->s2e_tb->executionSignals.push_back(new ExecutionSignal);
@@ -265,9 +626,22 @@ void s2e_on_translate_instruction_end(
     ExecutionSignal *signal = static_cast<ExecutionSignal*>(
                                     tb->s2e_tb->executionSignals.back());
     assert(signal->empty());
+    S2E_NAME_SIGNAL(*signal, "onExecuteInstructionEnd");
 
     try {
-        s2e->getCorePlugin()->onTranslateInstructionEnd.emit(signal, state, tb, pc);
+        CorePlugin *core = s2e->getCorePlugin();
+        core->onTranslateInstructionEnd.emit(signal, state, tb, pc);
+
+        const CorePlugin::TranslationInterval *interval =
+                core->getTranslationInterval(pc, CorePlugin::TRANSLATE_INSTRUCTION_END);
+        if (interval) {
+            foreach2(it, interval->subscribers.begin(), interval->subscribers.end()) {
+                if ((*it).events & CorePlugin::TRANSLATE_INSTRUCTION_END) {
+                    (*it).signals->onTranslateInstructionEnd.emit(signal, state, tb, pc);
+                }
+            }
+        }
+
         if(!signal->empty()) {
             s2e_tcg_instrument_code(s2e, signal, pc, nextpc);
             tb->s2e_tb->executionSignals.push_back(new ExecutionSignal);
@@ -299,19 +673,23 @@ void s2e_trace_memory_access(
         uint64_t vaddr, uint64_t haddr, uint8_t* buf, unsigned size,
         int isWrite, int isIO)
 {
-    if(!s2e->getCorePlugin()->onDataMemoryAccess.empty()) {
-        uint64_t value = 0;
-        memcpy((void*) &value, buf, size);
+    CorePlugin *core = s2e->getCorePlugin();
+    uint64_t value = 0;
+    memcpy((void*) &value, buf, size);
 
-        try {
-            s2e->getCorePlugin()->onDataMemoryAccess.emit(state,
+    try {
+        core->notifyConcreteDataMemoryAccess(state, vaddr, haddr,
+                                             value, size, isWrite, isIO);
+
+        if(!core->onDataMemoryAccess.empty()) {
+            core->onDataMemoryAccess.emit(state,
                 klee::ConstantExpr::create(vaddr, 64),
                 klee::ConstantExpr::create(haddr, 64),
                 klee::ConstantExpr::create(value, size*8),
                 isWrite, isIO);
-        } catch(s2e::CpuExitException&) {
-            longjmp(env->jmp_env, 1);
         }
+    } catch(s2e::CpuExitException&) {
+        longjmp(env->jmp_env, 1);
     }
 }
 
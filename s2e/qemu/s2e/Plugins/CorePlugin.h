@@ -41,6 +41,7 @@
 #include <klee/Expr.h>
 
 #include <s2e/Signals/Signals.h>
+#include <s2e/s2e_qemu.h>
 #include <vector>
 #include <inttypes.h>
 
@@ -63,16 +64,121 @@ typedef sigc::signal<void, S2EExecutionState*, uint64_t /* pc */> ExecutionSigna
 typedef bool (*SYMB_PORT_CHECK)(uint16_t port, void *opaque);
 typedef bool (*SYMB_MMIO_CHECK)(uint64_t physaddress, uint64_t size, void *opaque);
 
+/** Types of the signals emitted when translating code */
+typedef sigc::signal<void, ExecutionSignal*,
+            S2EExecutionState*,
+            TranslationBlock*,
+            uint64_t /* block PC */>
+        TranslateBlockStartSignal;
+
+typedef sigc::signal<void, ExecutionSignal*,
+            S2EExecutionState*,
+            TranslationBlock*,
+            uint64_t /* ending instruction pc */,
+            bool /* static target is valid */,
+            uint64_t /* static target pc */>
+        TranslateBlockEndSignal;
+
+typedef sigc::signal<void, ExecutionSignal*,
+            S2EExecutionState*,
+            TranslationBlock*,
+            uint64_t /* instruction PC */>
+        TranslateInstructionSignal;
+
+typedef sigc::signal<void, ExecutionSignal*,
+            S2EExecutionState*,
+            TranslationBlock*,
+            uint64_t /* instruction PC */,
+            int /* jump_type */>
+        TranslateJumpStartSignal;
+
+/** A type of a signal emitted on concrete data memory accesses */
+typedef sigc::signal<void, S2EExecutionState*,
+                 uint64_t /* virtualAddress */,
+                 uint64_t /* hostAddress */,
+                 uint64_t /* value */,
+                 unsigned /* size */,
+                 bool /* isWrite */, bool /* isIO */>
+        ConcreteDataMemoryAccessSignal;
+
 class CorePlugin : public Plugin {
     S2E_PLUGIN
 
+public:
+    /** Translation events a plugin can subscribe to */
+    enum TranslationEvent {
+        TRANSLATE_BLOCK_START = 1,
+        TRANSLATE_BLOCK_END = 2,
+        TRANSLATE_INSTRUCTION_START = 4,
+        TRANSLATE_INSTRUCTION_END = 8,
+        /* Returns from functions and interrupts */
+        TRANSLATE_JUMP_START = 16,
+        TRANSLATE_ALL = 31
+    };
+
+    /** Translation signals of one plugin, emitted only for the code
+        the plugin subscribed to */
+    struct TranslationSignals {
+        TranslateBlockStartSignal onTranslateBlockStart;
+        TranslateBlockEndSignal onTranslateBlockEnd;
+        TranslateInstructionSignal onTranslateInstructionStart;
+        TranslateInstructionSignal onTranslateInstructionEnd;
+        TranslateJumpStartSignal onTranslateJumpStart;
+    };
+
+    struct TranslationSubscriber {
+        TranslationSignals *signals;
+        unsigned events;
+    };
+
+    /** Range of program counters with the plugins subscribed to it */
+    struct TranslationInterval {
+        uint64_t start;
+        uint64_t end;
+        unsigned events;
+        std::vector<TranslationSubscriber> subscribers;
+    };
+
 private:
+    struct TranslationSubscription {
+        Plugin *plugin;
+        uint64_t start;
+        uint64_t end;
+        unsigned events;
+    };
+
+    /** Translation signals, in the order in which plugins requested them */
+    typedef std::vector<std::pair<Plugin*, TranslationSignals*> > TranslationSignalsList;
+    TranslationSignalsList m_translationSignals;
+    std::vector<TranslationSubscription> m_translationSubscriptions;
+
+    /** Sorted, disjoint intervals compiled from the subscriptions */
+    std::vector<TranslationInterval> m_translationIndex;
+    unsigned m_translationEvents;
+    mutable unsigned m_lastInterval;
+
+    void compileTranslationIndex();
+
     struct QEMUTimer *m_Timer;
     SYMB_PORT_CHECK m_isPortSymbolicCb;
     SYMB_MMIO_CHECK m_isMmioSymbolicCb;
     void *m_isPortSymbolicOpaque;
     void *m_isMmioSymbolicOpaque;
 
+    struct DataMemoryWatch {
+        Plugin *plugin;
+        std::vector<S2EMemoryRange> ranges;
+        ConcreteDataMemoryAccessSignal signal;
+    };
+
+    std::vector<DataMemoryWatch*> m_memoryWatches;
+
+    /** Union of the watched ranges, read by the softmmu helpers */
+    std::vector<S2EMemoryRange> m_memoryRanges;
+
+    DataMemoryWatch *getMemoryWatch(Plugin *plugin);
+    void updateMemoryRanges();
+
 public:
     CorePlugin(S2E* s2e): Plugin(s2e) {
         m_Timer = NULL;
@@ -80,8 +186,12 @@ public:
         m_isMmioSymbolicCb = NULL;
         m_isPortSymbolicOpaque = NULL;
         m_isMmioSymbolicOpaque = NULL;
+        m_translationEvents = 0;
+        m_lastInterval = 0;
     }
 
+    ~CorePlugin();
+
     void initialize();
     void initializeTimers();
 
@@ -113,39 +223,71 @@ public:
         return m_Timer;
     }
 
+    /** Returns the translation signals of the plugin. Unlike the global
+        onTranslateXXX signals below, they are only emitted for the events
+        and the program counters the plugin subscribed to. Code outside
+        of all subscriptions is translated without calling any plugin,
+        unless some plugin listens to the global signals. */
+    TranslationSignals &getTranslationSignals(Plugin *plugin);
+
+    /** Subscribes the plugin to the translation events (TranslationEvent
+        mask) of the code in [start, end]. Code that is already translated
+        keeps its instrumentation until the translation cache is flushed. */
+    void subscribeTranslation(Plugin *plugin, uint64_t start, uint64_t end,
+                              unsigned events);
+
+    /** Removes one subscription made with the same range */
+    void unsubscribeTranslation(Plugin *plugin, uint64_t start, uint64_t end);
+
+    /** Returns the interval of the index that contains pc if some
+        subscriber wants one of the events, NULL otherwise */
+    const TranslationInterval *getTranslationInterval(uint64_t pc, unsigned event) const {
+        if (!(m_translationEvents & event)) {
+            return NULL;
+        }
+
+        const TranslationInterval *last = &m_translationIndex[m_lastInterval];
+        if (!(last->start <= pc && pc <= last->end)) {
+            last = findTranslationInterval(pc);
+        }
+        return last && (last->events & event) ? last : NULL;
+    }
+
+    const TranslationInterval *findTranslationInterval(uint64_t pc) const;
+
+    /** Signal emitted on the concrete data memory accesses that overlap
+        the ranges watched by the plugin. Accesses outside the ranges
+        watched by all plugins are filtered in the softmmu helpers. */
+    ConcreteDataMemoryAccessSignal &onConcreteDataMemoryAccess(Plugin *plugin) {
+        return getMemoryWatch(plugin)->signal;
+    }
+
+    /** Watches the virtual addresses in [start, end] for the plugin */
+    void watchDataMemory(Plugin *plugin, uint64_t start, uint64_t end);
+
+    /** Stops watching all the ranges of the plugin */
+    void unwatchDataMemory(Plugin *plugin);
+
+    /** Emits onConcreteDataMemoryAccess for the plugins watching the access */
+    void notifyConcreteDataMemoryAccess(S2EExecutionState *state,
+                                        uint64_t virtualAddress,
+                                        uint64_t hostAddress,
+                                        uint64_t value, unsigned size,
+                                        bool isWrite, bool isIO);
+
     /** Signal that is emitted on begining and end of code generation
         for each QEMU translation block.
     */
-    sigc::signal<void, ExecutionSignal*, 
-            S2EExecutionState*,
-            TranslationBlock*,
-            uint64_t /* block PC */>
-            onTranslateBlockStart;
+    TranslateBlockStartSignal onTranslateBlockStart;
 
     /** Signal that is emitted upon end of translation block */
-    sigc::signal<void, ExecutionSignal*, 
-            S2EExecutionState*,
-            TranslationBlock*,
-            uint64_t /* ending instruction pc */,
-            bool /* static target is valid */,
-            uint64_t /* static target pc */>
-            onTranslateBlockEnd;
+    TranslateBlockEndSignal onTranslateBlockEnd;
 
-    
     /** Signal that is emitted on code generation for each instruction */
-    sigc::signal<void, ExecutionSignal*, 
-            S2EExecutionState*,
-            TranslationBlock*,
-            uint64_t /* instruction PC */>
-            onTranslateInstructionStart, onTranslateInstructionEnd;
+    TranslateInstructionSignal onTranslateInstructionStart, onTranslateInstructionEnd;
 
     /** Signal that is emitted on code generation for each jump instruction */
-    sigc::signal<void, ExecutionSignal*,
-            S2EExecutionState*,
-            TranslationBlock*,
-            uint64_t /* instruction PC */,
-            int /* jump_type */>
-            onTranslateJumpStart;
+    TranslateJumpStartSignal onTranslateJumpStart;
 
     /** Signal that is emitted upon exception */
     sigc::signal<void, S2EExecutionState*, 
@@ -161,6 +303,9 @@ public:
 
     /** Signal that is emitted on each memory access */
     /* XXX: this signal is still not emmited for code */
+    /* Listening to it makes every concrete access call into S2E and
+       build expressions, prefer onConcreteDataMemoryAccess and
+       onSymbolicDataMemoryAccess */
     sigc::signal<void, S2EExecutionState*,
                  klee::ref<klee::Expr> /* virtualAddress */,
                  klee::ref<klee::Expr> /* hostAddress */,
@@ -168,6 +313,15 @@ public:
                  bool /* isWrite */, bool /* isIO */>
             onDataMemoryAccess;
 
+    /** Signal that is emitted on each data memory access
+        whose address or value is symbolic */
+    sigc::signal<void, S2EExecutionState*,
+                 klee::ref<klee::Expr> /* virtualAddress */,
+                 klee::ref<klee::Expr> /* hostAddress */,
+                 klee::ref<klee::Expr> /* value */,
+                 bool /* isWrite */, bool /* isIO */>
+            onSymbolicDataMemoryAccess;
+
     /** Signal that is emitted on each port access */
     sigc::signal<void, S2EExecutionState*,
                  klee::ref<klee::Expr> /* port */,
@@ -183,6 +337,18 @@ public:
                  const std::vector<klee::ref<klee::Expr> >& /* newConditions */>
             onStateFork;
 
+    /** Signal emitted after the solver decided a symbolic branch,
+        before the state is forked (if several outcomes are feasible).
+        The solver time is in seconds */
+    sigc::signal<void, S2EExecutionState*,
+                 bool /* forked */,
+                 double /* solverTime */>
+            onBranchDecision;
+
+    /** Signal emitted when a state is terminated */
+    /** It is not emitted for states moved to another S2E process */
+    sigc::signal<void, S2EExecutionState*> onStateKill;
+
     /** Signal emited when spawning a new S2E process */
     /** The signal is emitted in the child processes only */
     sigc::signal<void, bool /* prefork */,
@@ -76,8 +76,7 @@ void Debugger::initialize()
     initAddressTriggers(getConfigKey() + ".addressTriggers");
 
     if (!m_timeTrigger) {
-        s2e()->getCorePlugin()->onDataMemoryAccess.connect(
-                sigc::mem_fun(*this, &Debugger::onDataMemoryAccess));
+        enableMemoryTracing();
     }else {
         m_timerConnection = s2e()->getCorePlugin()->onTimer.connect(
                 sigc::mem_fun(*this, &Debugger::onTimer));
@@ -194,26 +193,21 @@ bool Debugger::decideTracing(S2EExecutionState *state, uint64_t addr, uint64_t d
     return false;
 }
 
-void Debugger::onDataMemoryAccess(S2EExecutionState *state,
-                               klee::ref<klee::Expr> address,
-                               klee::ref<klee::Expr> hostAddress,
-                               klee::ref<klee::Expr> value,
-                               bool isWrite, bool isIO)
+void Debugger::enableMemoryTracing()
 {
-    if(!isa<klee::ConstantExpr>(address) || !isa<klee::ConstantExpr>(value)) {
-        //We do not support symbolic values yet...
-        return;
-    }
-
-    uint64_t addr = cast<klee::ConstantExpr>(address)->getZExtValue(64);
-    uint64_t val = cast<klee::ConstantExpr>(value)->getZExtValue(64);
-
-    if (addr < m_catchAbove) {
-        //Skip uninteresting ranges
-        return;
-    }
-
+    //We do not support symbolic values yet, only concrete accesses above
+    //catchAccessesAbove are needed
+    CorePlugin *core = s2e()->getCorePlugin();
+    core->watchDataMemory(this, m_catchAbove, (uint64_t) -1);
+    core->onConcreteDataMemoryAccess(this).connect(
+            sigc::mem_fun(*this, &Debugger::onConcreteDataMemoryAccess));
+}
 
+void Debugger::onConcreteDataMemoryAccess(S2EExecutionState *state,
+                               uint64_t addr, uint64_t hostAddress,
+                               uint64_t val, unsigned size,
+                               bool isWrite, bool isIO)
+{
     if (decideTracing(state, addr, val)) {
         s2e()->getDebugStream() <<
                    " MEM PC=0x" << std::hex << state->getPc() <<
@@ -257,8 +251,7 @@ void Debugger::onTimer()
     }
 
     s2e()->getMessagesStream() << "Debugger Plugin: Enabling memory tracing" << std::endl;
-    s2e()->getCorePlugin()->onDataMemoryAccess.connect(
-            sigc::mem_fun(*this, &Debugger::onDataMemoryAccess));
+    enableMemoryTracing();
 
     //s2e()->getCorePlugin()->onTranslateInstructionStart.connect(
       //      sigc::mem_fun(*this, &Debugger::onTranslateInstructionStart));
@@ -91,12 +91,13 @@ private:
 
     bool decideTracing(S2EExecutionState *state, uint64_t addr, uint64_t data) const;
 
-    void onDataMemoryAccess(S2EExecutionState *state,
-                                   klee::ref<klee::Expr> address,
-                                   klee::ref<klee::Expr> hostAddress,
-                                   klee::ref<klee::Expr> value,
+    void onConcreteDataMemoryAccess(S2EExecutionState *state,
+                                   uint64_t address, uint64_t hostAddress,
+                                   uint64_t value, unsigned size,
                                    bool isWrite, bool isIO);
 
+    void enableMemoryTracing();
+
     void onTranslateInstructionStart(
         ExecutionSignal *signal,
         S2EExecutionState *state,
@@ -0,0 +1,487 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "AsyncTraceWriter.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+/* How long the writer sleeps when the ring is not filling up */
+#define WRITER_PERIOD_MS 100
+
+static uint64_t getTimeMicroseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+AsyncTraceWriter::AsyncTraceWriter(unsigned bufferSize, bool directIo, bool dropWhenFull,
+                                   RecordHandler *handler)
+{
+    m_bufferSize = 64 * 1024;
+    while (m_bufferSize < bufferSize) {
+        m_bufferSize <<= 1;
+    }
+
+    void *buffer = NULL, *bounce = NULL;
+    if (posix_memalign(&buffer, DIRECT_IO_BLOCK, m_bufferSize) ||
+        posix_memalign(&bounce, DIRECT_IO_BLOCK, DIRECT_IO_BLOCK)) {
+        abort();
+    }
+    m_buffer = (uint8_t*) buffer;
+    m_bounce = (uint8_t*) bounce;
+
+    m_handler = handler;
+    m_directIo = directIo && !handler;
+    m_dropWhenFull = dropWhenFull;
+    m_head = m_tail = 0;
+    m_fd = -1;
+    m_fileOffset = 0;
+    m_running = false;
+    m_stop = false;
+    m_flushRequest = m_flushDone = 0;
+    m_ioError = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_wakeup, NULL);
+    pthread_cond_init(&m_flushed, NULL);
+}
+
+AsyncTraceWriter::~AsyncTraceWriter()
+{
+    close();
+    pthread_cond_destroy(&m_flushed);
+    pthread_cond_destroy(&m_wakeup);
+    pthread_mutex_destroy(&m_mutex);
+    free(m_bounce);
+    free(m_buffer);
+}
+
+bool AsyncTraceWriter::openFile(const std::string &fileName, bool append)
+{
+    int flags = O_RDWR | O_CREAT | (append ? 0 : O_TRUNC);
+    m_fd = -1;
+#ifdef O_DIRECT
+    if (m_directIo) {
+        m_fd = ::open(fileName.c_str(), flags | O_DIRECT, 0644);
+    }
+#endif
+    if (m_fd < 0) {
+        /* tmpfs and friends do not support O_DIRECT */
+        m_directIo = false;
+        m_fd = ::open(fileName.c_str(), flags, 0644);
+    }
+    if (m_fd < 0) {
+        return false;
+    }
+
+    if (append) {
+        off_t end = lseek(m_fd, 0, SEEK_END);
+        m_fileOffset = end < 0 ? 0 : end;
+        if (m_directIo && !loadPartialBlock()) {
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncTraceWriter::open(const std::string &fileName, bool append)
+{
+    assert(!m_running);
+
+    m_head = m_tail = 0;
+    m_fileOffset = 0;
+    m_ioError = false;
+
+    bool opened = m_handler ? m_handler->open(fileName, append) :
+                              openFile(fileName, append);
+    if (!opened) {
+        return false;
+    }
+
+    /* The writer must not steal the signals QEMU relies on */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&m_thread, NULL, threadMain, this);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (err) {
+        if (m_handler) {
+            m_handler->close();
+        } else {
+            ::close(m_fd);
+        }
+        m_fd = -1;
+        return false;
+    }
+
+    m_running = true;
+    return true;
+}
+
+/**
+ *  With O_DIRECT, writes must start on a block boundary. When appending
+ *  to a file whose size is not aligned, the trailing partial block is put
+ *  back into the ring so that it gets rewritten together with new data.
+ */
+bool AsyncTraceWriter::loadPartialBlock()
+{
+    uint64_t aligned = m_fileOffset & ~(uint64_t) (DIRECT_IO_BLOCK - 1);
+    uint64_t partial = m_fileOffset - aligned;
+    if (!partial) {
+        return true;
+    }
+
+    ssize_t ret = pread(m_fd, m_buffer, DIRECT_IO_BLOCK, aligned);
+    if (ret < (ssize_t) partial) {
+        return false;
+    }
+
+    m_fileOffset = aligned;
+    m_head = partial;
+    return true;
+}
+
+bool AsyncTraceWriter::close()
+{
+    if (!m_running) {
+        return true;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_stop = true;
+    pthread_cond_signal(&m_wakeup);
+    pthread_mutex_unlock(&m_mutex);
+
+    pthread_join(m_thread, NULL);
+
+    bool ok = true;
+    if (m_handler) {
+        ok = m_handler->close();
+    } else {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_running = false;
+    m_stop = false;
+    return ok;
+}
+
+void AsyncTraceWriter::flush()
+{
+    if (!m_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    uint64_t request = ++m_flushRequest;
+    pthread_cond_signal(&m_wakeup);
+    while (m_flushDone < request) {
+        pthread_cond_wait(&m_flushed, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void AsyncTraceWriter::wakeWriter()
+{
+    pthread_mutex_lock(&m_mutex);
+    pthread_cond_signal(&m_wakeup);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool AsyncTraceWriter::append(const void *header, unsigned headerSize,
+                              const void *data, unsigned size)
+{
+    /* Records are prefixed with their size */
+    uint32_t recordSize = headerSize + size;
+    unsigned prefixSize = m_handler ? sizeof(recordSize) : 0;
+
+    uint64_t total = prefixSize + headerSize + size;
+    uint64_t head = m_head;
+
+    if (!m_running || m_ioError || total > m_bufferSize) {
+        ++m_stats.droppedEntries;
+        m_stats.droppedBytes += total;
+        return false;
+    }
+
+    if (total > m_bufferSize - (head - m_tail)) {
+        if (m_dropWhenFull) {
+            ++m_stats.droppedEntries;
+            m_stats.droppedBytes += total;
+            wakeWriter();
+            return false;
+        }
+
+        /* Back-pressure: wait for the writer to make room */
+        uint64_t start = getTimeMicroseconds();
+        ++m_stats.stalls;
+        wakeWriter();
+        while (total > m_bufferSize - (head - m_tail)) {
+            if (m_ioError) {
+                ++m_stats.droppedEntries;
+                m_stats.droppedBytes += total;
+                return false;
+            }
+            usleep(50);
+        }
+        m_stats.stallMicroseconds += getTimeMicroseconds() - start;
+    }
+
+    /* Do not overwrite bytes before the writer is done with them */
+    __sync_synchronize();
+
+    uint64_t mask = m_bufferSize - 1;
+    const uint8_t *src[3] = {(const uint8_t*) &recordSize,
+                             (const uint8_t*) header, (const uint8_t*) data};
+    unsigned len[3] = {prefixSize, headerSize, size};
+    uint64_t pos = head;
+    for (unsigned i = 0; i < 3; ++i) {
+        uint64_t offset = pos & mask;
+        uint64_t first = m_bufferSize - offset;
+        if (first >= len[i]) {
+            memcpy(m_buffer + offset, src[i], len[i]);
+        } else {
+            memcpy(m_buffer + offset, src[i], first);
+            memcpy(m_buffer, src[i] + first, len[i] - first);
+        }
+        pos += len[i];
+    }
+
+    /* Publish the entry only once its bytes are in the ring */
+    __sync_synchronize();
+    m_head = head + total;
+
+    uint64_t used = head + total - m_tail;
+    if (used > m_stats.highWater) {
+        m_stats.highWater = used;
+    }
+    m_stats.appendedBytes += total;
+
+    /* Only signal when crossing the threshold, the writer polls anyway */
+    if (used >= m_bufferSize / 2 && used - total < m_bufferSize / 2) {
+        wakeWriter();
+    }
+    return true;
+}
+
+void *AsyncTraceWriter::threadMain(void *self)
+{
+    static_cast<AsyncTraceWriter*>(self)->run();
+    return NULL;
+}
+
+void AsyncTraceWriter::run()
+{
+    pthread_mutex_lock(&m_mutex);
+    while (true) {
+        if (!m_stop && m_flushRequest == m_flushDone &&
+            m_head - m_tail < m_bufferSize / 2) {
+            struct timeval now;
+            struct timespec deadline;
+            gettimeofday(&now, NULL);
+            uint64_t nsec = (uint64_t) now.tv_usec * 1000 + WRITER_PERIOD_MS * 1000000ULL;
+            deadline.tv_sec = now.tv_sec + nsec / 1000000000;
+            deadline.tv_nsec = nsec % 1000000000;
+            pthread_cond_timedwait(&m_wakeup, &m_mutex, &deadline);
+        }
+
+        bool stop = m_stop;
+        uint64_t request = m_flushRequest;
+        pthread_mutex_unlock(&m_mutex);
+
+        drain(stop || request != m_flushDone);
+
+        pthread_mutex_lock(&m_mutex);
+        if (request != m_flushDone) {
+            m_flushDone = request;
+            pthread_cond_broadcast(&m_flushed);
+        }
+        if (stop) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool AsyncTraceWriter::writeRing(uint64_t from, uint64_t length, uint64_t fileOffset)
+{
+    uint64_t mask = m_bufferSize - 1;
+    while (length > 0) {
+        uint64_t offset = from & mask;
+        uint64_t chunk = m_bufferSize - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        ssize_t ret = pwrite(m_fd, m_buffer + offset, chunk, fileOffset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        from += ret;
+        fileOffset += ret;
+        length -= ret;
+    }
+    return true;
+}
+
+void AsyncTraceWriter::copyFromRing(uint64_t from, void *buffer, uint64_t length) const
+{
+    uint64_t offset = from & (m_bufferSize - 1);
+    uint64_t first = m_bufferSize - offset;
+    if (first >= length) {
+        memcpy(buffer, m_buffer + offset, length);
+    } else {
+        memcpy(buffer, m_buffer + offset, first);
+        memcpy((uint8_t*) buffer + first, m_buffer, length - first);
+    }
+}
+
+/**
+ *  Passes the complete records to the handler, releasing
+ *  the space of each one as soon as it is processed.
+ */
+bool AsyncTraceWriter::drainRecords()
+{
+    uint64_t head = m_head;
+    __sync_synchronize();
+
+    uint64_t tail = m_tail;
+    bool ok = true;
+    while (tail != head) {
+        uint32_t recordSize;
+        copyFromRing(tail, &recordSize, sizeof(recordSize));
+        assert(head - tail >= sizeof(recordSize) + recordSize);
+
+        uint64_t offset = (tail + sizeof(recordSize)) & (m_bufferSize - 1);
+        const uint8_t *record = m_buffer + offset;
+        if (offset + recordSize > m_bufferSize) {
+            /* The record wraps around */
+            if (m_record.size() < recordSize) {
+                m_record.resize(recordSize);
+            }
+            copyFromRing(tail + sizeof(recordSize), &m_record[0], recordSize);
+            record = &m_record[0];
+        }
+
+        if (ok && !m_ioError) {
+            ok = m_handler->writeRecord(record, recordSize);
+        }
+
+        tail += sizeof(recordSize) + recordSize;
+        __sync_synchronize();
+        m_tail = tail;
+    }
+
+    if (!ok) {
+        m_ioError = true;
+    }
+    return ok;
+}
+
+/**
+ *  Writes out the pending bytes. With O_DIRECT, only whole blocks are
+ *  consumed. If all is set, the last partial block is also written (padded),
+ *  and the file is truncated to its real size.
+ */
+bool AsyncTraceWriter::drain(bool all)
+{
+    if (m_handler) {
+        return drainRecords();
+    }
+
+    uint64_t head = m_head;
+    /* Read the entries published before head */
+    __sync_synchronize();
+
+    uint64_t tail = m_tail;
+    uint64_t pending = head - tail;
+    uint64_t length = pending;
+    if (m_directIo) {
+        length &= ~(uint64_t) (DIRECT_IO_BLOCK - 1);
+    }
+
+    bool ok = true;
+    if (length > 0 && !m_ioError) {
+        ok = writeRing(tail, length, m_fileOffset);
+    }
+
+    if (ok && all && m_directIo && pending > length) {
+        /* The block starts on a block boundary of the ring and does not wrap */
+        uint64_t partial = pending - length;
+        memcpy(m_bounce, m_buffer + ((tail + length) & (m_bufferSize - 1)), partial);
+        memset(m_bounce + partial, 0, DIRECT_IO_BLOCK - partial);
+        uint64_t offset = m_fileOffset + length;
+        ok = pwrite(m_fd, m_bounce, DIRECT_IO_BLOCK, offset) == DIRECT_IO_BLOCK &&
+             ftruncate(m_fd, offset + partial) == 0;
+    }
+
+    if (!ok) {
+        /* Keep draining so that the emulation thread never blocks forever */
+        m_ioError = true;
+    }
+
+    m_fileOffset += length;
+    __sync_synchronize();
+    m_tail = tail + length;
+
+    if (m_ioError && m_directIo && all) {
+        /* Nothing else is going to consume the partial block */
+        m_tail = head;
+    }
+    return ok;
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,159 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_ASYNCTRACEWRITER_H
+#define S2E_PLUGINS_ASYNCTRACEWRITER_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Moves trace file writes off the emulation thread.
+ *
+ *  The emulation thread appends entries to a single-producer/single-consumer
+ *  ring buffer without taking any lock. A background thread drains the ring
+ *  to the trace file with large writes, waking up when the ring is half full
+ *  or periodically. Optionally, the file is opened with O_DIRECT, in which
+ *  case only whole blocks are written and the trailing partial block is
+ *  rewritten on the next drain.
+ *
+ *  When the ring is full, the producer either waits for the writer
+ *  (back-pressure) or drops the entry. Both are counted in the statistics.
+ *
+ *  If a RecordHandler is given, each appended entry is a record that the
+ *  writer thread passes to the handler instead of copying it to the file
+ *  as is. The handler owns the file in this case, and O_DIRECT is not used.
+ *
+ *  Each S2E process has its own writer: the thread must be stopped with
+ *  close() before fork and restarted with open() in both processes.
+ */
+class AsyncTraceWriter
+{
+public:
+    class RecordHandler {
+    public:
+        virtual ~RecordHandler() {}
+        virtual bool open(const std::string &fileName, bool append) = 0;
+        virtual bool writeRecord(const uint8_t *record, unsigned size) = 0;
+        virtual bool close() = 0;
+    };
+
+    struct Statistics {
+        uint64_t appendedBytes;
+        uint64_t droppedEntries;
+        uint64_t droppedBytes;
+        /* Number of times the producer had to wait for the writer */
+        uint64_t stalls;
+        uint64_t stallMicroseconds;
+        /* Highest ring occupancy seen, in bytes */
+        uint64_t highWater;
+    };
+
+private:
+    enum { DIRECT_IO_BLOCK = 4096 };
+
+    uint8_t *m_buffer;
+    uint64_t m_bufferSize;
+    bool m_directIo;
+    bool m_dropWhenFull;
+
+    /* Total bytes appended by the producer and consumed by the writer.
+       Each side only writes its own counter. */
+    volatile uint64_t m_head;
+    volatile uint64_t m_tail;
+
+    RecordHandler *m_handler;
+    std::vector<uint8_t> m_record;
+
+    int m_fd;
+    /* File offset at which the byte at m_tail goes */
+    uint64_t m_fileOffset;
+    uint8_t *m_bounce;
+
+    pthread_t m_thread;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_wakeup;
+    pthread_cond_t m_flushed;
+    bool m_running;
+    volatile bool m_stop;
+    uint64_t m_flushRequest;
+    uint64_t m_flushDone;
+    volatile bool m_ioError;
+
+    Statistics m_stats;
+
+    static void *threadMain(void *self);
+    bool openFile(const std::string &fileName, bool append);
+    void run();
+    bool drain(bool all);
+    bool writeRing(uint64_t from, uint64_t length, uint64_t fileOffset);
+    bool drainRecords();
+    void copyFromRing(uint64_t from, void *buffer, uint64_t length) const;
+    bool loadPartialBlock();
+    void wakeWriter();
+
+public:
+    AsyncTraceWriter(unsigned bufferSize, bool directIo, bool dropWhenFull,
+                     RecordHandler *handler = NULL);
+    ~AsyncTraceWriter();
+
+    bool open(const std::string &fileName, bool append);
+
+    /** Returns false if the record handler could not finish the file */
+    bool close();
+    bool isOpen() const { return m_running; }
+
+    /** Appends one entry made of a header and a payload. Must only be
+        called from the emulation thread. Returns false if the entry
+        was dropped. */
+    bool append(const void *header, unsigned headerSize,
+                const void *data, unsigned size);
+
+    /** Waits until everything appended so far is on disk */
+    void flush();
+
+    const Statistics &getStatistics() const { return m_stats; }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
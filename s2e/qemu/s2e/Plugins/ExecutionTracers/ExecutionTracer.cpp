@@ -40,19 +40,75 @@
 #include <s2e/ConfigFile.h>
 #include <s2e/Utils.h>
 
-#include <llvm/System/TimeValue.h>
-
 #include <iostream>
+#include <sys/time.h>
 
 namespace s2e {
 namespace plugins {
 
 S2E_DEFINE_PLUGIN(ExecutionTracer, "ExecutionTracer plugin", "",);
 
+static uint64_t getWallClockMicroseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static inline uint64_t readTsc()
+{
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t) high << 32) | low;
+}
+#else
+static inline uint64_t readTsc()
+{
+    return getWallClockMicroseconds();
+}
+#endif
+
 void ExecutionTracer::initialize()
 {
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //Version 2 is compressed and indexed by block and state
+    unsigned format = cfg->getInt(getConfigKey() + ".format", 1);
+    if (format == EXECTRACE_FORMAT_V2) {
+        unsigned blockSize = cfg->getInt(getConfigKey() + ".blockSize", 64) * 1024;
+        m_encoder = new TraceBlockEncoder(blockSize);
+        m_blockWriter = new TraceBlockWriter(blockSize);
+    } else if (format != 1) {
+        s2e()->getWarningsStream() << "ExecutionTracer: unsupported trace format "
+                << format << std::endl;
+        exit(-1);
+    }
+
+    //Trace entries are handed to a background thread by default
+    bool async = cfg->getBool(getConfigKey() + ".asyncWrites", true);
+    if (async) {
+        unsigned bufferSize = cfg->getInt(getConfigKey() + ".bufferSize", 16);
+        bool directIo = cfg->getBool(getConfigKey() + ".directIo", false);
+        bool dropWhenFull = cfg->getBool(getConfigKey() + ".dropWhenFull", false);
+        m_writer = new AsyncTraceWriter(bufferSize * 1024 * 1024, directIo, dropWhenFull,
+                                        m_blockWriter);
+    }
+    m_reportedDrops = 0;
+    m_droppedItems = 0;
+    m_reportedDroppedItems = 0;
+
+    calibrateClock(true);
     createNewTraceFile(false);
 
+    //Publish the entries on a Unix socket for live analysis
+    if (cfg->getBool(getConfigKey() + ".stream", false)) {
+        unsigned queueSize = cfg->getInt(getConfigKey() + ".streamBufferSize", 16);
+        m_stream = new TraceStreamServer(queueSize * 1024 * 1024);
+        m_reportedOverflows = 0;
+        openStream();
+    }
+
     s2e()->getCorePlugin()->onStateFork.connect(
             sigc::mem_fun(*this, &ExecutionTracer::onFork));
 
@@ -67,32 +123,249 @@ void ExecutionTracer::initialize()
 
 ExecutionTracer::~ExecutionTracer()
 {
-    fclose(m_LogFile);
+    //Last items, which live consumers also get
+    onClose.emit();
+    onFlushPendingItems.emit();
+
+    if (m_stream) {
+        m_stream->close();
+        delete m_stream;
+    }
+
+    closeTraceFile();
+    if (m_writer) {
+        reportWriterStatistics(true);
+        delete m_writer;
+    }
+    delete m_blockWriter;
+    delete m_encoder;
 }
 
 void ExecutionTracer::createNewTraceFile(bool append)
 {
-
-    if (append) {
-        assert(m_fileName.size() > 0);
-        m_LogFile = fopen(m_fileName.c_str(), "a");
-    }else {
+    if (!append) {
         m_fileName = s2e()->getOutputFilename("ExecutionTracer.dat");
-        m_LogFile = fopen(m_fileName.c_str(), "wb");
+    }
+    assert(m_fileName.size() > 0);
+
+    bool opened;
+    if (m_writer) {
+        opened = m_writer->open(m_fileName, append);
+    } else if (m_blockWriter) {
+        opened = m_blockWriter->open(m_fileName, append);
+    } else {
+        m_LogFile = fopen(m_fileName.c_str(), append ? "a" : "wb");
+        opened = m_LogFile != NULL;
     }
 
-    if (!m_LogFile) {
+    if (!opened) {
         s2e()->getWarningsStream() << "Could not create ExecutionTracer.dat" << std::endl;
         exit(-1);
     }
-    m_CurrentIndex = 0;
+
+    //Item indexes are relative to the file, which continues when appending
+    if (!append) {
+        m_CurrentIndex = 0;
+    }
+}
+
+void ExecutionTracer::closeTraceFile()
+{
+    if (m_encoder) {
+        writeBlock();
+    }
+
+    bool closed = true;
+    if (m_writer) {
+        closed = m_writer->close();
+    } else if (m_blockWriter) {
+        closed = m_blockWriter->close();
+    } else if (m_LogFile) {
+        fclose(m_LogFile);
+        m_LogFile = NULL;
+    }
+
+    if (!closed) {
+        s2e()->getWarningsStream() << "ExecutionTracer: could not write the index of "
+                << m_fileName << ", readers will have to rebuild it" << std::endl;
+    }
+}
+
+/**
+ *  Reading the TSC costs a few cycles, while querying the time of day
+ *  on every trace entry used to dominate the cost of tracing.
+ *  The TSC rate is estimated over a short busy loop at startup, then
+ *  refined every second over a longer window. Rebasing keeps the time
+ *  stamps continuous when the estimate changes.
+ */
+void ExecutionTracer::calibrateClock(bool initial)
+{
+    uint64_t now = getWallClockMicroseconds();
+    uint64_t tsc = readTsc();
+
+    if (initial) {
+        m_calibrationUsec = now;
+        m_calibrationTsc = tsc;
+        do {
+            now = getWallClockMicroseconds();
+        } while (now - m_calibrationUsec < 5000);
+        tsc = readTsc();
+
+        m_tscMult = ((now - m_calibrationUsec) << 32) /
+                    (tsc - m_calibrationTsc ? tsc - m_calibrationTsc : 1);
+        m_tscBase = tsc;
+        m_usecBase = now;
+        return;
+    }
+
+    uint64_t current = getTimeStamp();
+
+    if (now > m_calibrationUsec && tsc > m_calibrationTsc) {
+        m_tscMult = ((now - m_calibrationUsec) << 32) / (tsc - m_calibrationTsc);
+    }
+
+    //Restart the window before the shift above overflows
+    if (now - m_calibrationUsec > 600 * 1000000ULL) {
+        m_calibrationUsec = now;
+        m_calibrationTsc = tsc;
+    }
+
+    //Resynchronize if the TSC stopped or the wall clock was changed
+    int64_t skew = (int64_t) (current - now);
+    if (skew > 1000000 || skew < -1000000) {
+        current = now;
+    }
+
+    m_tscBase = tsc;
+    m_usecBase = current;
+}
+
+inline uint64_t ExecutionTracer::getTimeStamp() const
+{
+#if defined(__i386__) || defined(__x86_64__)
+    int64_t delta = readTsc() - m_tscBase;
+    if (delta < 0) {
+        //TSCs of different cores may be slightly off
+        delta = 0;
+    }
+    return m_usecBase + ((uint64_t) delta >> 32) * m_tscMult +
+           ((((uint64_t) delta & 0xffffffff) * m_tscMult) >> 32);
+#else
+    return getWallClockMicroseconds();
+#endif
+}
+
+void ExecutionTracer::reportWriterStatistics(bool final)
+{
+    const AsyncTraceWriter::Statistics &stats = m_writer->getStatistics();
+
+    if (stats.droppedEntries != m_reportedDrops) {
+        std::ostream &os = s2e()->getWarningsStream();
+        os << "ExecutionTracer: dropped " << std::dec << stats.droppedEntries - m_reportedDrops;
+        if (m_encoder) {
+            os << " trace blocks (" << m_droppedItems - m_reportedDroppedItems << " items)";
+        } else {
+            os << " trace entries";
+        }
+        os << " because the writer could not keep up" << std::endl;
+        m_reportedDrops = stats.droppedEntries;
+        m_reportedDroppedItems = m_droppedItems;
+    }
+
+    if (final) {
+        s2e()->getMessagesStream() << "ExecutionTracer: "
+                << std::dec << stats.appendedBytes << " bytes traced, "
+                << stats.droppedEntries << " entries (" << stats.droppedBytes << " bytes) dropped, "
+                << stats.stalls << " writer stalls (" << stats.stallMicroseconds / 1000 << " ms), "
+                << "buffer high water " << stats.highWater << " bytes" << std::endl;
+    }
+}
+
+void ExecutionTracer::openStream()
+{
+    std::string path = s2e()->getOutputFilename("ExecutionTracer.sock");
+    if (!m_stream->open(path)) {
+        s2e()->getWarningsStream() << "ExecutionTracer: could not create the trace stream socket "
+                << path << std::endl;
+        return;
+    }
+
+    s2e()->getMessagesStream() << "ExecutionTracer: streaming the trace on " << path << std::endl;
+}
+
+void ExecutionTracer::pollStream()
+{
+    if (m_stream->hasPendingConnections()) {
+        //New clients read the entries written so far from the file
+        flush();
+        unsigned count = m_stream->accept(m_CurrentIndex);
+        s2e()->getMessagesStream() << "ExecutionTracer: " << std::dec << count
+                << " trace stream client(s) connected at item " << m_CurrentIndex << std::endl;
+    }
+
+    m_stream->poll();
+
+    const TraceStreamServer::Statistics &stats = m_stream->getStatistics();
+    if (stats.overflowedClients != m_reportedOverflows) {
+        s2e()->getWarningsStream() << "ExecutionTracer: disconnected "
+                << std::dec << stats.overflowedClients - m_reportedOverflows
+                << " trace stream client(s) that could not keep up" << std::endl;
+        m_reportedOverflows = stats.overflowedClients;
+    }
+}
+
+//Hands the current block over to the writer. The items of a dropped
+//block keep their indexes, which leaves a gap in the trace file.
+void ExecutionTracer::writeBlock()
+{
+    if (m_encoder->isEmpty()) {
+        return;
+    }
+
+    unsigned size;
+    const uint8_t *record = m_encoder->getRecord(&size);
+    bool written = m_writer ? m_writer->append(record, size, NULL, 0) :
+                              m_blockWriter->writeRecord(record, size);
+    if (!written) {
+        uint64_t first = m_encoder->getFirstItem();
+        m_droppedItems += m_encoder->getItemCount();
+        if (!m_writer) {
+            s2e()->getWarningsStream() << "ExecutionTracer: could not write trace items "
+                    << std::dec << first << " to " << first + m_encoder->getItemCount() - 1
+                    << std::endl;
+        }
+    }
+    m_encoder->reset();
 }
 
 void ExecutionTracer::onTimer()
 {
-    if (m_LogFile) {
+    calibrateClock(false);
+
+    //Bound the amount of trace lost if S2E crashes
+    if (m_encoder) {
+        writeBlock();
+    }
+
+    if (m_writer) {
+        reportWriterStatistics(false);
+    } else if (m_LogFile) {
         fflush(m_LogFile);
     }
+
+    if (m_stream) {
+        pollStream();
+    }
+}
+
+void ExecutionTracer::initItemHeader(const S2EExecutionState *state, unsigned size,
+                                     ExecTraceEntryType type, ExecutionTraceItemHeader &item) const
+{
+    item.timeStamp = getTimeStamp();
+    item.size = size;
+    item.type = type;
+    item.stateId = state->getID();
+    item.pid = state->getPid();
 }
 
 uint32_t ExecutionTracer::writeData(
@@ -100,32 +373,60 @@ uint32_t ExecutionTracer::writeData(
         void *data, unsigned size, ExecTraceEntryType type)
 {
     ExecutionTraceItemHeader item;
+    initItemHeader(state, size, type, item);
+    return writeItem(item, data);
+}
 
-    assert(m_LogFile);
+uint32_t ExecutionTracer::writeItem(const ExecutionTraceItemHeader &item, void *data)
+{
+    unsigned size = item.size;
 
-    item.timeStamp = llvm::sys::TimeValue::now().usec();
-    item.size = size;
-    item.type = type;
-    item.stateId = state->getID();
-    item.pid = state->getPid();
+    if (m_encoder) {
+        if (!m_encoder->fits(size)) {
+            writeBlock();
+        }
+        if (m_encoder->isEmpty()) {
+            m_encoder->setFirstItem(m_CurrentIndex);
+        }
+        m_encoder->add(item, data);
+        if (m_encoder->isFull()) {
+            writeBlock();
+        }
+    } else if (m_writer) {
+        if (!m_writer->append(&item, sizeof(item), data, size)) {
+            return 0;
+        }
+    } else {
+        assert(m_LogFile);
 
-    if (fwrite(&item, sizeof(item), 1, m_LogFile) != 1) {
-        return 0;
-    }
+        if (fwrite(&item, sizeof(item), 1, m_LogFile) != 1) {
+            return 0;
+        }
 
-    if (size) {
-        if (fwrite(data, size, 1, m_LogFile) != 1) {
-            //at this point the log is corrupted.
-            assert(false);
+        if (size) {
+            if (fwrite(data, size, 1, m_LogFile) != 1) {
+                //at this point the log is corrupted.
+                assert(false);
+            }
         }
     }
 
+    if (m_stream && m_stream->hasClients()) {
+        m_stream->append(&item, sizeof(item), data, size);
+    }
+
     return ++m_CurrentIndex;
 }
 
 void ExecutionTracer::flush()
 {
-    if (m_LogFile) {
+    if (m_encoder) {
+        writeBlock();
+    }
+
+    if (m_writer) {
+        m_writer->flush();
+    } else if (m_LogFile) {
         fflush(m_LogFile);
     }
 }
@@ -133,11 +434,17 @@ void ExecutionTracer::flush()
 void ExecutionTracer::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
 {
     if (preFork) {
-        fclose(m_LogFile);
-        m_LogFile = NULL;
+        onFlushPendingItems.emit();
+
+        //The writer thread would not survive the fork
+        closeTraceFile();
     }else {
         if (isChild) {
             createNewTraceFile(false);
+            if (m_stream) {
+                m_stream->detach();
+                openStream();
+            }
         }else {
             createNewTraceFile(true);
         }
@@ -151,6 +458,8 @@ void ExecutionTracer::onFork(S2EExecutionState *state,
 {
     assert(newStates.size() > 0);
 
+    onFlushPendingItems.emit();
+
     unsigned itemSize = sizeof(ExecutionTraceFork) +
                         (newStates.size()-1) * sizeof(uint32_t);
 
@@ -45,6 +45,9 @@
 #include <stdio.h>
 
 #include "TraceEntries.h"
+#include "AsyncTraceWriter.h"
+#include "TraceBlockWriter.h"
+#include "TraceStreamServer.h"
 
 namespace s2e {
 namespace plugins {
@@ -68,19 +71,63 @@ class ExecutionTracer : public Plugin
     OSMonitor *m_Monitor;
     ExecTracerModules m_Modules;
 
+    /* Set when writes go through the background writer thread */
+    AsyncTraceWriter *m_writer;
+    uint64_t m_reportedDrops;
+
+    /* Set when writing the compressed format (version 2) */
+    TraceBlockEncoder *m_encoder;
+    TraceBlockWriter *m_blockWriter;
+    uint64_t m_droppedItems;
+    uint64_t m_reportedDroppedItems;
+
+    /* Set when entries are also published live on a socket */
+    TraceStreamServer *m_stream;
+    uint64_t m_reportedOverflows;
+
+    /* Time stamps are derived from the TSC, calibrated against
+       the wall clock (microseconds since the epoch) */
+    uint64_t m_tscBase;
+    uint64_t m_usecBase;
+    uint64_t m_tscMult;
+    uint64_t m_calibrationTsc;
+    uint64_t m_calibrationUsec;
+
     uint16_t getCompressedId(const ModuleDescriptor *desc);
 
+    void calibrateClock(bool initial);
+    inline uint64_t getTimeStamp() const;
+
     void onTimer();
     void createNewTraceFile(bool append);
+    void closeTraceFile();
+    void writeBlock();
+    void reportWriterStatistics(bool final);
+    void openStream();
+    void pollStream();
 public:
-    ExecutionTracer(S2E* s2e): Plugin(s2e) {}
+    ExecutionTracer(S2E* s2e): Plugin(s2e), m_LogFile(NULL), m_writer(NULL),
+        m_encoder(NULL), m_blockWriter(NULL), m_stream(NULL) {}
     ~ExecutionTracer();
     void initialize();
 
+    /** Emitted before a fork item is written and before the trace file
+        is closed, so that plugins that hold back items can write them
+        while they still belong to the current segment of the trace. */
+    sigc::signal<void> onFlushPendingItems;
+
+    /** Emitted once when S2E exits, right before the trace file is closed */
+    sigc::signal<void> onClose;
+
     uint32_t writeData(
             const S2EExecutionState *state,
             void *data, unsigned size, ExecTraceEntryType type);
 
+    /** For items that are written some time after they were created */
+    void initItemHeader(const S2EExecutionState *state, unsigned size,
+                        ExecTraceEntryType type, ExecutionTraceItemHeader &item) const;
+    uint32_t writeItem(const ExecutionTraceItemHeader &item, void *data);
+
     void flush();
 private:
 
@@ -49,17 +49,26 @@ namespace plugins {
 S2E_DEFINE_PLUGIN(MemoryTracer, "Memory tracer plugin", "MemoryTracer", "ExecutionTracer");
 
 MemoryTracer::MemoryTracer(S2E* s2e)
-        : Plugin(s2e)
+        : Plugin(s2e), m_sampler(NULL)
 {
 
 }
 
+MemoryTracer::~MemoryTracer()
+{
+    delete m_sampler;
+}
+
 void MemoryTracer::initialize()
 {
 
     m_tracer = (ExecutionTracer*)s2e()->getPlugin("ExecutionTracer");
     assert(m_tracer);
 
+    //Reservoirs are per module if ModuleExecutionDetector is there
+    m_sampler = new TraceSampler(s2e(), m_tracer, getConfigKey(),
+            (ModuleExecutionDetector*)s2e()->getPlugin("ModuleExecutionDetector"));
+
     //Catch all accesses to the stack
     m_monitorStack = s2e()->getConfig()->getBool(getConfigKey() + ".monitorStack");
 
@@ -114,7 +123,42 @@ bool MemoryTracer::decideTracing(S2EExecutionState *state, uint64_t addr, uint64
     return true;
 }
 
-void MemoryTracer::onDataMemoryAccess(S2EExecutionState *state,
+void MemoryTracer::traceMemoryAccess(S2EExecutionState *state, ExecutionTraceMemory &e)
+{
+    if (!m_sampler->shouldTrace(state, state->getPc(), TRACE_MEMORY)) {
+        return;
+    }
+
+    e.pc = state->getPc();
+
+    if (m_traceHostAddresses) {
+        e.flags |= EXECTRACE_MEM_HASHOSTADDR;
+    }
+
+    m_sampler->write(state, &e, sizeof(e), TRACE_MEMORY);
+}
+
+void MemoryTracer::onConcreteDataMemoryAccess(S2EExecutionState *state,
+                               uint64_t address, uint64_t hostAddress,
+                               uint64_t value, unsigned size,
+                               bool isWrite, bool isIO)
+{
+    if (!decideTracing(state, address, value)) {
+       return;
+    }
+
+    ExecutionTraceMemory e;
+    e.address = address;
+    e.value = value;
+    e.size = size;
+    e.hostAddress = hostAddress;
+    e.flags = isWrite*EXECTRACE_MEM_WRITE |
+                 isIO*EXECTRACE_MEM_IO;
+
+    traceMemoryAccess(state, e);
+}
+
+void MemoryTracer::onSymbolicDataMemoryAccess(S2EExecutionState *state,
                                klee::ref<klee::Expr> address,
                                klee::ref<klee::Expr> hostAddress,
                                klee::ref<klee::Expr> value,
@@ -124,18 +168,8 @@ void MemoryTracer::onDataMemoryAccess(S2EExecutionState *state,
     bool isValCste = isa<klee::ConstantExpr>(value);
     bool isHostAddrCste = isa<klee::ConstantExpr>(hostAddress);
 
-    if (isAddrCste && isValCste) {
-        uint64_t addr = cast<klee::ConstantExpr>(address)->getZExtValue(64);
-        uint64_t val = cast<klee::ConstantExpr>(value)->getZExtValue(64);
-
-        if (!decideTracing(state, addr, val)) {
-           return;
-        }
-    }
-
     //Output to the trace entry here
     ExecutionTraceMemory e;
-    e.pc = state->getPc();
     e.address = isAddrCste ? cast<klee::ConstantExpr>(address)->getZExtValue(64) : 0xDEADBEEF;
     e.value = isValCste ? cast<klee::ConstantExpr>(value)->getZExtValue(64) : 0xDEADBEEF;
     e.size = klee::Expr::getMinBytesForWidth(value->getWidth());
@@ -144,10 +178,6 @@ void MemoryTracer::onDataMemoryAccess(S2EExecutionState *state,
 
     e.hostAddress = isHostAddrCste ? cast<klee::ConstantExpr>(hostAddress)->getZExtValue(64) : 0xDEADBEEF;
 
-    if (m_traceHostAddresses) {
-        e.flags |= EXECTRACE_MEM_HASHOSTADDR;
-    }
-
     if (!isAddrCste) {
        e.flags |= EXECTRACE_MEM_SYMBADDR;
     }
@@ -160,41 +190,54 @@ void MemoryTracer::onDataMemoryAccess(S2EExecutionState *state,
        e.flags |= EXECTRACE_MEM_SYMBHOSTADDR;
     }
 
-    unsigned strucSize = sizeof(e);
-    if (!(e.flags & EXECTRACE_MEM_HASHOSTADDR)) {
-       strucSize -= sizeof(e.hostAddress);
-    }
-
-    m_tracer->writeData(state, &e, sizeof(e), TRACE_MEMORY);
+    traceMemoryAccess(state, e);
 }
 
 void MemoryTracer::onTlbMiss(S2EExecutionState *state, uint64_t addr, bool is_write)
 {
+    if (!m_sampler->shouldTrace(state, state->getPc(), TRACE_TLBMISS)) {
+        return;
+    }
+
     ExecutionTraceTlbMiss e;
     e.pc = state->getPc();
     e.address = addr;
     e.isWrite = is_write;
 
-    m_tracer->writeData(state, &e, sizeof(e), TRACE_TLBMISS);
+    m_sampler->write(state, &e, sizeof(e), TRACE_TLBMISS);
 }
 
 void MemoryTracer::onPageFault(S2EExecutionState *state, uint64_t addr, bool is_write)
 {
+    if (!m_sampler->shouldTrace(state, state->getPc(), TRACE_PAGEFAULT)) {
+        return;
+    }
+
     ExecutionTracePageFault e;
     e.pc = state->getPc();
     e.address = addr;
     e.isWrite = is_write;
 
-    m_tracer->writeData(state, &e, sizeof(e), TRACE_PAGEFAULT);
+    m_sampler->write(state, &e, sizeof(e), TRACE_PAGEFAULT);
 }
 
 void MemoryTracer::enableTracing()
 {
     if (m_monitorMemory) {
         s2e()->getMessagesStream() << "MemoryTracer Plugin: Enabling memory tracing" << std::endl;
+        CorePlugin *core = s2e()->getCorePlugin();
+
+        //Accesses below catchAccessesAbove do not leave the softmmu helpers
+        core->unwatchDataMemory(this);
+        core->watchDataMemory(this, m_catchAbove, (uint64_t) -1);
+
         m_memoryMonitor.disconnect();
-        m_memoryMonitor = s2e()->getCorePlugin()->onDataMemoryAccess.connect(
-                sigc::mem_fun(*this, &MemoryTracer::onDataMemoryAccess));
+        m_memoryMonitor = core->onConcreteDataMemoryAccess(this).connect(
+                sigc::mem_fun(*this, &MemoryTracer::onConcreteDataMemoryAccess));
+
+        m_symbolicMemoryMonitor.disconnect();
+        m_symbolicMemoryMonitor = core->onSymbolicDataMemoryAccess.connect(
+                sigc::mem_fun(*this, &MemoryTracer::onSymbolicDataMemoryAccess));
     }
 
     if (m_monitorPageFaults) {
@@ -215,6 +258,8 @@ void MemoryTracer::enableTracing()
 void MemoryTracer::disableTracing()
 {
     m_memoryMonitor.disconnect();
+    m_symbolicMemoryMonitor.disconnect();
+    s2e()->getCorePlugin()->unwatchDataMemory(this);
     m_pageFaultsMonitor.disconnect();
     m_tlbMissesMonitor.disconnect();
 }
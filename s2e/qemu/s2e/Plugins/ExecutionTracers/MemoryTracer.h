@@ -41,6 +41,7 @@
 #include <s2e/Plugins/Opcodes.h>
 #include <string>
 #include "ExecutionTracer.h"
+#include "TraceSampler.h"
 
 namespace s2e{
 namespace plugins{
@@ -55,6 +56,7 @@ private:
 
 public:
     MemoryTracer(S2E* s2e);
+    virtual ~MemoryTracer();
 
     void initialize();
 
@@ -77,14 +79,23 @@ private:
     sigc::connection m_timerConnection;
 
     sigc::connection m_memoryMonitor;
+    sigc::connection m_symbolicMemoryMonitor;
     sigc::connection m_pageFaultsMonitor;
     sigc::connection m_tlbMissesMonitor;
 
     ExecutionTracer *m_tracer;
+    TraceSampler *m_sampler;
 
     bool decideTracing(S2EExecutionState *state, uint64_t addr, uint64_t data) const;
 
-    void onDataMemoryAccess(S2EExecutionState *state,
+    void traceMemoryAccess(S2EExecutionState *state, ExecutionTraceMemory &e);
+
+    void onConcreteDataMemoryAccess(S2EExecutionState *state,
+                                   uint64_t address, uint64_t hostAddress,
+                                   uint64_t value, unsigned size,
+                                   bool isWrite, bool isIO);
+
+    void onSymbolicDataMemoryAccess(S2EExecutionState *state,
                                    klee::ref<klee::Expr> address,
                                    klee::ref<klee::Expr> hostAddress,
                                    klee::ref<klee::Expr> value,
@@ -38,11 +38,18 @@
 
 #include <s2e/S2E.h>
 #include <s2e/Utils.h>
+#include <s2e/ConfigFile.h>
 #include <s2e/S2EExecutionState.h>
 #include <s2e/S2EExecutor.h>
 #include "TestCaseGenerator.h"
 #include "ExecutionTracer.h"
 
+#include <errno.h>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
 namespace s2e {
 namespace plugins {
 
@@ -53,14 +60,67 @@ TestCaseGenerator::TestCaseGenerator(S2E* s2e)
 {
     m_testIndex = 0;
     m_pathsExplored = 0;
-
+    m_nextBatchId = 0;
+    m_batchFile = NULL;
 }
 
 void TestCaseGenerator::initialize()
 {
-    //ConfigFile* conf = s2e()->getConfig();
+    ConfigFile* conf = s2e()->getConfig();
+
+    m_tracer = (ExecutionTracer*)s2e()->getPlugin("ExecutionTracer");
+    assert(m_tracer);
+
+    //Solve for the inputs in separate processes instead of stalling the guest
+    m_background = conf->getBool(getConfigKey() + ".backgroundSolving", false);
+
+    //Number of terminated states that triggers a solver process
+    m_batchSize = conf->getInt(getConfigKey() + ".batchSize", 16);
+
+    //Solver processes that may run at the same time
+    m_maxSolverProcesses = conf->getInt(getConfigKey() + ".maxSolverProcesses", 1);
+
+    if (!m_background) {
+        return;
+    }
+
+    if (!m_batchSize || !m_maxSolverProcesses) {
+        s2e()->getWarningsStream() << "TestCaseGenerator: batchSize and maxSolverProcesses must not be 0" << std::endl;
+        exit(-1);
+    }
+
+    std::string fileName = s2e()->getOutputFilename("testcases.dat");
+    m_batchFile = fopen(fileName.c_str(), "wb");
+    if (!m_batchFile) {
+        s2e()->getWarningsStream() << "TestCaseGenerator: could not create " << fileName << std::endl;
+        exit(-1);
+    }
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &TestCaseGenerator::onTimer));
+
+    s2e()->getCorePlugin()->onProcessFork.connect(
+            sigc::mem_fun(*this, &TestCaseGenerator::onProcessFork));
+
+    m_tracer->onClose.connect(
+            sigc::mem_fun(*this, &TestCaseGenerator::onTraceClose));
 }
 
+void TestCaseGenerator::printInputs(const ConcreteInputs &inputs)
+{
+    ConcreteInputs::const_iterator it;
+    for (it = inputs.begin(); it != inputs.end(); ++it) {
+        const VarValuePair &vp = *it;
+        s2e()->getMessagesStream() << vp.first << ": ";
+
+        for (unsigned i=0; i<vp.second.size(); ++i) {
+            s2e()->getMessagesStream() << std::setw(2) << std::setfill('0') << (unsigned) vp.second[i] << ' '
+                    << (vp.second[i] >= 0x20 ? (char) vp.second[i] : ' ');
+        }
+
+        s2e()->getMessagesStream() << std::setfill(' ')<< std::endl;
+    }
+}
 
 void TestCaseGenerator::processTestCase(const S2EExecutionState &state,
                      const char *err, const char *suffix)
@@ -70,6 +130,20 @@ void TestCaseGenerator::processTestCase(const S2EExecutionState &state,
             << " at address 0x" << std::hex << state.getPc()
             << std::endl;
 
+    if (m_background) {
+        //Only copies references to the constraints, the state is about to go away
+        m_pending.resize(m_pending.size() + 1);
+        PendingTestCase &tc = m_pending.back();
+        m_tracer->initItemHeader(&state, 0, TRACE_TESTCASE, tc.header);
+        tc.pc = state.getPc();
+        s2e()->getExecutor()->getSymbolicSolutionQuery(state, tc.query);
+
+        if (m_pending.size() >= m_batchSize) {
+            launchSolver();
+        }
+        return;
+    }
+
     ConcreteInputs out;
     bool success = s2e()->getExecutor()->getSymbolicSolution(state, out);
 
@@ -86,26 +160,222 @@ void TestCaseGenerator::processTestCase(const S2EExecutionState &state,
 
     s2e()->getMessagesStream() << std::endl;
 
-    ExecutionTracer *tracer = (ExecutionTracer*)s2e()->getPlugin("ExecutionTracer");
-    assert(tracer);
+    printInputs(out);
 
-    ConcreteInputs::iterator it;
-    for (it = out.begin(); it != out.end(); ++it) {
-        const VarValuePair &vp = *it;
-        s2e()->getMessagesStream() << vp.first << ": ";
+    unsigned bufsize;
+    ExecutionTraceTestCase *tc = ExecutionTraceTestCase::serialize(&bufsize, out);
+    m_tracer->writeData(&state, tc, bufsize, TRACE_TESTCASE);
+    ExecutionTraceTestCase::deallocate(tc);
+}
 
-        for (unsigned i=0; i<vp.second.size(); ++i) {
-            s2e()->getMessagesStream() << std::setw(2) << std::setfill('0') << (unsigned) vp.second[i] << ' '
-                    << (vp.second[i] >= 0x20 ? (char) vp.second[i] : ' ');
+/**
+ *  Batch files hold, for each state of the batch, a status byte (1 if
+ *  the inputs could be computed), an item header with the id of the
+ *  state, and the serialized inputs. The solver process renames the
+ *  file once it is complete.
+ */
+std::string TestCaseGenerator::getBatchFileName(unsigned batchId, bool done)
+{
+    std::stringstream ss;
+    ss << "tcbatch" << batchId << (done ? ".dat" : ".tmp");
+    return s2e()->getOutputFilename(ss.str());
+}
+
+void TestCaseGenerator::solveBatch(const PendingTestCases &batch, const std::string &fileName)
+{
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        return;
+    }
+
+    PendingTestCases::const_iterator it;
+    for (it = batch.begin(); it != batch.end(); ++it) {
+        ConcreteInputs out;
+        ExecutionTraceItemHeader header = (*it).header;
+        uint8_t success = s2e()->getExecutor()->getSymbolicSolution((*it).query, out);
+
+        unsigned bufsize = 0;
+        ExecutionTraceTestCase *tc = ExecutionTraceTestCase::serialize(&bufsize, out);
+        header.size = success ? bufsize : 0;
+
+        fwrite(&success, sizeof(success), 1, fp);
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(tc, header.size, 1, fp);
+        ExecutionTraceTestCase::deallocate(tc);
+    }
+
+    fclose(fp);
+    rename(fileName.c_str(), (fileName.substr(0, fileName.size() - 4) + ".dat").c_str());
+}
+
+void TestCaseGenerator::launchSolver()
+{
+    if (m_pending.empty() || m_solvers.size() >= m_maxSolverProcesses) {
+        return;
+    }
+
+    SolverProcess solver;
+    solver.batchId = m_nextBatchId++;
+    solver.count = m_pending.size();
+    for (PendingTestCases::const_iterator it = m_pending.begin(); it != m_pending.end(); ++it) {
+        solver.stateIds.push_back((*it).header.stateId);
+    }
+
+    std::string fileName = getBatchFileName(solver.batchId, false);
+
+    //The child works on a copy-on-write snapshot of the constraints.
+    //Completion is signaled by the batch file, collectBatch reaps the child.
+    solver.pid = fork();
+    if (solver.pid == 0) {
+        solveBatch(m_pending, fileName);
+        _exit(0);
+    }
+
+    if (solver.pid < 0) {
+        s2e()->getWarningsStream() << "TestCaseGenerator: could not start a solver process, "
+                << "solving " << solver.count << " states in S2E" << std::endl;
+        solveBatch(m_pending, fileName);
+        solver.pid = 0;
+    }
+
+    m_solvers.push_back(solver);
+    m_pending.clear();
+}
+
+/**
+ *  QEMU's SIGCHLD handler reaps a single child per (coalesced) signal,
+ *  so the solver processes may stay zombies. Reap them here.
+ */
+bool TestCaseGenerator::hasExited(pid_t pid)
+{
+    if (pid <= 0) {
+        return true;
+    }
+
+    int status;
+    pid_t ret = waitpid(pid, &status, WNOHANG);
+    return ret == pid || (ret < 0 && errno == ECHILD);
+}
+
+bool TestCaseGenerator::collectBatch(const SolverProcess &solver, bool wait)
+{
+    std::string fileName = getBatchFileName(solver.batchId, true);
+
+    FILE *fp;
+    while (!(fp = fopen(fileName.c_str(), "rb"))) {
+        if (hasExited(solver.pid)) {
+            //The process may have renamed the file right before exiting
+            if ((fp = fopen(fileName.c_str(), "rb"))) {
+                break;
+            }
+
+            s2e()->getWarningsStream() << "TestCaseGenerator: solver process " << std::dec << solver.pid
+                    << " exited without its batch file" << std::endl;
+            foreach2(it, solver.stateIds.begin(), solver.stateIds.end()) {
+                s2e()->getWarningsStream() << "Could not get symbolic solutions for state "
+                        << std::dec << *it << std::endl;
+            }
+            unlink(getBatchFileName(solver.batchId, false).c_str());
+            return true;
         }
 
-        s2e()->getMessagesStream() << std::setfill(' ')<< std::endl;
+        if (!wait) {
+            return false;
+        }
+        usleep(10000);
     }
 
-    unsigned bufsize;
-    ExecutionTraceTestCase *tc = ExecutionTraceTestCase::serialize(&bufsize, out);
-    tracer->writeData(&state, tc, bufsize, TRACE_TESTCASE);
-    ExecutionTraceTestCase::deallocate(tc);
+    uint8_t success;
+    ExecutionTraceItemHeader header;
+    while (fread(&success, sizeof(success), 1, fp) == 1 &&
+           fread(&header, sizeof(header), 1, fp) == 1) {
+        std::vector<uint8_t> data(header.size);
+        if (header.size && fread(&data[0], header.size, 1, fp) != 1) {
+            break;
+        }
+
+        if (!success) {
+            s2e()->getWarningsStream() << "Could not get symbolic solutions for state "
+                    << std::dec << header.stateId << std::endl;
+            continue;
+        }
+
+        ConcreteInputs out;
+        if (header.size) {
+            ExecutionTraceTestCase::deserialize(&data[0], data.size(), out);
+        }
+
+        s2e()->getMessagesStream() << "TestCaseGenerator: test case of state "
+                << std::dec << header.stateId << std::endl;
+        printInputs(out);
+
+        //Keeps the time stamp of the termination
+        void *item = header.size ? &data[0] : NULL;
+        m_tracer->writeItem(header, item);
+        fwrite(&header, sizeof(header), 1, m_batchFile);
+        if (item) {
+            fwrite(item, header.size, 1, m_batchFile);
+        }
+    }
+
+    fclose(fp);
+    unlink(fileName.c_str());
+    return true;
+}
+
+void TestCaseGenerator::collectBatches(bool wait)
+{
+    SolverProcesses::iterator it = m_solvers.begin();
+    while (it != m_solvers.end()) {
+        if (collectBatch(*it, wait)) {
+            it = m_solvers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TestCaseGenerator::onTimer()
+{
+    collectBatches(false);
+
+    //Do not let the last states of a burst wait for a full batch
+    launchSolver();
+}
+
+void TestCaseGenerator::onTraceClose()
+{
+    while (!m_pending.empty() || !m_solvers.empty()) {
+        launchSolver();
+        collectBatches(true);
+    }
+
+    fclose(m_batchFile);
+    m_batchFile = NULL;
+}
+
+void TestCaseGenerator::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    if (preFork) {
+        //The child must not write the buffered data again
+        fflush(m_batchFile);
+        return;
+    }
+
+    if (!isChild) {
+        return;
+    }
+
+    //The parent takes care of the states that terminated so far
+    m_pending.clear();
+    m_solvers.clear();
+
+    fclose(m_batchFile);
+    m_batchFile = fopen(s2e()->getOutputFilename("testcases.dat").c_str(), "wb");
+    if (!m_batchFile) {
+        s2e()->getWarningsStream() << "TestCaseGenerator: could not create testcases.dat" << std::endl;
+        exit(-1);
+    }
 }
 
 }
@@ -38,11 +38,19 @@
 #define S2E_PLUGINS_TCGEN_H
 
 #include <s2e/Plugin.h>
+#include <klee/Executor.h>
 #include <string>
+#include <vector>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "TraceEntries.h"
 
 namespace s2e{
 namespace plugins{
 
+class ExecutionTracer;
+
 /** Handler required for KLEE interpreter */
 class TestCaseGenerator : public Plugin
 {
@@ -52,9 +60,51 @@ private:
     typedef std::pair<std::string, std::vector<unsigned char> > VarValuePair;
     typedef std::vector<VarValuePair> ConcreteInputs;
 
+    /** Snapshot of a terminated state, solved in the background */
+    struct PendingTestCase {
+        ExecutionTraceItemHeader header;
+        uint64_t pc;
+        klee::Executor::SymbolicSolutionQuery query;
+    };
+    typedef std::vector<PendingTestCase> PendingTestCases;
+
+    struct SolverProcess {
+        pid_t pid;
+        unsigned batchId;
+        unsigned count;
+        //Reported as failed if the process exits without its batch file
+        std::vector<uint32_t> stateIds;
+    };
+    typedef std::vector<SolverProcess> SolverProcesses;
+
     unsigned m_testIndex;  // number of tests written so far
     unsigned m_pathsExplored; // number of paths explored so far
 
+    ExecutionTracer *m_tracer;
+
+    bool m_background;
+    unsigned m_batchSize;
+    unsigned m_maxSolverProcesses;
+
+    PendingTestCases m_pending;
+    SolverProcesses m_solvers;
+    unsigned m_nextBatchId;
+    FILE *m_batchFile;
+
+    void printInputs(const ConcreteInputs &inputs);
+    void writeTestCase(const ExecutionTraceItemHeader &header, const ConcreteInputs &inputs);
+
+    std::string getBatchFileName(unsigned batchId, bool done);
+    void launchSolver();
+    void solveBatch(const PendingTestCases &batch, const std::string &fileName);
+    bool hasExited(pid_t pid);
+    bool collectBatch(const SolverProcess &solver, bool wait);
+    void collectBatches(bool wait);
+
+    void onTimer();
+    void onTraceClose();
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+
 public:
     TestCaseGenerator(S2E* s2e);
 
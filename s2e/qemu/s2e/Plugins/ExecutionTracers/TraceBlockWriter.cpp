@@ -0,0 +1,374 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "TraceBlockWriter.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+namespace s2e {
+namespace plugins {
+
+TraceBlockEncoder::TraceBlockEncoder(unsigned blockSize)
+{
+    m_blockSize = blockSize;
+    m_buffer.resize(sizeof(m_header) + blockSize);
+    reset();
+}
+
+void TraceBlockEncoder::reset()
+{
+    memset(&m_header, 0, sizeof(m_header));
+    m_header.magic = EXECTRACE_BLOCK_MAGIC;
+    m_used = sizeof(m_header);
+    m_delta = ExecutionTraceDeltaState();
+    m_states.clear();
+    m_lastState = 0;
+}
+
+void TraceBlockEncoder::add(const ExecutionTraceItemHeader &hdr, const void *data)
+{
+    unsigned needed = m_used + traceMaxEncodedSize(hdr.size);
+    if (m_buffer.size() < needed) {
+        //Items larger than a block get a block of their own
+        m_buffer.resize(needed);
+    }
+
+    uint8_t *p = traceEncodeItem(&m_buffer[m_used], hdr, (const uint8_t*) data, m_delta);
+    m_used = p - &m_buffer[0];
+
+    if (!m_header.itemCount) {
+        m_header.firstTimeStamp = hdr.timeStamp;
+    }
+    m_header.lastTimeStamp = hdr.timeStamp;
+    ++m_header.itemCount;
+
+    //Items of the same state usually come in long runs
+    if (m_states.empty() || hdr.stateId != m_lastState) {
+        if (std::find(m_states.begin(), m_states.end(), hdr.stateId) == m_states.end()) {
+            m_states.push_back(hdr.stateId);
+        }
+        m_lastState = hdr.stateId;
+    }
+}
+
+const uint8_t *TraceBlockEncoder::getRecord(unsigned *size)
+{
+    m_header.uncompressedSize = m_used - sizeof(m_header);
+    m_header.stateCount = m_states.size();
+
+    unsigned statesSize = m_states.size() * sizeof(uint32_t);
+    if (m_buffer.size() < m_used + statesSize) {
+        m_buffer.resize(m_used + statesSize);
+    }
+
+    memcpy(&m_buffer[0], &m_header, sizeof(m_header));
+    if (statesSize) {
+        memcpy(&m_buffer[m_used], &m_states[0], statesSize);
+    }
+
+    *size = m_used + statesSize;
+    return &m_buffer[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TraceBlockWriter::TraceBlockWriter(unsigned blockSize)
+{
+    m_fd = -1;
+    m_offset = 0;
+    m_blockSize = blockSize;
+    m_itemCount = 0;
+}
+
+TraceBlockWriter::~TraceBlockWriter()
+{
+    close();
+}
+
+bool TraceBlockWriter::writeAll(const void *data, uint64_t size)
+{
+    const uint8_t *p = (const uint8_t*) data;
+    while (size > 0) {
+        ssize_t ret = pwrite(m_fd, p, size, m_offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += ret;
+        size -= ret;
+        m_offset += ret;
+    }
+    return true;
+}
+
+void TraceBlockWriter::addToIndex(const ExecutionTraceBlockHeader &hdr,
+                                  const uint32_t *states, uint64_t offset)
+{
+    ExecutionTraceBlockIndexEntry entry;
+    entry.offset = offset;
+    entry.firstItem = hdr.firstItem;
+    entry.itemCount = hdr.itemCount;
+    entry.firstTimeStamp = hdr.firstTimeStamp;
+    entry.lastTimeStamp = hdr.lastTimeStamp;
+
+    uint32_t blockNumber = m_blocks.size();
+    m_blocks.push_back(entry);
+
+    for (unsigned i = 0; i < hdr.stateCount; ++i) {
+        m_stateBlocks[states[i]].push_back(blockNumber);
+    }
+
+    m_itemCount = hdr.firstItem + hdr.itemCount;
+}
+
+/**
+ *  Rebuilds the index of a trace that was not closed properly
+ *  by walking the block headers. Stops at the first incomplete block.
+ */
+bool TraceBlockWriter::scanBlocks(uint64_t start, uint64_t end)
+{
+    uint64_t offset = start;
+    std::vector<uint32_t> states;
+
+    while (offset + sizeof(ExecutionTraceBlockHeader) <= end) {
+        ExecutionTraceBlockHeader hdr;
+        if (pread(m_fd, &hdr, sizeof(hdr), offset) != sizeof(hdr) ||
+            hdr.magic != EXECTRACE_BLOCK_MAGIC) {
+            break;
+        }
+
+        uint64_t statesSize = (uint64_t) hdr.stateCount * sizeof(uint32_t);
+        uint64_t blockEnd = offset + sizeof(hdr) + statesSize + hdr.compressedSize;
+        if (blockEnd > end) {
+            break;
+        }
+
+        states.resize(hdr.stateCount);
+        if (statesSize && pread(m_fd, &states[0], statesSize,
+                                offset + sizeof(hdr)) != (ssize_t) statesSize) {
+            break;
+        }
+
+        addToIndex(hdr, states.empty() ? NULL : &states[0], offset);
+        offset = blockEnd;
+    }
+
+    m_offset = offset;
+    return ftruncate(m_fd, m_offset) == 0;
+}
+
+/**
+ *  Reloads the indexes of a closed trace and chops them off the file,
+ *  so that new blocks can be appended. They are written again on close.
+ */
+bool TraceBlockWriter::loadIndex()
+{
+    off_t fileSize = lseek(m_fd, 0, SEEK_END);
+    if (fileSize < (off_t) sizeof(ExecutionTraceFileHeader)) {
+        return false;
+    }
+
+    ExecutionTraceFooter footer;
+    bool hasFooter = fileSize >= (off_t) (sizeof(ExecutionTraceFileHeader) + sizeof(footer)) &&
+            pread(m_fd, &footer, sizeof(footer), fileSize - sizeof(footer)) == sizeof(footer) &&
+            footer.magic == EXECTRACE_FILE_MAGIC && footer.version == EXECTRACE_FORMAT_V2 &&
+            footer.blockIndexOffset <= (uint64_t) fileSize;
+
+    if (!hasFooter) {
+        return scanBlocks(sizeof(ExecutionTraceFileHeader), fileSize);
+    }
+
+    m_blocks.resize(footer.blockCount);
+    ssize_t size = footer.blockCount * sizeof(ExecutionTraceBlockIndexEntry);
+    if (size && pread(m_fd, &m_blocks[0], size, footer.blockIndexOffset) != size) {
+        return false;
+    }
+
+    std::vector<ExecutionTraceStateIndexEntry> stateEntries(footer.stateCount);
+    size = footer.stateCount * sizeof(ExecutionTraceStateIndexEntry);
+    if (size && pread(m_fd, &stateEntries[0], size, footer.stateIndexOffset) != size) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < stateEntries.size(); ++i) {
+        const ExecutionTraceStateIndexEntry &e = stateEntries[i];
+        std::vector<uint32_t> &list = m_stateBlocks[e.stateId];
+        list.resize(e.blockCount);
+        size = e.blockCount * sizeof(uint32_t);
+        if (size && pread(m_fd, &list[0], size,
+                          footer.blockListOffset + e.firstBlock * sizeof(uint32_t)) != size) {
+            return false;
+        }
+    }
+
+    m_itemCount = footer.itemCount;
+    m_offset = footer.blockIndexOffset;
+    return ftruncate(m_fd, m_offset) == 0;
+}
+
+bool TraceBlockWriter::open(const std::string &fileName, bool append)
+{
+    assert(m_fd < 0);
+
+    m_blocks.clear();
+    m_stateBlocks.clear();
+    m_itemCount = 0;
+    m_offset = 0;
+
+    m_fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    if (append && lseek(m_fd, 0, SEEK_END) > 0) {
+        ExecutionTraceFileHeader hdr;
+        if (pread(m_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+            hdr.magic != EXECTRACE_FILE_MAGIC || hdr.version != EXECTRACE_FORMAT_V2 ||
+            !loadIndex()) {
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        return true;
+    }
+
+    ExecutionTraceFileHeader hdr;
+    hdr.magic = EXECTRACE_FILE_MAGIC;
+    hdr.version = EXECTRACE_FORMAT_V2;
+    hdr.blockSize = m_blockSize;
+    return writeAll(&hdr, sizeof(hdr));
+}
+
+bool TraceBlockWriter::writeRecord(const uint8_t *record, unsigned size)
+{
+    assert(m_fd >= 0);
+
+    ExecutionTraceBlockHeader hdr;
+    memcpy(&hdr, record, sizeof(hdr));
+    const uint8_t *contents = record + sizeof(hdr);
+
+    std::vector<uint32_t> states(hdr.stateCount);
+    unsigned statesSize = hdr.stateCount * sizeof(uint32_t);
+    assert(sizeof(hdr) + hdr.uncompressedSize + statesSize == size);
+    if (statesSize) {
+        memcpy(&states[0], contents + hdr.uncompressedSize, statesSize);
+    }
+
+    uLongf compressedSize = compressBound(hdr.uncompressedSize);
+    if (m_compressed.size() < compressedSize) {
+        m_compressed.resize(compressedSize);
+    }
+    if (compress2(&m_compressed[0], &compressedSize, contents,
+                  hdr.uncompressedSize, Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    //Item numbers are global to the file, which may be appended to.
+    //Blocks dropped before reaching the writer leave a gap in the numbers.
+    hdr.compressedSize = compressedSize;
+    if (hdr.firstItem < m_itemCount) {
+        hdr.firstItem = m_itemCount;
+    }
+
+    uint64_t offset = m_offset;
+    if (!writeAll(&hdr, sizeof(hdr)) ||
+        (statesSize && !writeAll(&states[0], statesSize)) ||
+        !writeAll(&m_compressed[0], compressedSize)) {
+        return false;
+    }
+
+    addToIndex(hdr, states.empty() ? NULL : &states[0], offset);
+    return true;
+}
+
+bool TraceBlockWriter::close()
+{
+    if (m_fd < 0) {
+        return true;
+    }
+
+    ExecutionTraceFooter footer;
+    footer.magic = EXECTRACE_FILE_MAGIC;
+    footer.version = EXECTRACE_FORMAT_V2;
+    footer.itemCount = m_itemCount;
+    footer.blockCount = m_blocks.size();
+    footer.stateCount = m_stateBlocks.size();
+
+    footer.blockIndexOffset = m_offset;
+    bool ok = m_blocks.empty() ||
+              writeAll(&m_blocks[0], m_blocks.size() * sizeof(m_blocks[0]));
+
+    std::vector<ExecutionTraceStateIndexEntry> stateEntries;
+    uint64_t firstBlock = 0;
+    for (StateBlocks::const_iterator it = m_stateBlocks.begin();
+         it != m_stateBlocks.end(); ++it) {
+        ExecutionTraceStateIndexEntry e;
+        e.stateId = (*it).first;
+        e.blockCount = (*it).second.size();
+        e.firstBlock = firstBlock;
+        firstBlock += e.blockCount;
+        stateEntries.push_back(e);
+    }
+
+    footer.stateIndexOffset = m_offset;
+    ok = ok && (stateEntries.empty() ||
+                writeAll(&stateEntries[0], stateEntries.size() * sizeof(stateEntries[0])));
+
+    footer.blockListOffset = m_offset;
+    for (StateBlocks::const_iterator it = m_stateBlocks.begin();
+         ok && it != m_stateBlocks.end(); ++it) {
+        const std::vector<uint32_t> &list = (*it).second;
+        ok = list.empty() || writeAll(&list[0], list.size() * sizeof(uint32_t));
+    }
+
+    ok = ok && writeAll(&footer, sizeof(footer)) &&
+         ftruncate(m_fd, m_offset) == 0;
+
+    ::close(m_fd);
+    m_fd = -1;
+    return ok;
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,129 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TRACEBLOCKWRITER_H
+#define S2E_PLUGINS_TRACEBLOCKWRITER_H
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "TraceFormat.h"
+#include "AsyncTraceWriter.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Accumulates trace items into the delta-encoded (uncompressed) contents
+ *  of a version 2 block. This runs on the emulation thread and is cheap.
+ *
+ *  A finished block is handed out as a record made of an
+ *  ExecutionTraceBlockHeader (compressedSize not set yet), the encoded
+ *  items, and the ids of the states that have items in the block.
+ */
+class TraceBlockEncoder
+{
+    unsigned m_blockSize;
+    std::vector<uint8_t> m_buffer;
+    unsigned m_used;
+
+    ExecutionTraceBlockHeader m_header;
+    ExecutionTraceDeltaState m_delta;
+    std::vector<uint32_t> m_states;
+    uint32_t m_lastState;
+
+public:
+    TraceBlockEncoder(unsigned blockSize);
+
+    void reset();
+    void add(const ExecutionTraceItemHeader &hdr, const void *data);
+
+    /** Index of the first item of the block, set before adding to an empty block */
+    void setFirstItem(uint64_t index) { m_header.firstItem = index; }
+
+    bool isEmpty() const { return m_header.itemCount == 0; }
+    uint64_t getFirstItem() const { return m_header.firstItem; }
+    uint32_t getItemCount() const { return m_header.itemCount; }
+    bool isFull() const { return m_used - sizeof(m_header) >= m_blockSize; }
+    bool fits(uint32_t payloadSize) const {
+        return isEmpty() ||
+               m_used - sizeof(m_header) + traceMaxEncodedSize(payloadSize) <= m_blockSize;
+    }
+
+    /** Finalizes the record, valid until the next call to reset() */
+    const uint8_t *getRecord(unsigned *size);
+};
+
+/**
+ *  Compresses the blocks produced by TraceBlockEncoder and writes them
+ *  to the trace file, along with the block and state indexes.
+ *  This is where the bulk of the work is done, it runs on the writer thread
+ *  when the trace is written asynchronously.
+ */
+class TraceBlockWriter: public AsyncTraceWriter::RecordHandler
+{
+    typedef std::map<uint32_t, std::vector<uint32_t> > StateBlocks;
+
+    int m_fd;
+    uint64_t m_offset;
+    unsigned m_blockSize;
+    uint64_t m_itemCount;
+
+    std::vector<ExecutionTraceBlockIndexEntry> m_blocks;
+    StateBlocks m_stateBlocks;
+    std::vector<uint8_t> m_compressed;
+
+    bool writeAll(const void *data, uint64_t size);
+    bool loadIndex();
+    bool scanBlocks(uint64_t start, uint64_t end);
+    void addToIndex(const ExecutionTraceBlockHeader &hdr, const uint32_t *states,
+                    uint64_t offset);
+
+public:
+    TraceBlockWriter(unsigned blockSize);
+    virtual ~TraceBlockWriter();
+
+    virtual bool open(const std::string &fileName, bool append);
+    virtual bool writeRecord(const uint8_t *record, unsigned size);
+    virtual bool close();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -62,6 +62,7 @@ enum ExecTraceEntryType {
     TRACE_PAGEFAULT,
     TRACE_TLBMISS,
     TRACE_ICOUNT,
+    TRACE_SAMPLING,
     TRACE_MAX
 };
 
@@ -265,6 +266,24 @@ struct ExecutionTraceICount
     uint64_t count;
 }__attribute__((packed));
 
+enum ExecTraceSamplingMode {
+    SAMPLING_NONE = 0,
+    SAMPLING_PC,
+    SAMPLING_TIME,
+    SAMPLING_RESERVOIR
+};
+
+//The items of type itemType that follow in the same state stand for
+//seen occurrences out of which only kept were written.
+//Readers scale their counts by seen/kept.
+struct ExecutionTraceSampling
+{
+    uint8_t itemType;
+    uint8_t mode;
+    uint64_t seen;
+    uint64_t kept;
+}__attribute__((packed));
+
 //XXX: Avoid hard-coded registers
 //XXX: Extend to other kinds of registers
 struct ExecutionTraceTb
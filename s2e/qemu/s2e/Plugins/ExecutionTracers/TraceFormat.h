@@ -0,0 +1,272 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TRACEFORMAT_H
+#define S2E_PLUGINS_TRACEFORMAT_H
+
+#include <inttypes.h>
+#include <string.h>
+#include <vector>
+
+#include "TraceEntries.h"
+
+/**
+ *  Version 2 of the ExecutionTracer.dat format.
+ *
+ *  The file starts with an ExecutionTraceFileHeader, followed by blocks.
+ *  Each block holds a bounded number of items, encoded as follows and then
+ *  compressed with zlib:
+ *
+ *      varint  time stamp delta (zigzag, relative to the previous item)
+ *      uint8   type
+ *      varint  stateId
+ *      varint  pid
+ *      varint  payload size
+ *      payload
+ *
+ *  For the item types whose payload starts with a program counter, the
+ *  first 8 bytes of the payload are replaced with the zigzag varint of the
+ *  difference with the previous such program counter of the block.
+ *  Deltas are reset at the start of every block, so that blocks can be
+ *  decoded independently.
+ *
+ *  When the trace is closed, the index of the blocks, the list of blocks
+ *  in which each state has items, and an ExecutionTraceFooter are appended.
+ *  A trace without footer (e.g., S2E crashed) can still be read by walking
+ *  the block headers.
+ */
+
+namespace s2e {
+namespace plugins {
+
+#define EXECTRACE_FILE_MAGIC   0x4543415254453253ULL /* "S2ETRACE" */
+#define EXECTRACE_BLOCK_MAGIC  0x4b4c4254 /* "TBLK" */
+#define EXECTRACE_FORMAT_V2    2
+
+struct ExecutionTraceFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    //Maximum size of the uncompressed contents of a block
+    uint32_t blockSize;
+}__attribute__((packed));
+
+struct ExecutionTraceBlockHeader {
+    uint32_t magic;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint32_t itemCount;
+    //Index of the first item of the block in the file
+    uint64_t firstItem;
+    uint64_t firstTimeStamp;
+    uint64_t lastTimeStamp;
+    //Followed by stateCount uint32_t state ids, then the compressed data
+    uint32_t stateCount;
+}__attribute__((packed));
+
+struct ExecutionTraceBlockIndexEntry {
+    //File offset of the ExecutionTraceBlockHeader
+    uint64_t offset;
+    uint64_t firstItem;
+    uint32_t itemCount;
+    uint64_t firstTimeStamp;
+    uint64_t lastTimeStamp;
+}__attribute__((packed));
+
+struct ExecutionTraceStateIndexEntry {
+    uint32_t stateId;
+    uint32_t blockCount;
+    //Position of the first block number in the block list
+    uint64_t firstBlock;
+}__attribute__((packed));
+
+struct ExecutionTraceFooter {
+    uint64_t blockIndexOffset;
+    uint64_t stateIndexOffset;
+    uint64_t blockListOffset;
+    uint64_t itemCount;
+    uint32_t blockCount;
+    uint32_t stateCount;
+    uint32_t version;
+    uint64_t magic;
+}__attribute__((packed));
+
+static inline uint64_t traceZigZag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t traceUnZigZag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static inline uint8_t *traceEncodeVarint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+static inline const uint8_t *traceDecodeVarint(const uint8_t *p, const uint8_t *end,
+                                               uint64_t *v) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        result |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline bool traceItemStartsWithPc(uint8_t type, uint32_t size) {
+    if (size < sizeof(uint64_t)) {
+        return false;
+    }
+    switch (type) {
+        case TRACE_CALL: case TRACE_RET:
+        case TRACE_TB_START: case TRACE_TB_END:
+        case TRACE_FORK: case TRACE_BRANCHCOV:
+        case TRACE_MEMORY: case TRACE_PAGEFAULT: case TRACE_TLBMISS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//Values the deltas of a block are computed against
+struct ExecutionTraceDeltaState {
+    uint64_t timeStamp;
+    uint64_t pc;
+
+    ExecutionTraceDeltaState() : timeStamp(0), pc(0) {}
+};
+
+//Upper bound of the encoded size of an item
+static inline unsigned traceMaxEncodedSize(uint32_t payloadSize) {
+    return 4 * 10 + 1 + payloadSize;
+}
+
+static inline uint8_t *traceEncodeItem(uint8_t *p,
+                                       const ExecutionTraceItemHeader &hdr,
+                                       const uint8_t *data,
+                                       ExecutionTraceDeltaState &delta) {
+    p = traceEncodeVarint(p, traceZigZag(hdr.timeStamp - delta.timeStamp));
+    delta.timeStamp = hdr.timeStamp;
+    *p++ = hdr.type;
+    p = traceEncodeVarint(p, hdr.stateId);
+    p = traceEncodeVarint(p, hdr.pid);
+    p = traceEncodeVarint(p, hdr.size);
+
+    uint32_t size = hdr.size;
+    if (traceItemStartsWithPc(hdr.type, size)) {
+        uint64_t pc;
+        memcpy(&pc, data, sizeof(pc));
+        p = traceEncodeVarint(p, traceZigZag(pc - delta.pc));
+        delta.pc = pc;
+        data += sizeof(pc);
+        size -= sizeof(pc);
+    }
+
+    memcpy(p, data, size);
+    return p + size;
+}
+
+/**
+ *  Decodes the uncompressed contents of a block into the version 1 layout
+ *  (ExecutionTraceItemHeader followed by the payload), appended to out.
+ *  Returns false if the block is malformed.
+ */
+static inline bool traceDecodeBlock(const uint8_t *p, unsigned size, unsigned itemCount,
+                                    std::vector<uint8_t> &out) {
+    const uint8_t *end = p + size;
+    ExecutionTraceDeltaState delta;
+
+    for (unsigned i = 0; i < itemCount; ++i) {
+        uint64_t ts, stateId, pid, payloadSize;
+        if (!(p = traceDecodeVarint(p, end, &ts)) || p >= end) {
+            return false;
+        }
+        uint8_t type = *p++;
+        if (!(p = traceDecodeVarint(p, end, &stateId)) ||
+            !(p = traceDecodeVarint(p, end, &pid)) ||
+            !(p = traceDecodeVarint(p, end, &payloadSize))) {
+            return false;
+        }
+
+        ExecutionTraceItemHeader hdr;
+        hdr.timeStamp = delta.timeStamp + traceUnZigZag(ts);
+        delta.timeStamp = hdr.timeStamp;
+        hdr.type = type;
+        hdr.stateId = stateId;
+        hdr.pid = pid;
+        hdr.size = payloadSize;
+
+        size_t pos = out.size();
+        out.resize(pos + sizeof(hdr) + hdr.size);
+        memcpy(&out[pos], &hdr, sizeof(hdr));
+        pos += sizeof(hdr);
+
+        uint32_t remaining = hdr.size;
+        if (traceItemStartsWithPc(type, remaining)) {
+            uint64_t pcDelta;
+            if (!(p = traceDecodeVarint(p, end, &pcDelta))) {
+                return false;
+            }
+            uint64_t pc = delta.pc + traceUnZigZag(pcDelta);
+            delta.pc = pc;
+            memcpy(&out[pos], &pc, sizeof(pc));
+            pos += sizeof(pc);
+            remaining -= sizeof(pc);
+        }
+
+        if ((uint64_t) (end - p) < remaining) {
+            return false;
+        }
+        if (remaining) {
+            memcpy(&out[pos], p, remaining);
+        }
+        p += remaining;
+    }
+    return p == end;
+}
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "TraceSampler.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Plugins/CorePlugin.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace s2e {
+namespace plugins {
+
+namespace {
+struct ReservoirItemOrder {
+    template <typename T>
+    bool operator()(const T &a, const T &b) const {
+        if (a.header.stateId != b.header.stateId) {
+            return a.header.stateId < b.header.stateId;
+        }
+        return a.header.timeStamp < b.header.timeStamp;
+    }
+};
+}
+
+TraceSampler::TraceSampler(S2E *s2e, ExecutionTracer *tracer, const std::string &configKey,
+                           ModuleExecutionDetector *detector)
+{
+    m_s2e = s2e;
+    m_tracer = tracer;
+    m_detector = detector;
+    m_mode = SAMPLING_NONE;
+    m_traceClosed = false;
+    m_oversizedItems = 0;
+
+    ConfigFile *cfg = s2e->getConfig();
+    std::string mode = cfg->getString(configKey + ".sampling", "none");
+
+    //Record one out of samplingRate executions of each program counter
+    m_rate = cfg->getInt(configKey + ".samplingRate", 100);
+
+    //Length of a sampling window and how much of it is traced, in seconds.
+    //The reservoirs are written at the end of each window.
+    m_period = cfg->getInt(configKey + ".samplingPeriod", 10);
+    m_duration = cfg->getInt(configKey + ".samplingDuration", 1);
+
+    //Items kept per module and item type in each window
+    m_reservoirSize = cfg->getInt(configKey + ".reservoirSize", 1000);
+
+    if (mode == "pc") {
+        m_mode = SAMPLING_PC;
+    } else if (mode == "time") {
+        m_mode = SAMPLING_TIME;
+    } else if (mode == "reservoir") {
+        m_mode = SAMPLING_RESERVOIR;
+    } else if (mode != "none") {
+        s2e->getWarningsStream() << configKey << ": unknown sampling mode " << mode
+                << " (use none, pc, time or reservoir)" << std::endl;
+        exit(-1);
+    }
+
+    if ((m_mode == SAMPLING_PC && m_rate == 0) ||
+        (m_mode == SAMPLING_TIME && (m_duration == 0 || m_duration > m_period)) ||
+        (m_mode == SAMPLING_RESERVOIR && (m_reservoirSize == 0 || m_period == 0))) {
+        s2e->getWarningsStream() << configKey << ": invalid sampling parameters" << std::endl;
+        exit(-1);
+    }
+
+    m_start = m_lastFlush = time(NULL);
+    m_active = true;
+    m_random = 0x9E3779B97F4A7C15ULL ^ m_start;
+
+    if (m_mode == SAMPLING_NONE) {
+        return;
+    }
+
+    if (m_mode == SAMPLING_PC) {
+        m_pcCounters.resize(PC_COUNTERS, 0);
+    }
+
+    if (m_mode == SAMPLING_TIME || m_mode == SAMPLING_RESERVOIR) {
+        s2e->getCorePlugin()->onTimer.connect(
+                sigc::mem_fun(*this, &TraceSampler::onTimer));
+    }
+
+    m_tracer->onFlushPendingItems.connect(
+            sigc::mem_fun(*this, &TraceSampler::flushPendingItems));
+    m_tracer->onClose.connect(
+            sigc::mem_fun(*this, &TraceSampler::onTraceClose));
+
+    s2e->getMessagesStream() << configKey << ": sampling mode " << mode << std::endl;
+}
+
+//The owner may be destroyed before or after ExecutionTracer
+TraceSampler::~TraceSampler()
+{
+    if (!m_traceClosed) {
+        flushPendingItems();
+    }
+
+    if (m_oversizedItems) {
+        m_s2e->getWarningsStream() << "TraceSampler: dropped " << std::dec << m_oversizedItems
+                << " items too large for the reservoir" << std::endl;
+    }
+}
+
+bool TraceSampler::sample(uint64_t pc, ExecTraceEntryType type)
+{
+    switch (m_mode) {
+        case SAMPLING_PC: {
+            //Collisions only merge the counters of a few program counters,
+            //which keeps the overall rate.
+            uint64_t h = (pc ^ ((uint64_t) type << 56)) * 0x9E3779B97F4A7C15ULL;
+            uint32_t &counter = m_pcCounters[h >> 48];
+            return (counter++ % m_rate) == 0;
+        }
+
+        case SAMPLING_TIME:
+            return m_active;
+
+        default:
+            return true;
+    }
+}
+
+void TraceSampler::writeSampled(S2EExecutionState *state, void *data, unsigned size,
+                                ExecTraceEntryType type)
+{
+    if (m_mode == SAMPLING_RESERVOIR) {
+        addToReservoir(state, data, size, type);
+        return;
+    }
+
+    writeRate(state, type);
+    m_tracer->writeData(state, data, size, type);
+}
+
+void TraceSampler::writeRate(S2EExecutionState *state, ExecTraceEntryType type)
+{
+    if (!m_announced.insert(std::make_pair(state->getID(), (uint8_t) type)).second) {
+        return;
+    }
+
+    ExecutionTraceSampling s;
+    s.itemType = type;
+    s.mode = m_mode;
+    if (m_mode == SAMPLING_PC) {
+        s.seen = m_rate;
+        s.kept = 1;
+    } else {
+        s.seen = m_period;
+        s.kept = m_duration;
+    }
+
+    m_tracer->writeData(state, &s, sizeof(s), TRACE_SAMPLING);
+}
+
+uint64_t TraceSampler::nextRandom()
+{
+    //xorshift64
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 7;
+    m_random ^= m_random << 17;
+    return m_random;
+}
+
+void TraceSampler::addToReservoir(S2EExecutionState *state, void *data, unsigned size,
+                                  ExecTraceEntryType type)
+{
+    //Writing such items as is would skew the counts of the sampled ones
+    if (size > MAX_RESERVOIR_ITEM_SIZE) {
+        if (!m_oversizedItems++) {
+            m_s2e->getWarningsStream() << "TraceSampler: items of type " << std::dec << type
+                    << " (" << size << " bytes) are too large for the reservoir,"
+                    << " they will not be traced" << std::endl;
+        }
+        return;
+    }
+
+    const std::string *module = NULL;
+    if (m_detector) {
+        const ModuleDescriptor *desc = m_detector->getCurrentDescriptor(state);
+        if (desc) {
+            module = m_detector->getModuleId(*desc);
+        }
+    }
+
+    Reservoir &r = m_reservoirs[std::make_pair(module, (uint8_t) type)];
+    ++r.seen;
+
+    ReservoirItem *item;
+    if (r.items.size() < m_reservoirSize) {
+        r.items.resize(r.items.size() + 1);
+        item = &r.items.back();
+    } else {
+        uint64_t slot = nextRandom() % r.seen;
+        if (slot >= m_reservoirSize) {
+            return;
+        }
+        item = &r.items[slot];
+    }
+
+    m_tracer->initItemHeader(state, size, type, item->header);
+    memcpy(item->data, data, size);
+}
+
+void TraceSampler::onTimer()
+{
+    uint64_t now = time(NULL);
+
+    if (m_mode == SAMPLING_TIME) {
+        m_active = ((now - m_start) % m_period) < m_duration;
+        return;
+    }
+
+    if (now - m_lastFlush >= m_period) {
+        flushPendingItems();
+    }
+}
+
+/**
+ *  Called at the end of each reservoir window, and by ExecutionTracer
+ *  before forks and before closing the trace. The items of each state
+ *  are written together, after a sampling item with the weight of the
+ *  window, and keep their original time stamps.
+ */
+void TraceSampler::flushPendingItems()
+{
+    //The next segment of the trace may be read without the current one
+    m_announced.clear();
+    m_lastFlush = time(NULL);
+
+    if (m_mode != SAMPLING_RESERVOIR) {
+        return;
+    }
+
+    for (Reservoirs::iterator it = m_reservoirs.begin(); it != m_reservoirs.end(); ++it) {
+        Reservoir &r = (*it).second;
+        if (r.items.empty()) {
+            continue;
+        }
+
+        std::sort(r.items.begin(), r.items.end(), ReservoirItemOrder());
+
+        ExecutionTraceSampling s;
+        s.itemType = (*it).first.second;
+        s.mode = SAMPLING_RESERVOIR;
+        s.seen = r.seen;
+        s.kept = r.items.size();
+
+        for (unsigned i = 0; i < r.items.size(); ++i) {
+            ReservoirItem &item = r.items[i];
+            if (i == 0 || item.header.stateId != r.items[i - 1].header.stateId) {
+                ExecutionTraceItemHeader hdr = item.header;
+                hdr.type = TRACE_SAMPLING;
+                hdr.size = sizeof(s);
+                m_tracer->writeItem(hdr, &s);
+            }
+            m_tracer->writeItem(item.header, item.data);
+        }
+
+        r.seen = 0;
+        r.items.clear();
+    }
+}
+
+void TraceSampler::onTraceClose()
+{
+    //The tracer flushes the pending items right after this
+    m_traceClosed = true;
+}
+
+} // namespace plugins
+} // namespace s2e
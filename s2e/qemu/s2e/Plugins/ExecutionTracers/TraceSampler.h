@@ -0,0 +1,162 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TRACESAMPLER_H
+#define S2E_PLUGINS_TRACESAMPLER_H
+
+#include <s2e/S2EExecutionState.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ExecutionTracer.h"
+#include "TraceEntries.h"
+
+namespace s2e {
+
+class S2E;
+
+namespace plugins {
+
+/**
+ *  Lets tracer plugins write only part of their items.
+ *  Configured in the section of the plugin that owns it:
+ *
+ *  sampling="none": every item is written (default)
+ *  sampling="pc": one out of samplingRate occurrences of each program counter
+ *  sampling="time": everything during samplingDuration seconds
+ *                   out of every samplingPeriod seconds
+ *  sampling="reservoir": reservoirSize items per module and item type,
+ *                        uniformly picked among those of each samplingPeriod
+ *
+ *  Before the sampled items of a state, a TRACE_SAMPLING item tells
+ *  how many occurrences they stand for, so that the offline tools can
+ *  scale their counts back.
+ */
+class TraceSampler : public sigc::trackable
+{
+public:
+    TraceSampler(S2E *s2e, ExecutionTracer *tracer, const std::string &configKey,
+                 ModuleExecutionDetector *detector = NULL);
+
+    /** Writes the held back items if the trace is still open */
+    ~TraceSampler();
+
+    ExecTraceSamplingMode getMode() const {
+        return m_mode;
+    }
+
+    /** Whether the item about to be built has a chance to be written */
+    bool shouldTrace(S2EExecutionState *state, uint64_t pc, ExecTraceEntryType type) {
+        if (m_mode == SAMPLING_NONE) {
+            return true;
+        }
+        return sample(pc, type);
+    }
+
+    /** Must only be called for items for which shouldTrace returned true */
+    void write(S2EExecutionState *state, void *data, unsigned size, ExecTraceEntryType type) {
+        if (m_mode == SAMPLING_NONE) {
+            m_tracer->writeData(state, data, size, type);
+            return;
+        }
+        writeSampled(state, data, size, type);
+    }
+
+private:
+    enum {
+        PC_COUNTERS = 0x10000,
+        MAX_RESERVOIR_ITEM_SIZE = 64
+    };
+
+    struct ReservoirItem {
+        ExecutionTraceItemHeader header;
+        uint8_t data[MAX_RESERVOIR_ITEM_SIZE];
+    };
+
+    struct Reservoir {
+        uint64_t seen;
+        std::vector<ReservoirItem> items;
+        Reservoir() : seen(0) {}
+    };
+
+    //Module id (or NULL outside of modules) and item type
+    typedef std::pair<const std::string *, uint8_t> ReservoirKey;
+    typedef std::map<ReservoirKey, Reservoir> Reservoirs;
+
+    //States that already got the sampling item of a given type
+    typedef std::set<std::pair<int, uint8_t> > AnnouncedRates;
+
+    S2E *m_s2e;
+    ExecutionTracer *m_tracer;
+    ModuleExecutionDetector *m_detector;
+    ExecTraceSamplingMode m_mode;
+
+    unsigned m_rate;
+    std::vector<uint32_t> m_pcCounters;
+
+    unsigned m_period;
+    unsigned m_duration;
+    uint64_t m_start;
+    bool m_active;
+
+    unsigned m_reservoirSize;
+    Reservoirs m_reservoirs;
+    uint64_t m_oversizedItems;
+    uint64_t m_lastFlush;
+    uint64_t m_random;
+
+    AnnouncedRates m_announced;
+    bool m_traceClosed;
+
+    bool sample(uint64_t pc, ExecTraceEntryType type);
+    void writeSampled(S2EExecutionState *state, void *data, unsigned size, ExecTraceEntryType type);
+    void writeRate(S2EExecutionState *state, ExecTraceEntryType type);
+    void addToReservoir(S2EExecutionState *state, void *data, unsigned size, ExecTraceEntryType type);
+    uint64_t nextRandom();
+
+    void onTimer();
+    void flushPendingItems();
+    void onTraceClose();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "TraceStreamServer.h"
+#include "TraceStreamFormat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+/* Entries are batched until a client has that many bytes queued */
+#define STREAM_SEND_THRESHOLD (64 * 1024)
+
+TraceStreamServer::TraceStreamServer(unsigned queueLimit)
+{
+    m_listenFd = -1;
+    m_queueLimit = queueLimit;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+TraceStreamServer::~TraceStreamServer()
+{
+    close();
+}
+
+bool TraceStreamServer::open(const std::string &path)
+{
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    //Remove the socket of a previous run
+    unlink(path.c_str());
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    m_listenFd = fd;
+    m_path = path;
+    return true;
+}
+
+void TraceStreamServer::close()
+{
+    //Give the clients a chance to get the end of the trace
+    while (!m_clients.empty()) {
+        Client *client = m_clients.back();
+
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) & ~O_NONBLOCK);
+        setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        sendQueue(client);
+
+        dropClient(m_clients.size() - 1);
+    }
+
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        unlink(m_path.c_str());
+        m_listenFd = -1;
+    }
+}
+
+void TraceStreamServer::detach()
+{
+    //The sockets belong to the parent process, which keeps serving them
+    for (unsigned i = 0; i < m_clients.size(); ++i) {
+        ::close(m_clients[i]->fd);
+        delete m_clients[i];
+    }
+    m_clients.clear();
+
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        m_listenFd = -1;
+    }
+}
+
+bool TraceStreamServer::hasPendingConnections() const
+{
+    if (m_listenFd < 0) {
+        return false;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = m_listenFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+unsigned TraceStreamServer::accept(uint64_t firstItem)
+{
+    unsigned count = 0;
+
+    while (m_listenFd >= 0) {
+        int fd = ::accept(m_listenFd, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        Client *client = new Client();
+        client->fd = fd;
+        client->sent = 0;
+
+        ExecutionTraceStreamHeader hdr;
+        hdr.magic = EXECTRACE_STREAM_MAGIC;
+        hdr.version = EXECTRACE_STREAM_VERSION;
+        hdr.pid = getpid();
+        hdr.firstItem = firstItem;
+        const uint8_t *p = (const uint8_t*) &hdr;
+        client->queue.insert(client->queue.end(), p, p + sizeof(hdr));
+
+        m_clients.push_back(client);
+        ++m_stats.connectedClients;
+        ++count;
+    }
+
+    return count;
+}
+
+void TraceStreamServer::dropClient(unsigned index)
+{
+    ::close(m_clients[index]->fd);
+    delete m_clients[index];
+    m_clients.erase(m_clients.begin() + index);
+}
+
+//Returns false if the client went away
+bool TraceStreamServer::sendQueue(Client *client)
+{
+    while (client->sent < client->queue.size()) {
+        ssize_t ret = send(client->fd, &client->queue[client->sent],
+                           client->queue.size() - client->sent, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        client->sent += ret;
+        m_stats.sentBytes += ret;
+    }
+
+    if (client->sent == client->queue.size()) {
+        client->queue.clear();
+        client->sent = 0;
+    } else if (client->sent >= client->queue.size() / 2) {
+        client->queue.erase(client->queue.begin(), client->queue.begin() + client->sent);
+        client->sent = 0;
+    }
+    return true;
+}
+
+void TraceStreamServer::append(const void *header, unsigned headerSize,
+                               const void *data, unsigned size)
+{
+    for (unsigned i = 0; i < m_clients.size(); ) {
+        Client *client = m_clients[i];
+
+        if (client->queue.size() - client->sent + headerSize + size > m_queueLimit) {
+            ++m_stats.overflowedClients;
+            dropClient(i);
+            continue;
+        }
+
+        const uint8_t *p = (const uint8_t*) header;
+        client->queue.insert(client->queue.end(), p, p + headerSize);
+        if (size) {
+            p = (const uint8_t*) data;
+            client->queue.insert(client->queue.end(), p, p + size);
+        }
+
+        if (client->queue.size() - client->sent >= STREAM_SEND_THRESHOLD &&
+            !sendQueue(client)) {
+            dropClient(i);
+            continue;
+        }
+        ++i;
+    }
+}
+
+void TraceStreamServer::poll()
+{
+    for (unsigned i = 0; i < m_clients.size(); ) {
+        if (!sendQueue(m_clients[i])) {
+            dropClient(i);
+            continue;
+        }
+        ++i;
+    }
+}
+
+} // namespace plugins
+} // namespace s2e
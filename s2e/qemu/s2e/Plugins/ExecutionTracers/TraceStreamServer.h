@@ -0,0 +1,119 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TRACESTREAMSERVER_H
+#define S2E_PLUGINS_TRACESTREAMSERVER_H
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Publishes trace entries on a Unix socket while S2E runs.
+ *
+ *  Clients connect at any time and get a ExecutionTraceStreamHeader
+ *  followed by every entry appended after the connection. Entries are
+ *  queued per client and sent with non-blocking writes once enough of
+ *  them accumulated, or when poll() is called. The emulation thread never
+ *  waits for a client: a client whose queue exceeds the limit is
+ *  disconnected (it can reconnect and catch up from the trace file).
+ *
+ *  Each S2E process has its own server. After a fork, the child must
+ *  call detach() to drop the sockets it inherited from the parent.
+ */
+class TraceStreamServer
+{
+public:
+    struct Statistics {
+        uint64_t connectedClients;
+        /* Clients disconnected because their queue was full */
+        uint64_t overflowedClients;
+        uint64_t sentBytes;
+    };
+
+private:
+    struct Client {
+        int fd;
+        std::vector<uint8_t> queue;
+        size_t sent;
+    };
+
+    typedef std::vector<Client*> Clients;
+
+    std::string m_path;
+    int m_listenFd;
+    unsigned m_queueLimit;
+    Clients m_clients;
+    Statistics m_stats;
+
+    bool sendQueue(Client *client);
+    void dropClient(unsigned index);
+
+public:
+    TraceStreamServer(unsigned queueLimit);
+    ~TraceStreamServer();
+
+    bool open(const std::string &path);
+    void close();
+    void detach();
+    bool isOpen() const { return m_listenFd >= 0; }
+
+    bool hasClients() const { return !m_clients.empty(); }
+    bool hasPendingConnections() const;
+
+    /**
+     *  Accepts the pending connections. Their stream starts at the
+     *  given item of the trace file, the caller must have flushed the
+     *  preceding items to the file.
+     */
+    unsigned accept(uint64_t firstItem);
+
+    void append(const void *header, unsigned headerSize,
+                const void *data, unsigned size);
+
+    /* Sends what is queued, as far as the clients accept it */
+    void poll();
+
+    const Statistics &getStatistics() const { return m_stats; }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
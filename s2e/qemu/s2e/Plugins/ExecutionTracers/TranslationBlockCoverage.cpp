@@ -0,0 +1,315 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+extern "C" {
+#include "config.h"
+#include "qemu-common.h"
+}
+
+#include "TranslationBlockCoverage.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(TranslationBlockCoverage, "Shared-memory coverage of executed translation blocks",
+                  "TranslationBlockCoverage", "ModuleExecutionDetector");
+
+#define TBCOVERAGE_MAX_MODULES 256
+
+static uint64_t getTimeStampMicroseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+TranslationBlockCoverage::~TranslationBlockCoverage()
+{
+    if (m_shared) {
+        writeSnapshot();
+        delete m_shared;
+    }
+}
+
+void TranslationBlockCoverage::initialize()
+{
+    m_detector = (ModuleExecutionDetector*)s2e()->getPlugin("ModuleExecutionDetector");
+    m_reportedDrops = false;
+
+    //Number of distinct translation blocks that can be recorded
+    uint64_t maxBlocks = s2e()->getConfig()->getInt(getConfigKey() + ".maxBlocks", 1024 * 1024);
+
+    //Space for the bitmaps of all modules, in MB (1 MB covers 8 MB of code)
+    uint64_t bitmapSize = s2e()->getConfig()->getInt(getConfigKey() + ".bitmapSize", 4) * 1024 * 1024;
+
+    //How often to write tbcoverage.dat, in seconds (0 = only when S2E exits)
+    m_snapshotInterval = s2e()->getConfig()->getInt(getConfigKey() + ".snapshotInterval", 10);
+
+    uint64_t bitmapStart = sizeof(TbCoverageHeader) +
+                           TBCOVERAGE_MAX_MODULES * sizeof(TbCoverageModule) +
+                           maxBlocks * sizeof(TbCoverageBlock);
+    uint64_t regionSize = bitmapStart + bitmapSize;
+
+    if (regionSize >= 0x100000000ULL) {
+        s2e()->getWarningsStream() << "TranslationBlockCoverage: maxBlocks and bitmapSize "
+                << "must fit in 4 GB of shared memory" << std::endl;
+        exit(-1);
+    }
+
+    //Created before S2E forks any process, so that they all share it
+    m_shared = new S2ESynchronizedObjectInternal(regionSize);
+    m_region = (uint8_t*) m_shared->get();
+
+#ifdef _WIN32
+    //Shared memory is zero-filled, the Windows fallback is not
+    memset(m_region, 0, regionSize);
+#endif
+
+    m_header = (TbCoverageHeader*) m_region;
+    m_modules = (TbCoverageModule*) (m_region + sizeof(TbCoverageHeader));
+    m_blocks = (TbCoverageBlock*) (m_region + sizeof(TbCoverageHeader) +
+                                   TBCOVERAGE_MAX_MODULES * sizeof(TbCoverageModule));
+
+    m_header->magic = TBCOVERAGE_MAGIC;
+    m_header->version = TBCOVERAGE_VERSION;
+    m_header->maxModules = TBCOVERAGE_MAX_MODULES;
+    m_header->maxBlocks = maxBlocks;
+    m_header->bitmapUsed = bitmapStart;
+    m_header->bitmapSize = regionSize;
+    m_header->lastSnapshot = time(NULL);
+
+    m_detector->onModuleTranslateBlockStart.connect(
+            sigc::mem_fun(*this, &TranslationBlockCoverage::onModuleTranslateBlockStart));
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &TranslationBlockCoverage::onTimer));
+}
+
+/**
+ *  Module ids are allocated in the shared region, so that all processes
+ *  agree on them. The local map avoids taking the lock more than once
+ *  per module and process.
+ */
+int TranslationBlockCoverage::getModuleId(const ModuleDescriptor &module)
+{
+    std::map<std::string, int>::const_iterator it = m_moduleIds.find(module.Name);
+    if (it != m_moduleIds.end()) {
+        return (*it).second;
+    }
+
+    char name[TBCOVERAGE_MODULE_NAME_SIZE];
+    memset(name, 0, sizeof(name));
+    strncpy(name, module.Name.c_str(), sizeof(name) - 1);
+
+    int id = -1;
+    m_shared->aquire();
+
+    for (unsigned i = 0; i < m_header->moduleCount; ++i) {
+        if (!strcmp(m_modules[i].name, name)) {
+            id = i;
+            break;
+        }
+    }
+
+    uint64_t bitmapBytes = (module.Size + 7) / 8;
+    if (id < 0 && m_header->moduleCount < m_header->maxModules &&
+        m_header->bitmapUsed + bitmapBytes <= m_header->bitmapSize) {
+        id = m_header->moduleCount;
+
+        TbCoverageModule &m = m_modules[id];
+        memcpy(m.name, name, sizeof(name));
+        m.nativeBase = module.NativeBase;
+        m.size = module.Size;
+        m.bitmapOffset = m_header->bitmapUsed;
+        m_header->bitmapUsed += bitmapBytes;
+
+        //Snapshots read the modules without the lock
+        __sync_synchronize();
+        ++m_header->moduleCount;
+    }
+
+    m_shared->release();
+
+    if (id < 0) {
+        s2e()->getWarningsStream() << "TranslationBlockCoverage: no room left for module "
+                << module.Name << ", increase bitmapSize" << std::endl;
+    }
+
+    m_moduleIds[module.Name] = id;
+    return id;
+}
+
+void TranslationBlockCoverage::onModuleTranslateBlockStart(
+        ExecutionSignal *signal,
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        TranslationBlock *tb,
+        uint64_t pc)
+{
+    int id = getModuleId(module);
+    uint64_t offset = pc - module.LoadBase;
+    if (id < 0 || offset >= m_modules[id].size) {
+        return;
+    }
+
+    signal->connect(
+        sigc::bind(sigc::mem_fun(*this, &TranslationBlockCoverage::onExecuteBlockStart),
+                   (unsigned) id, offset)
+    );
+}
+
+bool TranslationBlockCoverage::isCovered(const ModuleDescriptor &module, uint64_t pc)
+{
+    int id = getModuleId(module);
+    uint64_t offset = pc - module.LoadBase;
+    if (id < 0 || offset >= m_modules[id].size) {
+        return false;
+    }
+
+    uint8_t byte = m_region[m_modules[id].bitmapOffset + (offset >> 3)];
+    return byte & (1 << (offset & 7));
+}
+
+//Runs for every executed block, keep it short
+void TranslationBlockCoverage::onExecuteBlockStart(S2EExecutionState *state, uint64_t pc,
+                                                   unsigned module, uint64_t offset)
+{
+    uint8_t *byte = m_region + m_modules[module].bitmapOffset + (offset >> 3);
+    uint8_t mask = 1 << (offset & 7);
+
+    if (*byte & mask) {
+        return;
+    }
+
+    //Another process or state may have executed the block in the meantime
+    if (__sync_fetch_and_or(byte, mask) & mask) {
+        return;
+    }
+
+    recordBlock(state, module, offset);
+}
+
+void TranslationBlockCoverage::recordBlock(S2EExecutionState *state, unsigned module, uint64_t offset)
+{
+    uint64_t index = __sync_fetch_and_add(&m_header->blockCount, 1);
+    if (index >= m_header->maxBlocks) {
+        __sync_fetch_and_add(&m_header->droppedBlocks, 1);
+        if (!m_reportedDrops) {
+            s2e()->getWarningsStream() << "TranslationBlockCoverage: the block table is full, "
+                    << "increase maxBlocks" << std::endl;
+            m_reportedDrops = true;
+        }
+        return;
+    }
+
+    TbCoverageBlock &block = m_blocks[index];
+    block.module = module;
+    block.offset = offset;
+    block.timeStamp = getTimeStampMicroseconds();
+
+    //A non-zero size tells the snapshots that the block is complete
+    __sync_synchronize();
+    unsigned size = state->getTb()->size;
+    block.size = size ? size : 1;
+}
+
+void TranslationBlockCoverage::onTimer()
+{
+    if (!m_snapshotInterval) {
+        return;
+    }
+
+    uint64_t now = time(NULL);
+    uint64_t last = m_header->lastSnapshot;
+    if (now - last < m_snapshotInterval) {
+        return;
+    }
+
+    //Only one process takes each snapshot
+    if (!__sync_bool_compare_and_swap(&m_header->lastSnapshot, last, now)) {
+        return;
+    }
+
+    writeSnapshot();
+}
+
+void TranslationBlockCoverage::writeSnapshot()
+{
+    std::string fileName = s2e()->getOutputDirectoryBase() + "/tbcoverage.dat";
+
+    //Processes may write at the same time, each one renames its own file
+    std::stringstream ss;
+    ss << fileName << "." << getpid();
+    std::string tmpName = ss.str();
+
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        s2e()->getWarningsStream() << "TranslationBlockCoverage: could not create "
+                << tmpName << std::endl;
+        return;
+    }
+
+    TbCoverageHeader hdr = *m_header;
+    if (hdr.blockCount > hdr.maxBlocks) {
+        hdr.blockCount = hdr.maxBlocks;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok &= fwrite(m_modules, sizeof(*m_modules), hdr.moduleCount, fp) == hdr.moduleCount;
+    ok &= fwrite(m_blocks, sizeof(*m_blocks), hdr.blockCount, fp) == hdr.blockCount;
+    ok &= fclose(fp) == 0;
+
+    if (!ok || rename(tmpName.c_str(), fileName.c_str()) < 0) {
+        s2e()->getWarningsStream() << "TranslationBlockCoverage: could not write "
+                << fileName << std::endl;
+        unlink(tmpName.c_str());
+    }
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,118 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TBCOVERAGE_H
+#define S2E_PLUGINS_TBCOVERAGE_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/Synchronization.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+
+#include <map>
+#include <string>
+
+#include "TranslationBlockCoverageFormat.h"
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Records which translation blocks of the modules configured in
+ *  ModuleExecutionDetector were executed, without going through the
+ *  execution trace. Each module gets a bitmap with one bit per byte of
+ *  its image. Executing a block only tests its bit, the first execution
+ *  also records the size and the time of the block. The bitmaps live in
+ *  shared memory, so that all S2E processes contribute to the same
+ *  coverage, which is periodically written to tbcoverage.dat in the
+ *  output directory. The coverage tool turns that file into the usual
+ *  reports.
+ */
+class TranslationBlockCoverage : public Plugin
+{
+    S2E_PLUGIN
+public:
+    TranslationBlockCoverage(S2E* s2e): Plugin(s2e), m_shared(NULL) {}
+    virtual ~TranslationBlockCoverage();
+
+    void initialize();
+
+    /** Returns true if some S2E process executed the block that starts at pc */
+    bool isCovered(const ModuleDescriptor &module, uint64_t pc);
+
+    /** Number of blocks covered by all processes so far. It changes
+        whenever any process covers a new block. */
+    uint64_t getCoveredBlockCount() const {
+        return *(volatile uint64_t*) &m_header->blockCount;
+    }
+
+private:
+    ModuleExecutionDetector *m_detector;
+
+    S2ESynchronizedObjectInternal *m_shared;
+    uint8_t *m_region;
+    TbCoverageHeader *m_header;
+    TbCoverageModule *m_modules;
+    TbCoverageBlock *m_blocks;
+
+    //Module ids already looked up by this process, -1 if the module does not fit
+    std::map<std::string, int> m_moduleIds;
+
+    unsigned m_snapshotInterval;
+    bool m_reportedDrops;
+
+    int getModuleId(const ModuleDescriptor &module);
+    void recordBlock(S2EExecutionState *state, unsigned module, uint64_t offset);
+
+    void onModuleTranslateBlockStart(
+            ExecutionSignal *signal,
+            S2EExecutionState* state,
+            const ModuleDescriptor &module,
+            TranslationBlock *tb,
+            uint64_t pc);
+
+    void onExecuteBlockStart(S2EExecutionState *state, uint64_t pc,
+                             unsigned module, uint64_t offset);
+
+    void onTimer();
+    void writeSnapshot();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_TBCOVERAGEFORMAT_H
+#define S2E_PLUGINS_TBCOVERAGEFORMAT_H
+
+#include <inttypes.h>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Translation block coverage (TranslationBlockCoverage plugin).
+ *  The shared memory region of the plugin starts with the same layout
+ *  as the snapshot file: a TbCoverageHeader, maxModules TbCoverageModule
+ *  slots, and maxBlocks TbCoverageBlock slots. The snapshot file only
+ *  keeps the moduleCount modules and blockCount blocks in use.
+ *  Each block records the first execution of a translation block.
+ *  Blocks whose size is 0 were still being written and must be ignored.
+ */
+#define TBCOVERAGE_MAGIC 0x564f434254453253ULL /* "S2ETBCOV" */
+#define TBCOVERAGE_VERSION 1
+#define TBCOVERAGE_MODULE_NAME_SIZE 64
+
+struct TbCoverageHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t maxModules;
+    uint32_t moduleCount;
+    //Keeps the counters below aligned, they are updated atomically
+    uint32_t padding;
+    uint64_t maxBlocks;
+    uint64_t blockCount;
+    //Blocks executed for the first time after the block table was full
+    uint64_t droppedBlocks;
+    //End of the space reserved for the bitmaps and end of the part given
+    //to modules, as offsets in the shared region
+    uint64_t bitmapSize;
+    uint64_t bitmapUsed;
+    //Time of the last snapshot, so that only one process takes it
+    uint64_t lastSnapshot;
+}__attribute__((packed));
+
+struct TbCoverageModule {
+    char name[TBCOVERAGE_MODULE_NAME_SIZE];
+    uint64_t nativeBase;
+    uint64_t size;
+    //Offset of the bitmap in the shared region (one bit per byte of the image)
+    uint64_t bitmapOffset;
+}__attribute__((packed));
+
+struct TbCoverageBlock {
+    uint32_t module;
+    uint32_t size;
+    //Offset of the first instruction from the load base of the module
+    uint64_t offset;
+    uint64_t timeStamp;
+}__attribute__((packed));
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
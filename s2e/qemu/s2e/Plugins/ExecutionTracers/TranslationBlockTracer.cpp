@@ -56,10 +56,16 @@ namespace plugins {
 S2E_DEFINE_PLUGIN(TranslationBlockTracer, "Tracer for executed translation blocks", "TranslationBlockTracer", "ExecutionTracer",
                   "ModuleExecutionDetector");
 
+TranslationBlockTracer::~TranslationBlockTracer()
+{
+    delete m_sampler;
+}
+
 void TranslationBlockTracer::initialize()
 {
     m_tracer = (ExecutionTracer *)s2e()->getPlugin("ExecutionTracer");
     m_detector = (ModuleExecutionDetector*)s2e()->getPlugin("ModuleExecutionDetector");
+    m_sampler = new TraceSampler(s2e(), m_tracer, getConfigKey(), m_detector);
 
     bool ok = false;
     //Specify whether or not to enable cutom instructions for enabling/disabling tracing
@@ -136,6 +142,11 @@ void TranslationBlockTracer::onModuleTranslateBlockEnd(
 
 void TranslationBlockTracer::trace(S2EExecutionState *state, uint64_t pc, ExecTraceEntryType type)
 {
+    //Reading the registers is what costs, decide first
+    if (!m_sampler->shouldTrace(state, pc, type)) {
+        return;
+    }
+
     ExecutionTraceTb tb;
 
     tb.pc = pc;
@@ -155,8 +166,7 @@ void TranslationBlockTracer::trace(S2EExecutionState *state, uint64_t pc, ExecTr
         }
     }
 
-    m_tracer->writeData(state, &tb, sizeof(tb), type);
-
+    m_sampler->write(state, &tb, sizeof(tb), type);
 }
 
 void TranslationBlockTracer::onExecuteBlockStart(S2EExecutionState *state, uint64_t pc)
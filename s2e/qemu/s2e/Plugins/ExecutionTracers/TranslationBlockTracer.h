@@ -43,6 +43,7 @@
 
 #include "ExecutionTracer.h"
 #include "TraceEntries.h"
+#include "TraceSampler.h"
 #include <s2e/Plugins/ModuleExecutionDetector.h>
 
 namespace s2e {
@@ -54,7 +55,8 @@ class TranslationBlockTracer : public Plugin
 {
     S2E_PLUGIN
 public:
-    TranslationBlockTracer(S2E* s2e): Plugin(s2e) {}
+    TranslationBlockTracer(S2E* s2e): Plugin(s2e), m_sampler(NULL) {}
+    virtual ~TranslationBlockTracer();
 
     void initialize(void);
 
@@ -66,6 +68,7 @@ public:
 private:
     ExecutionTracer *m_tracer;
     ModuleExecutionDetector *m_detector;
+    TraceSampler *m_sampler;
 
     sigc::connection m_tbStartConnection;
     sigc::connection m_tbEndConnection;
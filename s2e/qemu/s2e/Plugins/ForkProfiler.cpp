@@ -0,0 +1,380 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+#include "ForkProfiler.h"
+#include "ForkProfilerFormat.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(ForkProfiler, "Per-pc fork and solver time profile", "ForkProfiler");
+
+void ForkProfiler::initialize()
+{
+    //Optional, pcs are absolute without it
+    m_detector = (ModuleExecutionDetector*)s2e()->getPlugin("ModuleExecutionDetector");
+
+    m_interval = s2e()->getConfig()->getInt(getConfigKey() + ".interval", 10);
+    m_topCount = s2e()->getConfig()->getInt(getConfigKey() + ".topCount", 20);
+
+    m_startTime = time(NULL);
+    m_lastReport = m_startTime;
+
+    s2e()->getCorePlugin()->onBranchDecision.connect(
+            sigc::mem_fun(*this, &ForkProfiler::onBranchDecision));
+
+    s2e()->getCorePlugin()->onStateFork.connect(
+            sigc::mem_fun(*this, &ForkProfiler::onStateFork));
+
+    s2e()->getCorePlugin()->onStateKill.connect(
+            sigc::mem_fun(*this, &ForkProfiler::onStateKill));
+
+    s2e()->getCorePlugin()->onProcessFork.connect(
+            sigc::mem_fun(*this, &ForkProfiler::onProcessFork));
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &ForkProfiler::onTimer));
+}
+
+ForkProfiler::~ForkProfiler()
+{
+    writeProfile();
+    writeReport();
+}
+
+unsigned ForkProfiler::getSite(S2EExecutionState *state)
+{
+    uint64_t pc = state->getPc();
+    unsigned module = FORKPROFILE_NO_MODULE;
+
+    const ModuleDescriptor *desc = m_detector ? m_detector->getCurrentDescriptor(state) : NULL;
+    const std::string *id = desc ? m_detector->getModuleId(*desc) : NULL;
+    if (id) {
+        ModuleIndex::iterator it = m_moduleIndex.find(id);
+        if (it == m_moduleIndex.end()) {
+            it = m_moduleIndex.insert(std::make_pair(id, (unsigned) m_modules.size())).first;
+            m_modules.push_back(*id);
+        }
+        module = it->second;
+        pc = desc->ToNativeBase(pc);
+    }
+
+    SiteKey key(module, pc);
+    SiteIndex::iterator it = m_siteIndex.find(key);
+    if (it != m_siteIndex.end()) {
+        return it->second;
+    }
+
+    Site site;
+    memset(&site, 0, sizeof(site));
+    site.module = module;
+    site.pc = pc;
+
+    unsigned index = m_sites.size();
+    m_sites.push_back(site);
+    m_siteIndex[key] = index;
+    return index;
+}
+
+void ForkProfiler::onBranchDecision(S2EExecutionState *state, bool forked, double solverTime)
+{
+    Site &site = m_sites[getSite(state)];
+    ++site.decisions;
+    site.solverTime += solverTime;
+    if (forked) {
+        ++site.forks;
+    }
+}
+
+void ForkProfiler::onStateFork(S2EExecutionState *state,
+                               const std::vector<S2EExecutionState*> &newStates,
+                               const std::vector<klee::ref<klee::Expr> > &newConditions)
+{
+    unsigned index = getSite(state);
+    m_sites[index].states += newStates.size();
+
+    //The forking state takes one of the outcomes as well
+    foreach2(it, newStates.begin(), newStates.end()) {
+        DECLARE_PLUGINSTATE(ForkProfilerState, *it);
+        plgState->m_site = index;
+    }
+}
+
+void ForkProfiler::onStateKill(S2EExecutionState *state)
+{
+    DECLARE_PLUGINSTATE(ForkProfilerState, state);
+    if (plgState->m_site >= 0) {
+        ++m_sites[plgState->m_site].killed;
+    }
+}
+
+void ForkProfiler::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    if (preFork || !isChild) {
+        return;
+    }
+
+    //The parent keeps the history, so that the profiles of all
+    //processes can be added up. Sites stay allocated, states refer to them.
+    foreach2(it, m_sites.begin(), m_sites.end()) {
+        (*it).decisions = 0;
+        (*it).forks = 0;
+        (*it).states = 0;
+        (*it).killed = 0;
+        (*it).solverTime = 0;
+    }
+
+    m_startTime = time(NULL);
+    m_lastReport = m_startTime;
+}
+
+void ForkProfiler::onTimer()
+{
+    if (!m_interval) {
+        return;
+    }
+
+    uint64_t now = time(NULL);
+    if (now - m_lastReport < m_interval) {
+        return;
+    }
+
+    m_lastReport = now;
+    writeProfile();
+    writeReport();
+}
+
+void ForkProfiler::writeProfile()
+{
+    std::string fileName = s2e()->getOutputFilename("forkprofile.dat");
+    std::string tmpName = fileName + ".tmp";
+
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        s2e()->getWarningsStream() << "ForkProfiler: could not create "
+                << tmpName << std::endl;
+        return;
+    }
+
+    ForkProfileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = FORKPROFILE_MAGIC;
+    hdr.version = FORKPROFILE_VERSION;
+    hdr.moduleCount = m_modules.size();
+    hdr.elapsed = time(NULL) - m_startTime;
+
+    foreach2(it, m_sites.begin(), m_sites.end()) {
+        if ((*it).decisions) {
+            ++hdr.siteCount;
+        }
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+    foreach2(it, m_modules.begin(), m_modules.end()) {
+        ForkProfileModule mod;
+        memset(&mod, 0, sizeof(mod));
+        strncpy(mod.name, (*it).c_str(), sizeof(mod.name) - 1);
+        ok &= fwrite(&mod, sizeof(mod), 1, fp) == 1;
+    }
+
+    foreach2(it, m_sites.begin(), m_sites.end()) {
+        const Site &site = *it;
+        if (!site.decisions) {
+            continue;
+        }
+
+        ForkProfileSite s;
+        s.module = site.module;
+        s.pc = site.pc;
+        s.decisions = site.decisions;
+        s.forks = site.forks;
+        s.states = site.states;
+        s.killed = site.killed;
+        s.solverTime = (uint64_t) (site.solverTime * 1000000.0);
+        ok &= fwrite(&s, sizeof(s), 1, fp) == 1;
+    }
+
+    ok &= fclose(fp) == 0;
+
+    if (!ok || rename(tmpName.c_str(), fileName.c_str()) < 0) {
+        s2e()->getWarningsStream() << "ForkProfiler: could not write "
+                << fileName << std::endl;
+        unlink(tmpName.c_str());
+    }
+}
+
+namespace {
+struct BySolverTime {
+    const std::vector<ForkProfiler::Site> &sites;
+    BySolverTime(const std::vector<ForkProfiler::Site> &s) : sites(s) {}
+    bool operator()(unsigned a, unsigned b) const {
+        return sites[a].solverTime > sites[b].solverTime;
+    }
+};
+
+struct ByForks {
+    const std::vector<ForkProfiler::Site> &sites;
+    ByForks(const std::vector<ForkProfiler::Site> &s) : sites(s) {}
+    bool operator()(unsigned a, unsigned b) const {
+        if (sites[a].forks != sites[b].forks) {
+            return sites[a].forks > sites[b].forks;
+        }
+        return sites[a].killed > sites[b].killed;
+    }
+};
+}
+
+template <typename Order>
+static void printTopSites(std::ostream &os, const std::vector<ForkProfiler::Site> &sites,
+                          const std::vector<std::string> &modules,
+                          std::vector<unsigned> &order, unsigned count)
+{
+    if (count > order.size()) {
+        count = order.size();
+    }
+
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), Order(sites));
+
+    os << std::setw(24) << std::left << "Module" << std::right
+       << std::setw(12) << "Pc"
+       << std::setw(12) << "Decisions"
+       << std::setw(10) << "Forks"
+       << std::setw(10) << "States"
+       << std::setw(10) << "Killed"
+       << std::setw(12) << "Solver(s)" << std::endl;
+
+    for (unsigned i = 0; i < count; ++i) {
+        const ForkProfiler::Site &site = sites[order[i]];
+        std::string module = site.module == FORKPROFILE_NO_MODULE ? "-" : modules[site.module];
+
+        std::stringstream pc;
+        pc << "0x" << std::hex << site.pc;
+
+        os << std::setw(24) << std::left << module << std::right
+           << std::setw(12) << pc.str()
+           << std::setw(12) << site.decisions
+           << std::setw(10) << site.forks
+           << std::setw(10) << site.states
+           << std::setw(10) << site.killed
+           << std::setw(12) << std::fixed << std::setprecision(3) << site.solverTime
+           << std::endl;
+    }
+}
+
+void ForkProfiler::writeReport()
+{
+    std::string fileName = s2e()->getOutputFilename("forkprofile.txt");
+    std::string tmpName = fileName + ".tmp";
+
+    std::vector<unsigned> order;
+    uint64_t forks = 0;
+    double solverTime = 0;
+
+    for (unsigned i = 0; i < m_sites.size(); ++i) {
+        if (!m_sites[i].decisions) {
+            continue;
+        }
+        order.push_back(i);
+        forks += m_sites[i].forks;
+        solverTime += m_sites[i].solverTime;
+    }
+
+    {
+        std::ofstream os(tmpName.c_str());
+        if (!os) {
+            s2e()->getWarningsStream() << "ForkProfiler: could not create "
+                    << tmpName << std::endl;
+            return;
+        }
+
+        os << "Fork profile after " << (time(NULL) - m_startTime) << " seconds: "
+           << forks << " forks at " << order.size() << " branches, "
+           << std::fixed << std::setprecision(3) << solverTime << " seconds in the solver"
+           << std::endl
+           << "Pcs are relative to the native load base of the modules" << std::endl
+           << std::endl;
+
+        os << "Top " << m_topCount << " branches by solver time" << std::endl;
+        printTopSites<BySolverTime>(os, m_sites, m_modules, order, m_topCount);
+        os << std::endl;
+
+        os << "Top " << m_topCount << " branches by forks" << std::endl;
+        printTopSites<ByForks>(os, m_sites, m_modules, order, m_topCount);
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) < 0) {
+        s2e()->getWarningsStream() << "ForkProfiler: could not write "
+                << fileName << std::endl;
+        unlink(tmpName.c_str());
+    }
+}
+
+ForkProfilerState::ForkProfilerState()
+{
+    m_site = -1;
+}
+
+ForkProfilerState::~ForkProfilerState()
+{
+
+}
+
+PluginState *ForkProfilerState::clone() const
+{
+    return new ForkProfilerState(*this);
+}
+
+PluginState *ForkProfilerState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new ForkProfilerState();
+}
+
+} // namespace plugins
+} // namespace s2e
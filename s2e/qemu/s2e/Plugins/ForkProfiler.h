@@ -0,0 +1,135 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_FORKPROFILER_H
+#define S2E_PLUGINS_FORKPROFILER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Keeps per-pc counters of the symbolic branches decided by the
+ *  current S2E process: how many forked, how many states they created,
+ *  how many of these states were later killed, and how much solver time
+ *  was spent deciding them. The counters are periodically written to
+ *  forkprofile.dat and summarized in forkprofile.txt, which helps finding
+ *  the branches worth annotating with EdgeKiller or concretizing.
+ */
+class ForkProfiler : public Plugin
+{
+    S2E_PLUGIN
+public:
+    ForkProfiler(S2E* s2e): Plugin(s2e) {}
+    virtual ~ForkProfiler();
+
+    void initialize();
+
+    struct Site {
+        unsigned module;
+        uint64_t pc;
+        uint64_t decisions;
+        uint64_t forks;
+        uint64_t states;
+        uint64_t killed;
+        double solverTime;
+    };
+
+private:
+    ModuleExecutionDetector *m_detector;
+
+    typedef std::pair<unsigned, uint64_t> SiteKey;
+    typedef std::map<SiteKey, unsigned> SiteIndex;
+    typedef std::map<const std::string*, unsigned> ModuleIndex;
+
+    //Module ids are copied, the detector may be gone when the final
+    //report is written
+    std::vector<std::string> m_modules;
+    ModuleIndex m_moduleIndex;
+
+    std::vector<Site> m_sites;
+    SiteIndex m_siteIndex;
+
+    unsigned m_interval;
+    unsigned m_topCount;
+    uint64_t m_startTime;
+    uint64_t m_lastReport;
+
+    unsigned getSite(S2EExecutionState *state);
+
+    void onBranchDecision(S2EExecutionState *state, bool forked, double solverTime);
+
+    void onStateFork(S2EExecutionState *state,
+                     const std::vector<S2EExecutionState*> &newStates,
+                     const std::vector<klee::ref<klee::Expr> > &newConditions);
+
+    void onStateKill(S2EExecutionState *state);
+
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+
+    void onTimer();
+
+    void writeProfile();
+    void writeReport();
+};
+
+class ForkProfilerState : public PluginState
+{
+private:
+    //Site of the fork the state comes from, -1 for the initial state
+    int m_site;
+
+public:
+    ForkProfilerState();
+    virtual ~ForkProfilerState();
+    virtual PluginState *clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class ForkProfiler;
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_FORKPROFILERFORMAT_H
+#define S2E_PLUGINS_FORKPROFILERFORMAT_H
+
+#include <inttypes.h>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Fork profile (ForkProfiler plugin).
+ *  The file contains a ForkProfileHeader, moduleCount ForkProfileModule
+ *  entries, and siteCount ForkProfileSite entries.
+ *  Each S2E process writes the sites that branched since it was started,
+ *  so that the profiles of all processes can be added up.
+ */
+#define FORKPROFILE_MAGIC 0x464f525046453253ULL /* "S2EFPROF" */
+#define FORKPROFILE_VERSION 1
+#define FORKPROFILE_MODULE_NAME_SIZE 64
+#define FORKPROFILE_NO_MODULE 0xffffffff
+
+struct ForkProfileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t moduleCount;
+    uint64_t siteCount;
+    //Seconds elapsed since the plugin was initialized
+    uint64_t elapsed;
+}__attribute__((packed));
+
+struct ForkProfileModule {
+    //Module id, as configured in ModuleExecutionDetector
+    char name[FORKPROFILE_MODULE_NAME_SIZE];
+}__attribute__((packed));
+
+struct ForkProfileSite {
+    uint32_t module;
+    //Relative to the native load base of the module,
+    //absolute if module is FORKPROFILE_NO_MODULE
+    uint64_t pc;
+    //Symbolic branches decided at this pc
+    uint64_t decisions;
+    //Decisions where more than one outcome was feasible
+    uint64_t forks;
+    //States that left the forks, including the forking ones
+    uint64_t states;
+    //States terminated before forking again
+    uint64_t killed;
+    //Solver time spent deciding the branches, in microseconds
+    uint64_t solverTime;
+}__attribute__((packed));
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -68,6 +68,10 @@ void FunctionMonitor::initialize()
 #endif
 
     m_monitor = static_cast<OSMonitor*>(s2e()->getPlugin("Interceptor"));
+    if (m_monitor) {
+        m_monitor->onProcessUnload.connect(
+                sigc::mem_fun(*this, &FunctionMonitor::onProcessUnload));
+    }
 }
 
 //XXX: Implement onmoduleunload to automatically clear all call signals
@@ -117,12 +121,10 @@ void FunctionMonitor::disconnect(S2EExecutionState *state, const ModuleDescripto
     return plgState->disconnect(desc);
 }
 
-//See notes for slotRet to see how to use this function.
+//See notes for popReturnSignals to see how to use this function.
 void FunctionMonitor::eraseSp(S2EExecutionState *state, uint64_t pc)
 {
-    DECLARE_PLUGINSTATE(FunctionMonitorState, state);
-
-    return plgState->slotRet(state, pc, false);
+    popReturnSignals(state, pc, false);
 }
 
 void FunctionMonitor::registerReturnSignal(S2EExecutionState *state, FunctionMonitor::ReturnSignal &sig)
@@ -134,9 +136,79 @@ void FunctionMonitor::registerReturnSignal(S2EExecutionState *state, FunctionMon
 
 void FunctionMonitor::slotRet(S2EExecutionState *state, uint64_t pc)
 {
+    popReturnSignals(state, pc, true);
+}
+
+//The calls of the threads of the process will never return
+void FunctionMonitor::onProcessUnload(S2EExecutionState *state, uint64_t pid)
+{
+    {
+        DECLARE_PLUGINSTATE_CONST(FunctionMonitorState, state);
+        if (plgState->m_shadowStacks.empty()) {
+            return;
+        }
+    }
+
     DECLARE_PLUGINSTATE(FunctionMonitorState, state);
+    plgState->discardProcess(pid);
+}
+
+/**
+ *  When emitSignal is false, this function simply removes all the return descriptors
+ * for the current stack pointer. This can be used when a return handler manually changes the
+ * program counter and/or wants to exit to the cpu loop and avoid being called again.
+ *
+ *  Note: all the return handlers will be erased if emitSignal is false, not just the one
+ * that issued the call. Also note that it not possible to return from the handler normally
+ * whenever this function is called from within a return handler.
+ */
+void FunctionMonitor::popReturnSignals(S2EExecutionState *state, uint64_t pc, bool emitSignal)
+{
+    target_ulong esp;
+    bool ok = state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_ESP]),
+                                             &esp, sizeof(target_ulong));
+    if(!ok) {
+        s2e()->getWarningsStream(state)
+            << "Function return with symbolic ESP!" << std::endl
+            << "  EIP=" << hexval(state->getPc()) << " CR3=" << hexval(state->getPid()) << std::endl;
+        return;
+    }
 
-    return plgState->slotRet(state, pc, true);
+    uint64_t pid = state->getPid();
+    if (m_monitor) {
+        pid = m_monitor->getPid(state, pc);
+    }
+
+    bool staleFrames;
+    {
+        //Most returns have no handler, do not copy a shared plugin state for them
+        DECLARE_PLUGINSTATE_CONST(FunctionMonitorState, state);
+        staleFrames = plgState->hasStaleFrames(pid, esp);
+        if (!staleFrames && !plgState->hasReturnSignals(pid, esp)) {
+            return;
+        }
+    }
+
+    if (staleFrames) {
+        DECLARE_PLUGINSTATE(FunctionMonitorState, state);
+        plgState->discardStaleFrames(pid, esp);
+    }
+
+    //Handlers may fork, get the plugin state of the state again for each of them
+    while (true) {
+        DECLARE_PLUGINSTATE(FunctionMonitorState, state);
+        FunctionMonitorState::ReturnDescriptor *rd = plgState->getReturnDescriptor(pid, esp);
+        if (!rd) {
+            break;
+        }
+
+        FunctionMonitor::ReturnSignal signal(rd->signal);
+        plgState->popReturnDescriptor(pid, esp);
+
+        if (emitSignal) {
+            signal.emit(state);
+        }
+    }
 }
 
 #if 0
@@ -166,16 +238,31 @@ FunctionMonitorState::FunctionMonitorState()
 
 }
 
-FunctionMonitorState::~FunctionMonitorState()
+FunctionMonitorState::FunctionMonitorState(const FunctionMonitorState &other) :
+    PluginState(other),
+    m_callDescriptors(other.m_callDescriptors),
+    m_newCallDescriptors(other.m_newCallDescriptors),
+    m_shadowStacks(other.m_shadowStacks),
+    m_plugin(other.m_plugin)
 {
+    //The stacks are copied when one of the states modifies them
+    foreach2(it, m_shadowStacks.begin(), m_shadowStacks.end()) {
+        ++(*it).second->refCount;
+    }
+}
 
+FunctionMonitorState::~FunctionMonitorState()
+{
+    foreach2(it, m_shadowStacks.begin(), m_shadowStacks.end()) {
+        releaseStack((*it).second);
+    }
 }
 
 FunctionMonitorState* FunctionMonitorState::clone() const
 {
     FunctionMonitorState *ret = new FunctionMonitorState(*this);
     m_plugin->s2e()->getDebugStream() << "Forking FunctionMonitorState ret=" << std::hex << ret << std::endl;
-    assert(ret->m_returnDescriptors.size() == m_returnDescriptors.size());
+    assert(ret->m_shadowStacks.size() == m_shadowStacks.size());
     return ret;
 }
 
@@ -281,62 +368,146 @@ void FunctionMonitorState::registerReturnSignal(S2EExecutionState *state, Functi
     if (m_plugin->m_monitor) {
         pid = m_plugin->m_monitor->getPid(state, state->getPc());
     }
-    ReturnDescriptor descriptor = {pid, sig };
-    m_returnDescriptors.insert(std::make_pair(esp, descriptor));
+    //Handlers that fork may pass the plugin state of the original state,
+    //make sure the descriptor goes to the plugin state of the target state.
+    DECLARE_PLUGINSTATE_P(m_plugin, FunctionMonitorState, state);
+
+    plgState->pushReturnSignal(pid, esp, sig);
+}
+
+FunctionMonitorState::ShadowStackKey FunctionMonitorState::getStackKey(uint64_t pid, uint64_t esp)
+{
+    return FunctionMonitorState::ShadowStackKey(pid, esp >> TARGET_PAGE_BITS);
+}
+
+void FunctionMonitorState::pushReturnSignal(uint64_t pid, uint64_t esp,
+                                            FunctionMonitor::ReturnSignal &sig)
+{
+    ShadowStack *&stack = m_shadowStacks[getStackKey(pid, esp)];
+    if (!stack) {
+        stack = new ShadowStack();
+        stack->refCount = 1;
+    } else if (stack->refCount > 1) {
+        --stack->refCount;
+        stack = new ShadowStack(*stack);
+        stack->refCount = 1;
+    }
+
+    ReturnDescriptor descriptor = {esp, sig};
+    stack->frames.push_back(descriptor);
+}
+
+void FunctionMonitorState::releaseStack(ShadowStack *stack)
+{
+    if (--stack->refCount == 0) {
+        delete stack;
+    }
+}
+
+bool FunctionMonitorState::hasReturnSignals(uint64_t pid, uint64_t esp) const
+{
+    if (m_shadowStacks.empty()) {
+        return false;
+    }
+
+    ShadowStacks::const_iterator it = m_shadowStacks.find(getStackKey(pid, esp));
+    if (it == m_shadowStacks.end()) {
+        return false;
+    }
+
+    //The stack grows down: deeper frames are either this call or abandoned
+    const ShadowStack *stack = (*it).second;
+    return !stack->frames.empty() && stack->frames.back().esp <= esp;
+}
+
+bool FunctionMonitorState::hasStaleFrames(uint64_t pid, uint64_t esp) const
+{
+    if (m_shadowStacks.empty() || (esp >> TARGET_PAGE_BITS) == 0) {
+        return false;
+    }
+
+    return m_shadowStacks.count(getStackKey(pid, esp - TARGET_PAGE_SIZE)) != 0;
 }
 
 /**
- *  When emitSignal is false, this function simply removes all the return descriptors
- * for the current stack pointer. This can be used when a return handler manually changes the
- * program counter and/or wants to exit to the cpu loop and avoid being called again.
- *
- *  Note: all the return handlers will be erased if emitSignal is false, not just the one
- * that issued the call. Also note that it not possible to return from the handler normally
- * whenever this function is called from within a return handler.
+ *  Discards the stacks of the pages below esp, down to the first page
+ *  without return descriptors. These calls were abandoned on the way
+ *  to a frame of a higher page, e.g., by an exception.
  */
-void FunctionMonitorState::slotRet(S2EExecutionState *state, uint64_t pc, bool emitSignal)
+void FunctionMonitorState::discardStaleFrames(uint64_t pid, uint64_t esp)
 {
-    target_ulong cr3 = state->readCpuState(CPU_OFFSET(cr[3]), 8*sizeof(target_ulong));
+    while ((esp >> TARGET_PAGE_BITS) != 0) {
+        esp -= TARGET_PAGE_SIZE;
+        ShadowStacks::iterator it = m_shadowStacks.find(getStackKey(pid, esp));
+        if (it == m_shadowStacks.end()) {
+            break;
+        }
+        releaseStack((*it).second);
+        m_shadowStacks.erase(it);
+    }
+}
 
-    target_ulong esp;
-    bool ok = state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_ESP]),
-                                             &esp, sizeof(target_ulong));
-    if(!ok) {
-        target_ulong eip = state->readCpuState(CPU_OFFSET(eip),
-                                               8*sizeof(target_ulong));
-        m_plugin->s2e()->getWarningsStream(state)
-            << "Function return with symbolic ESP!" << std::endl
-            << "  EIP=" << hexval(eip) << " CR3=" << hexval(cr3) << std::endl;
-        return;
+void FunctionMonitorState::discardProcess(uint64_t pid)
+{
+    ShadowStacks::iterator it = m_shadowStacks.begin();
+    while (it != m_shadowStacks.end()) {
+        if ((*it).first.first == pid) {
+            releaseStack((*it).second);
+            m_shadowStacks.erase(it++);
+        } else {
+            ++it;
+        }
     }
+}
 
-    if (m_returnDescriptors.empty()) {
-        return;
+FunctionMonitorState::ReturnDescriptor *FunctionMonitorState::getReturnDescriptor(
+        uint64_t pid, uint64_t esp)
+{
+    ShadowStacks::iterator it = m_shadowStacks.find(getStackKey(pid, esp));
+    if (it == m_shadowStacks.end()) {
+        return NULL;
     }
 
-    //m_plugin->s2e()->getDebugStream() << "ESP AT RETURN 0x" << std::hex << esp <<
-    //        " plgstate=0x" << this << " EmitSignal=" << emitSignal <<  std::endl;
+    ShadowStack *stack = (*it).second;
+    if (stack->frames.empty() || stack->frames.back().esp > esp) {
+        return NULL;
+    }
 
-    bool finished = true;
-    do {
-        finished = true;
-        std::pair<ReturnDescriptorsMap::iterator, ReturnDescriptorsMap::iterator>
-                range = m_returnDescriptors.equal_range(esp);
-        for(ReturnDescriptorsMap::iterator it = range.first; it != range.second; ++it) {
-            if (m_plugin->m_monitor) {
-                cr3 = m_plugin->m_monitor->getPid(state, pc);
-            }
+    if (stack->refCount > 1) {
+        --stack->refCount;
+        stack = new ShadowStack(*stack);
+        stack->refCount = 1;
+        (*it).second = stack;
+    }
 
-            if(it->second.cr3 == cr3) {
-                if (emitSignal) {
-                    it->second.signal.emit(state);
-                }
-                m_returnDescriptors.erase(it);
-                finished = false;
-                break;
-            }
-        }
-    } while(!finished);
+    //Calls left without a return, e.g., by exceptions
+    while (!stack->frames.empty() && stack->frames.back().esp < esp) {
+        stack->frames.pop_back();
+    }
+
+    if (stack->frames.empty()) {
+        delete stack;
+        m_shadowStacks.erase(it);
+        return NULL;
+    }
+
+    return stack->frames.back().esp == esp ? &stack->frames.back() : NULL;
+}
+
+void FunctionMonitorState::popReturnDescriptor(uint64_t pid, uint64_t esp)
+{
+    ShadowStacks::iterator it = m_shadowStacks.find(getStackKey(pid, esp));
+    assert(it != m_shadowStacks.end());
+
+    ShadowStack *stack = (*it).second;
+    assert(stack->refCount == 1 && !stack->frames.empty());
+    assert(stack->frames.back().esp == esp);
+
+    stack->frames.pop_back();
+    if (stack->frames.empty()) {
+        delete stack;
+        m_shadowStacks.erase(it);
+    }
 }
 
 void FunctionMonitorState::disconnect(const ModuleDescriptor &desc, CallDescriptorsMap &descMap)
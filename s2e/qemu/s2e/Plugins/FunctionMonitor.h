@@ -43,6 +43,7 @@
 #include <s2e/Plugins/OSMonitor.h>
 
 #include <tr1/unordered_map>
+#include <vector>
 
 namespace s2e {
 namespace plugins {
@@ -81,6 +82,10 @@ protected:
     void slotCall(S2EExecutionState* state, uint64_t pc);
     void slotRet(S2EExecutionState* state, uint64_t pc);
 
+    void popReturnSignals(S2EExecutionState *state, uint64_t pc, bool emitSignal);
+
+    void onProcessUnload(S2EExecutionState *state, uint64_t pid);
+
     void slotTraceCall(S2EExecutionState *state, FunctionMonitorState *fns);
     void slotTraceRet(S2EExecutionState *state, int f);
 
@@ -101,17 +106,40 @@ class FunctionMonitorState : public PluginState
     };
 
     struct ReturnDescriptor {
-        //S2EExecutionState *state;
-        uint64_t cr3;
+        //Stack pointer at the call, which the return must match
+        uint64_t esp;
         // TODO: add sourceModuleID and targetModuleID
         FunctionMonitor::ReturnSignal signal;
     };
+
+    /** Return descriptors of the calls made on one stack page, innermost
+        call last. A stack page belongs to one thread, so the calls return
+        in the reverse order of the pushes, except for those abandoned by
+        exceptions or longjmp. The page below the one of a return belongs to
+        the same thread (thread stacks are separated by guard pages), its
+        frames are deeper and are discarded by the return. Stacks are shared
+        by the forked states and copied by the first one that modifies them. */
+    struct ShadowStack {
+        unsigned refCount;
+        std::vector<ReturnDescriptor> frames;
+    };
+
+    /* Address space and stack page */
+    typedef std::pair<uint64_t, uint64_t> ShadowStackKey;
+
+    struct ShadowStackKeyHash {
+        size_t operator()(const ShadowStackKey &key) const {
+            return (size_t) (key.first * 0x9E3779B97F4A7C15ULL ^ key.second);
+        }
+    };
+
     typedef std::tr1::unordered_multimap<uint64_t, CallDescriptor> CallDescriptorsMap;
-    typedef std::tr1::unordered_multimap<uint64_t, ReturnDescriptor> ReturnDescriptorsMap;
+    typedef std::tr1::unordered_map<ShadowStackKey, ShadowStack*,
+                                    ShadowStackKeyHash> ShadowStacks;
 
     CallDescriptorsMap m_callDescriptors;
     CallDescriptorsMap m_newCallDescriptors;
-    ReturnDescriptorsMap m_returnDescriptors;
+    ShadowStacks m_shadowStacks;
 
     FunctionMonitor *m_plugin;
 
@@ -120,14 +148,39 @@ class FunctionMonitorState : public PluginState
     FunctionMonitor::CallSignal* getCallSignal(uint64_t eip, uint64_t cr3 = 0);
 
     void slotCall(S2EExecutionState *state, uint64_t pc);
-    void slotRet(S2EExecutionState *state, uint64_t pc, bool emitSignal);
+
+    static ShadowStackKey getStackKey(uint64_t pid, uint64_t esp);
+
+    void pushReturnSignal(uint64_t pid, uint64_t esp, FunctionMonitor::ReturnSignal &sig);
+
+    static void releaseStack(ShadowStack *stack);
+
+    /** Whether a return at esp would pop or discard return descriptors */
+    bool hasReturnSignals(uint64_t pid, uint64_t esp) const;
+
+    /** Whether the stack page below esp has return descriptors, which a
+        return at esp abandons */
+    bool hasStaleFrames(uint64_t pid, uint64_t esp) const;
+    void discardStaleFrames(uint64_t pid, uint64_t esp);
+
+    void discardProcess(uint64_t pid);
+
+    /** Discards the descriptors of the calls abandoned below esp and
+        returns the innermost descriptor of the call made at esp, if any */
+    ReturnDescriptor *getReturnDescriptor(uint64_t pid, uint64_t esp);
+    void popReturnDescriptor(uint64_t pid, uint64_t esp);
 
     void disconnect(const ModuleDescriptor &desc, CallDescriptorsMap &descMap);
     void disconnect(const ModuleDescriptor &desc);
+
+    FunctionMonitorState &operator=(const FunctionMonitorState &);
 public:
     FunctionMonitorState();
+    FunctionMonitorState(const FunctionMonitorState &other);
     virtual ~FunctionMonitorState();
     virtual FunctionMonitorState* clone() const;
+    //slotCall passes this object to call handlers, which may fork
+    virtual bool isClonedOnFork() const { return true; }
     static PluginState *factory(Plugin *p, S2EExecutionState *s);
 
     void registerReturnSignal(S2EExecutionState *s, FunctionMonitor::ReturnSignal &sig);
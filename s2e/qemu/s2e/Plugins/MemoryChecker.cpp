@@ -206,16 +206,34 @@ void MemoryChecker::onModuleTransition(S2EExecutionState *state,
 {
     DECLARE_PLUGINSTATE(MemoryCheckerState, state);
 
+    CorePlugin *core = s2e()->getCorePlugin();
+
     if(nextModule && nextModule->LoadBase == plgState->m_module.LoadBase) {
-        m_dataMemoryAccessConnection = s2e()->getCorePlugin()
-            ->onDataMemoryAccess.connect(
-                sigc::mem_fun(*this, &MemoryChecker::onDataMemoryAccess));
+        //Outside of the module, accesses do not leave the softmmu helpers
+        core->watchDataMemory(this, 0, (uint64_t) -1);
+        m_dataMemoryAccessConnection = core->onConcreteDataMemoryAccess(this).connect(
+                sigc::mem_fun(*this, &MemoryChecker::onConcreteDataMemoryAccess));
+        m_symbolicMemoryAccessConnection = core->onSymbolicDataMemoryAccess.connect(
+                sigc::mem_fun(*this, &MemoryChecker::onSymbolicDataMemoryAccess));
     } else {
         m_dataMemoryAccessConnection.disconnect();
+        m_symbolicMemoryAccessConnection.disconnect();
+        core->unwatchDataMemory(this);
     }
 }
 
-void MemoryChecker::onDataMemoryAccess(S2EExecutionState *state,
+void MemoryChecker::onConcreteDataMemoryAccess(S2EExecutionState *state,
+                                               uint64_t virtualAddress,
+                                               uint64_t hostAddress,
+                                               uint64_t value, unsigned size,
+                                               bool isWrite, bool isIO)
+{
+    DECLARE_PLUGINSTATE(MemoryCheckerState, state);
+    checkMemoryAccess(state, &plgState->m_module, virtualAddress,
+                      size, isWrite ? 2 : 1);
+}
+
+void MemoryChecker::onSymbolicDataMemoryAccess(S2EExecutionState *state,
                                        klee::ref<klee::Expr> virtualAddress,
                                        klee::ref<klee::Expr> hostAddress,
                                        klee::ref<klee::Expr> value,
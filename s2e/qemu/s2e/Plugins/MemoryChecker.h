@@ -71,6 +71,7 @@ class MemoryChecker : public Plugin
     bool m_terminateOnErrors;
 
     sigc::connection m_dataMemoryAccessConnection;
+    sigc::connection m_symbolicMemoryAccessConnection;
 
     void onModuleLoad(S2EExecutionState* state,
                       const ModuleDescriptor &module);
@@ -82,7 +83,12 @@ class MemoryChecker : public Plugin
                             const ModuleDescriptor *prevModule,
                             const ModuleDescriptor *nextModule);
 
-    void onDataMemoryAccess(S2EExecutionState *state,
+    void onConcreteDataMemoryAccess(S2EExecutionState *state,
+                 uint64_t virtualAddress, uint64_t hostAddress,
+                 uint64_t value, unsigned size,
+                 bool isWrite, bool isIO);
+
+    void onSymbolicDataMemoryAccess(S2EExecutionState *state,
                  klee::ref<klee::Expr> virtualAddress,
                  klee::ref<klee::Expr> hostAddress,
                  klee::ref<klee::Expr> value,
@@ -103,14 +103,19 @@ void ModuleExecutionDetector::initialize()
         )
     );
 
-    s2e()->getCorePlugin()->onTranslateBlockStart.connect(
+    //Only the code of the tracked modules needs to be instrumented.
+    //The address ranges are subscribed as the modules get loaded.
+    CorePlugin::TranslationSignals &translation =
+            s2e()->getCorePlugin()->getTranslationSignals(this);
+
+    translation.onTranslateBlockStart.connect(
         sigc::mem_fun(
             *this,
             &ModuleExecutionDetector::onTranslateBlockStart
         )
     );
 
-    s2e()->getCorePlugin()->onTranslateBlockEnd.connect(
+    translation.onTranslateBlockEnd.connect(
             sigc::mem_fun(
                 *this,
                 &ModuleExecutionDetector::onTranslateBlockEnd
@@ -215,6 +220,7 @@ void ModuleExecutionDetector::moduleLoadListener(
         }else {
             s2e()->getDebugStream() << " [REGISTERING]" << std::endl;
             plgState->loadDescriptor(module, true);
+            subscribeModule(module);
             onModuleLoad.emit(state, module);
         }
         return;
@@ -227,6 +233,7 @@ void ModuleExecutionDetector::moduleLoadListener(
         }else {
             s2e()->getDebugStream() << " [REGISTERING ID=" << (*it).id << "]" << std::endl;
             plgState->loadDescriptor(module, true);
+            subscribeModule(module);
             onModuleLoad.emit(state, module);
         }
         return;
@@ -246,6 +253,24 @@ void ModuleExecutionDetector::moduleLoadListener(
 
 
 
+}
+
+//The subscriptions are never removed: the descriptors are per-state and
+//other states may still have the module loaded. The translation handlers
+//look up the descriptors of the current state anyway.
+void ModuleExecutionDetector::subscribeModule(const ModuleDescriptor &module)
+{
+    if (module.Size == 0) {
+        return;
+    }
+
+    AddressRange range(module.LoadBase, module.LoadBase + module.Size - 1);
+    if (!m_SubscribedRanges.insert(range).second) {
+        return;
+    }
+
+    s2e()->getCorePlugin()->subscribeTranslation(this, range.first, range.second,
+        CorePlugin::TRANSLATE_BLOCK_START | CorePlugin::TRANSLATE_BLOCK_END);
 }
 
 void ModuleExecutionDetector::moduleUnloadListener(
@@ -418,9 +443,11 @@ void ModuleExecutionDetector::onExecution(
             DPRINTF("Entered unknown module\n");
         }
 #endif
-        onModuleTransition.emit(state, plgState->m_PreviousModule, currentModule);
-
+        //Update the state first, the handlers may fork
+        const ModuleDescriptor *previousModule = plgState->m_PreviousModule;
         plgState->m_PreviousModule = currentModule;
+
+        onModuleTransition.emit(state, previousModule, currentModule);
     }
 }
 
@@ -145,7 +145,11 @@ private:
     bool m_TrackAllModules;
     bool m_ConfigureAllModules;
 
+    typedef std::pair<uint64_t, uint64_t> AddressRange;
+    std::set<AddressRange> m_SubscribedRanges;
+
     void initializeConfiguration();
+    void subscribeModule(const ModuleDescriptor &module);
 public:
     ModuleExecutionDetector(S2E* s2e): Plugin(s2e) {}
     virtual ~ModuleExecutionDetector();
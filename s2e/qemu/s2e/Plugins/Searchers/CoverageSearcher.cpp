@@ -0,0 +1,352 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+extern "C" {
+#include "config.h"
+#include "qemu-common.h"
+}
+
+#include "CoverageSearcher.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+#include <s2e/S2EExecutor.h>
+
+#include <iostream>
+#include <deque>
+#include <sys/time.h>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(CoverageSearcher, "Prioritizes states that are close to code not covered by any S2E process",
+                  "CoverageSearcher", "ModuleExecutionDetector", "TranslationBlockCoverage");
+
+//Maximum length of an x86 instruction
+#define COVSEARCHER_MAX_INSTRUCTION_SIZE 15
+
+static uint64_t getTimeStampMilliseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void CoverageSearcher::initialize()
+{
+    m_detector = static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
+    m_coverage = static_cast<TranslationBlockCoverage*>(s2e()->getPlugin("TranslationBlockCoverage"));
+
+    m_searcherInited = false;
+    m_parentSearcher = NULL;
+    m_cfgChanged = false;
+    m_coveredBlocks = 0;
+    m_lastUpdate = 0;
+    m_selectionsWithoutProgress = 0;
+
+    //Minimum time between two recomputations of the distances, in milliseconds
+    m_updateInterval = s2e()->getConfig()->getInt(getConfigKey() + ".updateInterval", 1000);
+
+    //States farther away from uncovered code are left to the default searcher
+    m_maxDistance = s2e()->getConfig()->getInt(getConfigKey() + ".maxDistance", 64);
+
+    //Number of selections without new coverage before falling back to the default searcher
+    m_patience = s2e()->getConfig()->getInt(getConfigKey() + ".patience", 1000);
+
+    m_detector->onModuleTranslateBlockEnd.connect(
+            sigc::mem_fun(*this, &CoverageSearcher::onModuleTranslateBlockEnd));
+}
+
+void CoverageSearcher::initializeSearcher()
+{
+    if (m_searcherInited) {
+        return;
+    }
+
+    m_parentSearcher = s2e()->getExecutor()->getSearcher();
+    assert(m_parentSearcher);
+    s2e()->getExecutor()->setSearcher(this);
+    m_searcherInited = true;
+
+    //The states created so far were only given to the parent searcher
+    const std::set<klee::ExecutionState*> &states = s2e()->getExecutor()->getStates();
+    foreach2(it, states.begin(), states.end()) {
+        m_states.insert(static_cast<S2EExecutionState*>(*it));
+    }
+}
+
+unsigned CoverageSearcher::getModuleId(const ModuleDescriptor &module)
+{
+    std::map<std::string, unsigned>::iterator it = m_moduleIds.find(module.Name);
+    if (it != m_moduleIds.end()) {
+        return (*it).second;
+    }
+
+    unsigned id = m_modules.size();
+    m_modules.push_back(Module());
+    m_modules.back().descriptor = module;
+    m_moduleIds[module.Name] = id;
+    return id;
+}
+
+/**
+ *  Builds the control flow graph of the modules as their code gets translated.
+ *  Each translated block has an edge to its static target, if any.
+ *  Fall-through edges are added when computing the distances.
+ */
+void CoverageSearcher::onModuleTranslateBlockEnd(
+    ExecutionSignal *signal,
+    S2EExecutionState* state,
+    const ModuleDescriptor &module,
+    TranslationBlock *tb,
+    uint64_t endPc,
+    bool staticTarget,
+    uint64_t targetPc)
+{
+    initializeSearcher();
+
+    Module &m = m_modules[getModuleId(module)];
+    if (!m.descriptor.Contains(tb->pc)) {
+        return;
+    }
+
+    Block &block = m.blocks[tb->pc - m.descriptor.LoadBase];
+    block.lastInstruction = endPc - m.descriptor.LoadBase;
+    block.targets.clear();
+    if (staticTarget && m.descriptor.Contains(targetPc)) {
+        block.targets.push_back(targetPc - m.descriptor.LoadBase);
+    }
+
+    m_cfgChanged = true;
+}
+
+/**
+ *  Breadth-first search from the uncovered blocks along the reversed
+ *  edges of the graph. Static targets that were never translated count
+ *  as uncovered blocks.
+ */
+void CoverageSearcher::computeDistances(Module &module)
+{
+    std::map<uint64_t, unsigned> nodeIds;
+    std::vector<uint64_t> nodes;
+    std::vector<std::vector<unsigned> > predecessors;
+
+    foreach2(it, module.blocks.begin(), module.blocks.end()) {
+        nodeIds[(*it).first] = nodes.size();
+        nodes.push_back((*it).first);
+    }
+
+    foreach2(it, module.blocks.begin(), module.blocks.end()) {
+        foreach2(tit, (*it).second.targets.begin(), (*it).second.targets.end()) {
+            if (nodeIds.find(*tit) == nodeIds.end()) {
+                nodeIds[*tit] = nodes.size();
+                nodes.push_back(*tit);
+            }
+        }
+    }
+
+    predecessors.resize(nodes.size());
+
+    foreach2(it, module.blocks.begin(), module.blocks.end()) {
+        const Block &block = (*it).second;
+        unsigned id = nodeIds[(*it).first];
+
+        foreach2(tit, block.targets.begin(), block.targets.end()) {
+            predecessors[nodeIds[*tit]].push_back(id);
+        }
+
+        //The block that follows the last instruction, if it was translated
+        Blocks::const_iterator next = module.blocks.upper_bound(block.lastInstruction);
+        if (next != module.blocks.end() &&
+            (*next).first <= block.lastInstruction + COVSEARCHER_MAX_INSTRUCTION_SIZE) {
+            predecessors[nodeIds[(*next).first]].push_back(id);
+        }
+    }
+
+    std::vector<unsigned> distances(nodes.size(), (unsigned) -1);
+    std::deque<unsigned> queue;
+
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        if (!m_coverage->isCovered(module.descriptor, module.descriptor.LoadBase + nodes[i])) {
+            distances[i] = 0;
+            queue.push_back(i);
+        }
+    }
+
+    while (!queue.empty()) {
+        unsigned id = queue.front();
+        queue.pop_front();
+
+        if (distances[id] >= m_maxDistance) {
+            continue;
+        }
+
+        foreach2(it, predecessors[id].begin(), predecessors[id].end()) {
+            if (distances[*it] == (unsigned) -1) {
+                distances[*it] = distances[id] + 1;
+                queue.push_back(*it);
+            }
+        }
+    }
+
+    module.distances.clear();
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+        if (distances[i] != (unsigned) -1) {
+            module.distances[nodes[i]] = distances[i];
+        }
+    }
+}
+
+//Looks up the distance of the block the state is about to execute
+bool CoverageSearcher::getDistance(S2EExecutionState *state, unsigned *distance) const
+{
+    uint64_t pc = state->getPc();
+
+    foreach2(it, m_modules.begin(), m_modules.end()) {
+        const Module &module = *it;
+        if (!module.descriptor.Contains(pc)) {
+            continue;
+        }
+
+        uint64_t offset = pc - module.descriptor.LoadBase;
+        std::map<uint64_t, unsigned>::const_iterator dit = module.distances.find(offset);
+        if (dit == module.distances.end()) {
+            //The state may be in the middle of a block
+            Blocks::const_iterator bit = module.blocks.upper_bound(offset);
+            if (bit == module.blocks.begin()) {
+                return false;
+            }
+            --bit;
+            if (offset > (*bit).second.lastInstruction) {
+                return false;
+            }
+            dit = module.distances.find((*bit).first);
+            if (dit == module.distances.end()) {
+                return false;
+            }
+        }
+
+        *distance = (*dit).second;
+        return true;
+    }
+
+    return false;
+}
+
+void CoverageSearcher::prioritize(S2EExecutionState *state)
+{
+    unsigned distance;
+    if (getDistance(state, &distance)) {
+        m_prioritized.push(state, distance);
+    } else {
+        m_prioritized.erase(state);
+    }
+}
+
+void CoverageSearcher::reprioritize()
+{
+    foreach2(it, m_modules.begin(), m_modules.end()) {
+        computeDistances(*it);
+    }
+
+    foreach2(it, m_states.begin(), m_states.end()) {
+        prioritize(*it);
+    }
+
+    s2e()->getDebugStream() << "CoverageSearcher: " << m_prioritized.size() << " of "
+            << m_states.size() << " states are close to uncovered code ("
+            << m_coveredBlocks << " blocks covered)" << std::endl;
+}
+
+klee::ExecutionState& CoverageSearcher::selectState()
+{
+    //Another process (or this one) covered new blocks
+    uint64_t coveredBlocks = m_coverage->getCoveredBlockCount();
+    bool progress = coveredBlocks != m_coveredBlocks;
+    if (progress) {
+        m_selectionsWithoutProgress = 0;
+    }
+
+    if (progress || m_cfgChanged) {
+        uint64_t now = getTimeStampMilliseconds();
+        if (now - m_lastUpdate >= m_updateInterval) {
+            m_coveredBlocks = coveredBlocks;
+            m_cfgChanged = false;
+            m_lastUpdate = now;
+            reprioritize();
+        }
+    }
+
+    //Give up on the estimates if they do not lead to new code
+    if (!m_prioritized.empty() && m_selectionsWithoutProgress < m_patience) {
+        ++m_selectionsWithoutProgress;
+        return *m_prioritized.top();
+    }
+
+    return m_parentSearcher->selectState();
+}
+
+void CoverageSearcher::update(klee::ExecutionState *current,
+                    const std::set<klee::ExecutionState*> &addedStates,
+                    const std::set<klee::ExecutionState*> &removedStates)
+{
+    m_parentSearcher->update(current, addedStates, removedStates);
+
+    foreach2(it, removedStates.begin(), removedStates.end()) {
+        S2EExecutionState *es = static_cast<S2EExecutionState*>(*it);
+        m_states.erase(es);
+        m_prioritized.erase(es);
+    }
+
+    foreach2(it, addedStates.begin(), addedStates.end()) {
+        S2EExecutionState *es = static_cast<S2EExecutionState*>(*it);
+        m_states.insert(es);
+        prioritize(es);
+    }
+
+    S2EExecutionState *es = static_cast<S2EExecutionState*>(current);
+    if (es && m_states.find(es) != m_states.end()) {
+        prioritize(es);
+    }
+}
+
+bool CoverageSearcher::empty()
+{
+    return m_parentSearcher->empty();
+}
+
+} // namespace plugins
+} // namespace s2e
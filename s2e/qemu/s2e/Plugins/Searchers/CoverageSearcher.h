@@ -0,0 +1,137 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_COVERAGESEARCHER_H
+#define S2E_PLUGINS_COVERAGESEARCHER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+#include <s2e/Plugins/ExecutionTracers/TranslationBlockCoverage.h>
+#include <s2e/Plugins/Searchers/IndexedHeap.h>
+#include <s2e/S2EExecutionState.h>
+
+#include <klee/Searcher.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Prioritizes the states that are closest to code that no S2E process
+ *  has covered yet. Coverage comes from TranslationBlockCoverage, whose
+ *  bitmaps are shared by all processes. The distances are estimated on
+ *  the control flow graph of the translated blocks of the configured
+ *  modules, and are recomputed when the shared coverage changes.
+ */
+class CoverageSearcher : public Plugin, public klee::Searcher
+{
+    S2E_PLUGIN
+public:
+    CoverageSearcher(S2E* s2e): Plugin(s2e) {}
+    void initialize();
+
+    virtual klee::ExecutionState& selectState();
+    virtual void update(klee::ExecutionState *current,
+                        const std::set<klee::ExecutionState*> &addedStates,
+                        const std::set<klee::ExecutionState*> &removedStates);
+
+    virtual bool empty();
+
+private:
+    //Translated block, offsets are relative to the load base of the module
+    struct Block {
+        uint64_t lastInstruction;
+        std::vector<uint64_t> targets;
+    };
+
+    typedef std::map<uint64_t, Block> Blocks;
+
+    struct Module {
+        ModuleDescriptor descriptor;
+        Blocks blocks;
+        //Distance of each block (and static target) to uncovered code
+        std::map<uint64_t, unsigned> distances;
+    };
+
+    typedef IndexedHeap<S2EExecutionState*, uint64_t> StateHeap;
+
+    ModuleExecutionDetector *m_detector;
+    TranslationBlockCoverage *m_coverage;
+
+    klee::Searcher *m_parentSearcher;
+    bool m_searcherInited;
+
+    std::vector<Module> m_modules;
+    std::map<std::string, unsigned> m_moduleIds;
+    bool m_cfgChanged;
+
+    std::set<S2EExecutionState*> m_states;
+    StateHeap m_prioritized;
+
+    uint64_t m_coveredBlocks;
+    uint64_t m_lastUpdate;
+    uint64_t m_updateInterval;
+    unsigned m_maxDistance;
+
+    unsigned m_patience;
+    unsigned m_selectionsWithoutProgress;
+
+    void initializeSearcher();
+    unsigned getModuleId(const ModuleDescriptor &module);
+
+    void onModuleTranslateBlockEnd(
+        ExecutionSignal *signal,
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        TranslationBlock *tb,
+        uint64_t endPc,
+        bool staticTarget,
+        uint64_t targetPc);
+
+    void computeDistances(Module &module);
+    bool getDistance(S2EExecutionState *state, unsigned *distance) const;
+    void prioritize(S2EExecutionState *state);
+    void reprioritize();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
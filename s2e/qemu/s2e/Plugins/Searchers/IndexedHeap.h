@@ -0,0 +1,223 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_INDEXEDHEAP_H
+#define S2E_PLUGINS_INDEXEDHEAP_H
+
+#include <tr1/unordered_map>
+#include <functional>
+#include <vector>
+#include <cassert>
+#include <inttypes.h>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Binary min-heap of keys (typically execution states) ordered by a
+ *  priority stored in the heap itself. Keys are indexed, so that changing
+ *  the priority of a key or removing it costs O(log n), and comparisons
+ *  never have to look up plugin states.
+ *  Keys with the same priority are returned in insertion order.
+ */
+template <typename Key, typename Priority, typename Compare = std::less<Priority> >
+class IndexedHeap
+{
+private:
+    struct Entry {
+        Key key;
+        Priority priority;
+        uint64_t sequence;
+    };
+
+    typedef std::tr1::unordered_map<Key, unsigned> Positions;
+
+    std::vector<Entry> m_heap;
+    Positions m_positions;
+    Compare m_compare;
+    uint64_t m_sequence;
+
+    bool before(const Entry &e1, const Entry &e2) const {
+        if (m_compare(e1.priority, e2.priority)) {
+            return true;
+        }
+        if (m_compare(e2.priority, e1.priority)) {
+            return false;
+        }
+        return e1.sequence < e2.sequence;
+    }
+
+    void place(unsigned i, const Entry &e) {
+        m_heap[i] = e;
+        m_positions[e.key] = i;
+    }
+
+    void siftUp(unsigned i) {
+        Entry e = m_heap[i];
+        while (i > 0) {
+            unsigned parent = (i - 1) / 2;
+            if (!before(e, m_heap[parent])) {
+                break;
+            }
+            place(i, m_heap[parent]);
+            i = parent;
+        }
+        place(i, e);
+    }
+
+    void siftDown(unsigned i) {
+        Entry e = m_heap[i];
+        unsigned size = m_heap.size();
+        while (true) {
+            unsigned child = 2 * i + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && before(m_heap[child + 1], m_heap[child])) {
+                ++child;
+            }
+            if (!before(m_heap[child], e)) {
+                break;
+            }
+            place(i, m_heap[child]);
+            i = child;
+        }
+        place(i, e);
+    }
+
+    void removeAt(unsigned i) {
+        m_positions.erase(m_heap[i].key);
+
+        Entry last = m_heap.back();
+        m_heap.pop_back();
+        if (i == m_heap.size()) {
+            return;
+        }
+
+        m_heap[i] = last;
+        m_positions[last.key] = i;
+        if (i > 0 && before(last, m_heap[(i - 1) / 2])) {
+            siftUp(i);
+        } else {
+            siftDown(i);
+        }
+    }
+
+public:
+    IndexedHeap(const Compare &compare = Compare()):
+        m_compare(compare), m_sequence(0) {}
+
+    bool empty() const { return m_heap.empty(); }
+    unsigned size() const { return m_heap.size(); }
+
+    bool contains(const Key &key) const {
+        return m_positions.find(key) != m_positions.end();
+    }
+
+    /** Inserts the key, or changes its priority if it is already there */
+    void push(const Key &key, const Priority &priority) {
+        typename Positions::iterator it = m_positions.find(key);
+        if (it != m_positions.end()) {
+            update(key, priority);
+            return;
+        }
+
+        Entry e;
+        e.key = key;
+        e.priority = priority;
+        e.sequence = m_sequence++;
+        m_heap.push_back(e);
+        m_positions[key] = m_heap.size() - 1;
+        siftUp(m_heap.size() - 1);
+    }
+
+    /** Changes the priority of a key that is in the heap */
+    void update(const Key &key, const Priority &priority) {
+        typename Positions::iterator it = m_positions.find(key);
+        assert(it != m_positions.end());
+
+        unsigned i = (*it).second;
+        bool up = m_compare(priority, m_heap[i].priority);
+        m_heap[i].priority = priority;
+        if (up) {
+            siftUp(i);
+        } else {
+            siftDown(i);
+        }
+    }
+
+    /** Removes the key if it is in the heap */
+    bool erase(const Key &key) {
+        typename Positions::iterator it = m_positions.find(key);
+        if (it == m_positions.end()) {
+            return false;
+        }
+        removeAt((*it).second);
+        return true;
+    }
+
+    const Priority &priority(const Key &key) const {
+        typename Positions::const_iterator it = m_positions.find(key);
+        assert(it != m_positions.end());
+        return m_heap[(*it).second].priority;
+    }
+
+    const Key &top() const {
+        assert(!empty());
+        return m_heap[0].key;
+    }
+
+    const Priority &topPriority() const {
+        assert(!empty());
+        return m_heap[0].priority;
+    }
+
+    Key pop() {
+        Key key = top();
+        removeAt(0);
+        return key;
+    }
+
+    void clear() {
+        m_heap.clear();
+        m_positions.clear();
+    }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
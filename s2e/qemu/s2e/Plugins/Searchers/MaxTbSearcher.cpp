@@ -66,9 +66,6 @@ void MaxTbSearcher::initialize()
     m_searcherInited = false;
     m_parentSearcher = NULL;
 
-    m_sorter.p = this;
-    m_states = StateSet(m_sorter);
-
     //XXX: Take care of module load/unload
     m_moduleExecutionDetector->onModuleTranslateBlockEnd.connect(
             sigc::mem_fun(*this, &MaxTbSearcher::onModuleTranslateBlockEnd)
@@ -228,12 +225,10 @@ void MaxTbSearcher::onTraceTb(S2EExecutionState* state, uint64_t pc)
     uint64_t tbVa = curModule->ToRelative(state->getTb()->pc);
 
     if (!md) {
-        m_states.erase(state);
         m_coveredTbs[*curModule][tbVa]++;
-        DECLARE_PLUGINSTATE(MaxTbSearcherState, state);
-        plgState->m_metric = m_coveredTbs[*curModule][tbVa];
-        plgState->m_metric *= state->queryCost < 1 ? 1 : state->queryCost;
-        m_states.insert(state);
+        uint64_t metric = m_coveredTbs[*curModule][tbVa];
+        metric *= state->queryCost < 1 ? 1 : state->queryCost;
+        m_states.push(state, metric);
         return;
     }
 
@@ -250,8 +245,6 @@ void MaxTbSearcher::onTraceTb(S2EExecutionState* state, uint64_t pc)
     bool NextTbIsNew = NewTbIt == tbm.end();
     bool CurTbIsNew = CurTbIt == tbm.end();
 
-    m_states.erase(state);
-
     /**
      * Update the frequency of the current and next
      * translation blocks
@@ -272,30 +265,25 @@ void MaxTbSearcher::onTraceTb(S2EExecutionState* state, uint64_t pc)
       tbm[newPc] = 0;
     }
 
-    DECLARE_PLUGINSTATE(MaxTbSearcherState, state);
-    plgState->m_metric = tbm[newPc];
+    uint64_t metric = tbm[newPc];
 
 #if 1
-    s2e()->getDebugStream() << "Metric for 0x" << std::hex << (newPc+md->NativeBase) << " = " << plgState->m_metric
+    s2e()->getDebugStream() << "Metric for 0x" << std::hex << (newPc+md->NativeBase) << " = " << metric
             << std::endl;
 #endif
 
-    plgState->m_metric *= state->queryCost < 1 ? 1 : state->queryCost;
+    metric *= state->queryCost < 1 ? 1 : state->queryCost;
 
-    m_states.insert(state);
+    m_states.push(state, metric);
 }
 
 klee::ExecutionState& MaxTbSearcher::selectState()
 {
     //If there are no prioritized states, revert to the parent searcher
-    StateSet::iterator it;
-
 #if 0
     uint64_t absNextPc = 0;
-    while((it = m_states.begin()) != m_states.end()) {
-        S2EExecutionState *es = dynamic_cast<S2EExecutionState*>(*it);
-        m_states.erase(es);
-        ++it;
+    while(!m_states.empty()) {
+        S2EExecutionState *es = m_states.pop();
 
         //Get the program counter of the selected state, and add it
         //to the list of explored translation blocks
@@ -308,13 +296,8 @@ klee::ExecutionState& MaxTbSearcher::selectState()
     }while(absNextPc);
 #endif
 
-    if (m_states.size() > 0) {
-        S2EExecutionState *es = dynamic_cast<S2EExecutionState*>(*m_states.begin());
-        DECLARE_PLUGINSTATE(MaxTbSearcherState, es);
-        if (plgState->m_metric < 2) {
-            return *es;
-        }
-
+    if (!m_states.empty() && m_states.topPriority() < 2) {
+        return *m_states.top();
     }
 
     return m_parentSearcher->selectState();
@@ -337,16 +320,14 @@ bool MaxTbSearcher::updatePc(S2EExecutionState *es)
         return false;
     }
 
-    DECLARE_PLUGINSTATE(MaxTbSearcherState, es);
-
     //If not covered, add the forked state to the wait list
-    plgState->m_metric = m_coveredTbs[*md][md->ToRelative(absNextPc)];
+    uint64_t metric = m_coveredTbs[*md][md->ToRelative(absNextPc)];
 #if 1
-    s2e()->getDebugStream() << "MaxTBSearcher updatePc Metric for 0x" << std::hex << md->ToNativeBase(absNextPc) << " = " << plgState->m_metric
+    s2e()->getDebugStream() << "MaxTBSearcher updatePc Metric for 0x" << std::hex << md->ToNativeBase(absNextPc) << " = " << metric
             << std::endl;
 #endif
 
-    m_states.insert(es);
+    m_states.push(es, metric);
     return true;
 }
 
@@ -377,32 +358,5 @@ bool MaxTbSearcher::empty()
 }
 
 
-MaxTbSearcherState::MaxTbSearcherState()
-{
-
-}
-
-MaxTbSearcherState::MaxTbSearcherState(S2EExecutionState *s, Plugin *p)
-{
-    m_metric = 0;
-    m_plugin = static_cast<MaxTbSearcher*>(p);
-    m_state = s;
-}
-
-MaxTbSearcherState::~MaxTbSearcherState()
-{
-}
-
-PluginState *MaxTbSearcherState::clone() const
-{
-    return new MaxTbSearcherState(*this);
-}
-
-PluginState *MaxTbSearcherState::factory(Plugin *p, S2EExecutionState *s)
-{
-    MaxTbSearcherState *ret = new MaxTbSearcherState(s, p);
-    return ret;
-}
-
 } // namespace plugins
 } // namespace s2e
@@ -40,6 +40,7 @@
 #include <s2e/Plugin.h>
 #include <s2e/Plugins/CorePlugin.h>
 #include <s2e/Plugins/ModuleExecutionDetector.h>
+#include <s2e/Plugins/Searchers/IndexedHeap.h>
 #include <s2e/S2EExecutionState.h>
 
 #include <klee/Searcher.h>
@@ -49,49 +50,12 @@
 namespace s2e {
 namespace plugins {
 
-class MaxTbSearcher;
-
-class MaxTbSearcherState: public PluginState
-{
-private:
-    uint64_t m_metric;
-    MaxTbSearcher *m_plugin;
-    S2EExecutionState *m_state;
-public:
-
-    MaxTbSearcherState();
-    MaxTbSearcherState(S2EExecutionState *s, Plugin *p);
-    virtual ~MaxTbSearcherState();
-    virtual PluginState *clone() const;
-    static PluginState *factory(Plugin *p, S2EExecutionState *s);
-
-    friend class MaxTbSearcher;
-
-};
-
 class MaxTbSearcher : public Plugin, public klee::Searcher
 {
     S2E_PLUGIN
 public:
-    struct MaxTbSorter{
-        Plugin *p;
-
-        MaxTbSorter() {
-            p = NULL;
-        }
-
-        bool operator()(const S2EExecutionState *s1, const S2EExecutionState *s2) const{
-            const MaxTbSearcherState *p1 = static_cast<MaxTbSearcherState*>(p->getPluginState(const_cast<S2EExecutionState*>(s1), &MaxTbSearcherState::factory));
-            const MaxTbSearcherState *p2 = static_cast<MaxTbSearcherState*>(p->getPluginState(const_cast<S2EExecutionState*>(s2), &MaxTbSearcherState::factory));
-
-            if (p1->m_metric == p2->m_metric) {
-                return p1 < p2;
-            }
-            return p1->m_metric < p2->m_metric;
-        }
-    };
-
-    typedef std::set<S2EExecutionState*, MaxTbSorter> StateSet;
+    //Prioritized states, the ones with the lowest metric first
+    typedef IndexedHeap<S2EExecutionState*, uint64_t> StateHeap;
 
     //Maps a translation block address to the number of times it was executed
     typedef std::map<uint64_t, uint64_t> TbMap;
@@ -115,8 +79,7 @@ private:
     klee::Searcher *m_parentSearcher;
     TbsByModule m_coveredTbs;
 
-    MaxTbSorter m_sorter;
-    StateSet m_states;
+    StateHeap m_states;
 
 
     void addTb(S2EExecutionState *s, uint64_t absTargetPc);
@@ -136,8 +99,6 @@ private:
     void onTraceTb(S2EExecutionState* state, uint64_t pc);
 
     void initializeSearcher();
-
-    friend class MaxTbSearcherState;
 };
 
 
@@ -0,0 +1,443 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+extern "C" {
+#include "config.h"
+#include "qemu-common.h"
+#include "cpu.h"
+}
+
+#include "StateMerger.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+#include <s2e/S2EExecutor.h>
+
+#include <klee/Internal/System/Time.h>
+
+#include <iostream>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(StateMerger, "Merges states that reach the same program counter with the same stack",
+                  "StateMerger", "ModuleExecutionDetector");
+
+void StateMerger::initialize()
+{
+    m_detector = static_cast<ModuleExecutionDetector*>(s2e()->getPlugin("ModuleExecutionDetector"));
+    m_parentSearcher = NULL;
+    m_searcherInited = false;
+    m_automaticArrival = false;
+
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //Number of merge points remembered for each state, 0 disables automatic merging
+    m_historySize = cfg->getInt(getConfigKey() + ".historySize", 64);
+
+    //Merges that need more ite expressions than this are not done
+    m_maxSelects = cfg->getInt(getConfigKey() + ".maxDifferingBytes", 1024);
+
+    //Time after which a waiting state resumes, in milliseconds
+    m_maxWaitTime = cfg->getInt(getConfigKey() + ".maxWaitTime", 1000) / 1000.0;
+
+    m_detector->onModuleTranslateBlockStart.connect(
+            sigc::mem_fun(*this, &StateMerger::onModuleTranslateBlockStart));
+
+    s2e()->getCorePlugin()->onStateFork.connect(
+            sigc::mem_fun(*this, &StateMerger::onStateFork));
+}
+
+void StateMerger::initializeSearcher()
+{
+    if (m_searcherInited) {
+        return;
+    }
+
+    m_parentSearcher = s2e()->getExecutor()->getSearcher();
+    assert(m_parentSearcher);
+    s2e()->getExecutor()->setSearcher(this);
+    m_searcherInited = true;
+}
+
+/**
+ *  Merge points are identified by the program counter, the address space,
+ *  and the stack and frame pointers. Two states at the same merge point
+ *  are likely in the same function invocation.
+ */
+bool StateMerger::getMergePoint(S2EExecutionState *state, uint64_t pc, uint64_t *mergePoint)
+{
+    target_ulong sp, bp;
+    if (!state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_ESP]), &sp, sizeof(sp)) ||
+        !state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_EBP]), &bp, sizeof(bp))) {
+        return false;
+    }
+
+    uint64_t pid = state->getPid();
+    uint64_t hash = hashBuffer(&pc, sizeof(pc));
+    hash = hashBuffer(&pid, sizeof(pid), hash);
+    hash = hashBuffer(&sp, sizeof(sp), hash);
+    *mergePoint = hashBuffer(&bp, sizeof(bp), hash);
+    return true;
+}
+
+void StateMerger::setPosition(S2EExecutionState *state, uint64_t mergePoint)
+{
+    std::map<S2EExecutionState*, uint64_t>::iterator it = m_positions.find(state);
+    if (it != m_positions.end()) {
+        if ((*it).second == mergePoint) {
+            return;
+        }
+        erasePosition(state);
+    }
+
+    m_positions[state] = mergePoint;
+    m_statesByPosition[mergePoint].insert(state);
+}
+
+void StateMerger::erasePosition(S2EExecutionState *state)
+{
+    std::map<S2EExecutionState*, uint64_t>::iterator it = m_positions.find(state);
+    if (it == m_positions.end()) {
+        return;
+    }
+
+    StatesByMergePoint::iterator pit = m_statesByPosition.find((*it).second);
+    assert(pit != m_statesByPosition.end());
+    (*pit).second.erase(state);
+    if ((*pit).second.empty()) {
+        m_statesByPosition.erase(pit);
+    }
+    m_positions.erase(it);
+}
+
+bool StateMerger::isRunnable(S2EExecutionState *state) const
+{
+    return m_heldStates.find(state) == m_heldStates.end() &&
+           s2e()->getExecutor()->getStates().count(state);
+}
+
+void StateMerger::onModuleTranslateBlockStart(
+        ExecutionSignal *signal,
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        TranslationBlock *tb,
+        uint64_t pc)
+{
+    initializeSearcher();
+
+    signal->connect(
+        sigc::mem_fun(*this, &StateMerger::onBlockStart)
+    );
+}
+
+void StateMerger::onBlockStart(S2EExecutionState* state, uint64_t pc)
+{
+    uint64_t mergePoint;
+    if (!getMergePoint(state, pc, &mergePoint)) {
+        return;
+    }
+
+    DECLARE_PLUGINSTATE(StateMergerState, state);
+
+    //The state resumes the block it was waiting at, the merge was refused
+    //or timed out. Queueing it again would livelock with the other states.
+    if (plgState->m_released) {
+        plgState->m_released = false;
+        if (plgState->m_releasedMergePoint == mergePoint) {
+            return;
+        }
+    }
+
+    //Blocks entered from several predecessors are join points
+    if (plgState->m_lastPc) {
+        std::pair<std::tr1::unordered_map<uint64_t, uint64_t>::iterator, bool> res =
+                m_predecessors.insert(std::make_pair(pc, plgState->m_lastPc));
+        if (!res.second && (*res.first).second != plgState->m_lastPc) {
+            (*res.first).second = JOIN_POINT;
+        }
+    }
+
+    StatesByMergePoint::iterator wit = m_waitingByMergePoint.find(mergePoint);
+    bool arrives = wit != m_waitingByMergePoint.end();
+
+    //Look for the states that sit at a merge point this state passed recently
+    m_expected.clear();
+    std::tr1::unordered_map<uint64_t, uint64_t>::iterator jit = m_predecessors.find(pc);
+    if (jit != m_predecessors.end() && (*jit).second == JOIN_POINT) {
+        foreach2(hit, plgState->m_history.begin(), plgState->m_history.end()) {
+            StatesByMergePoint::iterator pit = m_statesByPosition.find(*hit);
+            if (pit == m_statesByPosition.end()) {
+                continue;
+            }
+            foreach2(sit, (*pit).second.begin(), (*pit).second.end()) {
+                if (*sit != state && isRunnable(*sit)) {
+                    m_expected.insert(*sit);
+                }
+            }
+        }
+    }
+
+    if (arrives || !m_expected.empty()) {
+        //Merged states must have the same KLEE stack, run the block symbolically.
+        //This restarts the block if the state was running concretely.
+        state->jumpToSymbolicCpp();
+    }
+
+    plgState->m_lastPc = pc;
+    if (!plgState->m_history.empty()) {
+        plgState->m_history[plgState->m_next] = mergePoint;
+        plgState->m_next = (plgState->m_next + 1) % plgState->m_history.size();
+    }
+    setPosition(state, mergePoint);
+
+    if (arrives || !m_expected.empty()) {
+        m_automaticArrival = true;
+        s2e()->getExecutor()->queueStateForMerge(state, mergePoint);
+        //The request was ignored
+        m_automaticArrival = false;
+    }
+}
+
+//The new states start at the merge point of the forking state
+void StateMerger::onStateFork(S2EExecutionState *state,
+                              const std::vector<S2EExecutionState*> &newStates,
+                              const std::vector<klee::ref<klee::Expr> > &newConditions)
+{
+    initializeSearcher();
+
+    std::map<S2EExecutionState*, uint64_t>::iterator it = m_positions.find(state);
+    if (it == m_positions.end()) {
+        return;
+    }
+
+    uint64_t mergePoint = (*it).second;
+    foreach2(sit, newStates.begin(), newStates.end()) {
+        if (*sit != state) {
+            setPosition(*sit, mergePoint);
+        }
+    }
+}
+
+void StateMerger::queueStateForMerge(S2EExecutionState *state, uint64_t mergePoint)
+{
+    WaitingState ws;
+    ws.mergePoint = mergePoint;
+    ws.since = klee::util::getWallTime();
+    ws.guest = !m_automaticArrival;
+    ws.automatic = m_automaticArrival;
+    if (m_automaticArrival) {
+        ws.expected = m_expected;
+        m_automaticArrival = false;
+    } else {
+        setPosition(state, mergePoint);
+    }
+
+    m_parentSearcher->removeState(state, state);
+    m_heldStates.insert(state);
+    m_arrivals.push_back(std::make_pair(state, ws));
+}
+
+void StateMerger::stopWaiting(S2EExecutionState *state)
+{
+    WaitingStates::iterator it = m_waitingStates.find(state);
+    if (it == m_waitingStates.end()) {
+        return;
+    }
+
+    StatesByMergePoint::iterator wit = m_waitingByMergePoint.find((*it).second.mergePoint);
+    assert(wit != m_waitingByMergePoint.end());
+    (*wit).second.erase(state);
+    if ((*wit).second.empty()) {
+        m_waitingByMergePoint.erase(wit);
+    }
+    m_waitingStates.erase(it);
+}
+
+void StateMerger::release(S2EExecutionState *state)
+{
+    WaitingStates::iterator it = m_waitingStates.find(state);
+    if (it != m_waitingStates.end() && (*it).second.automatic) {
+        DECLARE_PLUGINSTATE(StateMergerState, state);
+        plgState->m_released = true;
+        plgState->m_releasedMergePoint = (*it).second.mergePoint;
+    }
+
+    stopWaiting(state);
+    m_heldStates.erase(state);
+    m_parentSearcher->addState(state);
+}
+
+/**
+ *  Merges the waiting states into the state that arrived at their merge
+ *  point. The merged state waits in turn for the states that are still
+ *  behind any of them.
+ */
+void StateMerger::processArrival(S2EExecutionState *state, WaitingState &ws)
+{
+    StatesByMergePoint::iterator wit = m_waitingByMergePoint.find(ws.mergePoint);
+    if (wit != m_waitingByMergePoint.end()) {
+        StateSet candidates = (*wit).second;
+        foreach2(it, candidates.begin(), candidates.end()) {
+            S2EExecutionState *other = *it;
+            if (!s2e()->getExecutor()->mergeAndTerminate(*state, *other, m_maxSelects)) {
+                continue;
+            }
+
+            const WaitingState &ows = m_waitingStates[other];
+            ws.expected.insert(ows.expected.begin(), ows.expected.end());
+            ws.guest = ws.guest || ows.guest;
+
+            //The killed state stays held until the executor removes it
+            stopWaiting(other);
+        }
+    }
+
+    ws.expected.erase(state);
+    m_waitingStates[state] = ws;
+    m_waitingByMergePoint[ws.mergePoint].insert(state);
+}
+
+/**
+ *  Resumes the states that waited for too long, whose expected states
+ *  all stopped or died, and all of them when nothing else can run.
+ */
+void StateMerger::releaseWaitingStates()
+{
+    double now = klee::util::getWallTime();
+    bool idle = m_parentSearcher->empty();
+
+    std::vector<S2EExecutionState*> released;
+    foreach2(it, m_waitingStates.begin(), m_waitingStates.end()) {
+        const WaitingState &ws = (*it).second;
+
+        bool expecting = false;
+        foreach2(eit, ws.expected.begin(), ws.expected.end()) {
+            if (isRunnable(*eit)) {
+                expecting = true;
+                break;
+            }
+        }
+
+        if (idle || now - ws.since > m_maxWaitTime || (!ws.guest && !expecting)) {
+            released.push_back((*it).first);
+        }
+    }
+
+    foreach2(it, released.begin(), released.end()) {
+        release(*it);
+    }
+}
+
+klee::ExecutionState& StateMerger::selectState()
+{
+    std::vector<std::pair<S2EExecutionState*, WaitingState> > arrivals;
+    arrivals.swap(m_arrivals);
+    foreach2(it, arrivals.begin(), arrivals.end()) {
+        processArrival((*it).first, (*it).second);
+    }
+
+    releaseWaitingStates();
+
+    //Let the states that are behind catch up with the waiting ones
+    foreach2(it, m_waitingStates.begin(), m_waitingStates.end()) {
+        const StateSet &expected = (*it).second.expected;
+        foreach2(eit, expected.begin(), expected.end()) {
+            if (isRunnable(*eit)) {
+                return **eit;
+            }
+        }
+    }
+
+    return m_parentSearcher->selectState();
+}
+
+void StateMerger::update(klee::ExecutionState *current,
+                    const std::set<klee::ExecutionState*> &addedStates,
+                    const std::set<klee::ExecutionState*> &removedStates)
+{
+    //The parent searcher does not know about the held states
+    std::set<klee::ExecutionState*> parentRemovedStates;
+
+    foreach2(it, removedStates.begin(), removedStates.end()) {
+        S2EExecutionState *es = static_cast<S2EExecutionState*>(*it);
+        erasePosition(es);
+
+        if (m_heldStates.erase(es)) {
+            stopWaiting(es);
+            for (unsigned i = 0; i < m_arrivals.size(); ++i) {
+                if (m_arrivals[i].first == es) {
+                    m_arrivals.erase(m_arrivals.begin() + i);
+                    break;
+                }
+            }
+        } else {
+            parentRemovedStates.insert(es);
+        }
+    }
+
+    m_parentSearcher->update(current, addedStates, parentRemovedStates);
+}
+
+bool StateMerger::empty()
+{
+    return m_parentSearcher->empty() && m_waitingStates.empty() && m_arrivals.empty();
+}
+
+StateMergerState::StateMergerState(unsigned historySize)
+    : m_history(historySize, 0), m_next(0), m_lastPc(0),
+      m_released(false), m_releasedMergePoint(0)
+{
+
+}
+
+StateMergerState::~StateMergerState()
+{
+
+}
+
+StateMergerState* StateMergerState::clone() const
+{
+    return new StateMergerState(*this);
+}
+
+PluginState *StateMergerState::factory(Plugin *p, S2EExecutionState *s)
+{
+    return new StateMergerState(static_cast<StateMerger*>(p)->m_historySize);
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,183 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_STATEMERGER_H
+#define S2E_PLUGINS_STATEMERGER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/Plugins/ModuleExecutionDetector.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/S2EExecutor.h>
+
+#include <klee/Searcher.h>
+
+#include <tr1/unordered_map>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Merges states that reach the same program counter with the same stack.
+ *  The translation blocks of the configured modules are the candidate
+ *  merge points, identified by the program counter, the address space,
+ *  and the stack and frame pointers. A state that reaches a join point
+ *  (a block entered from more than one predecessor) waits there if
+ *  another state is behind it, i.e., sits at a merge point that the
+ *  waiting state passed recently. The states that are behind run first,
+ *  and are merged with the waiting state when they reach its merge point.
+ *  The guest-specified merge points are handled the same way.
+ */
+class StateMerger : public Plugin, public klee::Searcher,
+                    public S2EMergingSearcher
+{
+    S2E_PLUGIN
+public:
+    StateMerger(S2E* s2e): Plugin(s2e) {}
+    void initialize();
+
+    virtual klee::ExecutionState& selectState();
+    virtual void update(klee::ExecutionState *current,
+                        const std::set<klee::ExecutionState*> &addedStates,
+                        const std::set<klee::ExecutionState*> &removedStates);
+
+    virtual bool empty();
+
+    virtual void queueStateForMerge(S2EExecutionState *state,
+                                    uint64_t mergePoint);
+
+private:
+    typedef std::set<S2EExecutionState*> StateSet;
+
+    struct WaitingState {
+        uint64_t mergePoint;
+        double since;
+        bool guest;
+        //Queued at the start of a block, which is executed again on release
+        bool automatic;
+        //States that are behind this one
+        StateSet expected;
+    };
+
+    typedef std::map<S2EExecutionState*, WaitingState> WaitingStates;
+    typedef std::tr1::unordered_map<uint64_t, StateSet> StatesByMergePoint;
+
+    ModuleExecutionDetector *m_detector;
+
+    klee::Searcher *m_parentSearcher;
+    bool m_searcherInited;
+
+    //States that are not in the parent searcher
+    StateSet m_heldStates;
+    WaitingStates m_waitingStates;
+    StatesByMergePoint m_waitingByMergePoint;
+
+    //States that queued themselves since the last selection
+    std::vector<std::pair<S2EExecutionState*, WaitingState> > m_arrivals;
+
+    //Last merge point of each state, and the reverse index
+    std::map<S2EExecutionState*, uint64_t> m_positions;
+    StatesByMergePoint m_statesByPosition;
+
+    //First predecessor of each block, JOIN_POINT if there are several
+    std::tr1::unordered_map<uint64_t, uint64_t> m_predecessors;
+
+    bool m_automaticArrival;
+    StateSet m_expected;
+
+    unsigned m_historySize;
+    unsigned m_maxSelects;
+    double m_maxWaitTime;
+
+    static const uint64_t JOIN_POINT = (uint64_t) -1;
+
+    void initializeSearcher();
+
+    bool getMergePoint(S2EExecutionState *state, uint64_t pc, uint64_t *mergePoint);
+    void setPosition(S2EExecutionState *state, uint64_t mergePoint);
+    void erasePosition(S2EExecutionState *state);
+    bool isRunnable(S2EExecutionState *state) const;
+
+    void stopWaiting(S2EExecutionState *state);
+    void release(S2EExecutionState *state);
+    void processArrival(S2EExecutionState *state, WaitingState &ws);
+    void releaseWaitingStates();
+
+    void onModuleTranslateBlockStart(
+        ExecutionSignal *signal,
+        S2EExecutionState* state,
+        const ModuleDescriptor &module,
+        TranslationBlock *tb,
+        uint64_t pc);
+
+    void onBlockStart(S2EExecutionState* state, uint64_t pc);
+
+    void onStateFork(S2EExecutionState *state,
+                     const std::vector<S2EExecutionState*> &newStates,
+                     const std::vector<klee::ref<klee::Expr> > &newConditions);
+
+    friend class StateMergerState;
+};
+
+class StateMergerState : public PluginState
+{
+private:
+    //Ring of the last merge points passed by the state
+    std::vector<uint64_t> m_history;
+    unsigned m_next;
+    uint64_t m_lastPc;
+
+    //Merge point the state was released at without being merged,
+    //it must not queue there again before running the block
+    bool m_released;
+    uint64_t m_releasedMergePoint;
+
+public:
+    StateMergerState(unsigned historySize);
+    virtual ~StateMergerState();
+    virtual StateMergerState* clone() const;
+    static PluginState *factory(Plugin *p, S2EExecutionState *s);
+
+    friend class StateMerger;
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "SwitchCostSearcher.h"
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+#include <s2e/S2EExecutor.h>
+
+#include <klee/Internal/System/Time.h>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(SwitchCostSearcher, "Runs states in batches that amortize the cost of state switches",
+                  "SwitchCostSearcher",);
+
+void SwitchCostSearcher::initialize()
+{
+    m_parentSearcher = NULL;
+    m_searcherInited = false;
+    m_current = NULL;
+    m_batchStart = 0;
+    m_relativeBatches = 0;
+
+    ConfigFile *cfg = s2e()->getConfig();
+
+    //The batch lasts costFactor times the average switch time
+    m_costFactor = cfg->getDouble(getConfigKey() + ".costFactor", 20);
+
+    //Bounds of the batch time, in milliseconds
+    m_minBatchTime = cfg->getInt(getConfigKey() + ".minBatchTime", 10) / 1000.0;
+    m_maxBatchTime = cfg->getInt(getConfigKey() + ".maxBatchTime", 5000) / 1000.0;
+
+    //Maximum number of fork tree edges between the current state and a preferred relative
+    m_relativeDistance = cfg->getInt(getConfigKey() + ".relativeDistance", 4);
+
+    //Consecutive batches given to relatives before following the wrapped searcher again
+    m_maxRelativeBatches = cfg->getInt(getConfigKey() + ".maxRelativeBatches", 4);
+
+    //Root of the fork tree
+    m_nodes.push_back(ForkNode());
+    m_nodes[0].parent = 0;
+
+    s2e()->getCorePlugin()->onStateFork.connect(
+            sigc::mem_fun(*this, &SwitchCostSearcher::onStateFork));
+}
+
+void SwitchCostSearcher::initializeSearcher()
+{
+    if (m_searcherInited) {
+        return;
+    }
+
+    m_parentSearcher = s2e()->getExecutor()->getSearcher();
+    assert(m_parentSearcher);
+    s2e()->getExecutor()->setSearcher(this);
+    m_searcherInited = true;
+
+    //The states created so far were only given to the parent searcher
+    const std::set<klee::ExecutionState*> &states = s2e()->getExecutor()->getStates();
+    foreach2(it, states.begin(), states.end()) {
+        setNode(static_cast<S2EExecutionState*>(*it), 0);
+    }
+}
+
+unsigned SwitchCostSearcher::allocateNode(unsigned parent)
+{
+    unsigned node;
+    if (m_freeNodes.empty()) {
+        node = m_nodes.size();
+        m_nodes.push_back(ForkNode());
+    } else {
+        node = m_freeNodes.back();
+        m_freeNodes.pop_back();
+    }
+
+    m_nodes[node].parent = parent;
+    m_nodes[parent].children.push_back(node);
+    return node;
+}
+
+//Removes the node and its ancestors that have neither states nor children
+void SwitchCostSearcher::pruneNode(unsigned node)
+{
+    while (node != 0 && m_nodes[node].states.empty() && m_nodes[node].children.empty()) {
+        unsigned parent = m_nodes[node].parent;
+        std::vector<unsigned> &siblings = m_nodes[parent].children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), node));
+
+        //Release the memory of the containers
+        std::vector<unsigned>().swap(m_nodes[node].children);
+        m_freeNodes.push_back(node);
+        node = parent;
+    }
+}
+
+void SwitchCostSearcher::setNode(S2EExecutionState *state, unsigned node)
+{
+    std::map<S2EExecutionState*, unsigned>::iterator it = m_stateNodes.find(state);
+    unsigned oldNode = 0;
+    bool moved = it != m_stateNodes.end();
+    if (moved) {
+        oldNode = (*it).second;
+        m_nodes[oldNode].states.erase(state);
+    }
+
+    m_stateNodes[state] = node;
+    m_nodes[node].states.insert(state);
+
+    if (moved) {
+        pruneNode(oldNode);
+    }
+}
+
+//All the states of a fork become children of a new node
+void SwitchCostSearcher::onStateFork(S2EExecutionState *state,
+                                     const std::vector<S2EExecutionState*> &newStates,
+                                     const std::vector<klee::ref<klee::Expr> > &newConditions)
+{
+    initializeSearcher();
+
+    std::map<S2EExecutionState*, unsigned>::iterator it = m_stateNodes.find(state);
+    unsigned parent = it == m_stateNodes.end() ? 0 : (*it).second;
+
+    unsigned node = allocateNode(parent);
+
+    foreach2(sit, newStates.begin(), newStates.end()) {
+        setNode(*sit, node);
+    }
+}
+
+/**
+ *  Breadth-first search of the fork tree around the node of the state.
+ *  Returns the closest other state, NULL if there is none within
+ *  m_relativeDistance edges.
+ */
+S2EExecutionState *SwitchCostSearcher::findRelative(S2EExecutionState *state) const
+{
+    std::map<S2EExecutionState*, unsigned>::const_iterator it = m_stateNodes.find(state);
+    if (it == m_stateNodes.end()) {
+        return NULL;
+    }
+
+    std::deque<std::pair<unsigned, unsigned> > queue;
+    std::set<unsigned> visited;
+    queue.push_back(std::make_pair((*it).second, 0));
+    visited.insert((*it).second);
+
+    while (!queue.empty()) {
+        unsigned node = queue.front().first;
+        unsigned distance = queue.front().second;
+        queue.pop_front();
+
+        const ForkNode &n = m_nodes[node];
+        foreach2(sit, n.states.begin(), n.states.end()) {
+            if (*sit != state) {
+                return *sit;
+            }
+        }
+
+        if (distance == m_relativeDistance) {
+            continue;
+        }
+
+        if (visited.insert(n.parent).second) {
+            queue.push_back(std::make_pair(n.parent, distance + 1));
+        }
+        foreach2(cit, n.children.begin(), n.children.end()) {
+            if (visited.insert(*cit).second) {
+                queue.push_back(std::make_pair(*cit, distance + 1));
+            }
+        }
+    }
+
+    return NULL;
+}
+
+klee::ExecutionState& SwitchCostSearcher::selectState()
+{
+    double now = klee::util::getWallTime();
+
+    double budget = m_costFactor * s2e()->getExecutor()->getStateSwitchTime();
+    if (budget < m_minBatchTime) {
+        budget = m_minBatchTime;
+    }
+    if (budget > m_maxBatchTime) {
+        budget = m_maxBatchTime;
+    }
+
+    if (m_current && now - m_batchStart < budget) {
+        return *m_current;
+    }
+
+    S2EExecutionState *selected =
+            static_cast<S2EExecutionState*>(&m_parentSearcher->selectState());
+
+    if (m_current && selected != m_current) {
+        S2EExecutionState *relative = NULL;
+        if (m_relativeBatches < m_maxRelativeBatches) {
+            relative = findRelative(m_current);
+        }
+
+        if (relative) {
+            selected = relative;
+            ++m_relativeBatches;
+        } else {
+            m_relativeBatches = 0;
+        }
+    }
+
+    if (selected != m_current) {
+        m_current = selected;
+        m_batchStart = now;
+    }
+
+    return *selected;
+}
+
+void SwitchCostSearcher::update(klee::ExecutionState *current,
+                    const std::set<klee::ExecutionState*> &addedStates,
+                    const std::set<klee::ExecutionState*> &removedStates)
+{
+    m_parentSearcher->update(current, addedStates, removedStates);
+
+    foreach2(it, removedStates.begin(), removedStates.end()) {
+        S2EExecutionState *es = static_cast<S2EExecutionState*>(*it);
+        std::map<S2EExecutionState*, unsigned>::iterator nit = m_stateNodes.find(es);
+        if (nit != m_stateNodes.end()) {
+            unsigned node = (*nit).second;
+            m_nodes[node].states.erase(es);
+            m_stateNodes.erase(nit);
+            pruneNode(node);
+        }
+
+        if (es == m_current) {
+            m_current = NULL;
+        }
+    }
+
+    foreach2(it, addedStates.begin(), addedStates.end()) {
+        S2EExecutionState *es = static_cast<S2EExecutionState*>(*it);
+        if (m_stateNodes.find(es) == m_stateNodes.end()) {
+            setNode(es, 0);
+        }
+    }
+}
+
+bool SwitchCostSearcher::empty()
+{
+    return m_parentSearcher->empty();
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,115 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_SWITCHCOSTSEARCHER_H
+#define S2E_PLUGINS_SWITCHCOSTSEARCHER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+#include <s2e/S2EExecutionState.h>
+
+#include <klee/Searcher.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Wraps the searcher in use and amortizes the cost of state switches.
+ *  The current state keeps running until it used a time budget that is
+ *  proportional to the measured cost of a switch. When the budget is
+ *  used, states that forked from a recent ancestor of the current state
+ *  are preferred over the choice of the wrapped searcher, for a bounded
+ *  number of consecutive batches.
+ */
+class SwitchCostSearcher : public Plugin, public klee::Searcher
+{
+    S2E_PLUGIN
+public:
+    SwitchCostSearcher(S2E* s2e): Plugin(s2e) {}
+    void initialize();
+
+    virtual klee::ExecutionState& selectState();
+    virtual void update(klee::ExecutionState *current,
+                        const std::set<klee::ExecutionState*> &addedStates,
+                        const std::set<klee::ExecutionState*> &removedStates);
+
+    virtual bool empty();
+
+private:
+    //Fork tree, each node is a fork point
+    struct ForkNode {
+        unsigned parent;
+        std::vector<unsigned> children;
+        std::set<S2EExecutionState*> states;
+    };
+
+    klee::Searcher *m_parentSearcher;
+    bool m_searcherInited;
+
+    std::vector<ForkNode> m_nodes;
+    //Indexes of m_nodes that were pruned from the tree
+    std::vector<unsigned> m_freeNodes;
+    std::map<S2EExecutionState*, unsigned> m_stateNodes;
+
+    S2EExecutionState *m_current;
+    double m_batchStart;
+
+    double m_costFactor;
+    double m_minBatchTime;
+    double m_maxBatchTime;
+    unsigned m_relativeDistance;
+    unsigned m_maxRelativeBatches;
+    unsigned m_relativeBatches;
+
+    void initializeSearcher();
+    unsigned allocateNode(unsigned parent);
+    void pruneNode(unsigned node);
+    void setNode(S2EExecutionState *state, unsigned node);
+    S2EExecutionState *findRelative(S2EExecutionState *state) const;
+
+    void onStateFork(S2EExecutionState *state,
+                     const std::vector<S2EExecutionState*> &newStates,
+                     const std::vector<klee::ref<klee::Expr> > &newConditions);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include <s2e/S2E.h>
+#include <s2e/ConfigFile.h>
+#include <s2e/Utils.h>
+
+#include "SignalProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+S2E_DEFINE_PLUGIN(SignalProfiler, "Per-plugin signal slot profile", "SignalProfiler");
+
+void SignalProfiler::initialize()
+{
+#ifdef S2E_PROFILE_SIGNALS
+    m_interval = s2e()->getConfig()->getInt(getConfigKey() + ".interval", 10);
+
+    //The slots of a plugin are member functions of the plugin object,
+    //which is not always at the address of its Plugin base
+    const std::vector<Plugin*> &plugins = s2e()->getActivePlugins();
+    foreach2(it, plugins.begin(), plugins.end()) {
+        const std::string &name = (*it)->getPluginInfo()->name;
+        m_owners[static_cast<const void*>(*it)] = name;
+        m_owners[dynamic_cast<const void*>(*it)] = name;
+    }
+
+    m_startTime = time(NULL);
+    m_lastReport = m_startTime;
+    m_startCycles = fsigc::profiler::cycles();
+
+    s2e()->getCorePlugin()->onProcessFork.connect(
+            sigc::mem_fun(*this, &SignalProfiler::onProcessFork));
+
+    s2e()->getCorePlugin()->onTimer.connect(
+            sigc::mem_fun(*this, &SignalProfiler::onTimer));
+
+    fsigc::profiler::enabled = true;
+#else
+    s2e()->getWarningsStream() << "SignalProfiler: S2E was built without "
+            << "S2E_PROFILE_SIGNALS, signals will not be profiled" << std::endl;
+#endif
+}
+
+SignalProfiler::~SignalProfiler()
+{
+#ifdef S2E_PROFILE_SIGNALS
+    fsigc::profiler::enabled = false;
+    writeReport();
+#endif
+}
+
+#ifdef S2E_PROFILE_SIGNALS
+
+std::string SignalProfiler::getOwnerName(const void *owner) const
+{
+    if (!owner) {
+        return "-";
+    }
+
+    Owners::const_iterator it = m_owners.find(owner);
+    if (it != m_owners.end()) {
+        return (*it).second;
+    }
+
+    std::stringstream ss;
+    ss << "0x" << std::hex << (uintptr_t) owner;
+    return ss.str();
+}
+
+void SignalProfiler::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+    if (preFork || !isChild) {
+        return;
+    }
+
+    //Each process reports its own slots, the parent keeps the history
+    fsigc::profiler::reset();
+
+    m_startTime = time(NULL);
+    m_lastReport = m_startTime;
+    m_startCycles = fsigc::profiler::cycles();
+}
+
+void SignalProfiler::onTimer()
+{
+    if (!m_interval) {
+        return;
+    }
+
+    uint64_t now = time(NULL);
+    if (now - m_lastReport < m_interval) {
+        return;
+    }
+
+    m_lastReport = now;
+    writeReport();
+}
+
+namespace {
+typedef fsigc::profiler::entry Entry;
+
+struct Row {
+    std::string plugin;
+    std::string signal;
+    Entry entry;
+};
+
+struct BySelfCycles {
+    bool operator()(const Row &a, const Row &b) const {
+        return a.entry.selfCycles > b.entry.selfCycles;
+    }
+};
+
+void addEntry(Entry &to, const Entry &e)
+{
+    to.calls += e.calls;
+    to.cycles += e.cycles;
+    to.selfCycles += e.selfCycles;
+    for (unsigned i = 0; i < fsigc::profiler::HISTOGRAM_SIZE; ++i) {
+        to.histogram[i] += e.histogram[i];
+    }
+}
+}
+
+static void printRow(std::ostream &os, const std::string &plugin,
+                     const std::string &signal, const Entry &e,
+                     uint64_t elapsedCycles)
+{
+    double share = elapsedCycles ? 100.0 * e.selfCycles / elapsedCycles : 0;
+
+    os << std::setw(28) << std::left << plugin
+       << std::setw(32) << signal << std::right
+       << std::setw(12) << e.calls
+       << std::setw(16) << e.cycles
+       << std::setw(16) << e.selfCycles
+       << std::setw(8) << std::fixed << std::setprecision(2) << share
+       << std::setw(10) << e.cycles / e.calls
+       << std::setw(12) << fsigc::profiler::percentile(e, 0.99)
+       << std::endl;
+}
+
+static void printHeader(std::ostream &os, const char *first, const char *second)
+{
+    os << std::setw(28) << std::left << first
+       << std::setw(32) << second << std::right
+       << std::setw(12) << "Calls"
+       << std::setw(16) << "Cycles"
+       << std::setw(16) << "SelfCycles"
+       << std::setw(8) << "Self%"
+       << std::setw(10) << "Avg"
+       << std::setw(12) << "P99" << std::endl;
+}
+
+void SignalProfiler::writeReport()
+{
+    std::string fileName = s2e()->getOutputFilename("signalprofile.txt");
+    std::string tmpName = fileName + ".tmp";
+
+    uint64_t elapsedCycles = fsigc::profiler::cycles() - m_startCycles;
+
+    std::vector<Entry> entries;
+    fsigc::profiler::collect(entries);
+
+    //Signals of different translation units share names,
+    //slots of non-plugin objects share owners
+    typedef std::map<std::pair<std::string, std::string>, unsigned> RowIndex;
+    RowIndex rowIndex;
+    std::vector<Row> rows;
+
+    typedef std::map<std::string, Entry> PluginTotals;
+    PluginTotals plugins;
+    uint64_t selfCycles = 0;
+
+    foreach2(it, entries.begin(), entries.end()) {
+        const Entry &e = *it;
+
+        std::string plugin = getOwnerName(e.owner);
+        std::string signal;
+        if (e.signalName) {
+            signal = e.signalName;
+        } else {
+            std::stringstream ss;
+            ss << "signal@0x" << std::hex << (uintptr_t) e.signal;
+            signal = ss.str();
+        }
+
+        std::pair<RowIndex::iterator, bool> ins =
+                rowIndex.insert(std::make_pair(std::make_pair(plugin, signal), rows.size()));
+        if (ins.second) {
+            Row row;
+            row.plugin = plugin;
+            row.signal = signal;
+            row.entry = e;
+            rows.push_back(row);
+        } else {
+            addEntry(rows[(*ins.first).second].entry, e);
+        }
+
+        PluginTotals::iterator pit = plugins.find(plugin);
+        if (pit == plugins.end()) {
+            plugins[plugin] = e;
+        } else {
+            addEntry((*pit).second, e);
+        }
+
+        selfCycles += e.selfCycles;
+    }
+
+    std::vector<Row> totals;
+    foreach2(it, plugins.begin(), plugins.end()) {
+        Row row;
+        row.plugin = (*it).first;
+        row.entry = (*it).second;
+        totals.push_back(row);
+    }
+
+    std::sort(rows.begin(), rows.end(), BySelfCycles());
+    std::sort(totals.begin(), totals.end(), BySelfCycles());
+
+    {
+        std::ofstream os(tmpName.c_str());
+        if (!os) {
+            s2e()->getWarningsStream() << "SignalProfiler: could not create "
+                    << tmpName << std::endl;
+            return;
+        }
+
+        os << "Signal profile after " << (time(NULL) - m_startTime) << " seconds: "
+           << selfCycles << " of " << elapsedCycles << " cycles spent in slots"
+           << std::endl
+           << "Cycles include the signals emitted by the slots, self cycles do not."
+           << std::endl
+           << "P99 is the latency within which 99% of the calls completed, over by at most 25%."
+           << std::endl << std::endl;
+
+        os << "Plugins by self cycles" << std::endl;
+        printHeader(os, "Plugin", "Signal");
+        foreach2(it, totals.begin(), totals.end()) {
+            printRow(os, (*it).plugin, "(all)", (*it).entry, elapsedCycles);
+        }
+        os << std::endl;
+
+        os << "Slots by self cycles" << std::endl;
+        printHeader(os, "Plugin", "Signal");
+        foreach2(it, rows.begin(), rows.end()) {
+            printRow(os, (*it).plugin, (*it).signal, (*it).entry, elapsedCycles);
+        }
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) < 0) {
+        s2e()->getWarningsStream() << "SignalProfiler: could not write "
+                << fileName << std::endl;
+        unlink(tmpName.c_str());
+    }
+}
+
+#endif
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,86 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_PLUGINS_SIGNALPROFILER_H
+#define S2E_PLUGINS_SIGNALPROFILER_H
+
+#include <s2e/Plugin.h>
+#include <s2e/Plugins/CorePlugin.h>
+
+#include <map>
+#include <string>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ *  Times the slots of all signals while S2E runs and periodically
+ *  writes signalprofile.txt: calls, cycles, self cycles and 99th
+ *  percentile of the slot latency, per plugin and per signal.
+ *  Requires S2E_PROFILE_SIGNALS (see s2e_config.h).
+ */
+class SignalProfiler : public Plugin
+{
+    S2E_PLUGIN
+public:
+    SignalProfiler(S2E* s2e): Plugin(s2e) {}
+    virtual ~SignalProfiler();
+
+    void initialize();
+
+private:
+    //Plugin names by object address, resolved while all plugins exist
+    typedef std::map<const void*, std::string> Owners;
+    Owners m_owners;
+
+    unsigned m_interval;
+    uint64_t m_startTime;
+    uint64_t m_startCycles;
+    uint64_t m_lastReport;
+
+    std::string getOwnerName(const void *owner) const;
+
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+
+    void onTimer();
+
+    void writeReport();
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif
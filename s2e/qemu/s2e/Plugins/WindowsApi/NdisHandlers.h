@@ -218,6 +218,8 @@ public:
     NdisHandlersState();
     virtual ~NdisHandlersState();
     virtual NdisHandlersState* clone() const;
+    //The return handlers keep updating the state after forking
+    virtual bool isClonedOnFork() const { return true; }
     static PluginState *factory(Plugin *p, S2EExecutionState *s);
 
     friend class NdisHandlers;
@@ -163,6 +163,9 @@ public:
     /** Get Core plugin */
     inline CorePlugin* getCorePlugin() const { return m_corePlugin; }
 
+    /** Get all active plugins, CorePlugin first */
+    const std::vector<Plugin*>& getActivePlugins() const { return m_activePluginsList; }
+
     /** Get database */
     Database *getDb() const {
         return m_database;
@@ -174,6 +177,9 @@ public:
     /** Get output directory name */
     const std::string& getOutputDirectory() const { return m_outputDirectory; }
 
+    /** Get the output directory shared by all S2E processes */
+    const std::string& getOutputDirectoryBase() const { return m_outputDirectoryBase; }
+
     /** Get a filename inside an output directory */
     std::string getOutputFilename(const std::string& fileName);
 
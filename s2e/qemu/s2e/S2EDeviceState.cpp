@@ -97,6 +97,7 @@ void S2EDeviceState::clone(S2EDeviceState **state1, S2EDeviceState **state2)
     copy1->m_State = 0;
     copy1->m_StateSize = 0;
     copy1->m_canTransferSector = m_canTransferSector;
+    copy1->m_DiskHash = m_DiskHash;
     *state1 = copy1;
 
     S2EDeviceState* copy2 = new S2EDeviceState();
@@ -104,6 +105,7 @@ void S2EDeviceState::clone(S2EDeviceState **state1, S2EDeviceState **state2)
     copy2->m_State = 0;
     copy2->m_StateSize = 0;
     copy2->m_canTransferSector = m_canTransferSector;
+    copy2->m_DiskHash = m_DiskHash;
     *state2 = copy2;
 }
 
@@ -123,6 +125,9 @@ S2EDeviceState::S2EDeviceState()
 {
     m_Parent = NULL;
     m_canTransferSector = true;
+    m_DiskHash = 0;
+    m_SnapshotHash = 0;
+    m_SnapshotHashValid = false;
 }
 
 S2EDeviceState::~S2EDeviceState()
@@ -209,6 +214,7 @@ void S2EDeviceState::saveDeviceState()
     //DPRINTF("\n");
 
     ShrinkBuffer();
+    m_SnapshotHashValid = false;
     s2e_dev_snapshot_enable = 0;
     s_CurrentState = NULL;
     vm_start();
@@ -243,11 +249,41 @@ void S2EDeviceState::restoreDeviceState()
 }
 
 
+void S2EDeviceState::spillSnapshot(uint8_t *buffer)
+{
+    assert(m_State);
+    memcpy(buffer, m_State, m_StateSize);
+    free(m_State);
+    m_State = NULL;
+    m_StateSize = 0;
+    m_Offset = 0;
+}
+
+void S2EDeviceState::fillSnapshot(const uint8_t *buffer, unsigned size)
+{
+    assert(!m_State);
+    AllocateBuffer(size);
+    memcpy(m_State, buffer, size);
+    m_Offset = size;
+    ShrinkBuffer();
+}
+
 bool S2EDeviceState::canTransferSector() const
 {
     return m_canTransferSector;
 }
 
+uint64_t S2EDeviceState::getStateHash()
+{
+    //Spilling and filling the snapshot does not change its contents
+    if (!m_SnapshotHashValid) {
+        assert(m_State && "The device state must be saved and paged in");
+        m_SnapshotHash = hashBuffer(m_State, m_StateSize);
+        m_SnapshotHashValid = true;
+    }
+    return hashBuffer(&m_DiskHash, sizeof(m_DiskHash), m_SnapshotHash);
+}
+
 /*****************************************************************************/
 /*****************************************************************************/
 /*****************************************************************************/
@@ -323,11 +359,45 @@ int S2EDeviceState::GetBuffer(uint8_t *buf, int size1)
 /*****************************************************************************/
 /*****************************************************************************/
 
+namespace {
+uint64_t hashSector(BlockDriverState *bs, int64_t sector, const uint8_t *buf)
+{
+    uint64_t hash = hashBuffer(&bs, sizeof(bs));
+    hash = hashBuffer(&sector, sizeof(sector), hash);
+    return hashBuffer(buf, 512, hash);
+}
+}
+
+//Returns the last version of the sector written by this state or its
+//parents, NULL if the sector still has the contents of the disk image
+const uint8_t *S2EDeviceState::findSector(BlockDriverState *bs, int64_t sector)
+{
+    for (S2EDeviceState *curState = this; curState; curState = curState->m_Parent) {
+        BlockDeviceToSectorMap::iterator bit = curState->m_BlockDevices.find(bs);
+        if (bit == curState->m_BlockDevices.end()) {
+            continue;
+        }
+        SectorMap::iterator it = (*bit).second.find(sector);
+        if (it != (*bit).second.end()) {
+            return (*it).second;
+        }
+    }
+    return NULL;
+}
+
 int S2EDeviceState::writeSector(struct BlockDriverState *bs, int64_t sector, const uint8_t *buf, int nb_sectors)
 {
     SectorMap &dev = m_BlockDevices[bs];
  //   DPRINTF("writeSector %#"PRIx64" count=%d\n", sector, nb_sectors);
     for (int64_t i = sector; i<sector+nb_sectors; i++) {
+        //Replace the contribution of the previous version of the sector.
+        //Unwritten sectors do not contribute to the hash.
+        const uint8_t *oldSector = findSector(bs, i);
+        if (oldSector) {
+            m_DiskHash ^= hashSector(bs, i, oldSector);
+        }
+        m_DiskHash ^= hashSector(bs, i, buf);
+
         SectorMap::iterator it = dev.find(i);
         uint8_t *secbuf;
         
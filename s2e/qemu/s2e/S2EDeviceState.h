@@ -69,12 +69,20 @@ private:
     S2EDeviceState *m_Parent;
     BlockDeviceToSectorMap m_BlockDevices;
     bool  m_canTransferSector;
+
+    //Combination of the hashes of all the sectors written by this
+    //state and its parents, maintained by writeSector
+    uint64_t m_DiskHash;
+
+    uint64_t m_SnapshotHash;
+    bool m_SnapshotHashValid;
     
 
     void AllocateBuffer(unsigned int Sz);
     void ShrinkBuffer();
 
     void cloneDiskState();
+    const uint8_t *findSector(BlockDriverState *bs, int64_t sector);
 
     S2EDeviceState(const S2EDeviceState &);
 public:
@@ -107,6 +115,15 @@ public:
     void initDeviceState();
     void restoreDeviceState();
     void saveDeviceState();
+
+    /** Hash of the saved snapshot and of the disk writes. Execution
+        states are only merged if their device states have the same hash. */
+    uint64_t getStateHash();
+
+    //Moves the snapshot of an inactive state to/from secondary storage
+    unsigned getSnapshotSize() const { return m_State ? m_StateSize : 0; }
+    void spillSnapshot(uint8_t *buffer);
+    void fillSnapshot(const uint8_t *buffer, unsigned size);
 };
 
 }
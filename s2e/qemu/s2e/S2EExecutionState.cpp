@@ -111,7 +111,9 @@ S2EExecutionState::~S2EExecutionState()
     //print_stacktrace();
 
     for(it = m_PluginState.begin(); it != m_PluginState.end(); ++it) {
-        delete it->second;
+        if (*it && --(*it)->m_RefCount == 0) {
+            delete *it;
+        }
     }
 
     g_s2e->refreshPlugins();
@@ -249,13 +251,25 @@ ExecutionState* S2EExecutionState::clone()
     ret->m_timersState = new TimersState;
     *ret->m_timersState = *m_timersState;
 
-    // Clone the plugins
-    PluginStateMap::iterator it;
-    ret->m_PluginState.clear();
-    for(it = m_PluginState.begin(); it != m_PluginState.end(); ++it) {
-        ret->m_PluginState.insert(std::make_pair((*it).first, (*it).second->clone()));
+    // Share the plugin states, they get copied when first accessed.
+    // The states that opted out of sharing are copied right away.
+    ret->m_PluginState = m_PluginState;
+    for(unsigned i = 0; i < m_PluginState.size(); ++i) {
+        PluginState *ps = m_PluginState[i];
+        if (!ps) {
+            continue;
+        }
+
+        if (ps->isClonedOnFork()) {
+            ret->m_PluginState[i] = ps->clone();
+        } else {
+            ++ps->m_RefCount;
+        }
     }
 
+    // The plugins may have cached the states that are now shared
+    g_s2e->refreshPlugins();
+
     // This objects are not in TLB and won't cause any changes to it
     ret->m_cpuRegistersObject = ret->addressSpace.getWriteable(
                             m_cpuRegistersState, m_cpuRegistersObject);
@@ -515,36 +529,87 @@ uint64_t S2EExecutionState::getSymbolicRegistersMask() const
     return mask;
 }
 
-bool S2EExecutionState::readMemoryConcrete(uint64_t address, void *buf,
+uint64_t S2EExecutionState::readMemoryConcretePrefix(uint64_t address, void *buf,
                                    uint64_t size, AddressType addressType)
 {
     uint8_t *d = (uint8_t*)buf;
-    while (size>0) {
-        ref<Expr> v = readMemory(address, Expr::Int8, addressType);
-        if (v.isNull() || !isa<ConstantExpr>(v)) {
-            return false;
+    uint64_t done = 0;
+    while (done < size) {
+        /* Translate once per guest page, then copy whole objects */
+        uint64_t hostAddress = getHostAddress(address + done, addressType);
+        if (hostAddress == (uint64_t) -1) {
+            break;
+        }
+
+        uint64_t pageEnd = done + TARGET_PAGE_SIZE -
+                           ((address + done) & ~TARGET_PAGE_MASK);
+        if (pageEnd > size) {
+            pageEnd = size;
+        }
+
+        while (done < pageEnd) {
+            uint64_t offset = hostAddress & ~S2E_RAM_OBJECT_MASK;
+            uint64_t length = S2E_RAM_OBJECT_SIZE - offset;
+            if (length > pageEnd - done) {
+                length = pageEnd - done;
+            }
+
+            ObjectPair op = addressSpace.findObject(hostAddress & S2E_RAM_OBJECT_MASK);
+
+            assert(op.first && op.first->isUserSpecified
+                   && op.first->size == S2E_RAM_OBJECT_SIZE);
+
+            unsigned n = op.second->readConcrete(offset, d + done, length);
+            done += n;
+            hostAddress += n;
+            if (n < length) {
+                return done;
+            }
         }
-        *d = (uint8_t)cast<ConstantExpr>(v)->getZExtValue(8);
-        size--;
-        d++;
-        address++;
     }
-    return true;
+    return done;
+}
+
+bool S2EExecutionState::readMemoryConcrete(uint64_t address, void *buf,
+                                   uint64_t size, AddressType addressType)
+{
+    return readMemoryConcretePrefix(address, buf, size, addressType) == size;
 }
 
 bool S2EExecutionState::writeMemoryConcrete(uint64_t address, void *buf,
                                    uint64_t size, AddressType addressType)
 {
     uint8_t *d = (uint8_t*)buf;
-    while (size>0) {
-        klee::ref<klee::ConstantExpr> val = klee::ConstantExpr::create(*d, klee::Expr::Int8);
-        bool b = writeMemory(address, val,  addressType);
-        if (!b) {
+    uint64_t done = 0;
+    while (done < size) {
+        uint64_t hostAddress = getHostAddress(address + done, addressType);
+        if (hostAddress == (uint64_t) -1) {
             return false;
         }
-        size--;
-        d++;
-        address++;
+
+        uint64_t pageEnd = done + TARGET_PAGE_SIZE -
+                           ((address + done) & ~TARGET_PAGE_MASK);
+        if (pageEnd > size) {
+            pageEnd = size;
+        }
+
+        while (done < pageEnd) {
+            uint64_t offset = hostAddress & ~S2E_RAM_OBJECT_MASK;
+            uint64_t length = S2E_RAM_OBJECT_SIZE - offset;
+            if (length > pageEnd - done) {
+                length = pageEnd - done;
+            }
+
+            ObjectPair op = addressSpace.findObject(hostAddress & S2E_RAM_OBJECT_MASK);
+
+            assert(op.first && op.first->isUserSpecified
+                   && op.first->size == S2E_RAM_OBJECT_SIZE);
+
+            ObjectState *wos = addressSpace.getWriteable(op.first, op.second);
+            wos->writeConcrete(offset, d + done, length);
+            done += length;
+            hostAddress += length;
+        }
     }
     return true;
 }
@@ -589,37 +654,57 @@ uint64_t S2EExecutionState::getHostAddress(uint64_t address,
 bool S2EExecutionState::readString(uint64_t address, std::string &s, unsigned maxLen)
 {
     s = "";
-    do {
-        uint8_t c;
-        SREADR(this, address, c);
+    uint8_t buf[S2E_RAM_OBJECT_SIZE];
+    while (s.size() < maxLen) {
+        uint64_t chunk = maxLen - s.size();
+        if (chunk > sizeof(buf)) {
+            chunk = sizeof(buf);
+        }
 
-        if (c) {
-            s = s + (char)c;
-        }else {
-            return true;
+        /* The chunk may extend past the terminator into symbolic or
+           unmapped memory, only the bytes before it matter */
+        uint64_t n = readMemoryConcretePrefix(address, buf, chunk);
+        for (uint64_t i = 0; i < n; ++i) {
+            if (!buf[i]) {
+                s.append((const char*) buf, i);
+                return true;
+            }
         }
-        address++;
-        maxLen--;
-    }while(maxLen>=0);
+        if (n < chunk) {
+            return false;
+        }
+
+        s.append((const char*) buf, n);
+        address += n;
+    }
     return true;
 }
 
 bool S2EExecutionState::readUnicodeString(uint64_t address, std::string &s, unsigned maxLen)
 {
     s = "";
-    do {
-        uint16_t c;
-        SREADR(this, address, c);
+    uint16_t buf[S2E_RAM_OBJECT_SIZE / 2];
+    unsigned len = 0;
+    while (len < maxLen) {
+        uint64_t chunk = maxLen - len;
+        if (chunk > sizeof(buf) / 2) {
+            chunk = sizeof(buf) / 2;
+        }
 
-        if (c) {
-            s = s + (char)c;
-        }else {
-            return true;
+        uint64_t n = readMemoryConcretePrefix(address, buf, chunk * 2) / 2;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (!buf[i]) {
+                return true;
+            }
+            s = s + (char)buf[i];
+        }
+        if (n < chunk) {
+            return false;
         }
 
-        address+=2;
-        maxLen--;
-    }while(maxLen>=0);
+        len += n;
+        address += n * 2;
+    }
     return true;
 }
 
@@ -824,17 +909,15 @@ void S2EExecutionState::readRamConcreteCheck(uint64_t hostAddress, uint8_t* buf,
                op.first->address == page_addr &&
                op.first->size == S2E_RAM_OBJECT_SIZE);
 
-        for(uint64_t i=0; i<size; ++i) {
-            if(!op.second->readConcrete8(page_offset+i, buf+i)) {
-                if (PrintModeSwitch) {
-                    g_s2e->getMessagesStream()
-                            << "Switching to KLEE executor at pc = "
-                            << std::hex << getPc() << std::endl;
-                }
-                m_startSymbexAtPC = getPc();
-                // XXX: what about regs_to_env ?
-                longjmp(env->jmp_env, 1);
+        if(op.second->readConcrete(page_offset, buf, size) != size) {
+            if (PrintModeSwitch) {
+                g_s2e->getMessagesStream()
+                        << "Switching to KLEE executor at pc = "
+                        << std::hex << getPc() << std::endl;
             }
+            m_startSymbexAtPC = getPc();
+            // XXX: what about regs_to_env ?
+            longjmp(env->jmp_env, 1);
         }
     } else {
         /* Access spans multiple MemoryObject's */
@@ -866,16 +949,21 @@ void S2EExecutionState::readRamConcrete(uint64_t hostAddress, uint8_t* buf, uint
                op.first->size == S2E_RAM_OBJECT_SIZE);
 
         ObjectState *wos = NULL;
-        for(uint64_t i=0; i<size; ++i) {
-            if(!op.second->readConcrete8(page_offset+i, buf+i)) {
-                if(!wos) {
-                    op.second = wos = addressSpace.getWriteable(
-                                                    op.first, op.second);
-                }
-                buf[i] = g_s2e->getExecutor()->toConstant(*this, wos->read8(page_offset+i),
-                       "memory access from concrete code")->getZExtValue(8);
-                wos->write8(page_offset+i, buf[i]);
+        uint64_t i = 0;
+        while(i < size) {
+            /* Copy concrete spans at once, concretize symbolic bytes */
+            i += op.second->readConcrete(page_offset+i, buf+i, size-i);
+            if(i == size)
+                break;
+
+            if(!wos) {
+                op.second = wos = addressSpace.getWriteable(
+                                                op.first, op.second);
             }
+            buf[i] = g_s2e->getExecutor()->toConstant(*this, wos->read8(page_offset+i),
+                   "memory access from concrete code")->getZExtValue(8);
+            wos->write8(page_offset+i, buf[i]);
+            ++i;
         }
     } else {
         /* Access spans multiple MemoryObject's */
@@ -908,9 +996,7 @@ void S2EExecutionState::writeRamConcrete(uint64_t hostAddress, const uint8_t* bu
 
         ObjectState* wos =
                 addressSpace.getWriteable(op.first, op.second);
-        for(uint64_t i=0; i<size; ++i) {
-            wos->write8(page_offset+i, buf[i]);
-        }
+        wos->writeConcrete(page_offset, buf, size);
 
     } else {
         /* Access spans multiple MemoryObject's */
@@ -1117,7 +1203,32 @@ void S2EExecutionState::dumpX86State(std::ostream &os) const
     os << std::dec;
 }
 
+namespace {
+//Number of bytes that would need an ite expression, counting stops
+//once the limit is exceeded
+unsigned countDifferingBytes(const ObjectState *a, const ObjectState *b,
+                             unsigned limit)
+{
+    unsigned count = 0;
+    for(unsigned i = 0; i < a->size && count <= limit; ++i) {
+        uint8_t av, bv;
+        if(a->readConcrete8(i, &av) && b->readConcrete8(i, &bv)) {
+            if(av != bv)
+                ++count;
+        } else if(a->read8(i) != b->read8(i)) {
+            ++count;
+        }
+    }
+    return count;
+}
+}
+
 bool S2EExecutionState::merge(const ExecutionState &_b)
+{
+    return merge(_b, (unsigned) -1);
+}
+
+bool S2EExecutionState::merge(const ExecutionState &_b, unsigned maxSelects)
 {
     assert(dynamic_cast<const S2EExecutionState*>(&_b));
     const S2EExecutionState& b = static_cast<const S2EExecutionState&>(_b);
@@ -1151,6 +1262,7 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
             if(itA->caller!=itB->caller || itA->kf!=itB->kf) {
                 if(DebugLogStateMerge)
                     s << "merge failed: different callstacks" << std::endl;
+                return false;
             }
           ++itA;
           ++itB;
@@ -1205,6 +1317,13 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
         }
     }
 
+    /* Check device state, compared through the hash of its snapshot */
+    if(m_deviceState->getStateHash() != b.m_deviceState->getStateHash()) {
+        if(DebugLogStateMerge)
+            s << "merge failed: different device state" << std::endl;
+        return false;
+    }
+
     // We cannot merge if addresses would resolve differently in the
     // states. This means:
     //
@@ -1258,6 +1377,23 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
         return false;
     }
 
+    /* Estimate the cost of the merge before modifying the state */
+    if(maxSelects != (unsigned) -1) {
+        unsigned selects = 0;
+        for(std::set<const MemoryObject*>::iterator it = mutated.begin(),
+                        ie = mutated.end(); it != ie && selects <= maxSelects; ++it) {
+            selects += countDifferingBytes(addressSpace.findObject(*it),
+                                           b.addressSpace.findObject(*it),
+                                           maxSelects - selects);
+        }
+        if(selects > maxSelects) {
+            if(DebugLogStateMerge)
+                s << "merge failed: more than " << maxSelects
+                  << " bytes differ" << std::endl;
+            return false;
+        }
+    }
+
     // Create state predicates
     ref<Expr> inA = ConstantExpr::alloc(1, Expr::Bool);
     ref<Expr> inB = ConstantExpr::alloc(1, Expr::Bool);
@@ -1344,22 +1480,24 @@ bool S2EExecutionState::merge(const ExecutionState &_b)
         }
     }
 
-    // Flush TLB
-    {
-        CPUState* cpu = (CPUState*) (m_cpuSystemObject->getConcreteStore() - CPU_OFFSET(eip));
-        cpu->current_tb = NULL;
-
-        for (int mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-            for(int i = 0; i < CPU_TLB_SIZE; i++)
-                cpu->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
-            for(int i = 0; i < CPU_S2E_TLB_SIZE; i++)
-                cpu->s2e_tlb_table[mmu_idx][i].objectState = 0;
-        }
+    flushTlb();
 
-        memset (cpu->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
+    return true;
+}
+
+void S2EExecutionState::flushTlb()
+{
+    CPUState* cpu = (CPUState*) (m_cpuSystemObject->getConcreteStore() - CPU_OFFSET(eip));
+    cpu->current_tb = NULL;
+
+    for (int mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for(int i = 0; i < CPU_TLB_SIZE; i++)
+            cpu->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
+        for(int i = 0; i < CPU_S2E_TLB_SIZE; i++)
+            cpu->s2e_tlb_table[mmu_idx][i].objectState = 0;
     }
 
-    return true;
+    memset (cpu->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 }
 
 CPUState *S2EExecutionState::getConcreteCpuState() const
@@ -1384,17 +1522,13 @@ void S2EExecutionState::dmaRead(uint64_t hostAddress, uint8_t *buf, unsigned siz
             m_memcache.put(hostAddress, op);
         }
         assert(op.first && op.second && op.first->address == hostPage);
-        ObjectState *os = const_cast<ObjectState*>(op.second);
-        uint8_t *concreteStore = os->getConcreteStore();
 
         unsigned offset = hostAddress & (S2E_RAM_OBJECT_SIZE-1);
 
-        for (unsigned i=0; i<length; ++i) {
-            if (_s2e_check_concrete(os, offset+i, 1)) {
-                buf[i] = concreteStore[offset+i];
-            }else {
-                readRamConcrete(hostAddress+i, &buf[i], sizeof(buf[i]));
-            }
+        /* Fully concrete objects are copied at once, symbolic bytes go
+           through readRamConcrete, which concretizes the rest too */
+        if (op.second->readConcrete(offset, buf, length) != length) {
+            readRamConcrete(hostAddress, buf, length);
         }
         buf+=length;
         hostAddress+=length;
@@ -1420,17 +1554,9 @@ void S2EExecutionState::dmaWrite(uint64_t hostAddress, uint8_t *buf, unsigned si
 
         assert(op.first && op.second && op.first->address == hostPage);
         ObjectState *os = addressSpace.getWriteable(op.first, op.second);
-        uint8_t *concreteStore = os->getConcreteStore();
 
         unsigned offset = hostAddress & (S2E_RAM_OBJECT_SIZE-1);
-
-        for (unsigned i=0; i<length; ++i) {
-            if (_s2e_check_concrete(os, offset+i, 1)) {
-                concreteStore[offset+i] = buf[i];
-            }else {
-                writeRamConcrete(hostAddress+i, &buf[i], sizeof(buf[i]));
-            }
-        }
+        os->writeConcrete(offset, buf, length);
         buf+=length;
         hostAddress+=length;
         size -= length;
@@ -42,6 +42,7 @@
 
 #include "S2EStatsTracker.h"
 #include "MemoryCache.h"
+#include "Plugin.h"
 #include "s2e_config.h"
 
 extern "C" {
@@ -55,7 +56,7 @@ extern "C" {
 struct CPUX86State;
 #define CPU_OFFSET(field) offsetof(CPUX86State, field)
 
-//#include <tr1/unordered_map>
+#include <vector>
 
 namespace s2e {
 
@@ -65,8 +66,8 @@ class S2EDeviceState;
 class S2EExecutionState;
 struct S2ETranslationBlock;
 
-//typedef std::tr1::unordered_map<const Plugin*, PluginState*> PluginStateMap;
-typedef std::map<const Plugin*, PluginState*> PluginStateMap;
+//Plugin states indexed by Plugin::getPluginIndex()
+typedef std::vector<PluginState*> PluginStateMap;
 typedef PluginState* (*PluginStateFactory)(Plugin *p, S2EExecutionState *s);
 
 typedef MemoryCachePool<klee::ObjectPair,
@@ -178,14 +179,30 @@ public:
     /*************************************************/
 
     PluginState* getPluginState(Plugin *plugin, PluginStateFactory factory) {
-        PluginStateMap::iterator it = m_PluginState.find(plugin);
-        if (it == m_PluginState.end()) {
-            PluginState *ret = factory(plugin, this);
+        unsigned index = plugin->getPluginIndex();
+        if (index >= m_PluginState.size()) {
+            m_PluginState.resize(index + 1, NULL);
+        }
+
+        PluginState *&ret = m_PluginState[index];
+        if (!ret) {
+            ret = factory(plugin, this);
             assert(ret);
-            m_PluginState[plugin] = ret;
-            return ret;
+        } else if (ret->m_RefCount > 1) {
+            //Still shared with another state, copy it before it gets modified
+            PluginState *copy = ret->clone();
+            --ret->m_RefCount;
+            ret = copy;
+        }
+        return ret;
+    }
+
+    const PluginState* getConstPluginState(Plugin *plugin, PluginStateFactory factory) {
+        unsigned index = plugin->getPluginIndex();
+        if (index < m_PluginState.size() && m_PluginState[index]) {
+            return m_PluginState[index];
         }
-        return (*it).second;
+        return getPluginState(plugin, factory);
     }
 
     /** Returns true is this is the active state */
@@ -261,6 +278,12 @@ public:
     bool readMemoryConcrete(uint64_t address, void *buf, uint64_t size,
                             AddressType addressType = VirtualAddress);
 
+    /** Read as many concrete bytes as possible from memory, stopping
+        at the first symbolic or unmapped byte. Returns the number of
+        bytes read. */
+    uint64_t readMemoryConcretePrefix(uint64_t address, void *buf, uint64_t size,
+                                      AddressType addressType = VirtualAddress);
+
     /** Write concrete value to memory */
     bool writeMemoryConcrete(uint64_t address, void *buf,
                              uint64_t size, AddressType addressType=VirtualAddress);
@@ -358,6 +381,13 @@ public:
     /** Attempt to merge two states */
     bool merge(const ExecutionState &b);
 
+    /** Attempt to merge two states, giving up if more than maxSelects
+        ite expressions would be needed for the differing bytes */
+    bool merge(const ExecutionState &b, unsigned maxSelects);
+
+    /** Invalidate the TLB and TB caches saved in the concrete CPU state */
+    void flushTlb();
+
     void updateTlbEntry(CPUX86State* env,
                               int mmu_idx, uint64_t virtAddr, uint64_t hostAddr);
 };
@@ -67,6 +67,8 @@ uint64_t helper_set_cc_op_eflags(void);
 #include <s2e/S2EDeviceState.h>
 #include <s2e/SelectRemovalPass.h>
 #include <s2e/S2EStatsTracker.h>
+#include <s2e/StateSpiller.h>
+#include <s2e/PageDeduplicator.h>
 
 //XXX: Remove this from executor
 #include <s2e/Plugins/ExecutionTracers/TestCaseGenerator.h>
@@ -86,6 +88,7 @@ uint64_t helper_set_cc_op_eflags(void);
 #include <llvm/System/Process.h>
 #include <llvm/Support/CommandLine.h>
 
+#include <klee/ConcreteStoreArena.h>
 #include <klee/PTree.h>
 #include <klee/Memory.h>
 #include <klee/Searcher.h>
@@ -94,6 +97,7 @@ uint64_t helper_set_cc_op_eflags(void);
 #include <klee/CoreStats.h>
 #include <klee/TimerStatIncrementer.h>
 #include <klee/Solver.h>
+#include <klee/Internal/System/Time.h>
 
 #include <llvm/System/TimeValue.h>
 
@@ -177,6 +181,23 @@ namespace {
     ConcretizeIoWrites("concretize-io-writes",
             cl::desc("Concretize symbolic I/O writes"),
             cl::init(true));
+
+    cl::opt<unsigned>
+    StateSpillWatermark("state-spill-watermark",
+            cl::desc("Resident memory (in MB) above which inactive states are"
+                     " spilled to disk (0 to disable)"),
+            cl::init(0));
+
+    cl::opt<unsigned>
+    StateSpillSegmentSize("state-spill-segment-size",
+            cl::desc("Size (in MB) of the segments of the state swap file"),
+            cl::init(64));
+
+    cl::opt<unsigned>
+    DedupConcretePages("dedup-concrete-pages",
+            cl::desc("Interval (in seconds) between passes that share identical"
+                     " concrete RAM objects of inactive states (0 to disable)"),
+            cl::init(0));
 }
 
 //The logs may be flooded with messages when switching execution mode.
@@ -333,19 +354,47 @@ void S2EExecutor::handlerTraceMemoryAccess(Executor* executor,
     assert(dynamic_cast<S2EExecutor*>(executor));
 
     S2EExecutor* s2eExecutor = static_cast<S2EExecutor*>(executor);
-    if(!s2eExecutor->m_s2e->getCorePlugin()->onDataMemoryAccess.empty()) {
-        assert(dynamic_cast<S2EExecutionState*>(state));
-        S2EExecutionState* s2eState = static_cast<S2EExecutionState*>(state);
+    CorePlugin *core = s2eExecutor->m_s2e->getCorePlugin();
+
+    assert(dynamic_cast<S2EExecutionState*>(state));
+    S2EExecutionState* s2eState = static_cast<S2EExecutionState*>(state);
 
-        assert(args.size() == 6);
+    assert(args.size() == 6);
 
-        Expr::Width width = cast<klee::ConstantExpr>(args[3])->getZExtValue();
-        bool isWrite = cast<klee::ConstantExpr>(args[4])->getZExtValue();
-        bool isIO    = cast<klee::ConstantExpr>(args[5])->getZExtValue();
+    Expr::Width width = cast<klee::ConstantExpr>(args[3])->getZExtValue();
+    bool isWrite = cast<klee::ConstantExpr>(args[4])->getZExtValue();
+    bool isIO    = cast<klee::ConstantExpr>(args[5])->getZExtValue();
 
-        ref<Expr> value = klee::ExtractExpr::create(args[2], 0, width);
+    bool isConcrete = isa<klee::ConstantExpr>(args[0]) &&
+                      isa<klee::ConstantExpr>(args[1]) &&
+                      isa<klee::ConstantExpr>(args[2]);
 
-        s2eExecutor->m_s2e->getCorePlugin()->onDataMemoryAccess.emit(
+    if(isConcrete) {
+        uint64_t value = cast<klee::ConstantExpr>(args[2])->getZExtValue();
+        if(width < 64) {
+            value &= (1ULL << width) - 1;
+        }
+
+        core->notifyConcreteDataMemoryAccess(s2eState,
+                cast<klee::ConstantExpr>(args[0])->getZExtValue(),
+                cast<klee::ConstantExpr>(args[1])->getZExtValue(),
+                value, width / 8, isWrite, isIO);
+    }
+
+    if((isConcrete || core->onSymbolicDataMemoryAccess.empty()) &&
+            core->onDataMemoryAccess.empty()) {
+        return;
+    }
+
+    ref<Expr> value = klee::ExtractExpr::create(args[2], 0, width);
+
+    if(!isConcrete) {
+        core->onSymbolicDataMemoryAccess.emit(
+                s2eState, args[0], args[1], value, isWrite, isIO);
+    }
+
+    if(!core->onDataMemoryAccess.empty()) {
+        core->onDataMemoryAccess.emit(
                 s2eState, args[0], args[1], value, isWrite, isIO);
     }
 }
@@ -457,8 +506,23 @@ void S2EExecutor::handleForkAndConcretize(Executor* executor,
         return;
     }
 
-    // go starting from min
     Query query(state->constraints, expr);
+
+    // Narrow [min, max] down to the values the expression can take:
+    // the enumeration below then starts at the first feasible value
+    // and does not probe past the last one.
+    ref<klee::ConstantExpr> example;
+    if (s2eExecutor->getSolver()->getValue(query, example)) {
+        uint64_t lower, upper;
+        if (s2eExecutor->getSolver()->getBounds(query, example->getZExtValue(),
+                                                lower, upper) &&
+            lower <= max && upper >= min) {
+            min = std::max(min, lower);
+            max = std::min(max, upper);
+        }
+    }
+
+    // go starting from min
     uint64_t step = 1;
     std::vector< uint64_t > values;
     std::vector< ref<Expr> > conditions;
@@ -769,6 +833,22 @@ S2EExecutor::S2EExecutor(S2E* s2e, TCGLLVMContext *tcgLLVMContext,
 
     m_forceConcretizations = false;
 
+    m_stateSpiller = NULL;
+    if (StateSpillWatermark) {
+        m_stateSpiller = new StateSpiller(m_s2e,
+                (uint64_t) StateSpillWatermark << 20,
+                (uint64_t) StateSpillSegmentSize << 20);
+    }
+
+    m_pageDeduplicator = NULL;
+    m_dedupTimerTicks = 0;
+
+    m_stateSwitchTime = 0;
+    m_stateSwitchCount = 0;
+    if (DedupConcretePages) {
+        m_pageDeduplicator = new PageDeduplicator(m_s2e);
+    }
+
     g_s2e_fork_on_symbolic_address = ForkOnSymbolicAddress;
     g_s2e_concretize_io_addresses = ConcretizeIoAddress;
     g_s2e_concretize_io_writes = ConcretizeIoWrites;
@@ -791,6 +871,12 @@ S2EExecutor::~S2EExecutor()
     tb_flush(env); // release references to TB functions
     if(statsTracker)
         statsTracker->done();
+
+    if (m_stateSpiller)
+        delete m_stateSpiller;
+
+    if (m_pageDeduplicator)
+        delete m_pageDeduplicator;
 }
 
 S2EExecutionState* S2EExecutor::createInitialState()
@@ -886,6 +972,38 @@ void S2EExecutor::initializeExecution(S2EExecutionState* state,
     bindModuleConstants();
 
     initTimers();
+
+    if (m_stateSpiller || m_pageDeduplicator) {
+        m_s2e->getCorePlugin()->onTimer.connect(
+                sigc::mem_fun(*this, &S2EExecutor::onStateMemoryTimer));
+    }
+
+    if (m_stateSpiller) {
+        m_s2e->getCorePlugin()->onProcessFork.connect(
+                sigc::mem_fun(*m_stateSpiller, &StateSpiller::onProcessFork));
+    }
+}
+
+void S2EExecutor::onStateMemoryTimer()
+{
+    //Deduplicate first, the spiller only moves what states still own
+    if (m_pageDeduplicator && ++m_dedupTimerTicks >= DedupConcretePages) {
+        m_dedupTimerTicks = 0;
+
+        std::vector<S2EExecutionState*> inactive;
+        foreach(ExecutionState *es, states) {
+            S2EExecutionState *s = static_cast<S2EExecutionState*>(es);
+            if (s != g_s2e_state && !s->isActive() &&
+                !(m_stateSpiller && m_stateSpiller->isSpilled(s))) {
+                inactive.push_back(s);
+            }
+        }
+        m_pageDeduplicator->deduplicate(inactive);
+    }
+
+    if (m_stateSpiller) {
+        m_stateSpiller->checkMemoryPressure(states, g_s2e_state);
+    }
 }
 
 void S2EExecutor::registerCpu(S2EExecutionState *initialState,
@@ -976,6 +1094,9 @@ void S2EExecutor::registerRam(S2EExecutionState *initialState,
         mprotect((void*) hostAddress, size, PROT_NONE);
 #endif
         m_unusedMemoryRegions.push_back(make_pair(hostAddress, size));
+    }else {
+        //QEMU owns the shared-concrete memory, the arena can only advise it
+        ConcreteStoreArena::get().adviseRegion((uint8_t*) hostAddress, size);
     }
 
     initialState->m_memcache.registerPool(hostAddress, size);
@@ -1087,6 +1208,8 @@ void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
     assert(!newState || !newState->m_active);
     assert(!newState || !newState->m_runningConcrete);
 
+    double switchStart = util::getWallTime();
+
     //Clear the asynchronous request queue, which is not saved as part of
     //the snapshots by QEMU.
     //This is the same mechanism as used by load/save_vmstate, so it should work reliably
@@ -1173,6 +1296,11 @@ void S2EExecutor::doStateSwitch(S2EExecutionState* oldState,
 
     cpu_enable_ticks();
     //m_s2e->getCorePlugin()->onStateSwitch.emit(oldState, newState);
+
+    double switchTime = util::getWallTime() - switchStart;
+    m_stateSwitchTime = m_stateSwitchCount ?
+                        0.9 * m_stateSwitchTime + 0.1 * switchTime : switchTime;
+    ++m_stateSwitchCount;
 }
 
 S2EExecutionState* S2EExecutor::selectNextState(S2EExecutionState *state)
@@ -1218,9 +1346,16 @@ S2EExecutionState* S2EExecutor::selectNextState(S2EExecutionState *state)
     }
 
     if(newState != state) {
+        if (m_stateSpiller) {
+            m_stateSpiller->fillState(newState);
+        }
         doStateSwitch(state, newState);
     }
 
+    if (m_stateSpiller) {
+        m_stateSpiller->onStateSelected(newState);
+    }
+
     //We can't free the state immediately if it is the current state.
     //Do it now.
     foreach(S2EExecutionState* s, m_deletedStates) {
@@ -1822,6 +1957,10 @@ void S2EExecutor::deleteState(klee::ExecutionState *state)
     assert(dynamic_cast<S2EExecutionState*>(state));
     processTree->remove(state->ptreeNode);
     m_deletedStates.push_back(static_cast<S2EExecutionState*>(state));
+
+    if (m_stateSpiller) {
+        m_stateSpiller->discardState(static_cast<S2EExecutionState*>(state));
+    }
 }
 
 void S2EExecutor::doProcessFork(S2EExecutionState *originalState,
@@ -1969,7 +2108,15 @@ S2EExecutor::StatePair S2EExecutor::fork(ExecutionState &current,
     assert(dynamic_cast<S2EExecutionState*>(&current));
     assert(!static_cast<S2EExecutionState*>(&current)->m_runningConcrete);
 
+    double solverTime = current.queryCost;
     StatePair res = Executor::fork(current, condition, isInternal);
+
+    if(!isa<klee::ConstantExpr>(condition)) {
+        m_s2e->getCorePlugin()->onBranchDecision.emit(
+                static_cast<S2EExecutionState*>(&current),
+                res.first && res.second, current.queryCost - solverTime);
+    }
+
     if(res.first && res.second) {
 
         assert(dynamic_cast<S2EExecutionState*>(res.first));
@@ -1997,6 +2144,7 @@ void S2EExecutor::branch(klee::ExecutionState &state,
     assert(dynamic_cast<S2EExecutionState*>(&state));
     assert(!static_cast<S2EExecutionState*>(&state)->m_runningConcrete);
 
+    double solverTime = state.queryCost;
     Executor::branch(state, conditions, result);
 
     unsigned n = conditions.size();
@@ -2015,6 +2163,10 @@ void S2EExecutor::branch(klee::ExecutionState &state,
         }
     }
 
+    m_s2e->getCorePlugin()->onBranchDecision.emit(
+            static_cast<S2EExecutionState*>(&state),
+            newStates.size() > 1, state.queryCost - solverTime);
+
     if(newStates.size() > 1) {
         doStateFork(static_cast<S2EExecutionState*>(&state),
                        newStates, newConditions);
@@ -2028,13 +2180,25 @@ bool S2EExecutor::merge(klee::ExecutionState &_base, klee::ExecutionState &_othe
     S2EExecutionState& base = static_cast<S2EExecutionState&>(_base);
     S2EExecutionState& other = static_cast<S2EExecutionState&>(_other);
 
+    return merge(base, other, (unsigned) -1);
+}
+
+bool S2EExecutor::merge(S2EExecutionState &base, S2EExecutionState &other,
+                        unsigned maxSelects)
+{
     /* Ensure that both states are inactive, otherwise merging will not work */
     if(base.m_active)
         doStateSwitch(&base, NULL);
     else if(other.m_active)
         doStateSwitch(&other, NULL);
 
-    if(base.merge(other)) {
+    /* The device snapshots and concrete stores must be in memory */
+    if(m_stateSpiller) {
+        m_stateSpiller->fillState(&base);
+        m_stateSpiller->fillState(&other);
+    }
+
+    if(base.merge(other, maxSelects)) {
         m_s2e->getMessagesStream(&base)
                 << "Merged with state " << other.getID() << std::endl;
         return true;
@@ -2045,9 +2209,21 @@ bool S2EExecutor::merge(klee::ExecutionState &_base, klee::ExecutionState &_othe
     }
 }
 
+bool S2EExecutor::mergeAndTerminate(S2EExecutionState &base, S2EExecutionState &other,
+                                    unsigned maxSelects)
+{
+    assert(&other != g_s2e_state);
+    if(!merge(base, other, maxSelects))
+        return false;
+
+    terminateState(other);
+    return true;
+}
+
 void S2EExecutor::terminateState(ExecutionState &s)
 {
     S2EExecutionState& state = static_cast<S2EExecutionState&>(s);
+    m_s2e->getCorePlugin()->onStateKill.emit(&state);
     terminateStateAtFork(state);
 
     //No need for exiting the loop if we kill another state.
@@ -2142,6 +2318,9 @@ bool S2EExecutor::suspendState(S2EExecutionState *state)
         size_t r = states.erase(state);
         assert(r == 1);
         processTree->deactivate(state->ptreeNode);
+        if (m_stateSpiller) {
+            m_stateSpiller->onStateSuspended(state);
+        }
         return true;
     }
     return false;
@@ -2157,6 +2336,9 @@ bool S2EExecutor::resumeState(S2EExecutionState *state)
         processTree->activate(state->ptreeNode);
         states.insert(state);
         searcher->addState(state, NULL);
+        if (m_stateSpiller) {
+            m_stateSpiller->onStateResumed(state);
+        }
         return true;
     }
     return false;
@@ -2176,10 +2358,25 @@ void S2EExecutor::unrefS2ETb(S2ETranslationBlock* s2e_tb)
 
 void S2EExecutor::queueStateForMerge(S2EExecutionState *state)
 {
-    if(dynamic_cast<MergingSearcher*>(searcher) == NULL) {
+    uint64_t mergePoint = 0;
+    if(!state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_ESP]), &mergePoint, 8)) {
+        m_s2e->getWarningsStream(state)
+                << "Warning: merge request for a state with symbolic ESP" << std::endl;
+    }
+    mergePoint = hash64(mergePoint);
+    mergePoint = hash64(state->getPc(), mergePoint);
+
+    queueStateForMerge(state, mergePoint);
+}
+
+void S2EExecutor::queueStateForMerge(S2EExecutionState *state, uint64_t mergePoint)
+{
+    MergingSearcher *kleeSearcher = dynamic_cast<MergingSearcher*>(searcher);
+    S2EMergingSearcher *s2eSearcher = dynamic_cast<S2EMergingSearcher*>(searcher);
+    if(kleeSearcher == NULL && s2eSearcher == NULL) {
         m_s2e->getWarningsStream(state)
                 << "State merging request is ignored because"
-                   " MergingSearcher is not activated\n";
+                   " no merging searcher is activated\n";
         return;
     }
     assert(state->m_active && !state->m_runningConcrete && state->pc);
@@ -2190,17 +2387,12 @@ void S2EExecutor::queueStateForMerge(S2EExecutionState *state)
 
     state->m_lastMergeICount = state->getTotalInstructionCount();
 
-    uint64_t mergePoint = 0;
-    if(!state->readCpuRegisterConcrete(CPU_OFFSET(regs[R_ESP]), &mergePoint, 8)) {
-        m_s2e->getWarningsStream(state)
-                << "Warning: merge request for a state with symbolic ESP" << std::endl;
-    }
-    mergePoint = hash64(mergePoint);
-    mergePoint = hash64(state->getPc(), mergePoint);
-
     m_s2e->getMessagesStream(state) << "Queueing state for merging" << std::endl;
 
-    static_cast<MergingSearcher*>(searcher)->queueStateForMerge(*state, mergePoint);
+    if(kleeSearcher)
+        kleeSearcher->queueStateForMerge(*state, mergePoint);
+    else
+        s2eSearcher->queueStateForMerge(state, mergePoint);
     throw CpuExitException();
 }
 
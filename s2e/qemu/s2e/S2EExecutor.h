@@ -53,6 +53,8 @@ namespace s2e {
 class S2E;
 class S2EExecutionState;
 class S2ETranslationBlock;
+class StateSpiller;
+class PageDeduplicator;
 
 class CpuExitException
 {
@@ -84,6 +86,15 @@ public:
 
 typedef void (*StateManagerCb)(S2EExecutionState *s, bool killingState);
 
+/** Interface of the searchers that hold states at merge points */
+class S2EMergingSearcher
+{
+public:
+    virtual ~S2EMergingSearcher() {}
+    virtual void queueStateForMerge(S2EExecutionState *state,
+                                    uint64_t mergePoint) = 0;
+};
+
 class S2EExecutor : public klee::Executor
 {
 protected:
@@ -108,6 +119,17 @@ protected:
 
     bool m_forkProcTerminateCurrentState;
 
+    /* Pages out inactive states under memory pressure */
+    StateSpiller *m_stateSpiller;
+
+    /* Shares identical concrete pages of inactive states */
+    PageDeduplicator *m_pageDeduplicator;
+    unsigned m_dedupTimerTicks;
+
+    /* Moving average of the wall time of doStateSwitch, in seconds */
+    double m_stateSwitchTime;
+    uint64_t m_stateSwitchCount;
+
 public:
     S2EExecutor(S2E* s2e, TCGLLVMContext *tcgLVMContext,
                 const InterpreterOptions &opts,
@@ -171,6 +193,15 @@ public:
         return searcher;
     }
 
+    /** Average wall time of a state switch, in seconds */
+    double getStateSwitchTime() const {
+        return m_stateSwitchTime;
+    }
+
+    uint64_t getStateSwitchCount() const {
+        return m_stateSwitchCount;
+    }
+
     void setSearcher(klee::Searcher *s) {
         searcher = s;
     }
@@ -181,6 +212,16 @@ public:
 
     bool merge(klee::ExecutionState &base, klee::ExecutionState &other);
 
+    /** Merges other into base, unless the merge needs more than
+        maxSelects ite expressions */
+    bool merge(S2EExecutionState &base, S2EExecutionState &other,
+               unsigned maxSelects);
+
+    /** Same as merge, and kills other if the merge succeeds.
+        Other must not be the current state. */
+    bool mergeAndTerminate(S2EExecutionState &base, S2EExecutionState &other,
+                           unsigned maxSelects);
+
     void setStateManagerCb(StateManagerCb cb) {
         m_stateManager = cb;
     }
@@ -195,8 +236,13 @@ public:
 
     void unrefS2ETb(S2ETranslationBlock* s2e_tb);
 
+    /** Suspends the state at a guest-specified merge point */
     void queueStateForMerge(S2EExecutionState *state);
 
+    /** Suspends the state at the given merge point. Does not return if
+        the searcher accepted the state. */
+    void queueStateForMerge(S2EExecutionState *state, uint64_t mergePoint);
+
     void initializeStatistics();
 
     void updateStats(S2EExecutionState *state);
@@ -280,6 +326,8 @@ protected:
     void terminateStateAtFork(S2EExecutionState &state);
 
     void setupTimersHandler();
+
+    void onStateMemoryTimer();
 };
 
 struct S2ETranslationBlock
@@ -39,6 +39,7 @@
 #include <s2e/S2EExecutor.h>
 #include <s2e/S2EExecutionState.h>
 
+#include <klee/ConcreteStoreArena.h>
 #include <klee/CoreStats.h>
 #include <klee/SolverStats.h>
 #include <klee/Internal/System/Time.h>
@@ -165,11 +166,18 @@ void S2EStatsTracker::writeStatsHeader() {
              << "'ForkTime',"
              << "'ResolveTime',"
              << "'MemoryUsage',"
+             << "'ConcreteStoreMapped',"
+             << "'ConcreteStoreLive',"
+             << "'ConcreteStoreHeap',"
+             << "'ConcreteStoreExternal',"
              << ")\n";
   statsFile->flush();
 }
 
 void S2EStatsTracker::writeStatsLine() {
+  const ConcreteStoreArena::Footprint &storeFootprint =
+          ConcreteStoreArena::get().getFootprint();
+
   *statsFile //<< "(" << stats::instructions
              //<< "," << fullBranches
              //<< "," << partialBranches
@@ -196,6 +204,10 @@ void S2EStatsTracker::writeStatsLine() {
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
              << "," << getProcessMemoryUsage() //sys::Process::GetTotalMemoryUsage()
+             << "," << storeFootprint.mappedBytes
+             << "," << storeFootprint.liveBytes
+             << "," << storeFootprint.heapBytes
+             << "," << storeFootprint.externalBytes
              << ")\n";
   statsFile->flush();
 }
@@ -46,4 +46,11 @@
 #include <sigc++/sigc++.h>
 #endif
 
+/** Names the signal in the reports of the SignalProfiler plugin */
+#ifdef S2E_PROFILE_SIGNALS
+#define S2E_NAME_SIGNAL(signal, name) (signal).setName(name)
+#else
+#define S2E_NAME_SIGNAL(signal, name)
+#endif
+
 #endif
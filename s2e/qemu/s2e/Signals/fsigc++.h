@@ -43,6 +43,12 @@
 
 #include <cassert>
 #include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#if !defined(__i386__) && !defined(__x86_64__)
+#include <sys/time.h>
+#endif
 
 namespace fsigc {
 
@@ -76,8 +82,16 @@ public:
 
 class mysignal_base
 {
+protected:
+    const char *m_name;
+
 public:
+    mysignal_base() : m_name(NULL) {}
     virtual void disconnect(void *functor, unsigned index) = 0;
+
+    /** The profiler reports the slots of unnamed signals by signal address */
+    void setName(const char *name) { m_name = name; }
+    const char *getName() const { return m_name; }
 };
 
 //*************************************************
@@ -96,6 +110,10 @@ public:
     void incref() { ++m_refcount; }
     unsigned decref() { assert(this->m_refcount > 0); return --m_refcount; }
     virtual ~functor_base() {assert(m_refcount == 0);}
+
+    /** Object whose member function the functor calls, if any */
+    virtual const void *getOwner() const { return NULL; }
+
     virtual RET operator()() {assert(false);};
     virtual RET operator()(P1 p1) {assert(false);};
     virtual RET operator()(P1 p1, P2 p2) {assert(false);};
@@ -107,6 +125,100 @@ public:
 };
 
 
+//*************************************************
+//Slot profiling
+//*************************************************
+
+/**
+ * Times the slots of the signals, by signal name and by the object
+ * that owns the slot. Signals only check the enabled flag when
+ * compiled with S2E_PROFILE_SIGNALS. Each thread keeps its own
+ * counters, collect() adds them up.
+ *
+ * The cycles of a slot include those of the signals it emits,
+ * its self cycles do not.
+ */
+class profiler
+{
+public:
+    /* Four buckets per power of two */
+    enum { HISTOGRAM_SIZE = 252 };
+
+    struct entry {
+        const char *signalName;
+        const mysignal_base *signal;
+        const void *owner;
+        uint64_t calls;
+        uint64_t cycles;
+        uint64_t selfCycles;
+        uint64_t histogram[HISTOGRAM_SIZE];
+        entry *next;
+    };
+
+    struct thread_data;
+
+    static bool enabled;
+
+    /** Time stamp counter, microseconds on non-x86 hosts */
+    static inline uint64_t cycles() {
+#if defined(__i386__) || defined(__x86_64__)
+        uint32_t lo, hi;
+        __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+        return ((uint64_t) hi << 32) | lo;
+#else
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+    }
+
+    /** Adds up the counters of all threads, by signal and owner */
+    static void collect(std::vector<entry> &entries);
+
+    /** Clears the counters of all threads */
+    static void reset();
+
+    /** Number of cycles within which the given fraction of the calls
+        completed, rounded up to the end of the histogram bucket */
+    static uint64_t percentile(const entry &e, double fraction);
+
+    static unsigned getBucket(uint64_t cycles);
+    static uint64_t getBucketLimit(unsigned bucket);
+
+    /** Times one slot invocation, including those left by an exception */
+    class slot_timer
+    {
+    private:
+        thread_data *m_thread;
+        uint64_t m_savedChildCycles;
+        const mysignal_base *m_signal;
+        const void *m_owner;
+        uint64_t m_start;
+
+    public:
+        slot_timer(const mysignal_base *signal, const void *owner) {
+            m_signal = signal;
+            m_owner = owner;
+            m_thread = profiler::enter(&m_savedChildCycles);
+            m_start = profiler::cycles();
+        }
+
+        ~slot_timer() {
+            profiler::leave(m_thread, m_savedChildCycles,
+                            m_signal, m_owner, m_start);
+        }
+    };
+
+private:
+    friend class slot_timer;
+
+    static thread_data *enter(uint64_t *savedChildCycles);
+    static void leave(thread_data *thread, uint64_t savedChildCycles,
+                      const mysignal_base *signal, const void *owner,
+                      uint64_t start);
+};
+
+
 //*************************************************
 //Stateless function pointers
 //0 parameter
@@ -164,6 +276,10 @@ public:
 
     virtual ~functor0() {}
 
+    virtual const void *getOwner() const {
+        return m_obj;
+    }
+
     virtual RET operator()() {
         FASSERT(this->m_refcount > 0);
         return (*m_obj.*m_func)();
@@ -379,6 +495,10 @@ public:
         }
     }
 
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
+
     virtual RET operator()() {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(a1);
@@ -414,6 +534,10 @@ public:
         }
     }
 
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
+
     virtual RET operator()() {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(a1, a2);
@@ -447,6 +571,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, a1);
@@ -480,6 +608,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, a1, a2);
@@ -514,6 +646,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, a1, a2, a3);
@@ -549,6 +685,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, a1);
@@ -582,6 +722,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, a1, a2);
@@ -618,6 +762,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2, BE3 be3) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, be3, a1);
@@ -651,6 +799,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2, BE3 be3) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, be3, a1, a2);
@@ -686,6 +838,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2, BE3 be3, BE4 be4) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, be3, be4, a1);
@@ -719,6 +875,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2, BE3 be3, BE4 be4) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, be3, be4, a1, a2);
@@ -752,6 +912,10 @@ public:
             delete m_fb;
         }
     }
+
+    virtual const void *getOwner() const {
+        return m_fb->getOwner();
+    }
     virtual RET operator()(BE1 be1, BE2 be2, BE3 be3, BE4 be4) {
         FASSERT(this->m_refcount > 0);
         return m_fb->operator ()(be1, be2, be3, be4, a1, a2, a3);
@@ -51,6 +51,10 @@ public:
 
     virtual ~FUNCTOR_NAME() {}
 
+    virtual const void *getOwner() const {
+        return m_obj;
+    }
+
     virtual RET operator()(OPERATOR_PARAM_DECL) {
         FASSERT(this->m_refcount > 0);
         return (*m_obj.*m_func)(CALL_PARAMS);
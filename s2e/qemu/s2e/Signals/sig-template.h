@@ -43,7 +43,7 @@ public:
 
 SIGNAL_CLASS() { m_size = 0; m_funcs = 0; m_activeSignals = 0;}
 
-SIGNAL_CLASS(const SIGNAL_CLASS &one) {
+SIGNAL_CLASS(const SIGNAL_CLASS &one) : mysignal_base(one) {
     m_activeSignals = one.m_activeSignals;
     m_size = one.m_size;
     m_funcs = new func_t[m_size];
@@ -110,12 +110,31 @@ bool empty() {
 }
 
 void emit(OPERATOR_PARAM_DECL) {
+#ifdef S2E_PROFILE_SIGNALS
+    if (profiler::enabled) {
+        emitProfiled(CALL_PARAMS);
+        return;
+    }
+#endif
+    for (unsigned i=0; i<m_size; ++i) {
+        if (m_funcs[i]) {
+            m_funcs[i]->operator ()(CALL_PARAMS);
+        }
+    }
+}
+
+#ifdef S2E_PROFILE_SIGNALS
+private:
+void emitProfiled(OPERATOR_PARAM_DECL) {
     for (unsigned i=0; i<m_size; ++i) {
         if (m_funcs[i]) {
+            //The slot may disconnect itself
+            profiler::slot_timer timer(this, m_funcs[i]->getOwner());
             m_funcs[i]->operator ()(CALL_PARAMS);
         }
     }
 }
+#endif
 
 
 #undef SIGNAL_CLASS
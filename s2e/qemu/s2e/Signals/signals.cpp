@@ -1,5 +1,10 @@
 #include "fsigc++.h"
 
+#include <map>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
 namespace fsigc {
 
 connection::connection(mysignal_base *sig, void *func, unsigned index) {
@@ -16,4 +21,203 @@ void connection::disconnect() {
     }
 }
 
+//*************************************************
+//Slot profiling
+//*************************************************
+
+struct profiler::thread_data {
+    //Open addressing table of the entries, only used by the thread
+    std::vector<entry*> table;
+    unsigned count;
+
+    //All the entries of the thread, also read by collect()
+    entry * volatile entries;
+
+    //Cycles of the slots called by the slot being timed
+    uint64_t childCycles;
+
+    thread_data *next;
+};
+
+bool profiler::enabled = false;
+
+static __thread profiler::thread_data *s_thread = NULL;
+static profiler::thread_data *s_threads = NULL;
+static pthread_mutex_t s_threadsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline const void *getKey(const mysignal_base *signal, const char *name) {
+    return name ? (const void*) name : (const void*) signal;
+}
+
+static inline unsigned hashKey(const void *key, const void *owner, unsigned mask) {
+    uint64_t h = (uint64_t) (uintptr_t) key * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t) (uintptr_t) owner * 0xC2B2AE3D27D4EB4FULL;
+    return (unsigned) (h ^ (h >> 29)) & mask;
+}
+
+static void insertEntry(std::vector<profiler::entry*> &table, profiler::entry *e) {
+    unsigned mask = table.size() - 1;
+    unsigned i = hashKey(getKey(e->signal, e->signalName), e->owner, mask);
+    while (table[i]) {
+        i = (i + 1) & mask;
+    }
+    table[i] = e;
+}
+
+static profiler::entry *getEntry(profiler::thread_data *t,
+                                 const mysignal_base *signal, const void *owner) {
+    const char *name = signal->getName();
+    const void *key = getKey(signal, name);
+    unsigned mask = t->table.size() - 1;
+
+    for (unsigned i = hashKey(key, owner, mask); t->table[i]; i = (i + 1) & mask) {
+        profiler::entry *e = t->table[i];
+        if (e->owner == owner && getKey(e->signal, e->signalName) == key) {
+            return e;
+        }
+    }
+
+    profiler::entry *e = new profiler::entry;
+    memset(e, 0, sizeof(*e));
+    e->signalName = name;
+    e->signal = signal;
+    e->owner = owner;
+
+    if (2 * (t->count + 1) > t->table.size()) {
+        std::vector<profiler::entry*> table(2 * t->table.size(), NULL);
+        for (profiler::entry *p = t->entries; p; p = p->next) {
+            insertEntry(table, p);
+        }
+        t->table.swap(table);
+    }
+    insertEntry(t->table, e);
+    ++t->count;
+
+    //Publish the entry once it is initialized
+    e->next = t->entries;
+    __sync_synchronize();
+    t->entries = e;
+    return e;
+}
+
+profiler::thread_data *profiler::enter(uint64_t *savedChildCycles) {
+    thread_data *t = s_thread;
+    if (!t) {
+        t = new thread_data;
+        t->table.resize(64, NULL);
+        t->count = 0;
+        t->entries = NULL;
+        t->childCycles = 0;
+
+        pthread_mutex_lock(&s_threadsLock);
+        t->next = s_threads;
+        s_threads = t;
+        pthread_mutex_unlock(&s_threadsLock);
+        s_thread = t;
+    }
+
+    *savedChildCycles = t->childCycles;
+    t->childCycles = 0;
+    return t;
+}
+
+void profiler::leave(thread_data *t, uint64_t savedChildCycles,
+                     const mysignal_base *signal, const void *owner,
+                     uint64_t start) {
+    uint64_t elapsed = cycles() - start;
+
+    entry *e = getEntry(t, signal, owner);
+    ++e->calls;
+    e->cycles += elapsed;
+    e->selfCycles += t->childCycles < elapsed ? elapsed - t->childCycles : 0;
+    ++e->histogram[getBucket(elapsed)];
+
+    //The bookkeeping above is charged to the slot, not to its caller
+    t->childCycles = savedChildCycles + (cycles() - start);
+}
+
+void profiler::collect(std::vector<entry> &entries) {
+    typedef std::pair<const void*, const void*> Key;
+    std::map<Key, entry> merged;
+
+    pthread_mutex_lock(&s_threadsLock);
+    for (thread_data *t = s_threads; t; t = t->next) {
+        for (entry *e = t->entries; e; e = e->next) {
+            Key key(getKey(e->signal, e->signalName), e->owner);
+            std::map<Key, entry>::iterator it = merged.find(key);
+            if (it == merged.end()) {
+                entry &m = merged[key];
+                m = *e;
+                m.next = NULL;
+                continue;
+            }
+
+            entry &m = (*it).second;
+            m.calls += e->calls;
+            m.cycles += e->cycles;
+            m.selfCycles += e->selfCycles;
+            for (unsigned i = 0; i < HISTOGRAM_SIZE; ++i) {
+                m.histogram[i] += e->histogram[i];
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_threadsLock);
+
+    for (std::map<Key, entry>::iterator it = merged.begin(); it != merged.end(); ++it) {
+        if ((*it).second.calls) {
+            entries.push_back((*it).second);
+        }
+    }
+}
+
+void profiler::reset() {
+    pthread_mutex_lock(&s_threadsLock);
+    for (thread_data *t = s_threads; t; t = t->next) {
+        for (entry *e = t->entries; e; e = e->next) {
+            e->calls = 0;
+            e->cycles = 0;
+            e->selfCycles = 0;
+            memset(e->histogram, 0, sizeof(e->histogram));
+        }
+    }
+    pthread_mutex_unlock(&s_threadsLock);
+}
+
+unsigned profiler::getBucket(uint64_t cycles) {
+    if (cycles < 4) {
+        return cycles;
+    }
+    unsigned msb = 63 - __builtin_clzll(cycles);
+    return (msb - 1) * 4 + ((cycles >> (msb - 2)) & 3);
+}
+
+uint64_t profiler::getBucketLimit(unsigned bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    unsigned shift = bucket / 4 - 1;
+    uint64_t low = (uint64_t) (4 + bucket % 4) << shift;
+    return low + ((1ULL << shift) - 1);
+}
+
+uint64_t profiler::percentile(const entry &e, double fraction) {
+    if (!e.calls) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t) ceil(e.calls * fraction);
+    if (target < 1) {
+        target = 1;
+    }
+
+    uint64_t count = 0;
+    for (unsigned i = 0; i < HISTOGRAM_SIZE; ++i) {
+        count += e.histogram[i];
+        if (count >= target) {
+            return getBucketLimit(i);
+        }
+    }
+    return getBucketLimit(HISTOGRAM_SIZE - 1);
+}
+
 }
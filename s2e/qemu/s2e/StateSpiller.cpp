@@ -0,0 +1,565 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "config-host.h"
+#include "StateSpiller.h"
+
+#include <s2e/S2E.h>
+#include <s2e/S2EExecutionState.h>
+#include <s2e/S2EDeviceState.h>
+#include <s2e/Utils.h>
+
+#include <klee/Memory.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef CONFIG_WIN32
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SPILL_MIN_SLOT_BITS 7
+
+using namespace klee;
+
+namespace s2e {
+
+namespace {
+struct ActivationOrder {
+    const std::map<const S2EExecutionState*, uint64_t> &stamps;
+
+    ActivationOrder(const std::map<const S2EExecutionState*, uint64_t> &s):
+            stamps(s) {}
+
+    uint64_t stamp(S2EExecutionState *s) const {
+        std::map<const S2EExecutionState*, uint64_t>::const_iterator it =
+                stamps.find(s);
+        return it == stamps.end() ? 0 : (*it).second;
+    }
+
+    bool operator()(S2EExecutionState *a, S2EExecutionState *b) const {
+        return stamp(a) < stamp(b);
+    }
+};
+}
+
+StateSpiller::StateSpiller(S2E *s2e, uint64_t watermark, uint64_t segmentSize)
+{
+    m_s2e = s2e;
+    m_highWatermark = watermark;
+    m_lowWatermark = watermark - watermark / 10;
+    m_fd = -1;
+    m_segmentSize = segmentSize;
+    m_segmentCur = NULL;
+    m_segmentEnd = NULL;
+    m_activationCounter = 0;
+    m_spilledBytes = 0;
+    m_spillCount = 0;
+    m_fillCount = 0;
+    m_forkPipe[0] = m_forkPipe[1] = -1;
+
+    unsigned classes = 1;
+    while ((1ULL << (SPILL_MIN_SLOT_BITS + classes - 1)) < m_segmentSize) {
+        ++classes;
+    }
+    m_freeSlots.resize(classes);
+
+    if (!createFile()) {
+        m_s2e->getWarningsStream() << "StateSpiller: could not create the swap file, "
+                << "states will not be spilled" << std::endl;
+    }
+}
+
+StateSpiller::~StateSpiller()
+{
+#ifndef CONFIG_WIN32
+    foreach2(it, m_segments.begin(), m_segments.end()) {
+        munmap(*it, m_segmentSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    foreach2(it, m_childCopies.begin(), m_childCopies.end()) {
+        close(*it);
+    }
+#endif
+}
+
+/**
+ *  The file is unlinked right away: it lives as long as the process
+ *  keeps it open and is reclaimed automatically on exit.
+ */
+bool StateSpiller::createFile()
+{
+#ifdef CONFIG_WIN32
+    return false;
+#else
+    std::stringstream ss;
+    ss << "statespill-" << m_s2e->getCurrentProcessId() << ".dat";
+    std::string fileName = m_s2e->getOutputFilename(ss.str());
+
+    m_fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (m_fd < 0) {
+        return false;
+    }
+    unlink(fileName.c_str());
+    return true;
+#endif
+}
+
+bool StateSpiller::mapSegment()
+{
+#ifdef CONFIG_WIN32
+    return false;
+#else
+    if (m_fd < 0) {
+        return false;
+    }
+
+    off_t offset = m_segments.size() * m_segmentSize;
+    if (ftruncate(m_fd, offset + m_segmentSize) < 0) {
+        return false;
+    }
+
+    void *p = mmap(NULL, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   m_fd, offset);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_segments.push_back((uint8_t*) p);
+    m_segmentCur = (uint8_t*) p;
+    m_segmentEnd = m_segmentCur + m_segmentSize;
+    return true;
+#endif
+}
+
+bool StateSpiller::allocateSlot(unsigned size, Slot &slot)
+{
+    unsigned sizeClass = 0;
+    uint64_t slotSize = 1ULL << SPILL_MIN_SLOT_BITS;
+    while (slotSize < size) {
+        slotSize <<= 1;
+        ++sizeClass;
+    }
+
+    if (sizeClass >= m_freeSlots.size()) {
+        return false;
+    }
+
+    slot.sizeClass = sizeClass;
+
+    std::vector<uint8_t*> &freeSlots = m_freeSlots[sizeClass];
+    if (!freeSlots.empty()) {
+        slot.address = freeSlots.back();
+        freeSlots.pop_back();
+        return true;
+    }
+
+    if (!m_segmentCur || m_segmentCur + slotSize > m_segmentEnd) {
+        if (!mapSegment()) {
+            return false;
+        }
+    }
+
+    slot.address = m_segmentCur;
+    m_segmentCur += slotSize;
+    return true;
+}
+
+void StateSpiller::freeSlot(const Slot &slot)
+{
+    m_freeSlots[slot.sizeClass].push_back(slot.address);
+}
+
+uint64_t StateSpiller::getResidentMemoryUsage()
+{
+#if defined(CONFIG_WIN32) || defined(CONFIG_DARWIN)
+    return 0;
+#else
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp) {
+        return 0;
+    }
+
+    unsigned long size = 0, resident = 0;
+    if (fscanf(fp, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+
+    return (uint64_t) resident * getpagesize();
+#endif
+}
+
+uint64_t StateSpiller::spillState(S2EExecutionState *state)
+{
+    assert(!isSpilled(state) && !state->isActive());
+
+    SpilledState spilled;
+    uint64_t bytes = 0;
+
+    const MemoryMap &objects = state->addressSpace.objects;
+    foreach2(it, objects.begin(), objects.end()) {
+        const MemoryObject *mo = (*it).first;
+        const ObjectState *os = (*it).second;
+
+        //Shared objects may be in use by other states, and the store
+        //of value-ignored objects does not hold anything useful.
+        if (mo->isValueIgnored || !state->addressSpace.isOwnedByUs(os)) {
+            continue;
+        }
+
+        SpilledObject so;
+        if (!allocateSlot(os->size, so.slot)) {
+            continue;
+        }
+
+        so.objectState = state->addressSpace.getWriteable(mo, os);
+        so.objectState->spillConcreteStore(so.slot.address);
+        spilled.objects.push_back(so);
+        bytes += os->size;
+    }
+
+    spilled.deviceSnapshotSize = 0;
+    S2EDeviceState *deviceState = state->getDeviceState();
+    unsigned snapshotSize = deviceState ? deviceState->getSnapshotSize() : 0;
+    if (snapshotSize && allocateSlot(snapshotSize, spilled.deviceSlot)) {
+        deviceState->spillSnapshot(spilled.deviceSlot.address);
+        spilled.deviceSnapshotSize = snapshotSize;
+        bytes += snapshotSize;
+    }
+
+    m_spilledStates[state] = spilled;
+    m_spilledBytes += bytes;
+    ++m_spillCount;
+    return bytes;
+}
+
+void StateSpiller::fillState(S2EExecutionState *state)
+{
+    SpilledStates::iterator it = m_spilledStates.find(state);
+    if (it == m_spilledStates.end()) {
+        return;
+    }
+
+    SpilledState &spilled = (*it).second;
+    foreach2(oit, spilled.objects.begin(), spilled.objects.end()) {
+        klee::ObjectState *os = (*oit).objectState;
+        uint8_t *buffer = os->fillConcreteStore();
+        assert(buffer == (*oit).slot.address);
+        freeSlot((*oit).slot);
+        m_spilledBytes -= os->size;
+    }
+
+    if (spilled.deviceSnapshotSize) {
+        state->getDeviceState()->fillSnapshot(spilled.deviceSlot.address,
+                                              spilled.deviceSnapshotSize);
+        freeSlot(spilled.deviceSlot);
+        m_spilledBytes -= spilled.deviceSnapshotSize;
+    }
+
+    //The saved TLB points to the old location of the stores
+    state->flushTlb();
+
+    m_spilledStates.erase(it);
+    ++m_fillCount;
+}
+
+void StateSpiller::discardState(S2EExecutionState *state)
+{
+    m_suspendedStates.erase(state);
+    m_activationStamps.erase(state);
+
+    SpilledStates::iterator it = m_spilledStates.find(state);
+    if (it == m_spilledStates.end()) {
+        return;
+    }
+
+    //The ObjectStates leave spilled stores alone when they get destroyed
+    SpilledState &spilled = (*it).second;
+    foreach2(oit, spilled.objects.begin(), spilled.objects.end()) {
+        freeSlot((*oit).slot);
+        m_spilledBytes -= (*oit).objectState->size;
+    }
+
+    if (spilled.deviceSnapshotSize) {
+        freeSlot(spilled.deviceSlot);
+        m_spilledBytes -= spilled.deviceSnapshotSize;
+    }
+
+    m_spilledStates.erase(it);
+}
+
+void StateSpiller::onStateSelected(S2EExecutionState *state)
+{
+    m_activationStamps[state] = ++m_activationCounter;
+}
+
+void StateSpiller::onStateSuspended(S2EExecutionState *state)
+{
+    m_suspendedStates.insert(state);
+}
+
+void StateSpiller::onStateResumed(S2EExecutionState *state)
+{
+    m_suspendedStates.erase(state);
+}
+
+void StateSpiller::checkMemoryPressure(const std::set<klee::ExecutionState*> &states,
+                                       const S2EExecutionState *current)
+{
+    if (m_fd < 0 || !childCopiesDone()) {
+        return;
+    }
+
+    uint64_t resident = getResidentMemoryUsage();
+    if (resident <= m_highWatermark) {
+        return;
+    }
+
+    //Suspended states go first, then the ones that ran the longest time ago
+    std::vector<S2EExecutionState*> candidates;
+    foreach2(it, m_suspendedStates.begin(), m_suspendedStates.end()) {
+        if (!isSpilled(*it)) {
+            candidates.push_back(*it);
+        }
+    }
+
+    std::vector<S2EExecutionState*> active;
+    foreach2(it, states.begin(), states.end()) {
+        S2EExecutionState *s = static_cast<S2EExecutionState*>(*it);
+        if (s != current && !s->isActive() && !isSpilled(s)) {
+            active.push_back(s);
+        }
+    }
+    std::sort(active.begin(), active.end(), ActivationOrder(m_activationStamps));
+    candidates.insert(candidates.end(), active.begin(), active.end());
+
+    uint64_t toSpill = resident - m_lowWatermark;
+    uint64_t spilled = 0;
+    unsigned stateCount = 0;
+    foreach2(it, candidates.begin(), candidates.end()) {
+        if (spilled >= toSpill) {
+            break;
+        }
+        spilled += spillState(*it);
+        ++stateCount;
+    }
+
+    if (!stateCount) {
+        return;
+    }
+
+#ifndef CONFIG_WIN32
+    //Drop the spilled pages from the resident set, they stay in the
+    //page cache until the kernel writes them back.
+    foreach2(it, m_segments.begin(), m_segments.end()) {
+        madvise(*it, m_segmentSize, MADV_DONTNEED);
+    }
+#endif
+
+    m_s2e->getDebugStream() << "StateSpiller: spilled " << stateCount << " states ("
+            << (spilled >> 20) << " MB), resident memory was "
+            << (resident >> 20) << " MB, "
+            << (m_spilledBytes >> 20) << " MB spilled in total" << std::endl;
+}
+
+/**
+ *  Returns true when no child is still copying the swap file.
+ *  Spilling is the only thing that writes to the file, so the parent
+ *  holds it back until then.
+ */
+bool StateSpiller::childCopiesDone()
+{
+#ifndef CONFIG_WIN32
+    std::vector<int>::iterator it = m_childCopies.begin();
+    while (it != m_childCopies.end()) {
+        char c;
+        if (read(*it, &c, sizeof(c)) < 0 && (errno == EAGAIN || errno == EINTR)) {
+            //The child is still copying
+            ++it;
+            continue;
+        }
+        close(*it);
+        it = m_childCopies.erase(it);
+    }
+#endif
+    return m_childCopies.empty();
+}
+
+/**
+ *  Copies the segments into a new swap file and maps them back at
+ *  the same addresses, so that spilled stores stay valid.
+ *  Returns false and keeps the current file if the copy fails.
+ */
+bool StateSpiller::copyFile()
+{
+#ifdef CONFIG_WIN32
+    return false;
+#else
+    int oldFd = m_fd;
+    if (!createFile()) {
+        m_fd = oldFd;
+        return false;
+    }
+
+    bool ok = ftruncate(m_fd, (off_t) m_segments.size() * m_segmentSize) == 0;
+    for (unsigned i = 0; ok && i < m_segments.size(); ++i) {
+        off_t offset = (off_t) i * m_segmentSize;
+        ok = pwrite(m_fd, m_segments[i], m_segmentSize, offset) == (ssize_t) m_segmentSize;
+    }
+
+    if (!ok) {
+        close(m_fd);
+        m_fd = oldFd;
+        return false;
+    }
+
+    for (unsigned i = 0; i < m_segments.size(); ++i) {
+        void *p = mmap(m_segments[i], m_segmentSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, m_fd, (off_t) i * m_segmentSize);
+        if (p == MAP_FAILED) {
+            //The old mapping is gone, the spilled stores cannot be recovered
+            m_s2e->getWarningsStream() << "StateSpiller: could not remap segment"
+                    << std::endl;
+            exit(-1);
+        }
+    }
+
+    close(oldFd);
+    return true;
+#endif
+}
+
+/** Pages all the states back in and stops spilling */
+void StateSpiller::fillAllStates()
+{
+#ifndef CONFIG_WIN32
+    while (!m_spilledStates.empty()) {
+        fillState(const_cast<S2EExecutionState*>((*m_spilledStates.begin()).first));
+    }
+
+    foreach2(it, m_segments.begin(), m_segments.end()) {
+        munmap(*it, m_segmentSize);
+    }
+    m_segments.clear();
+    m_segmentCur = NULL;
+    m_segmentEnd = NULL;
+
+    foreach2(it, m_freeSlots.begin(), m_freeSlots.end()) {
+        (*it).clear();
+    }
+
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+/**
+ *  Parent and child inherit the same shared mapping of the swap file.
+ *  The parent keeps it. The child copies the segments into its own file
+ *  while the parent holds back spilling, which would modify them.
+ *  If the copy fails, the child pages its states back in and stops
+ *  spilling.
+ */
+void StateSpiller::onProcessFork(bool preFork, bool isChild, unsigned parentProcId)
+{
+#ifndef CONFIG_WIN32
+    if (m_fd < 0) {
+        return;
+    }
+
+    if (preFork) {
+        if (pipe(m_forkPipe) < 0) {
+            m_forkPipe[0] = m_forkPipe[1] = -1;
+        }
+        return;
+    }
+
+    if (!isChild) {
+        if (m_forkPipe[0] < 0) {
+            //The parent cannot tell when the child is done with the file
+            m_s2e->getWarningsStream() << "StateSpiller: could not synchronize with the child process, "
+                    << "states will not be spilled anymore" << std::endl;
+            close(m_fd);
+            m_fd = -1;
+            return;
+        }
+
+        close(m_forkPipe[1]);
+        fcntl(m_forkPipe[0], F_SETFL, O_NONBLOCK);
+        m_childCopies.push_back(m_forkPipe[0]);
+        m_forkPipe[0] = m_forkPipe[1] = -1;
+        return;
+    }
+
+    //The pipes of the other children belong to the parent
+    foreach2(it, m_childCopies.begin(), m_childCopies.end()) {
+        close(*it);
+    }
+    m_childCopies.clear();
+
+    if (m_forkPipe[0] >= 0) {
+        close(m_forkPipe[0]);
+    }
+
+    //Without the pipe, the parent stopped spilling and no longer
+    //writes to the file
+    if (!copyFile()) {
+        m_s2e->getWarningsStream() << "StateSpiller: could not copy the swap file after fork, "
+                << "states will not be spilled anymore" << std::endl;
+        fillAllStates();
+    }
+
+    if (m_forkPipe[1] >= 0) {
+        close(m_forkPipe[1]);
+    }
+    m_forkPipe[0] = m_forkPipe[1] = -1;
+#endif
+}
+
+} // namespace s2e
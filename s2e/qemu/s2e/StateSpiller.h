@@ -0,0 +1,164 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2E_STATESPILLER_H
+#define S2E_STATESPILLER_H
+
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace klee {
+class ExecutionState;
+class ObjectState;
+}
+
+namespace s2e {
+
+class S2E;
+class S2EExecutionState;
+
+/**
+ *  Pages out the memory of inactive states when the S2E process
+ *  goes above a resident memory watermark.
+ *
+ *  The concrete stores of the ObjectStates owned by a state and its
+ *  device snapshot are moved to slots of a memory-mapped file in the
+ *  output directory. The kernel is then free to write them back and
+ *  drop them from RAM. Spilled stores remain addressable, so code that
+ *  peeks at an inactive state still works, albeit slowly.
+ *  States are paged back in when they are selected for execution.
+ *
+ *  Constraints, symbolic contents and plugin states stay in memory.
+ */
+class StateSpiller
+{
+private:
+    struct Slot {
+        uint8_t *address;
+        unsigned sizeClass;
+    };
+
+    struct SpilledObject {
+        klee::ObjectState *objectState;
+        Slot slot;
+    };
+
+    struct SpilledState {
+        std::vector<SpilledObject> objects;
+        Slot deviceSlot;
+        unsigned deviceSnapshotSize;
+    };
+
+    typedef std::map<const S2EExecutionState*, SpilledState> SpilledStates;
+    typedef std::map<const S2EExecutionState*, uint64_t> ActivationStamps;
+
+    S2E *m_s2e;
+
+    /* Resident memory (in bytes) above which states get spilled,
+       and down to which they are spilled. */
+    uint64_t m_highWatermark;
+    uint64_t m_lowWatermark;
+
+    int m_fd;
+    uint64_t m_segmentSize;
+    std::vector<uint8_t*> m_segments;
+    uint8_t *m_segmentCur;
+    uint8_t *m_segmentEnd;
+
+    std::vector<std::vector<uint8_t*> > m_freeSlots;
+
+    /* Pipe created before a fork. The child closes its write end once
+       it has its own copy of the swap file. */
+    int m_forkPipe[2];
+
+    /* Read ends of the pipes of the children still copying the file */
+    std::vector<int> m_childCopies;
+
+    SpilledStates m_spilledStates;
+    std::set<S2EExecutionState*> m_suspendedStates;
+    ActivationStamps m_activationStamps;
+    uint64_t m_activationCounter;
+
+    uint64_t m_spilledBytes;
+    uint64_t m_spillCount;
+    uint64_t m_fillCount;
+
+    bool allocateSlot(unsigned size, Slot &slot);
+    void freeSlot(const Slot &slot);
+    bool mapSegment();
+    bool createFile();
+    bool copyFile();
+    bool childCopiesDone();
+    void fillAllStates();
+
+    uint64_t spillState(S2EExecutionState *state);
+
+public:
+    StateSpiller(S2E *s2e, uint64_t watermark, uint64_t segmentSize);
+    ~StateSpiller();
+
+    static uint64_t getResidentMemoryUsage();
+
+    /** Spill inactive states if the process is above the watermark */
+    void checkMemoryPressure(const std::set<klee::ExecutionState*> &states,
+                             const S2EExecutionState *current);
+
+    /** Page the state back in, called before it gets activated */
+    void fillState(S2EExecutionState *state);
+
+    /** Forget about a state that is being deleted */
+    void discardState(S2EExecutionState *state);
+
+    void onStateSelected(S2EExecutionState *state);
+    void onStateSuspended(S2EExecutionState *state);
+    void onStateResumed(S2EExecutionState *state);
+
+    /** The child of a fork() gets its own copy of the swap file */
+    void onProcessFork(bool preFork, bool isChild, unsigned parentProcId);
+
+    bool isSpilled(const S2EExecutionState *state) const {
+        return m_spilledStates.count(state) > 0;
+    }
+
+    uint64_t getSpilledBytes() const { return m_spilledBytes; }
+};
+
+} // namespace s2e
+
+#endif // S2E_STATESPILLER_H
@@ -68,6 +68,19 @@ inline std::ostream& operator<<(std::ostream& out, const hexval& h)
     return out;
 }
 
+/** FNV-1a hash of a buffer. Pass the previous result as initial
+    to hash several buffers. */
+inline uint64_t hashBuffer(const void *buffer, unsigned size,
+                           uint64_t initial = 14695981039346656037ULL)
+{
+    const uint8_t *bytes = static_cast<const uint8_t*>(buffer);
+    for (unsigned i = 0; i < size; ++i) {
+        initial ^= bytes[i];
+        initial *= 1099511628211ULL;
+    }
+    return initial;
+}
+
 /** A macro used to escape "," in an argument to another macro */
 #define S2E_NOOP(...) __VA_ARGS__
 
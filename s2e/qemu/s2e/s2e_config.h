@@ -66,4 +66,10 @@
 
 #define S2E_USE_FAST_SIGNALS
 
+/** Lets the SignalProfiler plugin time the slots of the fast signals.
+    Signal emission tests one flag when the plugin is disabled. */
+#ifdef S2E_USE_FAST_SIGNALS
+#define S2E_PROFILE_SIGNALS
+#endif
+
 #endif // S2E_CONFIG_H
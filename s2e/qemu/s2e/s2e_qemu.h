@@ -150,6 +150,45 @@ void s2e_trace_memory_access(
         uint64_t vaddr, uint64_t haddr, uint8_t* buf, unsigned size,
         int isWrite, int isIO);
 
+/** Range of virtual addresses watched by plugins (bounds are inclusive) */
+struct S2EMemoryRange {
+    uint64_t start;
+    uint64_t end;
+};
+
+/** Number of listeners of CorePlugin::onDataMemoryAccess,
+    which needs all memory accesses */
+extern const unsigned *g_s2e_data_memory_listeners;
+
+/** Sorted, non-overlapping union of the ranges watched by all plugins */
+extern const struct S2EMemoryRange *g_s2e_memory_ranges;
+extern unsigned g_s2e_memory_range_count;
+
+/** Checks whether a concrete memory access must be reported to S2E.
+    Called inline by the softmmu helpers, so that unwatched
+    accesses do not leave them. */
+static inline int s2e_is_memory_traced(uint64_t vaddr, unsigned size)
+{
+    unsigned lo = 0, hi = g_s2e_memory_range_count;
+
+    if (*g_s2e_data_memory_listeners) {
+        return 1;
+    }
+
+    /* Look for the first range that ends at or after vaddr */
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (g_s2e_memory_ranges[mid].end < vaddr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo < g_s2e_memory_range_count &&
+           g_s2e_memory_ranges[lo].start <= vaddr + size - 1;
+}
+
 /** Called on port access from helper code */
 void s2e_trace_port_access(
         struct S2E *s2e, struct S2EExecutionState* state,
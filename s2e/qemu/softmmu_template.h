@@ -73,8 +73,10 @@
     tcg_llvm_fork_and_concretize(val, 0, max)
 #else // S2E_LLVM_LIB
 #define S2E_TRACE_MEMORY(vaddr, haddr, value, isWrite, isIO) \
-    s2e_trace_memory_access(g_s2e, g_s2e_state, vaddr, haddr, \
-                            (uint8_t*) &value, sizeof(value), isWrite, isIO);
+    if (unlikely(s2e_is_memory_traced(vaddr, sizeof(value)))) { \
+        s2e_trace_memory_access(g_s2e, g_s2e_state, vaddr, haddr, \
+                                (uint8_t*) &value, sizeof(value), isWrite, isIO); \
+    }
 #define S2E_FORK_AND_CONCRETIZE(val, max) (val)
 #endif // S2E_LLVM_LIB
 
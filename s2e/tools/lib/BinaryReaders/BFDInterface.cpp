@@ -41,12 +41,28 @@
 #include "Macho.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <cassert>
 
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
+#include <unistd.h>
+
+#include "llvm/Support/CommandLine.h"
+
+namespace {
+    llvm::cl::opt<bool>
+            UseSymbolIndex("symindex", llvm::cl::desc("Cache debug information in a sorted index next to each binary"),
+                           llvm::cl::init(true));
+}
+
+//Beyond that, building the index would take longer than the BFD lookups it saves
+#define SYMBOLINDEX_MAX_CODE_SIZE (64 * 1024 * 1024)
+
 namespace s2etools
 {
 
@@ -61,6 +77,8 @@ BFDInterface::BFDInterface(const std::string &fileName):ExecutableFile(fileName)
 
     m_file = llvm::MemoryBuffer::getFile(fileName.c_str());
     m_binary = NULL;
+    m_symbolIndex = NULL;
+    m_symbolIndexLoaded = false;
 }
 
 BFDInterface::BFDInterface(const std::string &fileName, bool requireSymbols):ExecutableFile(fileName)
@@ -70,6 +88,8 @@ BFDInterface::BFDInterface(const std::string &fileName, bool requireSymbols):Exe
     m_requireSymbols = requireSymbols;
     m_file = llvm::MemoryBuffer::getFile(fileName.c_str());
     m_binary = NULL;
+    m_symbolIndex = NULL;
+    m_symbolIndexLoaded = false;
 }
 
 BFDInterface::~BFDInterface()
@@ -78,6 +98,8 @@ BFDInterface::~BFDInterface()
         delete m_binary;
     }
 
+    delete m_symbolIndex;
+
     if (m_bfd) {
         free(m_symbolTable);
         bfd_close(m_bfd);
@@ -203,12 +225,113 @@ bool BFDInterface::initialize(const std::string &format)
     return true;
 }
 
+/**
+ *  Resolves every byte of the code sections with BFD and merges the runs
+ *  that have the same function or the same line.
+ */
+bool BFDInterface::buildSymbolIndex(std::vector<uint8_t> &out)
+{
+    uint64_t binarySize, binaryTime;
+    if (!SymbolIndex::getBinaryStamp(m_fileName, binarySize, binaryTime)) {
+        return false;
+    }
+
+    uint64_t codeSize = 0;
+    Sections::const_iterator it;
+    for (it = m_sections.begin(); it != m_sections.end(); ++it) {
+        asection *section = (*it).second;
+        if (section->flags & SEC_CODE) {
+            codeSize += section->size;
+        }
+    }
+
+    if (codeSize > SYMBOLINDEX_MAX_CODE_SIZE) {
+        return false;
+    }
+
+    SymbolIndexWriter writer;
+    for (it = m_sections.begin(); it != m_sections.end(); ++it) {
+        asection *section = (*it).second;
+        if (!(section->flags & SEC_CODE) || !section->size) {
+            continue;
+        }
+
+        writer.beginRange(section->vma);
+        for (uint64_t offset = 0; offset < section->size; ++offset) {
+            const char *filename = NULL;
+            const char *funcname = NULL;
+            unsigned int sourceline = 0;
+
+            if (!bfd_find_nearest_line(m_bfd, section, m_symbolTable, offset,
+                                       &filename, &funcname, &sourceline)) {
+                filename = funcname = NULL;
+                sourceline = 0;
+            }
+
+            writer.add(section->vma + offset, filename, sourceline, funcname);
+        }
+        writer.endRange(section->vma + section->size);
+    }
+
+    writer.serialize(binarySize, binaryTime, out);
+    return true;
+}
+
+void BFDInterface::loadSymbolIndex()
+{
+    m_symbolIndexLoaded = true;
+    if (!UseSymbolIndex) {
+        return;
+    }
+
+    m_symbolIndex = new SymbolIndex();
+    if (m_symbolIndex->load(m_fileName)) {
+        return;
+    }
+
+    std::cerr << "Building symbol index for " << m_fileName << std::endl;
+
+    std::vector<uint8_t> data;
+    if (!buildSymbolIndex(data)) {
+        delete m_symbolIndex;
+        m_symbolIndex = NULL;
+        return;
+    }
+
+    //Write to a temporary file first, several tools may build the same index
+    std::stringstream tmpName;
+    tmpName << SymbolIndex::getIndexFileName(m_fileName) << ".tmp" << getpid();
+    std::ofstream ofs(tmpName.str().c_str(), std::ios::binary);
+    bool written = ofs.good() && ofs.write((const char*) &data[0], data.size()).good();
+    ofs.close();
+
+    if (written && !rename(tmpName.str().c_str(), SymbolIndex::getIndexFileName(m_fileName).c_str()) &&
+        m_symbolIndex->load(m_fileName)) {
+        return;
+    }
+
+    //Read-only directory, keep the index for this run only
+    unlink(tmpName.str().c_str());
+    if (!m_symbolIndex->adopt(data)) {
+        delete m_symbolIndex;
+        m_symbolIndex = NULL;
+    }
+}
+
 bool BFDInterface::getInfo(uint64_t addr, std::string &source, uint64_t &line, std::string &function)
 {
     if (!initialize()) {
         return false;
     }
 
+    if (!m_symbolIndexLoaded) {
+        loadSymbolIndex();
+    }
+
+    if (m_symbolIndex && m_symbolIndex->covers(addr)) {
+        return m_symbolIndex->lookup(addr, source, line, function);
+    }
+
     BFDSection s;
     s.start = addr;
     s.size = 1;
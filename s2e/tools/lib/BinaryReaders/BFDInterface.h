@@ -44,9 +44,11 @@ extern "C" {
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 #include <inttypes.h>
 
 #include "ExecutableFile.h"
+#include "SymbolIndex.h"
 #include "llvm/Support/MemoryBuffer.h"
 
 namespace s2etools
@@ -131,7 +133,13 @@ private:
     RelocationEntries m_relocations;
     Imports m_imports;
 
+    //Built on the first lookup, NULL if disabled or if it could not be built
+    SymbolIndex *m_symbolIndex;
+    bool m_symbolIndexLoaded;
+
     static void initSections(bfd *abfd, asection *sect, void *obj);
+    void loadSymbolIndex();
+    bool buildSymbolIndex(std::vector<uint8_t> &out);
 
     bool initPeImports();
     asection *getSection(uint64_t va, unsigned size) const;
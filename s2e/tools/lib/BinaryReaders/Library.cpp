@@ -51,6 +51,21 @@ namespace {
 
 namespace s2etools {
 
+namespace {
+
+class LibraryLock {
+    pthread_mutex_t *m_lock;
+public:
+    LibraryLock(pthread_mutex_t *lock) : m_lock(lock) {
+        pthread_mutex_lock(m_lock);
+    }
+    ~LibraryLock() {
+        pthread_mutex_unlock(m_lock);
+    }
+};
+
+}
+
 uint64_t Library::translatePid(uint64_t pid, uint64_t pc)
 {
     if (pc >= KernelStart) {
@@ -61,7 +76,12 @@ uint64_t Library::translatePid(uint64_t pid, uint64_t pc)
 
 Library::Library()
 {
-
+    //get() is called with the lock held
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
 }
 
 Library::~Library()
@@ -70,6 +90,7 @@ Library::~Library()
     for(it = m_libraries.begin(); it != m_libraries.end(); ++it) {
         delete (*it).second;
     }
+    pthread_mutex_destroy(&m_lock);
 }
 
 void Library::addPath(const std::string &path)
@@ -136,6 +157,7 @@ bool Library::addLibraryAbs(const std::string &libName)
 //Get a library using a name
 ExecutableFile *Library::get(const std::string &name)
 {
+    LibraryLock lock(&m_lock);
     std::string s;
     if (!findLibrary(name, s)) {
         return NULL;
@@ -158,6 +180,8 @@ bool Library::getInfo(const ModuleInstance *mi, uint64_t pc, std::string &file,
 {
     if(!mi)
         return false;
+
+    LibraryLock lock(&m_lock);
     ExecutableFile *exec = get(mi->Name);
     if (!exec) {
         return false;
@@ -176,7 +200,7 @@ bool Library::print(
         const std::string &modName, uint64_t loadBase, uint64_t imageBase,
         uint64_t pc, std::string &out, bool file, bool line, bool func)
 {
-
+    LibraryLock lock(&m_lock);
     ExecutableFile *exec = get(modName);
     if (!exec) {
         return false;
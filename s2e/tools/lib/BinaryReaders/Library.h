@@ -44,6 +44,7 @@
 #include <string>
 #include <set>
 #include <inttypes.h>
+#include <pthread.h>
 
 namespace s2etools
 {
@@ -82,6 +83,9 @@ private:
     ModuleNameToExec m_libraries;
     StringSet m_badLibraries;
 
+    //BFD is not thread-safe, lookups are serialized
+    pthread_mutex_t m_lock;
+
 };
 
 }
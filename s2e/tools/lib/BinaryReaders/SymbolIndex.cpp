@@ -0,0 +1,391 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include "SymbolIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace s2etools
+{
+
+namespace {
+
+template <typename T>
+struct StartOrder {
+    bool operator()(uint64_t addr, const T &e) const {
+        return addr < e.start;
+    }
+};
+
+//Last entry that starts at or before addr, NULL if none
+template <typename T>
+const T *findEntry(const T *entries, uint32_t count, uint64_t addr)
+{
+    const T *it = std::upper_bound(entries, entries + count, addr, StartOrder<T>());
+    if (it == entries) {
+        return NULL;
+    }
+    return it - 1;
+}
+
+}
+
+SymbolIndexWriter::SymbolIndexWriter()
+{
+
+}
+
+uint32_t SymbolIndexWriter::getString(const char *s)
+{
+    if (!s) {
+        return SYMBOLINDEX_NONE;
+    }
+
+    std::map<std::string, uint32_t>::iterator it = m_stringOffsets.find(s);
+    if (it != m_stringOffsets.end()) {
+        return (*it).second;
+    }
+
+    uint32_t offset = m_strings.size();
+    m_strings.append(s, strlen(s) + 1);
+    m_stringOffsets[s] = offset;
+    return offset;
+}
+
+void SymbolIndexWriter::beginRange(uint64_t start)
+{
+    assert(m_ranges.empty() || m_ranges.back().end <= start);
+
+    SymbolIndexRange r;
+    r.start = start;
+    r.end = start;
+    m_ranges.push_back(r);
+}
+
+void SymbolIndexWriter::endRange(uint64_t end)
+{
+    assert(!m_ranges.empty());
+    m_ranges.back().end = end;
+
+    //Terminate the last entries, unless the next range is contiguous
+    if (m_functions.empty() || m_functions.back().name != SYMBOLINDEX_NONE) {
+        SymbolIndexFunction f;
+        f.start = end;
+        f.name = SYMBOLINDEX_NONE;
+        m_functions.push_back(f);
+    }
+
+    if (m_lines.empty() || m_lines.back().file != SYMBOLINDEX_NONE || m_lines.back().line) {
+        SymbolIndexLine l;
+        l.start = end;
+        l.line = 0;
+        l.file = SYMBOLINDEX_NONE;
+        m_lines.push_back(l);
+    }
+}
+
+void SymbolIndexWriter::add(uint64_t address, const char *file, unsigned line, const char *function)
+{
+    uint32_t name = getString(function);
+    uint32_t fileName = getString(file);
+
+    //A gap marker at the same address is replaced by the actual entry
+    if (!m_functions.empty() && m_functions.back().start == address) {
+        m_functions.pop_back();
+    }
+    if (m_functions.empty() || m_functions.back().name != name) {
+        SymbolIndexFunction f;
+        f.start = address;
+        f.name = name;
+        m_functions.push_back(f);
+    }
+
+    if (!m_lines.empty() && m_lines.back().start == address) {
+        m_lines.pop_back();
+    }
+    if (m_lines.empty() || m_lines.back().file != fileName || m_lines.back().line != line) {
+        SymbolIndexLine l;
+        l.start = address;
+        l.line = line;
+        l.file = fileName;
+        m_lines.push_back(l);
+    }
+}
+
+void SymbolIndexWriter::serialize(uint64_t binarySize, uint64_t binaryTime,
+                                  std::vector<uint8_t> &out) const
+{
+    SymbolIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SYMBOLINDEX_MAGIC;
+    hdr.version = SYMBOLINDEX_VERSION;
+    hdr.rangeCount = m_ranges.size();
+    hdr.binarySize = binarySize;
+    hdr.binaryTime = binaryTime;
+    hdr.functionCount = m_functions.size();
+    hdr.lineCount = m_lines.size();
+    hdr.stringsSize = m_strings.size();
+
+    out.clear();
+    out.insert(out.end(), (const uint8_t*) &hdr, (const uint8_t*) (&hdr + 1));
+
+    if (!m_ranges.empty()) {
+        out.insert(out.end(), (const uint8_t*) &m_ranges[0],
+                   (const uint8_t*) (&m_ranges[0] + m_ranges.size()));
+    }
+    if (!m_functions.empty()) {
+        out.insert(out.end(), (const uint8_t*) &m_functions[0],
+                   (const uint8_t*) (&m_functions[0] + m_functions.size()));
+    }
+    if (!m_lines.empty()) {
+        out.insert(out.end(), (const uint8_t*) &m_lines[0],
+                   (const uint8_t*) (&m_lines[0] + m_lines.size()));
+    }
+    out.insert(out.end(), m_strings.begin(), m_strings.end());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SymbolIndex::SymbolIndex()
+{
+    m_data = NULL;
+    m_size = 0;
+    m_mapped = false;
+    m_header = NULL;
+}
+
+SymbolIndex::~SymbolIndex()
+{
+    release();
+}
+
+void SymbolIndex::release()
+{
+    if (!m_data) {
+        return;
+    }
+
+#ifndef _WIN32
+    if (m_mapped) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    } else
+#endif
+    {
+        delete [] m_data;
+    }
+
+    m_data = NULL;
+    m_header = NULL;
+}
+
+std::string SymbolIndex::getIndexFileName(const std::string &binary)
+{
+    return binary + ".symidx";
+}
+
+bool SymbolIndex::getBinaryStamp(const std::string &binary, uint64_t &size, uint64_t &time)
+{
+    struct stat st;
+    if (stat(binary.c_str(), &st) < 0) {
+        return false;
+    }
+    size = st.st_size;
+    time = st.st_mtime;
+    return true;
+}
+
+bool SymbolIndex::attach(const uint8_t *data, uint64_t size)
+{
+    if (size < sizeof(SymbolIndexHeader)) {
+        return false;
+    }
+
+    const SymbolIndexHeader *hdr = (const SymbolIndexHeader*) data;
+    if (hdr->magic != SYMBOLINDEX_MAGIC || hdr->version != SYMBOLINDEX_VERSION) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(SymbolIndexHeader) +
+                        (uint64_t) hdr->rangeCount * sizeof(SymbolIndexRange) +
+                        (uint64_t) hdr->functionCount * sizeof(SymbolIndexFunction) +
+                        (uint64_t) hdr->lineCount * sizeof(SymbolIndexLine) +
+                        hdr->stringsSize;
+    if (size != expected) {
+        return false;
+    }
+
+    const uint8_t *p = data + sizeof(SymbolIndexHeader);
+    m_ranges = (const SymbolIndexRange*) p;
+    p += hdr->rangeCount * sizeof(SymbolIndexRange);
+    m_functions = (const SymbolIndexFunction*) p;
+    p += hdr->functionCount * sizeof(SymbolIndexFunction);
+    m_lines = (const SymbolIndexLine*) p;
+    p += hdr->lineCount * sizeof(SymbolIndexLine);
+    m_strings = (const char*) p;
+
+    m_header = hdr;
+    return true;
+}
+
+bool SymbolIndex::load(const std::string &binary)
+{
+    release();
+
+    uint64_t binarySize, binaryTime;
+    if (!getBinaryStamp(binary, binarySize, binaryTime)) {
+        return false;
+    }
+
+    std::string fileName = getIndexFileName(binary);
+
+#ifndef _WIN32
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    off_t fileSize = lseek(fd, 0, SEEK_END);
+    if (fileSize <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = (const uint8_t*) data;
+    m_size = fileSize;
+    m_mapped = true;
+#else
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fileSize <= 0) {
+        fclose(fp);
+        return false;
+    }
+
+    uint8_t *data = new uint8_t[fileSize];
+    bool ok = fread(data, 1, fileSize, fp) == (size_t) fileSize;
+    fclose(fp);
+
+    m_data = data;
+    m_size = fileSize;
+    m_mapped = false;
+    if (!ok) {
+        release();
+        return false;
+    }
+#endif
+
+    if (!attach(m_data, m_size) ||
+        m_header->binarySize != binarySize || m_header->binaryTime != binaryTime) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+bool SymbolIndex::adopt(const std::vector<uint8_t> &data)
+{
+    release();
+
+    uint8_t *copy = new uint8_t[data.size()];
+    memcpy(copy, &data[0], data.size());
+
+    m_data = copy;
+    m_size = data.size();
+    m_mapped = false;
+
+    if (!attach(m_data, m_size)) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+bool SymbolIndex::covers(uint64_t addr) const
+{
+    if (!m_header) {
+        return false;
+    }
+
+    const SymbolIndexRange *r = findEntry(m_ranges, m_header->rangeCount, addr);
+    return r && addr < r->end;
+}
+
+bool SymbolIndex::lookup(uint64_t addr, std::string &source, uint64_t &line, std::string &function) const
+{
+    assert(covers(addr));
+
+    const SymbolIndexFunction *f = findEntry(m_functions, m_header->functionCount, addr);
+    const SymbolIndexLine *l = findEntry(m_lines, m_header->lineCount, addr);
+
+    const char *funcname = (f && f->name != SYMBOLINDEX_NONE) ? m_strings + f->name : NULL;
+    const char *filename = (l && l->file != SYMBOLINDEX_NONE) ? m_strings + l->file : NULL;
+    unsigned sourceline = l ? l->line : 0;
+
+    if (!filename && !sourceline && !funcname) {
+        return false;
+    }
+
+    source = filename ? filename : "<unknown source>";
+    line = sourceline;
+    function = funcname ? funcname : "<unknown function>";
+    return true;
+}
+
+}
@@ -0,0 +1,160 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2ETOOLS_SYMBOLINDEX_H
+#define S2ETOOLS_SYMBOLINDEX_H
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ *  Precomputed answers to address -> source, line, function queries.
+ *
+ *  The index of a binary is built once from BFD and cached next to it
+ *  in <binary>.symidx. It covers the code sections of the binary with
+ *  two tables sorted by address: function ranges and line ranges. Each
+ *  entry holds until the start of the next one, entries without a name
+ *  (SYMBOLINDEX_NONE) mark the gaps. A lookup is a binary search in
+ *  each table, on a memory-mapped file.
+ *
+ *  Layout: header, indexed ranges, functions, lines, string table.
+ */
+
+namespace s2etools
+{
+
+#define SYMBOLINDEX_MAGIC 0x5844494d59533253ULL /* "S2SYMIDX" */
+#define SYMBOLINDEX_VERSION 1
+#define SYMBOLINDEX_NONE 0xffffffff
+
+struct SymbolIndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t rangeCount;
+    //Size and modification time of the binary the index was built from
+    uint64_t binarySize;
+    uint64_t binaryTime;
+    uint32_t functionCount;
+    uint32_t lineCount;
+    uint32_t stringsSize;
+}__attribute__((packed));
+
+struct SymbolIndexRange {
+    uint64_t start, end;
+}__attribute__((packed));
+
+struct SymbolIndexFunction {
+    uint64_t start;
+    //Offset in the string table
+    uint32_t name;
+}__attribute__((packed));
+
+struct SymbolIndexLine {
+    uint64_t start;
+    uint32_t line;
+    //Offset in the string table
+    uint32_t file;
+}__attribute__((packed));
+
+/**
+ *  Collects the debug information of consecutive addresses and
+ *  merges the runs that resolve to the same function or line.
+ *  Addresses must be added in increasing order, range by range.
+ */
+class SymbolIndexWriter
+{
+private:
+    std::vector<SymbolIndexRange> m_ranges;
+    std::vector<SymbolIndexFunction> m_functions;
+    std::vector<SymbolIndexLine> m_lines;
+    std::map<std::string, uint32_t> m_stringOffsets;
+    std::string m_strings;
+
+    uint32_t getString(const char *s);
+
+public:
+    SymbolIndexWriter();
+
+    void beginRange(uint64_t start);
+    void endRange(uint64_t end);
+
+    //Any of the fields may be NULL/0 when there is no information
+    void add(uint64_t address, const char *file, unsigned line, const char *function);
+
+    void serialize(uint64_t binarySize, uint64_t binaryTime, std::vector<uint8_t> &out) const;
+};
+
+class SymbolIndex
+{
+private:
+    const uint8_t *m_data;
+    uint64_t m_size;
+    bool m_mapped;
+
+    const SymbolIndexHeader *m_header;
+    const SymbolIndexRange *m_ranges;
+    const SymbolIndexFunction *m_functions;
+    const SymbolIndexLine *m_lines;
+    const char *m_strings;
+
+    bool attach(const uint8_t *data, uint64_t size);
+    void release();
+
+public:
+    SymbolIndex();
+    ~SymbolIndex();
+
+    static std::string getIndexFileName(const std::string &binary);
+    static bool getBinaryStamp(const std::string &binary, uint64_t &size, uint64_t &time);
+
+    //Maps the cached index of the binary, fails if it is missing or stale
+    bool load(const std::string &binary);
+
+    //Takes a serialized index that could not be cached on disk
+    bool adopt(const std::vector<uint8_t> &data);
+
+    //Whether lookups of this address can be answered by the index
+    bool covers(uint64_t addr) const;
+
+    //Same semantics as ExecutableFile::getInfo, for covered addresses
+    bool lookup(uint64_t addr, std::string &source, uint64_t &line, std::string &function) const;
+};
+
+}
+
+#endif
@@ -36,7 +36,12 @@
 
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <zlib.h>
 #include "LogParser.h"
+#include "Parallel.h"
+
+#include <s2e/Plugins/ExecutionTracers/TraceStreamFormat.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -46,8 +51,11 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
-
-
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
 
 #endif
 
@@ -90,10 +98,22 @@ LogParser::LogParser():LogEvents()
 {
     m_cachedProcessor = NULL;
     m_cachedState = NULL;
+    m_itemCount = 0;
+    m_threadCount = 0;
+
+    m_streamFd = -1;
+    m_streamRange = 0;
+    m_streamFill = 0;
+    m_chunkCur = NULL;
+    m_chunkLeft = 0;
 }
 
 LogParser::~LogParser()
 {
+    closeStream();
+    for (unsigned i = 0; i < m_streamChunks.size(); ++i) {
+        delete [] m_streamChunks[i];
+    }
 
     LogFiles::iterator it;
     for(it=m_files.begin(); it != m_files.end(); ++it) {
@@ -111,22 +131,36 @@ LogParser::~LogParser()
 }
 
 
+unsigned LogParser::getThreadCount() const
+{
+    return getWorkerCount(m_threadCount);
+}
+
+void LogParser::scanFiles(unsigned index, const std::vector<std::string> *fileNames,
+                          std::vector<ScannedFile> *scanned)
+{
+    scanFile((*fileNames)[index], (*scanned)[index]);
+}
+
 bool LogParser::parse(const std::vector<std::string> fileNames)
 {
-    std::vector<std::string>::const_iterator it;
-    for (it = fileNames.begin(); it != fileNames.end(); ++it) {
-        if (!parse(*it)) {
-            std::cerr << *it << " is incomplete" << std::endl;
+    //Mapping and scanning only touch the file itself, do it for all
+    //files at once. Items are then processed in the order of the list.
+    std::vector<ScannedFile> scanned(fileNames.size());
+    parallelFor(fileNames.size(), getThreadCount(),
+                sigc::bind(sigc::ptr_fun(&LogParser::scanFiles), &fileNames, &scanned));
+
+    for (unsigned i = 0; i < scanned.size(); ++i) {
+        if (!parseScanned(scanned[i], NULL)) {
+            std::cerr << fileNames[i] << " is incomplete" << std::endl;
         }
     }
     return true;
 }
 
 
-bool LogParser::parse(const std::string &fileName)
+bool LogParser::mapFile(const std::string &fileName, LogFile &element)
 {
-    LogFile element;
-
 #ifdef _WIN32
     element.m_hFile = CreateFile(fileName.c_str(), GENERIC_READ,
                               FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
@@ -179,55 +213,573 @@ bool LogParser::parse(const std::string &fileName)
     element.m_size = fileSize;
 
 #endif
+    return true;
+}
 
+bool LogParser::parse(const std::string &fileName)
+{
+    return parse(fileName, PathSet());
+}
 
-    uint64_t currentOffset = 0;
-    unsigned currentItem = m_ItemAddresses.size();
+bool LogParser::parse(const std::string &fileName, const PathSet &stateFilter)
+{
+    ScannedFile scanned;
+    scanFile(fileName, scanned);
+    return parseScanned(scanned, stateFilter.empty() ? NULL : &stateFilter);
+}
+
+/**
+ *  Maps the file and locates its items (version 1) or its blocks (version 2).
+ *  Does not touch the parser, so several files can be scanned concurrently.
+ */
+void LogParser::scanFile(const std::string &fileName, ScannedFile &scanned)
+{
+    LogFile &element = scanned.file;
+    if (!mapFile(fileName, element)) {
+        return;
+    }
+    scanned.mapped = true;
+
+    const s2e::plugins::ExecutionTraceFileHeader *fileHeader =
+            (const s2e::plugins::ExecutionTraceFileHeader *) element.m_File;
+    if (element.m_size >= sizeof(*fileHeader) &&
+        fileHeader->magic == EXECTRACE_FILE_MAGIC) {
+        scanned.compressed = true;
+        if (fileHeader->version != EXECTRACE_FORMAT_V2) {
+            std::cerr << "LogParser: unsupported trace format " << fileHeader->version << std::endl;
+            return;
+        }
+        scanned.complete = loadBlockIndex(element, scanned.blocks, &scanned.footer);
+        return;
+    }
 
+    uint64_t currentOffset = 0;
     uint8_t *buffer = (uint8_t*)element.m_File;
 
     while(currentOffset < element.m_size) {
+        s2e::plugins::ExecutionTraceItemHeader *hdr =
+                (s2e::plugins::ExecutionTraceItemHeader *)(buffer + currentOffset);
 
+        if (currentOffset + sizeof(*hdr) > element.m_size) {
+            std::cerr << "LogParser: Could not read header " << std::endl;
+            return;
+        }
+
+        if (currentOffset + sizeof(*hdr) + hdr->size > element.m_size) {
+            std::cerr << "LogParser: Could not read payload " << std::endl;
+            return;
+        }
+
+        scanned.items.push_back(buffer + currentOffset);
+        currentOffset += sizeof(*hdr) + hdr->size;
+    }
+
+    scanned.complete = true;
+}
+
+bool LogParser::parseScanned(ScannedFile &scanned, const PathSet *states)
+{
+    if (!scanned.mapped) {
+        return false;
+    }
+
+    //The items of incomplete files are still usable, keep the mapping
+    m_files.push_back(scanned.file);
+
+    if (scanned.compressed) {
+        return parseCompressed(scanned, states);
+    }
+
+    if (scanned.items.size() > scanned.maxItems) {
+        scanned.items.resize(scanned.maxItems);
+    }
+
+    ItemRange range;
+    range.firstItem = m_itemCount;
+    range.itemCount = scanned.items.size();
+    range.compressed = false;
+    range.base = m_ItemAddresses.size();
+    range.blockCount = 0;
+    m_ranges.push_back(range);
+
+    m_ItemAddresses.insert(m_ItemAddresses.end(), scanned.items.begin(), scanned.items.end());
+
+    for (unsigned i = 0; i < scanned.items.size(); ++i) {
+        uint8_t *buffer = scanned.items[i];
         s2e::plugins::ExecutionTraceItemHeader *hdr =
                 (s2e::plugins::ExecutionTraceItemHeader *)(buffer);
+        if (!states || states->count(hdr->stateId)) {
+            processItem(m_itemCount + i, *hdr, buffer + sizeof(*hdr));
+        }
+    }
 
-        if (currentOffset + sizeof(s2e::plugins::ExecutionTraceItemHeader) > element.m_size) {
-            std::cerr << "LogParser: Could not read header " << std::endl;
+    m_itemCount += scanned.items.size();
+    return scanned.complete;
+}
+
+/**
+ *  Reads the block index from the footer of a compressed trace.
+ *  If the trace has no footer (e.g., S2E crashed), the block headers are
+ *  walked instead.
+ */
+bool LogParser::loadBlockIndex(const LogFile &element,
+                               std::vector<ExecutionTraceBlockIndexEntry> &blocks,
+                               const ExecutionTraceFooter **footer)
+{
+    const uint8_t *base = (const uint8_t*) element.m_File;
+    uint64_t size = element.m_size;
+
+    *footer = NULL;
+    if (size >= sizeof(ExecutionTraceFileHeader) + sizeof(ExecutionTraceFooter)) {
+        const ExecutionTraceFooter *f =
+                (const ExecutionTraceFooter*) (base + size - sizeof(ExecutionTraceFooter));
+        if (f->magic == EXECTRACE_FILE_MAGIC && f->version == EXECTRACE_FORMAT_V2 &&
+            f->blockIndexOffset + f->blockCount * sizeof(ExecutionTraceBlockIndexEntry) <= size) {
+            const ExecutionTraceBlockIndexEntry *entries =
+                    (const ExecutionTraceBlockIndexEntry*) (base + f->blockIndexOffset);
+            blocks.assign(entries, entries + f->blockCount);
+            *footer = f;
+            return true;
+        }
+    }
+
+    std::cerr << "LogParser: trace has no index, scanning blocks" << std::endl;
+
+    uint64_t offset = sizeof(ExecutionTraceFileHeader);
+    while (offset + sizeof(ExecutionTraceBlockHeader) <= size) {
+        const ExecutionTraceBlockHeader *hdr = (const ExecutionTraceBlockHeader*) (base + offset);
+        if (hdr->magic != EXECTRACE_BLOCK_MAGIC) {
+            break;
+        }
+
+        uint64_t end = offset + sizeof(*hdr) + hdr->stateCount * sizeof(uint32_t) +
+                       hdr->compressedSize;
+        if (end > size) {
+            std::cerr << "LogParser: truncated block" << std::endl;
             return false;
         }
 
-        buffer += sizeof(*hdr);
+        ExecutionTraceBlockIndexEntry e;
+        e.offset = offset;
+        e.firstItem = hdr->firstItem;
+        e.itemCount = hdr->itemCount;
+        e.firstTimeStamp = hdr->firstTimeStamp;
+        e.lastTimeStamp = hdr->lastTimeStamp;
+        blocks.push_back(e);
 
-        if (hdr->size > 0) {
-            if (currentOffset + hdr->size > element.m_size) {
-                std::cerr << "LogParser: Could not read payload " << std::endl;
-                return false;
+        offset = end;
+    }
+    return true;
+}
+
+void LogParser::decodeBlocks(unsigned index, const TraceBlock *blocks,
+                             std::vector<BlockCache> *caches, std::vector<char> *status)
+{
+    (*status)[index] = decodeBlock(blocks[index].header, (*caches)[index]);
+}
+
+bool LogParser::parseCompressed(const ScannedFile &scanned, const PathSet *states)
+{
+    const uint8_t *base = (const uint8_t*) scanned.file.m_File;
+    const std::vector<ExecutionTraceBlockIndexEntry> &blocks = scanned.blocks;
+    const ExecutionTraceFooter *footer = scanned.footer;
+    bool complete = scanned.complete;
+
+    //Blocks that S2E dropped while tracing leave gaps in the item numbers
+    uint64_t expected = 0;
+    for (unsigned i = 0; i < blocks.size(); ++i) {
+        if (blocks[i].firstItem > expected) {
+            std::cerr << "LogParser: items " << expected << " to " << blocks[i].firstItem - 1
+                      << " were dropped while tracing" << std::endl;
+        }
+        expected = blocks[i].firstItem + blocks[i].itemCount;
+    }
+
+    //Use the state index to skip the blocks without items of interest
+    std::vector<uint32_t> selected;
+    if (states && footer) {
+        const ExecutionTraceStateIndexEntry *entries =
+                (const ExecutionTraceStateIndexEntry*) (base + footer->stateIndexOffset);
+        const uint32_t *lists = (const uint32_t*) (base + footer->blockListOffset);
+        for (unsigned i = 0; i < footer->stateCount; ++i) {
+            if (states->count(entries[i].stateId)) {
+                selected.insert(selected.end(), lists + entries[i].firstBlock,
+                                lists + entries[i].firstBlock + entries[i].blockCount);
             }
         }
+        std::sort(selected.begin(), selected.end());
+        selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+    } else {
+        for (unsigned i = 0; i < blocks.size(); ++i) {
+            selected.push_back(i);
+        }
+    }
+
+    ItemRange range;
+    range.firstItem = m_itemCount;
+    range.compressed = true;
+    range.base = m_blocks.size();
+
+    //Blocks are decompressed concurrently in batches, then the items
+    //of the batch are processed in order on this thread.
+    unsigned threadCount = getThreadCount();
+    unsigned batchSize = threadCount > 1 ? threadCount * 4 : 1;
+    std::vector<BlockCache> caches(batchSize);
+    std::vector<char> status(batchSize);
+    bool corrupted = false;
+
+    for (unsigned first = 0; first < selected.size() && !corrupted; first += batchSize) {
+        unsigned count = std::min<size_t>(batchSize, selected.size() - first);
+        size_t batchBase = m_blocks.size();
+
+        for (unsigned i = 0; i < count; ++i) {
+            const ExecutionTraceBlockIndexEntry &e = blocks[selected[first + i]];
+            TraceBlock b;
+            b.header = base + e.offset;
+            b.firstItem = m_itemCount + e.firstItem;
+            b.itemCount = e.itemCount;
+            m_blocks.push_back(b);
+        }
+
+        parallelFor(count, threadCount,
+                    sigc::bind(sigc::ptr_fun(&LogParser::decodeBlocks),
+                               &m_blocks[batchBase], &caches, &status));
+
+        for (unsigned i = 0; i < count; ++i) {
+            if (!status[i]) {
+                std::cerr << "LogParser: corrupted block at offset "
+                          << blocks[selected[first + i]].offset << std::endl;
+                m_blocks.resize(batchBase + i);
+                complete = false;
+                corrupted = true;
+                break;
+            }
+
+            const TraceBlock &b = m_blocks[batchBase + i];
+            BlockCache &cache = caches[i];
+            uint64_t fileItem = b.firstItem - m_itemCount;
+            for (unsigned j = 0; j < b.itemCount && fileItem + j < scanned.maxItems; ++j) {
+                uint8_t *item = &cache.decoded[cache.items[j]];
+                s2e::plugins::ExecutionTraceItemHeader *hdr =
+                        (s2e::plugins::ExecutionTraceItemHeader *) item;
+                if (!states || states->count(hdr->stateId)) {
+                    processItem(b.firstItem + j, *hdr, item + sizeof(*hdr));
+                }
+            }
+        }
+    }
+
+    range.blockCount = m_blocks.size() - range.base;
+
+    uint64_t fileItems = footer ? footer->itemCount :
+                         (blocks.empty() ? 0 : blocks.back().firstItem + blocks.back().itemCount);
+    if (fileItems > scanned.maxItems) {
+        fileItems = scanned.maxItems;
+    }
+    range.itemCount = fileItems;
+    m_ranges.push_back(range);
+    m_itemCount += fileItems;
+
+    return complete;
+}
+
+bool LogParser::decodeBlock(const uint8_t *header, BlockCache &cache)
+{
+    cache.block = -1;
+    cache.decoded.clear();
+    cache.items.clear();
+
+    const ExecutionTraceBlockHeader *hdr = (const ExecutionTraceBlockHeader*) header;
+    const uint8_t *compressed = header + sizeof(*hdr) + hdr->stateCount * sizeof(uint32_t);
+
+    cache.uncompressed.resize(hdr->uncompressedSize);
+    uLongf size = hdr->uncompressedSize;
+    if (size && uncompress(&cache.uncompressed[0], &size, compressed, hdr->compressedSize) != Z_OK) {
+        return false;
+    }
+    if (size != hdr->uncompressedSize) {
+        return false;
+    }
+
+    if (!traceDecodeBlock(size ? &cache.uncompressed[0] : NULL, size, hdr->itemCount, cache.decoded)) {
+        return false;
+    }
+
+    uint32_t offset = 0;
+    for (unsigned i = 0; i < hdr->itemCount; ++i) {
+        cache.items.push_back(offset);
+        const s2e::plugins::ExecutionTraceItemHeader *item =
+                (const s2e::plugins::ExecutionTraceItemHeader *) &cache.decoded[offset];
+        offset += sizeof(*item) + item->size;
+    }
+
+    return true;
+}
+
+#ifndef _WIN32
+
+bool LogParser::openStream(const std::string &socketPath, const std::string &traceFile)
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "LogParser: socket path too long " << socketPath << std::endl;
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        std::cerr << "LogParser: could not connect to " << socketPath << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    //S2E sends the header when it accepts the connection, on its next timer tick
+    ExecutionTraceStreamHeader hdr;
+    size_t received = 0;
+    while (received < sizeof(hdr)) {
+        ssize_t ret = read(fd, (uint8_t*) &hdr + received, sizeof(hdr) - received);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            std::cerr << "LogParser: could not read the stream header" << std::endl;
+            close(fd);
+            return false;
+        }
+        received += ret;
+    }
 
-        processItem(currentItem, *hdr, buffer);
-        buffer+=hdr->size;
+    if (hdr.magic != EXECTRACE_STREAM_MAGIC || hdr.version != EXECTRACE_STREAM_VERSION) {
+        std::cerr << "LogParser: " << socketPath << " is not an S2E trace stream" << std::endl;
+        close(fd);
+        return false;
+    }
 
-        m_ItemAddresses.push_back(currentOffset + (uint8_t*)element.m_File);
+    if (hdr.firstItem > 0) {
+        if (traceFile.empty()) {
+            std::cerr << "LogParser: the stream starts at item " << hdr.firstItem
+                      << ", the previous items are missing" << std::endl;
+        } else {
+            //S2E flushed the items preceding the stream, ignore the ones after
+            ScannedFile scanned;
+            scanned.maxItems = hdr.firstItem;
+            scanFile(traceFile, scanned);
+
+            uint64_t available = scanned.items.size();
+            for (unsigned i = 0; i < scanned.blocks.size(); ++i) {
+                available += scanned.blocks[i].itemCount;
+            }
 
-        currentOffset += sizeof(s2e::plugins::ExecutionTraceItemHeader)  + hdr->size;
+            if (available < hdr.firstItem) {
+                std::cerr << "LogParser: " << traceFile << " has " << available
+                          << " items, expected " << hdr.firstItem << std::endl;
+                close(fd);
+                return false;
+            }
 
-        ++currentItem;
+            parseScanned(scanned, NULL);
+        }
     }
 
-    m_files.push_back(element);
-    //fclose(file);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    m_streamFd = fd;
+    m_streamFill = 0;
+
+    //The stream is a version 1 trace whose range grows as items arrive
+    ItemRange range;
+    range.firstItem = m_itemCount;
+    range.itemCount = 0;
+    range.compressed = false;
+    range.base = m_ItemAddresses.size();
+    range.blockCount = 0;
+    m_streamRange = m_ranges.size();
+    m_ranges.push_back(range);
+
     return true;
 }
 
+bool LogParser::pollStream(unsigned timeoutMs)
+{
+    if (m_streamFd < 0) {
+        return false;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = m_streamFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    poll(&pfd, 1, timeoutMs);
+
+    //Bound the amount read at once so that callers get control back
+    bool open = true;
+    size_t readSize = 0;
+    while (readSize < 16 * 1024 * 1024) {
+        if (m_streamBuffer.size() - m_streamFill < 64 * 1024) {
+            m_streamBuffer.resize(m_streamFill + 1024 * 1024);
+        }
+
+        ssize_t ret = read(m_streamFd, &m_streamBuffer[m_streamFill],
+                           m_streamBuffer.size() - m_streamFill);
+        if (ret > 0) {
+            m_streamFill += ret;
+            readSize += ret;
+            continue;
+        }
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        open = false;
+        break;
+    }
+
+    processStreamBuffer();
+
+    if (!open) {
+        if (m_streamFill) {
+            std::cerr << "LogParser: the stream ended in the middle of an item" << std::endl;
+        }
+        closeStream();
+    }
+    return open;
+}
+
+#else
+
+bool LogParser::openStream(const std::string &socketPath, const std::string &traceFile)
+{
+    std::cerr << "LogParser: trace streams are not supported on this platform" << std::endl;
+    return false;
+}
+
+bool LogParser::pollStream(unsigned timeoutMs)
+{
+    return false;
+}
+
+#endif
+
+void LogParser::closeStream()
+{
+#ifndef _WIN32
+    if (m_streamFd >= 0) {
+        close(m_streamFd);
+        m_streamFd = -1;
+    }
+#endif
+}
+
+//Items must not move once processed, they are copied to fixed chunks
+uint8_t *LogParser::allocateStreamItem(size_t size)
+{
+    const size_t chunkSize = 1024 * 1024;
+
+    if (size > m_chunkLeft) {
+        size_t allocSize = size > chunkSize ? size : chunkSize;
+        m_chunkCur = new uint8_t[allocSize];
+        m_chunkLeft = allocSize;
+        m_streamChunks.push_back(m_chunkCur);
+    }
+
+    uint8_t *ret = m_chunkCur;
+    m_chunkCur += size;
+    m_chunkLeft -= size;
+    return ret;
+}
+
+void LogParser::processStreamBuffer()
+{
+    size_t offset = 0;
+
+    while (m_streamFill - offset >= sizeof(s2e::plugins::ExecutionTraceItemHeader)) {
+        const s2e::plugins::ExecutionTraceItemHeader *hdr =
+                (const s2e::plugins::ExecutionTraceItemHeader *) &m_streamBuffer[offset];
+        size_t itemSize = sizeof(*hdr) + hdr->size;
+        if (m_streamFill - offset < itemSize) {
+            break;
+        }
+
+        uint8_t *item = allocateStreamItem(itemSize);
+        memcpy(item, hdr, itemSize);
+        offset += itemSize;
+
+        m_ItemAddresses.push_back(item);
+        ++m_ranges[m_streamRange].itemCount;
+
+        hdr = (const s2e::plugins::ExecutionTraceItemHeader *) item;
+        processItem(m_itemCount++, *hdr, item + sizeof(*hdr));
+    }
+
+    if (offset) {
+        memmove(&m_streamBuffer[0], &m_streamBuffer[offset], m_streamFill - offset);
+        m_streamFill -= offset;
+    }
+}
+
 bool LogParser::getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data)
 {
-    if (index >= m_ItemAddresses.size() ) {
+    return getItem(index, hdr, data, m_cache);
+}
+
+bool LogParser::getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr,
+                        void **data, BlockCache &cache) const
+{
+    //Find the file the item comes from
+    std::vector<ItemRange>::const_iterator rit = m_ranges.end();
+    for (std::vector<ItemRange>::const_iterator it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+        if (index >= (*it).firstItem && index < (*it).firstItem + (*it).itemCount) {
+            rit = it;
+            break;
+        }
+    }
+
+    if (rit == m_ranges.end()) {
         assert(false);
         return false;
     }
 
-    uint8_t *buffer = m_ItemAddresses[index];
+    const ItemRange &range = *rit;
+    uint8_t *buffer;
+
+    if (!range.compressed) {
+        buffer = m_ItemAddresses[range.base + index - range.firstItem];
+    } else {
+        //The returned data stays valid until another block is decoded
+        unsigned lo = range.base, hi = range.base + range.blockCount;
+        while (lo < hi) {
+            unsigned mid = (lo + hi) / 2;
+            if (m_blocks[mid].firstItem + m_blocks[mid].itemCount <= index) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo == range.base + range.blockCount || m_blocks[lo].firstItem > index) {
+            //The block was skipped because of a state filter
+            return false;
+        }
+
+        if (cache.block != (int) lo) {
+            if (!decodeBlock(m_blocks[lo].header, cache)) {
+                return false;
+            }
+            cache.block = lo;
+        }
+        buffer = &cache.decoded[cache.items[index - m_blocks[lo].firstItem]];
+    }
+
     hdr = *(s2e::plugins::ExecutionTraceItemHeader*)buffer;
 
     *data = NULL;
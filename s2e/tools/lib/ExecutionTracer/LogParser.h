@@ -40,6 +40,7 @@
 #include <string>
 #include <sigc++/sigc++.h>
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+#include <s2e/Plugins/ExecutionTracers/TraceFormat.h>
 #include <stdio.h>
 #include <vector>
 #include <map>
@@ -97,6 +98,22 @@ protected:
 
 class LogParser: public LogEvents
 {
+public:
+    /**
+     *  Decoded block of a compressed (version 2) trace.
+     *  Threads that read items concurrently must each use their own cache.
+     */
+    struct BlockCache {
+        int block;
+        std::vector<uint8_t> uncompressed;
+        std::vector<uint8_t> decoded;
+        std::vector<uint32_t> items;
+
+        BlockCache() {
+            block = -1;
+        }
+    };
+
 private:
 
     struct LogFile {
@@ -119,13 +136,96 @@ private:
 
     typedef std::vector<LogFile> LogFiles;
 
+    /**
+     *  Block of a compressed (version 2) trace. Blocks are decoded
+     *  on demand, the most recently used one is cached.
+     */
+    struct TraceBlock {
+        const uint8_t *header;
+        uint64_t firstItem;
+        uint32_t itemCount;
+    };
+
+    /**
+     *  Range of item indexes coming from one file.
+     *  The base is an index in m_ItemAddresses or in m_blocks.
+     */
+    struct ItemRange {
+        uint64_t firstItem;
+        uint64_t itemCount;
+        bool compressed;
+        size_t base;
+        size_t blockCount;
+    };
+
+    /**
+     *  Result of the first pass over a file, which only looks at
+     *  the file itself and can run concurrently for several files.
+     */
+    struct ScannedFile {
+        LogFile file;
+        bool mapped;
+        bool compressed;
+        bool complete;
+
+        //Version 1: address of each item
+        std::vector<uint8_t*> items;
+
+        //Version 2: block index
+        std::vector<s2e::plugins::ExecutionTraceBlockIndexEntry> blocks;
+        const s2e::plugins::ExecutionTraceFooter *footer;
+
+        //Items past this one are ignored (the file is still being written)
+        uint64_t maxItems;
+
+        ScannedFile() {
+            mapped = compressed = complete = false;
+            footer = NULL;
+            maxItems = (uint64_t) -1;
+        }
+    };
+
     LogFiles m_files;
     std::vector<uint8_t*> m_ItemAddresses;
+    std::vector<TraceBlock> m_blocks;
+    std::vector<ItemRange> m_ranges;
+    uint64_t m_itemCount;
+    unsigned m_threadCount;
+
+    BlockCache m_cache;
+
+    //Live stream from a running ExecutionTracer
+    int m_streamFd;
+    size_t m_streamRange;
+    std::vector<uint8_t> m_streamBuffer;
+    size_t m_streamFill;
+    std::vector<uint8_t*> m_streamChunks;
+    uint8_t *m_chunkCur;
+    size_t m_chunkLeft;
 
     ItemProcessors m_ItemProcessors;
     void *m_cachedProcessor;
     ItemProcessorState* m_cachedState;
 
+    static bool mapFile(const std::string &fileName, LogFile &element);
+    static bool loadBlockIndex(const LogFile &element,
+                        std::vector<s2e::plugins::ExecutionTraceBlockIndexEntry> &blocks,
+                        const s2e::plugins::ExecutionTraceFooter **footer);
+    static bool decodeBlock(const uint8_t *header, BlockCache &cache);
+
+    static void scanFile(const std::string &fileName, ScannedFile &scanned);
+    static void scanFiles(unsigned index, const std::vector<std::string> *fileNames,
+                          std::vector<ScannedFile> *scanned);
+    static void decodeBlocks(unsigned index, const TraceBlock *blocks,
+                             std::vector<BlockCache> *caches, std::vector<char> *status);
+
+    bool parseScanned(ScannedFile &scanned, const PathSet *states);
+    bool parseCompressed(const ScannedFile &scanned, const PathSet *states);
+
+    uint8_t *allocateStreamItem(size_t size);
+    void processStreamBuffer();
+    void closeStream();
+
 protected:
 
 
@@ -133,10 +233,57 @@ public:
     LogParser();
     virtual ~LogParser();
 
+    /**
+     *  Number of threads used to scan files and decode blocks.
+     *  0 (the default) uses one thread per processor. Items are
+     *  always processed on the calling thread and in trace order.
+     */
+    void setThreadCount(unsigned count) {
+        m_threadCount = count;
+    }
+
+    unsigned getThreadCount() const;
+
+    /**
+     *  The files are mapped and scanned concurrently, then their items
+     *  are processed in the order of the list, as if they were parsed
+     *  one after the other.
+     */
     bool parse(const std::vector<std::string> fileNames);
     bool parse(const std::string &file);
+
+    /**
+     *  Only processes the items of the given states (all of them if the set
+     *  is empty). For compressed traces, this only decodes the blocks that
+     *  contain such items.
+     */
+    bool parse(const std::string &file, const PathSet &states);
+
+    /**
+     *  Connects to the socket of a running ExecutionTracer (stream option).
+     *  The items written before the connection are first read from
+     *  traceFile, which must be the trace of the same S2E process.
+     *  Without it, only the items that follow the connection are seen.
+     */
+    bool openStream(const std::string &socketPath, const std::string &traceFile);
+
+    /**
+     *  Processes the items received since the last call, waiting up to
+     *  timeoutMs for some to arrive. Returns false once S2E closed the
+     *  stream. The items stay available through getItem.
+     */
+    bool pollStream(unsigned timeoutMs);
+
     bool getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr, void **data);
 
+    /**
+     *  Same as above, but can be called concurrently from several threads
+     *  once parsing is done. The data stays valid until the next call
+     *  with the same cache.
+     */
+    bool getItem(unsigned index, s2e::plugins::ExecutionTraceItemHeader &hdr,
+                 void **data, BlockCache &cache) const;
+
     virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
     virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
     virtual void getPaths(PathSet &s);
@@ -61,6 +61,11 @@ void PageFault::onItem(unsigned traceIndex,
         const s2e::plugins::ExecutionTraceItemHeader &hdr,
         void *item)
 {
+    if (hdr.type == s2e::plugins::TRACE_SAMPLING) {
+        PageFaultState *state = static_cast<PageFaultState*>(m_events->getState(this, &PageFaultState::factory));
+        state->m_weights.update(*(ExecutionTraceSampling*)item);
+    }else
+
     if (hdr.type == s2e::plugins::TRACE_PAGEFAULT) {
         PageFaultState *state = static_cast<PageFaultState*>(m_events->getState(this, &PageFaultState::factory));
 
@@ -71,9 +76,9 @@ void PageFault::onItem(unsigned traceIndex,
             if (!mi || mi->Name != m_module) {
                 return;
             }
-            state->m_totalPageFaults++;
+            state->m_totalPageFaults += state->m_weights.get(hdr.type);
         }else {
-            state->m_totalPageFaults++;
+            state->m_totalPageFaults += state->m_weights.get(hdr.type);
         }
     }else
 
@@ -87,9 +92,9 @@ void PageFault::onItem(unsigned traceIndex,
             if (!mi || mi->Name != m_module) {
                 return;
             }
-            state->m_totalTlbMisses++;
+            state->m_totalTlbMisses += state->m_weights.get(hdr.type);
         }else {
-            state->m_totalTlbMisses++;
+            state->m_totalTlbMisses += state->m_weights.get(hdr.type);
         }
     }
 }
@@ -40,6 +40,7 @@
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
 #include "LogParser.h"
 #include "ModuleParser.h"
+#include "Sampling.h"
 
 namespace s2etools {
 
@@ -74,8 +75,10 @@ public:
 class PageFaultState : public ItemProcessorState
 {
 private:
-    uint64_t m_totalPageFaults;
-    uint64_t m_totalTlbMisses;
+    //Estimates, in case the trace is sampled
+    double m_totalPageFaults;
+    double m_totalTlbMisses;
+    SamplingWeights m_weights;
 
 public:
     static ItemProcessorState *factory();
@@ -85,11 +88,15 @@ public:
     friend class PageFault;
 
     uint64_t getPageFaults() const {
-        return m_totalPageFaults;
+        return (uint64_t) (m_totalPageFaults + 0.5);
     }
 
     uint64_t getTlbMisses() const {
-        return m_totalTlbMisses;
+        return (uint64_t) (m_totalTlbMisses + 0.5);
+    }
+
+    bool isSampled() const {
+        return m_weights.isSampled();
     }
 };
 
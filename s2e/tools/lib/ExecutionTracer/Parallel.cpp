@@ -0,0 +1,127 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include <vector>
+#include <iostream>
+#include "Parallel.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace s2etools
+{
+
+unsigned getWorkerCount(unsigned requested)
+{
+    if (requested) {
+        return requested;
+    }
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) {
+        return count;
+    }
+#endif
+    return 1;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+struct ParallelWork {
+    const ParallelTask *task;
+    unsigned count;
+    volatile unsigned next;
+};
+
+void *parallelWorker(void *opaque)
+{
+    ParallelWork *work = static_cast<ParallelWork*>(opaque);
+    unsigned i;
+    while ((i = __sync_fetch_and_add(&work->next, 1)) < work->count) {
+        (*work->task)(i);
+    }
+    return NULL;
+}
+
+}
+
+void parallelFor(unsigned count, unsigned threadCount, const ParallelTask &task)
+{
+    if (threadCount > count) {
+        threadCount = count;
+    }
+
+    ParallelWork work;
+    work.task = &task;
+    work.count = count;
+    work.next = 0;
+
+    //The calling thread is one of the workers
+    std::vector<pthread_t> threads;
+    for (unsigned i = 1; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, parallelWorker, &work)) {
+            std::cerr << "parallelFor: could not create thread, continuing with "
+                      << threads.size() + 1 << std::endl;
+            break;
+        }
+        threads.push_back(thread);
+    }
+
+    parallelWorker(&work);
+
+    for (unsigned i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+#else
+
+void parallelFor(unsigned count, unsigned threadCount, const ParallelTask &task)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        task(i);
+    }
+}
+
+#endif
+
+}
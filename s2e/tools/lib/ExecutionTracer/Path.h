@@ -139,7 +139,48 @@ typedef std::map<uint32_t, PathSegmentList> StateToSegments;
 typedef std::vector<uint32_t> ExecutionPath;
 typedef std::vector<ExecutionPath> ExecutionPaths;
 
+/**
+ *  Replays the items of a single path, from the root of the fork tree
+ *  to the leaf. Processors attached to a replay keep one state for the
+ *  whole path, so several replays can run concurrently on the same tree.
+ */
+class PathReplay: public LogEvents
+{
+private:
+    const LogParser *m_Parser;
+    uint32_t m_PathId;
+    PathSegmentList m_Segments;
+    PathSegmentStateMap m_State;
+    LogParser::BlockCache m_Cache;
+
+public:
+    PathReplay(const LogParser *parser, uint32_t pathId, const PathSegmentList &segments);
+    virtual ~PathReplay();
+
+    uint32_t getPathId() const {
+        return m_PathId;
+    }
+
+    bool run();
+
+    virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
+    virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
+    virtual void getPaths(PathSet &s);
+};
 
+/**
+ *  Work done for each path by PathBuilder::processPaths.
+ *  processPath runs on a worker thread: it must attach its own processors
+ *  to the replay, call run(), and store what it computed at the given index.
+ *  Merging the results in index order after processPaths returns gives the
+ *  same output regardless of the number of threads.
+ */
+class PathTask
+{
+public:
+    virtual ~PathTask() {}
+    virtual void processPath(unsigned index, PathReplay &replay) = 0;
+};
 
 
 class PathBuilder: public LogEvents
@@ -169,6 +210,18 @@ public:
     bool processPath(uint32_t);
     void processTree();
 
+    //Segments of the path, starting from the root
+    bool getSegments(uint32_t pathId, PathSegmentList &segments) const;
+
+    /**
+     *  Replays each path of the list with the given task, on up to
+     *  threadCount threads (0 means one per processor). The parser must
+     *  be done parsing. Unlike processPath, this does not touch the
+     *  state kept in the tree.
+     */
+    void processPaths(const std::vector<uint32_t> &paths, PathTask &task,
+                      unsigned threadCount = 0);
+
     void resetTree();
     virtual ItemProcessorState* getState(void *processor, ItemProcessorStateFactory f);
     virtual ItemProcessorState* getState(void *processor, uint32_t pathId);
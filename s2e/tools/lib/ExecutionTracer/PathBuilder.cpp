@@ -37,9 +37,11 @@
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
 #include <cassert>
 #include <stack>
+#include <algorithm>
 #include <ostream>
 #include <iostream>
 #include "Path.h"
+#include "Parallel.h"
 
 //#define DEBUG_PB
 
@@ -318,20 +320,12 @@ bool PathBuilder::processPath(uint32_t pathId)
 {
     resetTree();
 
-    StateToSegments::iterator it;
-    it = m_Leaves.find(pathId);
-    if (it == m_Leaves.end()) {
+    PathSegmentList segments;
+    if (!getSegments(pathId, segments)) {
         return false;
     }
 
-    std::vector<PathSegment*> segments;
-    PathSegment *seg = (*it).second.back();
-    while(seg) {
-        segments.push_back(seg);
-        seg=seg->getParent();
-    }
-
-    for (int i=segments.size()-1; i>=0; --i) {
+    for (unsigned i=0; i<segments.size(); ++i) {
         m_CurrentSegment = segments[i];
 
         if (m_CurrentSegment->getParent()) {
@@ -353,6 +347,61 @@ bool PathBuilder::processPath(uint32_t pathId)
     return true;
 }
 
+bool PathBuilder::getSegments(uint32_t pathId, PathSegmentList &segments) const
+{
+    StateToSegments::const_iterator it;
+    it = m_Leaves.find(pathId);
+    if (it == m_Leaves.end()) {
+        return false;
+    }
+
+    segments.clear();
+    PathSegment *seg = (*it).second.back();
+    while(seg) {
+        segments.push_back(seg);
+        seg=seg->getParent();
+    }
+    std::reverse(segments.begin(), segments.end());
+    return true;
+}
+
+namespace {
+
+struct PathTaskRunner {
+    const LogParser *parser;
+    const PathBuilder *builder;
+    const std::vector<uint32_t> *paths;
+    PathTask *task;
+
+    void run(unsigned index) {
+        PathSegmentList segments;
+        uint32_t pathId = (*paths)[index];
+        if (!builder->getSegments(pathId, segments)) {
+            std::cerr << "Could not find path with id " << std::dec << pathId
+                      << " in the execution trace." << std::endl;
+            segments.clear();
+        }
+
+        PathReplay replay(parser, pathId, segments);
+        task->processPath(index, replay);
+    }
+};
+
+}
+
+void PathBuilder::processPaths(const std::vector<uint32_t> &paths, PathTask &task,
+                               unsigned threadCount)
+{
+    PathTaskRunner runner;
+    runner.parser = m_Parser;
+    runner.builder = this;
+    runner.paths = &paths;
+    runner.task = &task;
+
+    parallelFor(paths.size(), getWorkerCount(threadCount),
+                sigc::mem_fun(runner, &PathTaskRunner::run));
+}
+
 //Discards all segment-local information kept by trace processors.
 void PathBuilder::resetTree()
 {
@@ -449,4 +498,85 @@ void PathBuilder::getPaths(PathSet &s)
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+PathReplay::PathReplay(const LogParser *parser, uint32_t pathId, const PathSegmentList &segments)
+{
+    m_Parser = parser;
+    m_PathId = pathId;
+    m_Segments = segments;
+}
+
+PathReplay::~PathReplay()
+{
+    PathSegmentStateMap::iterator it;
+    for (it = m_State.begin(); it != m_State.end(); ++it){
+        delete (*it).second;
+    }
+}
+
+//Returns false if the path does not exist or the trace is broken
+bool PathReplay::run()
+{
+    if (m_Segments.empty()) {
+        return false;
+    }
+
+    s2e::plugins::ExecutionTraceItemHeader hdr;
+    uint8_t *data;
+
+    PathSegmentList::const_iterator sit;
+    for (sit = m_Segments.begin(); sit != m_Segments.end(); ++sit) {
+        const PathSegment *seg = *sit;
+        const PathFragmentList &fra = seg->getFragmentList();
+        PathFragmentList::const_iterator it;
+
+        for (it = fra.begin(); it != fra.end(); ++it) {
+            const PathFragment &f = (*it);
+            for (uint32_t s = f.startIndex; s <= f.endIndex; ++s) {
+                if (!m_Parser->getItem(s, hdr, (void**)&data, m_Cache)) {
+                    std::cerr << "Trace is broken at item " << std::dec << s << std::endl;
+                    return false;
+                }
+                assert(hdr.stateId == seg->getStateId());
+                processItem(s, hdr, data);
+            }
+        }
+    }
+    return true;
+}
+
+ItemProcessorState* PathReplay::getState(void *processor, ItemProcessorStateFactory f)
+{
+    PathSegmentStateMap::iterator it = m_State.find(processor);
+    if (it != m_State.end()) {
+        return (*it).second;
+    }
+
+    ItemProcessorState *s = f();
+    m_State[processor] = s;
+    return s;
+}
+
+ItemProcessorState* PathReplay::getState(void *processor, uint32_t pathId)
+{
+    if (pathId != m_PathId) {
+        return NULL;
+    }
+
+    PathSegmentStateMap::iterator it = m_State.find(processor);
+    if (it == m_State.end()) {
+        return NULL;
+    }
+    return (*it).second;
+}
+
+void PathReplay::getPaths(PathSet &s)
+{
+    s.clear();
+    s.insert(m_PathId);
+}
+
 }
@@ -0,0 +1,82 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2ETOOLS_EXECTRACER_SAMPLING_H
+#define S2ETOOLS_EXECTRACER_SAMPLING_H
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+
+namespace s2etools {
+
+/**
+ *  How many occurrences each item of a sampled trace stands for.
+ *  Meant to be embedded in the per-path state of the processors,
+ *  since sampling items only apply to the path that contains them.
+ */
+class SamplingWeights
+{
+private:
+    double m_weights[s2e::plugins::TRACE_MAX];
+    bool m_sampled;
+
+public:
+    SamplingWeights() {
+        for (unsigned i = 0; i < s2e::plugins::TRACE_MAX; ++i) {
+            m_weights[i] = 1.0;
+        }
+        m_sampled = false;
+    }
+
+    void update(const s2e::plugins::ExecutionTraceSampling &s) {
+        if (s.itemType >= s2e::plugins::TRACE_MAX || !s.kept) {
+            return;
+        }
+        m_weights[s.itemType] = (double) s.seen / (double) s.kept;
+        m_sampled = m_sampled || s.mode != s2e::plugins::SAMPLING_NONE;
+    }
+
+    double get(unsigned type) const {
+        return type < s2e::plugins::TRACE_MAX ? m_weights[type] : 1.0;
+    }
+
+    bool isSampled() const {
+        return m_sampled;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,769 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#include <iostream>
+#include <cassert>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <s2e/Plugins/ExecutionTracers/TraceFormat.h>
+
+#include "TraceColumns.h"
+#include "Parallel.h"
+
+using namespace s2e::plugins;
+
+namespace s2etools
+{
+
+static const char *s_columnFiles[COLUMN_MAX] = {
+    "pc.col", "relpc.col", "state.col", "type.col", "timestamp.col", "module.col"
+};
+
+static const unsigned s_columnWidths[COLUMN_MAX] = {
+    sizeof(uint64_t), sizeof(uint64_t), sizeof(uint32_t), sizeof(uint8_t),
+    sizeof(uint64_t), sizeof(uint16_t)
+};
+
+ColumnWriter::ColumnWriter(LogEvents *events, ModuleCache *cache, unsigned chunkRows)
+{
+    m_events = events;
+    m_cache = cache;
+    m_chunkRows = chunkRows;
+    m_rowCount = 0;
+    m_error = false;
+
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        m_files[i] = NULL;
+    }
+
+    m_connection = events->onEachItem.connect(
+            sigc::mem_fun(*this, &ColumnWriter::onItem));
+}
+
+ColumnWriter::~ColumnWriter()
+{
+    m_connection.disconnect();
+    close();
+}
+
+bool ColumnWriter::open(const std::string &directory)
+{
+#ifdef _WIN32
+    mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+
+    m_directory = directory;
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        std::string fileName = directory + "/" + s_columnFiles[i];
+        m_files[i] = fopen(fileName.c_str(), "wb");
+        if (!m_files[i]) {
+            std::cerr << "ColumnWriter: could not create " << fileName << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t ColumnWriter::getModuleId(const std::string &name)
+{
+    std::map<std::string, uint16_t>::const_iterator it = m_moduleIds.find(name);
+    if (it != m_moduleIds.end()) {
+        return (*it).second;
+    }
+
+    if (m_moduleNames.size() >= COLUMN_NO_MODULE) {
+        return COLUMN_NO_MODULE;
+    }
+
+    uint16_t id = m_moduleNames.size();
+    m_moduleNames.push_back(name);
+    m_moduleIds[name] = id;
+    return id;
+}
+
+void ColumnWriter::onItem(unsigned traceIndex,
+                          const s2e::plugins::ExecutionTraceItemHeader &hdr,
+                          void *item)
+{
+    if (!m_files[0]) {
+        return;
+    }
+
+    uint64_t pc = 0, relPc = 0;
+    uint16_t module = COLUMN_NO_MODULE;
+
+    if (traceItemStartsWithPc(hdr.type, hdr.size)) {
+        memcpy(&pc, item, sizeof(pc));
+        relPc = pc;
+
+        ModuleCacheState *mcs = static_cast<ModuleCacheState*>(
+                m_events->getState(m_cache, &ModuleCacheState::factory));
+        const ModuleInstance *mi = mcs->getInstance(hdr.pid, pc);
+        if (mi) {
+            module = getModuleId(mi->Name);
+            relPc = pc - mi->LoadBase + mi->ImageBase;
+        }
+    }
+
+    if (hdr.type == TRACE_FORK) {
+        const ExecutionTraceFork *f = (const ExecutionTraceFork*) item;
+        for (unsigned i = 0; i < f->stateCount; ++i) {
+            if (f->children[i] == hdr.stateId) {
+                continue;
+            }
+            TraceColumnsFork fork;
+            fork.row = m_rowCount + m_pcs.size();
+            fork.parent = hdr.stateId;
+            fork.child = f->children[i];
+            m_forks.push_back(fork);
+        }
+    }
+
+    m_pcs.push_back(pc);
+    m_relPcs.push_back(relPc);
+    m_states.push_back(hdr.stateId);
+    m_types.push_back(hdr.type);
+    m_timeStamps.push_back(hdr.timeStamp);
+    m_modules.push_back(module);
+
+    if (m_pcs.size() == m_chunkRows) {
+        writeChunk();
+    }
+}
+
+void ColumnWriter::writeChunk()
+{
+    unsigned n = m_pcs.size();
+    if (!n) {
+        return;
+    }
+
+    TraceColumnsChunk chunk;
+    chunk.firstRow = m_rowCount;
+    chunk.rowCount = n;
+    chunk.typeMask = 0;
+    chunk.minPc = chunk.minTimeStamp = (uint64_t) -1;
+    chunk.maxPc = chunk.maxTimeStamp = 0;
+    chunk.minState = (uint32_t) -1;
+    chunk.maxState = 0;
+    chunk.minModule = COLUMN_NO_MODULE;
+    chunk.maxModule = 0;
+
+    for (unsigned i = 0; i < n; ++i) {
+        chunk.typeMask |= 1 << m_types[i];
+        chunk.minPc = std::min(chunk.minPc, m_pcs[i]);
+        chunk.maxPc = std::max(chunk.maxPc, m_pcs[i]);
+        chunk.minTimeStamp = std::min(chunk.minTimeStamp, m_timeStamps[i]);
+        chunk.maxTimeStamp = std::max(chunk.maxTimeStamp, m_timeStamps[i]);
+        chunk.minState = std::min(chunk.minState, m_states[i]);
+        chunk.maxState = std::max(chunk.maxState, m_states[i]);
+        chunk.minModule = std::min(chunk.minModule, m_modules[i]);
+        chunk.maxModule = std::max(chunk.maxModule, m_modules[i]);
+    }
+
+    const void *columns[COLUMN_MAX] = {
+        &m_pcs[0], &m_relPcs[0], &m_states[0], &m_types[0], &m_timeStamps[0], &m_modules[0]
+    };
+
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        if (fwrite(columns[i], s_columnWidths[i], n, m_files[i]) != n) {
+            m_error = true;
+        }
+    }
+
+    m_chunks.push_back(chunk);
+    m_rowCount += n;
+
+    m_pcs.clear();
+    m_relPcs.clear();
+    m_states.clear();
+    m_types.clear();
+    m_timeStamps.clear();
+    m_modules.clear();
+}
+
+bool ColumnWriter::close()
+{
+    if (!m_files[0]) {
+        return !m_error;
+    }
+
+    writeChunk();
+
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        if (m_files[i]) {
+            fclose(m_files[i]);
+            m_files[i] = NULL;
+        }
+    }
+
+    //The index is written last, a directory without it is incomplete
+    std::string fileName = m_directory + "/index.dat";
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "ColumnWriter: could not create " << fileName << std::endl;
+        return false;
+    }
+
+    TraceColumnsHeader hdr;
+    hdr.magic = TRACECOLUMNS_MAGIC;
+    hdr.version = TRACECOLUMNS_VERSION;
+    hdr.chunkRows = m_chunkRows;
+    hdr.rowCount = m_rowCount;
+    hdr.chunkCount = m_chunks.size();
+    hdr.forkCount = m_forks.size();
+    hdr.moduleCount = m_moduleNames.size();
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    if (!m_chunks.empty()) {
+        ok &= fwrite(&m_chunks[0], sizeof(m_chunks[0]), m_chunks.size(), fp) == m_chunks.size();
+    }
+    if (!m_forks.empty()) {
+        ok &= fwrite(&m_forks[0], sizeof(m_forks[0]), m_forks.size(), fp) == m_forks.size();
+    }
+    for (unsigned i = 0; i < m_moduleNames.size(); ++i) {
+        uint32_t length = m_moduleNames[i].size();
+        ok &= fwrite(&length, sizeof(length), 1, fp) == 1;
+        ok &= fwrite(m_moduleNames[i].c_str(), 1, length, fp) == length;
+    }
+
+    ok &= fclose(fp) == 0;
+    if (!ok) {
+        m_error = true;
+    }
+    return !m_error;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+TraceColumns::TraceColumns()
+{
+    memset(&m_header, 0, sizeof(m_header));
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        m_columns[i].data = NULL;
+        m_columns[i].size = 0;
+    }
+}
+
+TraceColumns::~TraceColumns()
+{
+#ifndef _WIN32
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        if (m_columns[i].data && m_columns[i].size) {
+            munmap(m_columns[i].data, m_columns[i].size);
+        }
+    }
+#else
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        delete [] (uint8_t*) m_columns[i].data;
+    }
+#endif
+}
+
+bool TraceColumns::loadIndex(const std::string &fileName)
+{
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "TraceColumns: could not open " << fileName << std::endl;
+        return false;
+    }
+
+    bool ok = fread(&m_header, sizeof(m_header), 1, fp) == 1 &&
+              m_header.magic == TRACECOLUMNS_MAGIC &&
+              m_header.version == TRACECOLUMNS_VERSION;
+
+    if (ok) {
+        m_chunks.resize(m_header.chunkCount);
+        m_forks.resize(m_header.forkCount);
+        if (m_header.chunkCount) {
+            ok &= fread(&m_chunks[0], sizeof(m_chunks[0]), m_chunks.size(), fp) == m_chunks.size();
+        }
+        if (m_header.forkCount) {
+            ok &= fread(&m_forks[0], sizeof(m_forks[0]), m_forks.size(), fp) == m_forks.size();
+        }
+    }
+
+    for (unsigned i = 0; ok && i < m_header.moduleCount; ++i) {
+        uint32_t length;
+        ok = fread(&length, sizeof(length), 1, fp) == 1 && length < 4096;
+        if (ok) {
+            std::vector<char> name(length + 1, 0);
+            ok = fread(&name[0], 1, length, fp) == length;
+            m_modules.push_back(&name[0]);
+        }
+    }
+
+    fclose(fp);
+
+    if (!ok) {
+        std::cerr << "TraceColumns: " << fileName << " is not a valid column index" << std::endl;
+    }
+    return ok;
+}
+
+bool TraceColumns::open(const std::string &directory)
+{
+    if (!loadIndex(directory + "/index.dat")) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < COLUMN_MAX; ++i) {
+        std::string fileName = directory + "/" + s_columnFiles[i];
+        uint64_t size = m_header.rowCount * s_columnWidths[i];
+
+#ifndef _WIN32
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "TraceColumns: could not open " << fileName << std::endl;
+            return false;
+        }
+
+        off_t fileSize = lseek(fd, 0, SEEK_END);
+        if (fileSize < 0 || (uint64_t) fileSize < size) {
+            std::cerr << "TraceColumns: " << fileName << " is truncated" << std::endl;
+            ::close(fd);
+            return false;
+        }
+
+        void *data = NULL;
+        if (size) {
+            data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                std::cerr << "TraceColumns: could not map " << fileName << std::endl;
+                ::close(fd);
+                return false;
+            }
+            //Queries scan the columns sequentially
+            madvise(data, size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+#else
+        FILE *fp = fopen(fileName.c_str(), "rb");
+        if (!fp) {
+            std::cerr << "TraceColumns: could not open " << fileName << std::endl;
+            return false;
+        }
+        uint8_t *data = new uint8_t[size ? size : 1];
+        bool ok = fread(data, 1, size, fp) == size;
+        fclose(fp);
+        if (!ok) {
+            delete [] data;
+            std::cerr << "TraceColumns: " << fileName << " is truncated" << std::endl;
+            return false;
+        }
+#endif
+
+        m_columns[i].data = data;
+        m_columns[i].size = size;
+    }
+
+    return true;
+}
+
+uint16_t TraceColumns::findModule(const std::string &name) const
+{
+    for (unsigned i = 0; i < m_modules.size(); ++i) {
+        if (m_modules[i] == name) {
+            return i;
+        }
+    }
+    return COLUMN_NO_MODULE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+enum QueryMode {
+    QUERY_COUNT, QUERY_SELECT, QUERY_DISTINCT
+};
+
+/**
+ *  The filters clear the bits of the rows that do not match in a bitmap
+ *  with one bit per row of the chunk. Words that are already clear are
+ *  skipped. Rows are processed 64 at a time so that a group of SIMD
+ *  comparisons never straddles two words.
+ */
+
+void filterTypes(const uint8_t *types, unsigned n, uint32_t typeMask, uint64_t *mask)
+{
+    for (unsigned w = 0; w * 64 < n; ++w) {
+        if (!mask[w]) {
+            continue;
+        }
+
+        const uint8_t *v = types + w * 64;
+        unsigned end = std::min(64u, n - w * 64);
+        uint64_t bits = 0;
+        unsigned j = 0;
+
+#ifdef __SSE2__
+        for (; j + 16 <= end; j += 16) {
+            __m128i values = _mm_loadu_si128((const __m128i*) (v + j));
+            __m128i hits = _mm_setzero_si128();
+            for (unsigned t = 0; t < TRACE_MAX; ++t) {
+                if (typeMask & (1 << t)) {
+                    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(values, _mm_set1_epi8(t)));
+                }
+            }
+            bits |= (uint64_t) (uint16_t) _mm_movemask_epi8(hits) << j;
+        }
+#endif
+
+        for (; j < end; ++j) {
+            bits |= (uint64_t) (v[j] < 32 && (typeMask & (1u << v[j]))) << j;
+        }
+        mask[w] &= bits;
+    }
+}
+
+void filterRange64(const uint64_t *values, unsigned n, uint64_t lo, uint64_t hi, uint64_t *mask)
+{
+    //A single unsigned comparison per row, which compilers vectorize
+    uint64_t span = hi - lo;
+    for (unsigned w = 0; w * 64 < n; ++w) {
+        if (!mask[w]) {
+            continue;
+        }
+
+        const uint64_t *v = values + w * 64;
+        unsigned end = std::min(64u, n - w * 64);
+        uint64_t bits = 0;
+        for (unsigned j = 0; j < end; ++j) {
+            bits |= (uint64_t) (v[j] - lo <= span) << j;
+        }
+        mask[w] &= bits;
+    }
+}
+
+void filterEquals16(const uint16_t *values, unsigned n, uint16_t value, uint64_t *mask)
+{
+    for (unsigned w = 0; w * 64 < n; ++w) {
+        if (!mask[w]) {
+            continue;
+        }
+
+        const uint16_t *v = values + w * 64;
+        unsigned end = std::min(64u, n - w * 64);
+        uint64_t bits = 0;
+        unsigned j = 0;
+
+#ifdef __SSE2__
+        __m128i needle = _mm_set1_epi16(value);
+        for (; j + 8 <= end; j += 8) {
+            __m128i hits = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*) (v + j)), needle);
+            //Narrow the 16-bit results to bytes to get one bit per row
+            hits = _mm_packs_epi16(hits, _mm_setzero_si128());
+            bits |= (uint64_t) (uint8_t) _mm_movemask_epi8(hits) << j;
+        }
+#endif
+
+        for (; j < end; ++j) {
+            bits |= (uint64_t) (v[j] == value) << j;
+        }
+        mask[w] &= bits;
+    }
+}
+
+void filterStates(const uint32_t *states, unsigned n, uint64_t firstRow,
+                  const std::vector<uint64_t> &limits, uint64_t *mask)
+{
+    for (unsigned w = 0; w * 64 < n; ++w) {
+        if (!mask[w]) {
+            continue;
+        }
+
+        const uint32_t *v = states + w * 64;
+        unsigned end = std::min(64u, n - w * 64);
+        uint64_t row = firstRow + w * 64;
+        uint64_t bits = 0;
+        for (unsigned j = 0; j < end; ++j) {
+            bits |= (uint64_t) (v[j] < limits.size() && row + j < limits[v[j]]) << j;
+        }
+        mask[w] &= bits;
+    }
+}
+
+}
+
+ColumnQuery::ColumnQuery(const TraceColumns *columns)
+{
+    m_columns = columns;
+    m_typeMask = 0;
+    m_hasPcRange = m_relativePcs = false;
+    m_minPc = m_maxPc = 0;
+    m_hasTimeRange = false;
+    m_minTimeStamp = m_maxTimeStamp = 0;
+    m_hasModule = false;
+    m_module = 0;
+    m_minState = (uint32_t) -1;
+    m_maxState = 0;
+}
+
+void ColumnQuery::addType(s2e::plugins::ExecTraceEntryType type)
+{
+    m_typeMask |= 1 << type;
+}
+
+void ColumnQuery::setPcRange(uint64_t minPc, uint64_t maxPc, bool relative)
+{
+    m_hasPcRange = true;
+    m_relativePcs = relative;
+    m_minPc = minPc;
+    m_maxPc = maxPc;
+}
+
+void ColumnQuery::setTimeRange(uint64_t minTimeStamp, uint64_t maxTimeStamp)
+{
+    m_hasTimeRange = true;
+    m_minTimeStamp = minTimeStamp;
+    m_maxTimeStamp = maxTimeStamp;
+}
+
+void ColumnQuery::setModule(uint16_t module)
+{
+    m_hasModule = true;
+    m_module = module;
+}
+
+void ColumnQuery::selectState(uint32_t state, uint64_t limit)
+{
+    if (m_stateLimits.size() <= state) {
+        m_stateLimits.resize(state + 1, 0);
+    }
+    m_stateLimits[state] = std::max(m_stateLimits[state], limit);
+    m_minState = std::min(m_minState, state);
+    m_maxState = std::max(m_maxState, state);
+}
+
+void ColumnQuery::addState(uint32_t state)
+{
+    selectState(state, (uint64_t) -1);
+}
+
+void ColumnQuery::addPath(uint32_t state)
+{
+    selectState(state, (uint64_t) -1);
+
+    //Each state is forked once, walk up to the initial state
+    std::map<uint32_t, const TraceColumnsFork*> parents;
+    const std::vector<TraceColumnsFork> &forks = m_columns->getForks();
+    for (unsigned i = 0; i < forks.size(); ++i) {
+        parents[forks[i].child] = &forks[i];
+    }
+
+    std::map<uint32_t, const TraceColumnsFork*>::const_iterator it;
+    while ((it = parents.find(state)) != parents.end()) {
+        const TraceColumnsFork *fork = (*it).second;
+        selectState(fork->parent, fork->row + 1);
+        state = fork->parent;
+        parents.erase(it);
+    }
+}
+
+bool ColumnQuery::skipChunk(const TraceColumnsChunk &chunk) const
+{
+    if (m_typeMask && !(m_typeMask & chunk.typeMask)) {
+        return true;
+    }
+
+    if (m_hasPcRange && !m_relativePcs &&
+        (chunk.maxPc < m_minPc || chunk.minPc > m_maxPc)) {
+        return true;
+    }
+
+    if (m_hasTimeRange &&
+        (chunk.maxTimeStamp < m_minTimeStamp || chunk.minTimeStamp > m_maxTimeStamp)) {
+        return true;
+    }
+
+    if (m_hasModule && (m_module < chunk.minModule || m_module > chunk.maxModule)) {
+        return true;
+    }
+
+    if (!m_stateLimits.empty() &&
+        (chunk.maxState < m_minState || chunk.minState > m_maxState)) {
+        return true;
+    }
+
+    return false;
+}
+
+void ColumnQuery::filterChunk(unsigned index, std::vector<uint64_t> &mask) const
+{
+    const TraceColumnsChunk &chunk = m_columns->getChunks()[index];
+    uint64_t first = chunk.firstRow;
+    unsigned n = chunk.rowCount;
+
+    mask.assign((n + 63) / 64, (uint64_t) -1);
+    if (n % 64) {
+        mask.back() = (1ULL << (n % 64)) - 1;
+    }
+
+    if (m_typeMask) {
+        filterTypes(m_columns->getTypes() + first, n, m_typeMask, &mask[0]);
+    }
+
+    if (m_hasModule) {
+        filterEquals16(m_columns->getModules() + first, n, m_module, &mask[0]);
+    }
+
+    if (m_hasPcRange) {
+        const uint64_t *pcs = m_relativePcs ? m_columns->getRelativePcs() : m_columns->getPcs();
+        filterRange64(pcs + first, n, m_minPc, m_maxPc, &mask[0]);
+    }
+
+    if (m_hasTimeRange) {
+        filterRange64(m_columns->getTimeStamps() + first, n,
+                      m_minTimeStamp, m_maxTimeStamp, &mask[0]);
+    }
+
+    if (!m_stateLimits.empty()) {
+        filterStates(m_columns->getStates() + first, n, first, m_stateLimits, &mask[0]);
+    }
+}
+
+void ColumnQuery::runChunk(unsigned index, int mode, ColumnId column,
+                           std::vector<ChunkResult> *results) const
+{
+    const TraceColumnsChunk &chunk = m_columns->getChunks()[index];
+    ChunkResult &result = (*results)[index];
+    result.count = 0;
+
+    if (skipChunk(chunk)) {
+        return;
+    }
+
+    std::vector<uint64_t> mask;
+    filterChunk(index, mask);
+
+    for (unsigned w = 0; w < mask.size(); ++w) {
+        uint64_t bits = mask[w];
+        if (mode == QUERY_COUNT) {
+            result.count += __builtin_popcountll(bits);
+            continue;
+        }
+
+        while (bits) {
+            unsigned bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            uint64_t row = chunk.firstRow + w * 64 + bit;
+            ++result.count;
+
+            if (mode == QUERY_SELECT) {
+                result.rows.push_back(row);
+                continue;
+            }
+
+            uint64_t value;
+            switch (column) {
+                case COLUMN_PC: value = m_columns->getPcs()[row]; break;
+                case COLUMN_RELPC: value = m_columns->getRelativePcs()[row]; break;
+                case COLUMN_STATE: value = m_columns->getStates()[row]; break;
+                case COLUMN_TYPE: value = m_columns->getTypes()[row]; break;
+                case COLUMN_TIMESTAMP: value = m_columns->getTimeStamps()[row]; break;
+                case COLUMN_MODULE: value = m_columns->getModules()[row]; break;
+                default: assert(false); value = 0; break;
+            }
+            result.values.insert(value);
+        }
+    }
+}
+
+void ColumnQuery::run(int mode, ColumnId column, std::vector<ChunkResult> &results,
+                      unsigned threadCount) const
+{
+    results.resize(m_columns->getChunks().size());
+    parallelFor(results.size(), getWorkerCount(threadCount),
+                sigc::bind(sigc::mem_fun(*this, &ColumnQuery::runChunk),
+                           mode, column, &results));
+}
+
+uint64_t ColumnQuery::count(unsigned threadCount) const
+{
+    std::vector<ChunkResult> results;
+    run(QUERY_COUNT, COLUMN_MAX, results, threadCount);
+
+    uint64_t count = 0;
+    for (unsigned i = 0; i < results.size(); ++i) {
+        count += results[i].count;
+    }
+    return count;
+}
+
+void ColumnQuery::select(std::vector<uint64_t> &rows, unsigned threadCount) const
+{
+    std::vector<ChunkResult> results;
+    run(QUERY_SELECT, COLUMN_MAX, results, threadCount);
+
+    rows.clear();
+    for (unsigned i = 0; i < results.size(); ++i) {
+        rows.insert(rows.end(), results[i].rows.begin(), results[i].rows.end());
+    }
+}
+
+void ColumnQuery::distinct(ColumnId column, Values &values, unsigned threadCount) const
+{
+    std::vector<ChunkResult> results;
+    run(QUERY_DISTINCT, column, results, threadCount);
+
+    values.clear();
+    for (unsigned i = 0; i < results.size(); ++i) {
+        values.insert(results[i].values.begin(), results[i].values.end());
+    }
+}
+
+}
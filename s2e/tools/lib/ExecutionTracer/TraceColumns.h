@@ -0,0 +1,266 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#ifndef S2ETOOLS_EXECTRACER_TRACECOLUMNS_H
+#define S2ETOOLS_EXECTRACER_TRACECOLUMNS_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "LogParser.h"
+#include "ModuleParser.h"
+
+/**
+ *  Columnar layout of execution traces.
+ *
+ *  A column directory holds one file per item field, each an array with
+ *  one entry per trace item (rows are numbered like the items of the
+ *  original trace, so the payload of a row can still be fetched with
+ *  LogParser::getItem):
+ *
+ *      pc.col          uint64  program counter (0 for items without one)
+ *      relpc.col       uint64  program counter relative to the module's native base
+ *      state.col       uint32  state id
+ *      type.col        uint8   item type
+ *      timestamp.col   uint64  time stamp
+ *      module.col      uint16  index in the module dictionary (COLUMN_NO_MODULE if none)
+ *
+ *  index.dat starts with a TraceColumnsHeader, followed by the chunk index
+ *  (min/max of the columns over each group of chunkRows rows), the forks
+ *  (to reconstruct the paths of states), and the module names.
+ */
+
+namespace s2etools
+{
+
+#define TRACECOLUMNS_MAGIC 0x534e4d4c4f434553ULL /* "SECOLMNS" */
+#define TRACECOLUMNS_VERSION 1
+#define COLUMN_NO_MODULE 0xffff
+
+struct TraceColumnsHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t chunkRows;
+    uint64_t rowCount;
+    uint32_t chunkCount;
+    uint32_t forkCount;
+    uint32_t moduleCount;
+}__attribute__((packed));
+
+struct TraceColumnsChunk {
+    uint64_t firstRow;
+    uint32_t rowCount;
+    //Bit i is set if the chunk has items of type i
+    uint32_t typeMask;
+    uint64_t minPc, maxPc;
+    uint64_t minTimeStamp, maxTimeStamp;
+    uint32_t minState, maxState;
+    uint16_t minModule, maxModule;
+}__attribute__((packed));
+
+struct TraceColumnsFork {
+    uint64_t row;
+    uint32_t parent;
+    uint32_t child;
+}__attribute__((packed));
+
+enum ColumnId {
+    COLUMN_PC, COLUMN_RELPC, COLUMN_STATE, COLUMN_TYPE,
+    COLUMN_TIMESTAMP, COLUMN_MODULE, COLUMN_MAX
+};
+
+/**
+ *  Exports the items seen by the given LogEvents to a column directory.
+ *  Memory use is bounded by one chunk, whatever the size of the trace.
+ *  Module information comes from the given ModuleCache, which must be
+ *  attached to the same events before the writer.
+ */
+class ColumnWriter
+{
+private:
+    LogEvents *m_events;
+    ModuleCache *m_cache;
+    sigc::connection m_connection;
+
+    std::string m_directory;
+    unsigned m_chunkRows;
+    FILE *m_files[COLUMN_MAX];
+    bool m_error;
+
+    std::vector<uint64_t> m_pcs;
+    std::vector<uint64_t> m_relPcs;
+    std::vector<uint32_t> m_states;
+    std::vector<uint8_t> m_types;
+    std::vector<uint64_t> m_timeStamps;
+    std::vector<uint16_t> m_modules;
+
+    uint64_t m_rowCount;
+    std::vector<TraceColumnsChunk> m_chunks;
+    std::vector<TraceColumnsFork> m_forks;
+    std::vector<std::string> m_moduleNames;
+    std::map<std::string, uint16_t> m_moduleIds;
+
+    void onItem(unsigned traceIndex,
+                const s2e::plugins::ExecutionTraceItemHeader &hdr,
+                void *item);
+
+    uint16_t getModuleId(const std::string &name);
+    void writeChunk();
+
+public:
+    ColumnWriter(LogEvents *events, ModuleCache *cache, unsigned chunkRows = 65536);
+    ~ColumnWriter();
+
+    bool open(const std::string &directory);
+    bool close();
+
+    uint64_t getRowCount() const {
+        return m_rowCount;
+    }
+};
+
+/**
+ *  Read-only, memory-mapped view of a column directory.
+ */
+class TraceColumns
+{
+private:
+    struct MappedColumn {
+        void *data;
+        uint64_t size;
+    };
+
+    MappedColumn m_columns[COLUMN_MAX];
+    TraceColumnsHeader m_header;
+    std::vector<TraceColumnsChunk> m_chunks;
+    std::vector<TraceColumnsFork> m_forks;
+    std::vector<std::string> m_modules;
+
+    bool loadIndex(const std::string &fileName);
+
+public:
+    TraceColumns();
+    ~TraceColumns();
+
+    bool open(const std::string &directory);
+
+    uint64_t getRowCount() const { return m_header.rowCount; }
+
+    const uint64_t *getPcs() const { return (const uint64_t*) m_columns[COLUMN_PC].data; }
+    const uint64_t *getRelativePcs() const { return (const uint64_t*) m_columns[COLUMN_RELPC].data; }
+    const uint32_t *getStates() const { return (const uint32_t*) m_columns[COLUMN_STATE].data; }
+    const uint8_t *getTypes() const { return (const uint8_t*) m_columns[COLUMN_TYPE].data; }
+    const uint64_t *getTimeStamps() const { return (const uint64_t*) m_columns[COLUMN_TIMESTAMP].data; }
+    const uint16_t *getModules() const { return (const uint16_t*) m_columns[COLUMN_MODULE].data; }
+
+    const std::vector<TraceColumnsChunk> &getChunks() const { return m_chunks; }
+    const std::vector<TraceColumnsFork> &getForks() const { return m_forks; }
+    const std::vector<std::string> &getModuleNames() const { return m_modules; }
+
+    //Returns COLUMN_NO_MODULE if the module is not in the trace
+    uint16_t findModule(const std::string &name) const;
+};
+
+/**
+ *  Conjunction of conditions on the rows of a TraceColumns.
+ *  Chunks whose min/max index rules out a match are skipped, the others
+ *  are filtered a column at a time into bitmaps (with SSE2 where the
+ *  column type allows it), on several threads. Results do not depend on
+ *  the number of threads.
+ */
+class ColumnQuery
+{
+public:
+    typedef std::set<uint64_t> Values;
+
+private:
+    const TraceColumns *m_columns;
+
+    uint32_t m_typeMask;
+    bool m_hasPcRange, m_relativePcs;
+    uint64_t m_minPc, m_maxPc;
+    bool m_hasTimeRange;
+    uint64_t m_minTimeStamp, m_maxTimeStamp;
+    bool m_hasModule;
+    uint16_t m_module;
+
+    //Rows of state s match if row < m_stateLimits[s] (0 = state not selected)
+    std::vector<uint64_t> m_stateLimits;
+    uint32_t m_minState, m_maxState;
+
+    struct ChunkResult {
+        uint64_t count;
+        std::vector<uint64_t> rows;
+        Values values;
+    };
+
+    bool skipChunk(const TraceColumnsChunk &chunk) const;
+    void filterChunk(unsigned chunk, std::vector<uint64_t> &mask) const;
+    void runChunk(unsigned chunk, int mode, ColumnId column,
+                  std::vector<ChunkResult> *results) const;
+    void run(int mode, ColumnId column, std::vector<ChunkResult> &results,
+             unsigned threadCount) const;
+    void selectState(uint32_t state, uint64_t limit);
+
+public:
+    ColumnQuery(const TraceColumns *columns);
+
+    void addType(s2e::plugins::ExecTraceEntryType type);
+    void setPcRange(uint64_t minPc, uint64_t maxPc, bool relative);
+    void setTimeRange(uint64_t minTimeStamp, uint64_t maxTimeStamp);
+    void setModule(uint16_t module);
+
+    //Only the items of the state itself
+    void addState(uint32_t state);
+
+    //The items executed on the path that led to the state,
+    //including those of its ancestors before they forked it
+    void addPath(uint32_t state);
+
+    uint64_t count(unsigned threadCount = 0) const;
+    void select(std::vector<uint64_t> &rows, unsigned threadCount = 0) const;
+
+    //Distinct values of the column among the matching rows
+    void distinct(ColumnId column, Values &values, unsigned threadCount = 0) const;
+};
+
+}
+
+#endif
@@ -46,6 +46,7 @@
 #include <lib/BinaryReaders/BFDInterface.h>
 
 #include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+#include <s2e/Plugins/ExecutionTracers/TranslationBlockCoverageFormat.h>
 
 #include <stdio.h>
 #include <ostream>
@@ -54,6 +55,7 @@
 #include <sstream>
 #include <inttypes.h>
 #include <iomanip>
+#include <time.h>
 #include "Coverage.h"
 
 using namespace llvm;
@@ -76,6 +78,20 @@ cl::list<std::string>
 cl::opt<bool>
     Compact("compact", cl::desc("Do not display non-covered blocks"), cl::init(false));
 
+cl::opt<std::string>
+    StreamSocket("stream", cl::desc("Follow a running S2E through the socket of its ExecutionTracer. "
+                                    "The -trace file provides the items written before connecting."),
+                 cl::init(""));
+
+cl::opt<std::string>
+    TbCoverageFile("tbcoverage", cl::desc("Compute the coverage from the tbcoverage.dat file of the "
+                                          "TranslationBlockCoverage plugin instead of a trace"),
+                   cl::init(""));
+
+cl::opt<unsigned>
+    UpdateInterval("update", cl::desc("Rewrite the coverage every given number of seconds when following a stream"),
+                   cl::init(10));
+
 
 //cl::opt<std::string>
 //    CovType("covtype", cl::desc("Coverage type"), cl::init("basicblock"));
@@ -315,6 +331,25 @@ Coverage::~Coverage()
     }
 }
 
+BasicBlockCoverage *Coverage::getCoverage(const std::string &module)
+{
+    BasicBlockCoverage *bbcov = NULL;
+    BbCoverageMap::iterator it = m_bbCov.find(module);
+    if (it == m_bbCov.end()) {
+        //Look for the file containing the bbs.
+        std::string bblist = module + ".bblist";
+        std::string path;
+        if (m_library->findLibrary(bblist, path)) {
+            BasicBlockCoverage *bb = new BasicBlockCoverage(path, module);
+            m_bbCov[module] = bb;
+            bbcov = bb;
+        }
+    }else {
+        bbcov = (*it).second;
+    }
+    return bbcov;
+}
+
 void Coverage::onItem(unsigned traceIndex,
             const s2e::plugins::ExecutionTraceItemHeader &hdr,
             void *item)
@@ -334,20 +369,7 @@ void Coverage::onItem(unsigned traceIndex,
         return;
     }
 
-    BasicBlockCoverage *bbcov = NULL;
-    BbCoverageMap::iterator it = m_bbCov.find(mi->Name);
-    if (it == m_bbCov.end()) {
-        //Look for the file containing the bbs.
-        std::string bblist = mi->Name + ".bblist";
-        std::string path;
-        if (m_library->findLibrary(bblist, path)) {
-            BasicBlockCoverage *bb = new BasicBlockCoverage(path, mi->Name);
-            m_bbCov[mi->Name] = bb;
-            bbcov = bb;
-        }
-    }else {
-        bbcov = (*it).second;
-    }
+    BasicBlockCoverage *bbcov = getCoverage(mi->Name);
 
     uint64_t relPc = te->pc - mi->LoadBase + mi->ImageBase;
 
@@ -360,6 +382,66 @@ void Coverage::onItem(unsigned traceIndex,
     bbcov->addTranslationBlock(hdr.timeStamp, relPc, relPc+te->size-1);
 }
 
+//Reads the tbcoverage.dat file written by the TranslationBlockCoverage plugin
+bool Coverage::loadSnapshot(const std::string &fileName)
+{
+    FILE *fp = fopen(fileName.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "Could not open file " << fileName << std::endl;
+        return false;
+    }
+
+    s2e::plugins::TbCoverageHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != TBCOVERAGE_MAGIC || hdr.version != TBCOVERAGE_VERSION) {
+        std::cerr << fileName << " is not a translation block coverage file" << std::endl;
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<s2e::plugins::TbCoverageModule> modules(hdr.moduleCount);
+    if (hdr.moduleCount &&
+        fread(&modules[0], sizeof(modules[0]), modules.size(), fp) != modules.size()) {
+        std::cerr << fileName << " is truncated" << std::endl;
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<BasicBlockCoverage*> coverage(modules.size());
+    for (unsigned i = 0; i < modules.size(); ++i) {
+        modules[i].name[sizeof(modules[i].name) - 1] = 0;
+        coverage[i] = getCoverage(modules[i].name);
+        if (!coverage[i]) {
+            std::cerr << "Make sure the path to the lists of basic blocks for module "
+                      << modules[i].name << " is correct." << std::endl;
+        }
+    }
+
+    s2e::plugins::TbCoverageBlock block;
+    for (uint64_t i = 0; i < hdr.blockCount; ++i) {
+        if (fread(&block, sizeof(block), 1, fp) != 1) {
+            std::cerr << fileName << " is truncated" << std::endl;
+            break;
+        }
+
+        //Blocks being written when the snapshot was taken
+        if (!block.size || block.module >= modules.size() || !coverage[block.module]) {
+            continue;
+        }
+
+        uint64_t relPc = block.offset + modules[block.module].nativeBase;
+        coverage[block.module]->addTranslationBlock(block.timeStamp, relPc, relPc + block.size - 1);
+    }
+
+    if (hdr.droppedBlocks) {
+        std::cerr << "Warning: " << std::dec << hdr.droppedBlocks << " blocks did not fit in "
+                  << fileName << ", the coverage is incomplete" << std::endl;
+    }
+
+    fclose(fp);
+    return true;
+}
+
 void Coverage::outputCoverage(const std::string &path) const
 {
     BbCoverageMap::const_iterator it;
@@ -408,6 +490,36 @@ void CoverageTool::flatTrace()
     cov.outputCoverage(LogDir);
 }
 
+void CoverageTool::snapshot()
+{
+    Coverage cov(&m_binaries, NULL, &m_parser);
+    if (cov.loadSnapshot(TbCoverageFile)) {
+        cov.outputCoverage(LogDir);
+    }
+}
+
+//Coverage does not depend on the fork tree, the items are processed as they arrive
+void CoverageTool::liveTrace()
+{
+    ModuleCache mc(&m_parser);
+    Coverage cov(&m_binaries, &mc, &m_parser);
+
+    std::string traceFile = TraceFiles.empty() ? "" : TraceFiles[0];
+    if (!m_parser.openStream(StreamSocket, traceFile)) {
+        return;
+    }
+
+    time_t lastUpdate = time(NULL);
+    bool open;
+    do {
+        open = m_parser.pollStream(1000);
+        if (!open || time(NULL) - lastUpdate >= (time_t) UpdateInterval) {
+            cov.outputCoverage(LogDir);
+            lastUpdate = time(NULL);
+        }
+    } while (open);
+}
+
 
 }
 
@@ -417,7 +529,13 @@ int main(int argc, char **argv)
     cl::ParseCommandLineOptions(argc, (char**) argv, " coverage");
 
     s2etools::CoverageTool cov;
-    cov.flatTrace();
+    if (!TbCoverageFile.empty()) {
+        cov.snapshot();
+    } else if (StreamSocket.empty()) {
+        cov.flatTrace();
+    } else {
+        cov.liveTrace();
+    }
 
     return 0;
 }
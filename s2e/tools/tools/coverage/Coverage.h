@@ -160,10 +160,15 @@ private:
                 const s2e::plugins::ExecutionTraceItemHeader &hdr,
                 void *item);
 
+    //Returns NULL if there is no list of basic blocks for the module
+    BasicBlockCoverage *getCoverage(const std::string &module);
+
 public:
     Coverage(Library *lib, ModuleCache *cache, LogEvents *events);
     virtual ~Coverage();
 
+    bool loadSnapshot(const std::string &fileName);
+
     void outputCoverage(const std::string &Path) const;
 
 };
@@ -181,6 +186,8 @@ public:
 
     void process();
     void flatTrace();
+    void liveTrace();
+    void snapshot();
 };
 
 
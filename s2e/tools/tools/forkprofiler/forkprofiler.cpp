@@ -52,6 +52,7 @@
 #include <sstream>
 #include <inttypes.h>
 #include <iomanip>
+#include <time.h>
 #include "forkprofiler.h"
 
 using namespace llvm;
@@ -71,6 +72,15 @@ cl::opt<std::string>
 cl::list<std::string>
     ModPath("modpath", cl::desc("Path to modules"));
 
+cl::opt<std::string>
+    StreamSocket("stream", cl::desc("Follow a running S2E through the socket of its ExecutionTracer. "
+                                    "The -trace file provides the items written before connecting."),
+                 cl::init(""));
+
+cl::opt<unsigned>
+    UpdateInterval("update", cl::desc("Rewrite the profile every given number of seconds when following a stream"),
+                   cl::init(10));
+
 }
 
 namespace s2etools
@@ -285,6 +295,31 @@ int main(int argc, char **argv)
     library.setPaths(ModPath);
 
     LogParser parser;
+
+    if (!StreamSocket.empty()) {
+        //Fork points are counted as they arrive, regardless of the path
+        ModuleCache mc(&parser);
+        ForkProfiler fp(&library, &mc, &parser);
+
+        std::string traceFile = TraceFiles.empty() ? "" : TraceFiles[0];
+        if (!parser.openStream(StreamSocket, traceFile)) {
+            return -1;
+        }
+
+        time_t lastUpdate = time(NULL);
+        bool open;
+        do {
+            open = parser.pollStream(1000);
+            if (!open || time(NULL) - lastUpdate >= (time_t) UpdateInterval) {
+                fp.outputProfile(LogDir);
+                fp.outputGraph(LogDir);
+                lastUpdate = time(NULL);
+            }
+        } while (open);
+
+        return 0;
+    }
+
     PathBuilder pb(&parser);
     parser.parse(TraceFiles);
 
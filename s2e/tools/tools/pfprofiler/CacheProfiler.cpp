@@ -81,6 +81,12 @@ void CacheProfiler::onItem(unsigned traceIndex,
 {
     //std::cout << "Processing entry " << std::dec << traceIndex << " - " << (int)hdr.type << std::endl;
 
+    if (hdr.type == s2e::plugins::TRACE_SAMPLING) {
+        CacheProfilerState *state = static_cast<CacheProfilerState*>(m_Events->getState(this, &CacheProfilerState::factory));
+        state->m_weights.update(*(ExecutionTraceSampling*)item);
+        return;
+    }
+
     if (hdr.type != s2e::plugins::TRACE_CACHESIM) {
         return;
     }
@@ -177,11 +183,14 @@ void CacheProfilerState::processCacheItem(CacheProfiler *cp, uint64_t pid, const
     Cache *c = (*it).second;
     assert(c);
 
-    if (e->missCount > 0) {
+    //Each sampled entry stands for several accesses
+    uint64_t missCount = (uint64_t) (e->missCount * m_weights.get(s2e::plugins::TRACE_CACHESIM) + 0.5);
+
+    if (missCount > 0) {
         if (e->isWrite) {
-            c->m_TotalMissesOnWrite += e->missCount;
+            c->m_TotalMissesOnWrite += missCount;
         }else {
-            c->m_TotalMissesOnRead += e->missCount;
+            c->m_TotalMissesOnRead += missCount;
         }
     }
 
@@ -198,9 +207,9 @@ void CacheProfilerState::processCacheItem(CacheProfiler *cp, uint64_t pid, const
     s.stats.c = c;
 
     if (e->isWrite) {
-        s.stats.writeMissCount = e->missCount;
+        s.stats.writeMissCount = missCount;
     }else {
-        s.stats.readMissCount = e->missCount;
+        s.stats.readMissCount = missCount;
     }
 
     //Update the per-instruction statistics
@@ -210,9 +219,9 @@ void CacheProfilerState::processCacheItem(CacheProfiler *cp, uint64_t pid, const
     }else {
         assert((*cssit).first.first.pid == pid && (*cssit).first.first.pc == e->pc);
         if (e->isWrite) {
-            (*cssit).second.writeMissCount += e->missCount;
+            (*cssit).second.writeMissCount += missCount;
         }else {
-            (*cssit).second.readMissCount += e->missCount;
+            (*cssit).second.readMissCount += missCount;
         }
     }
 }
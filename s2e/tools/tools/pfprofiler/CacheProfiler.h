@@ -39,6 +39,7 @@
 
 #include <lib/ExecutionTracer/LogParser.h>
 #include <lib/ExecutionTracer/ModuleParser.h>
+#include <lib/ExecutionTracer/Sampling.h>
 #include <lib/BinaryReaders/ExecutableFile.h>
 
 #include <lib/BinaryReaders/Library.h>
@@ -182,6 +183,7 @@ class CacheProfilerState: public ItemProcessorState
 {
 private:
     CacheStatisticsMap m_statistics;
+    SamplingWeights m_weights;
 
     void processCacheItem(CacheProfiler *cp, uint64_t pid, const s2e::plugins::ExecutionTraceCacheSimEntry *e);
 public:
@@ -194,6 +196,11 @@ public:
         return m_statistics;
     }
 
+    //Miss counts are estimates when this is set
+    bool isSampled() const {
+        return m_weights.isSampled();
+    }
+
 
     friend class CacheProfiler;
 };
@@ -164,6 +164,7 @@ void PfProfiler::extractAggregatedData()
     pb.getPaths(paths);
 
     PathSet::iterator pit;
+    bool sampled = false;
 
     for(pit = paths.begin(); pit != paths.end(); ++pit) {
 
@@ -191,6 +192,7 @@ void PfProfiler::extractAggregatedData()
         } else {
             statsFile << std::dec << pfs->getPageFaults() << "\t";
             statsFile << pfs->getTlbMisses() << "\t";
+            sampled = sampled || pfs->isSampled();
         }
 
         if (!ics) {
@@ -202,6 +204,10 @@ void PfProfiler::extractAggregatedData()
         statsFile << std::endl;
 
     }
+
+    if (sampled) {
+        statsFile << "#PageFaults and TlbMisses are estimated from a sampled trace" << std::endl;
+    }
 }
 
 void PfProfiler::process()
@@ -262,6 +268,11 @@ void PfProfiler::process()
             statsFile << "No test case in the trace file for the current path" << std::endl;
         }
 
+        CacheProfilerState *cps = static_cast<CacheProfilerState*>(pb.getState(&cp, *pit));
+        if (cps && cps->isSampled()) {
+            statsFile << "Miss counts are estimated from a sampled trace" << std::endl;
+        }
+
         TopMissesPerModule tmpm(&m_binaries, &cp);
 
         tmpm.setFilteredProcess(CPFilterProcess);
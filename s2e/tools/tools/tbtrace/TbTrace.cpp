@@ -79,6 +79,10 @@ cl::opt<bool>
 cl::opt<bool>
         PrintMemory("printMemory", cl::desc("Print memory trace"), cl::init(false));
 
+cl::opt<unsigned>
+        ThreadCount("threads", cl::desc("Number of threads used to decode the trace and process the paths (0=one per processor)"),
+                    cl::init(0));
+
 }
 
 namespace s2etools
@@ -210,14 +214,69 @@ TbTraceTool::~TbTraceTool()
 
 }
 
+TbTraceTask::TbTraceTask(Library *lib, unsigned pathCount)
+{
+    m_library = lib;
+    m_messages.resize(pathCount);
+}
+
+void TbTraceTask::processPath(unsigned index, PathReplay &replay)
+{
+    uint32_t pathId = replay.getPathId();
+    std::stringstream messages;
+
+    std::stringstream ss;
+    ss << LogDir << "/" << pathId << ".txt";
+    std::ofstream traceFile(ss.str().c_str());
+
+    ModuleCache mc(&replay);
+    TestCase tc(&replay);
+    TbTrace trace(m_library, &mc, &replay, traceFile);
+
+    if (!replay.run()) {
+        messages << "Could not process path " << std::dec << pathId << std::endl;
+        m_messages[index] = messages.str();
+        return;
+    }
+
+    traceFile << "----------------------" << std::endl;
+
+    if (trace.hasDebugInfo() == false) {
+        traceFile << "WARNING: No debug information for any module in the path " << std::dec << pathId << std::endl;
+        traceFile << "WARNING: Make sure you have set the module path properly and the binaries contain debug information."
+                << std::endl << std::endl;
+    }
+
+    if (trace.hasModuleInfo() == false) {
+        traceFile << "WARNING: No module information for any module in the path " << std::dec << pathId << std::endl;
+        traceFile << "WARNING: Make sure to use the ModuleTracer plugin before running this tool."
+                << std::endl << std::endl;
+    }
+
+    if (trace.hasItems() == false ) {
+        traceFile << "WARNING: No basic blocks in the path " << std::dec << pathId << std::endl;
+        traceFile << "WARNING: Make sure to use the TranslationBlockTracer plugin before running this tool. "
+                << std::endl << std::endl;
+    }
+
+    TestCaseState *tcs = static_cast<TestCaseState*>(replay.getState(&tc, pathId));
+    if (!tcs) {
+        traceFile << "WARNING: No test case in the path " << std::dec << pathId << std::endl;
+        traceFile << "WARNING: Make sure to use the TestCaseGenerator plugin and terminate the states before running this tool. "
+                << std::endl << std::endl;
+    }else {
+        tcs->printInputs(traceFile);
+    }
+
+    m_messages[index] = messages.str();
+}
+
 void TbTraceTool::flatTrace()
 {
     PathBuilder pb(&m_parser);
+    m_parser.setThreadCount(ThreadCount);
     m_parser.parse(TraceFile);
 
-    ModuleCache mc(&pb);
-    TestCase tc(&pb);
-
     PathSet paths;
     pb.getPaths(paths);
 
@@ -230,58 +289,25 @@ void TbTraceTool::flatTrace()
         }
     }
 
-    //XXX: this is efficient only for short paths or for a small number of
-    //path, because complexity is O(n2): we reprocess the prefixes.
+    std::vector<uint32_t> pathIds;
     for(listit = PathList.begin(); listit != PathList.end(); ++listit) {
-        std::cout << "Processing path " << std::dec << *listit << std::endl;
-        PathSet::iterator pit = paths.find(*listit);
-        if (pit == paths.end()) {
+        if (paths.find(*listit) == paths.end()) {
             std::cerr << "Could not find path with id " << std::dec <<
                     *listit << " in the execution trace." << std::endl;
             continue;
         }
+        pathIds.push_back(*listit);
+    }
 
-        std::stringstream ss;
-        ss << LogDir << "/" << *listit << ".txt";
-        std::ofstream traceFile(ss.str().c_str());
-
-        TbTrace trace(&m_binaries, &mc, &pb, traceFile);
-
-        if (!pb.processPath(*listit)) {
-            std::cerr << "Could not process path " << std::dec << *listit << std::endl;
-            continue;
-        }
-
-        traceFile << "----------------------" << std::endl;
-
-        if (trace.hasDebugInfo() == false) {
-            traceFile << "WARNING: No debug information for any module in the path " << std::dec << *listit << std::endl;
-            traceFile << "WARNING: Make sure you have set the module path properly and the binaries contain debug information."
-                    << std::endl << std::endl;
-        }
+    //Each path replays its prefix from the root, which is O(n2) in the
+    //depth of the tree. Paths are independent, spread them on all processors.
+    TbTraceTask task(&m_binaries, pathIds.size());
+    pb.processPaths(pathIds, task, ThreadCount);
 
-        if (trace.hasModuleInfo() == false) {
-            traceFile << "WARNING: No module information for any module in the path " << std::dec << *listit << std::endl;
-            traceFile << "WARNING: Make sure to use the ModuleTracer plugin before running this tool."
-                    << std::endl << std::endl;
-        }
-
-        if (trace.hasItems() == false ) {
-            traceFile << "WARNING: No basic blocks in the path " << std::dec << *listit << std::endl;
-            traceFile << "WARNING: Make sure to use the TranslationBlockTracer plugin before running this tool. "
-                    << std::endl << std::endl;
-        }
-
-        TestCaseState *tcs = static_cast<TestCaseState*>(pb.getState(&tc, *pit));
-        if (!tcs) {
-            traceFile << "WARNING: No test case in the path " << std::dec << *listit << std::endl;
-            traceFile << "WARNING: Make sure to use the TestCaseGenerator plugin and terminate the states before running this tool. "
-                    << std::endl << std::endl;
-        }else {
-            tcs->printInputs(traceFile);
-        }
+    for (unsigned i = 0; i < pathIds.size(); ++i) {
+        std::cout << "Processed path " << std::dec << pathIds[i] << std::endl;
+        std::cerr << task.getMessages(i);
     }
-
 }
 
 }
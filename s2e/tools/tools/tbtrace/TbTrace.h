@@ -39,6 +39,7 @@
 
 #include <lib/ExecutionTracer/LogParser.h>
 #include <lib/ExecutionTracer/ModuleParser.h>
+#include <lib/ExecutionTracer/Path.h>
 
 #include <ostream>
 #include <fstream>
@@ -89,6 +90,27 @@ public:
 
 };
 
+/**
+ *  Writes the trace of each path in its own file.
+ *  Paths are replayed concurrently, the messages of each
+ *  path are kept aside and printed in order afterwards.
+ */
+class TbTraceTask: public PathTask
+{
+private:
+    Library *m_library;
+    std::vector<std::string> m_messages;
+
+public:
+    TbTraceTask(Library *lib, unsigned pathCount);
+
+    virtual void processPath(unsigned index, PathReplay &replay);
+
+    const std::string &getMessages(unsigned index) const {
+        return m_messages[index];
+    }
+};
+
 class TbTraceTool
 {
 private:
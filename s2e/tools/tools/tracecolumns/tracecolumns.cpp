@@ -0,0 +1,190 @@
+/*
+ * S2E Selective Symbolic Execution Framework
+ *
+ * Copyright (c) 2010, Dependable Systems Laboratory, EPFL
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Dependable Systems Laboratory, EPFL nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE DEPENDABLE SYSTEMS LABORATORY, EPFL BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Currently maintained by:
+ *    Vitaly Chipounov <vitaly.chipounov@epfl.ch>
+ *    Volodymyr Kuznetsov <vova.kuznetsov@epfl.ch>
+ *
+ * All contributors are listed in S2E-AUTHORS file.
+ *
+ */
+
+#define __STDC_FORMAT_MACROS 1
+
+#include "llvm/Support/CommandLine.h"
+
+#include <lib/ExecutionTracer/LogParser.h>
+#include <lib/ExecutionTracer/ModuleParser.h>
+#include <lib/ExecutionTracer/TraceColumns.h>
+
+#include <s2e/Plugins/ExecutionTracers/TraceEntries.h>
+
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#include <inttypes.h>
+
+using namespace llvm;
+using namespace s2etools;
+using namespace s2e::plugins;
+
+namespace {
+
+cl::list<std::string>
+    TraceFiles("trace", llvm::cl::value_desc("Input trace"), llvm::cl::Prefix,
+               llvm::cl::desc("Specify an execution trace file to export"));
+
+cl::opt<std::string>
+    ColumnDir("columns", cl::desc("Column directory to create from the -trace files, or to query"), cl::init(""));
+
+cl::opt<unsigned>
+    ChunkRows("chunkRows", cl::desc("Number of rows summarized by each entry of the chunk index"),
+              cl::init(65536));
+
+cl::list<unsigned>
+    PathList("pathId", cl::desc("Report the translation blocks executed on the path of the given state"));
+
+cl::opt<bool>
+    TestCasePaths("testcasePaths", cl::desc("Report the translation blocks executed on the paths of the "
+                                            "states that generated a test case"),
+                  cl::init(false));
+
+cl::opt<std::string>
+    ModuleName("module", cl::desc("Only report the translation blocks of this module"), cl::init(""));
+
+cl::opt<unsigned>
+    ThreadCount("threads", cl::desc("Number of threads used to run the queries (0=one per processor)"),
+                cl::init(0));
+
+}
+
+static int exportTrace()
+{
+    LogParser parser;
+    parser.setThreadCount(ThreadCount);
+
+    //The module cache must see the items before the writer
+    ModuleCache mc(&parser);
+    ColumnWriter writer(&parser, &mc, ChunkRows);
+
+    if (!writer.open(ColumnDir)) {
+        return -1;
+    }
+
+    if (!parser.parse(TraceFiles)) {
+        return -1;
+    }
+
+    if (!writer.close()) {
+        std::cerr << "Could not write " << ColumnDir << std::endl;
+        return -1;
+    }
+
+    std::cout << "Exported " << writer.getRowCount() << " items to " << ColumnDir << std::endl;
+    return 0;
+}
+
+static int queryCoverage()
+{
+    TraceColumns columns;
+    if (!columns.open(ColumnDir)) {
+        return -1;
+    }
+
+    ColumnQuery query(&columns);
+    query.addType(TRACE_TB_START);
+
+    for (unsigned i = 0; i < PathList.size(); ++i) {
+        query.addPath(PathList[i]);
+    }
+
+    if (TestCasePaths) {
+        ColumnQuery testCases(&columns);
+        testCases.addType(TRACE_TESTCASE);
+
+        ColumnQuery::Values states;
+        testCases.distinct(COLUMN_STATE, states, ThreadCount);
+        ColumnQuery::Values::const_iterator it;
+        for (it = states.begin(); it != states.end(); ++it) {
+            query.addPath(*it);
+        }
+
+        if (states.empty()) {
+            std::cerr << "No state generated a test case" << std::endl;
+            return 0;
+        }
+    }
+
+    const std::vector<std::string> &names = columns.getModuleNames();
+    std::vector<uint16_t> modules;
+
+    if (!ModuleName.empty()) {
+        uint16_t module = columns.findModule(ModuleName);
+        if (module == COLUMN_NO_MODULE) {
+            std::cerr << ModuleName << " does not appear in the trace" << std::endl;
+            return -1;
+        }
+        modules.push_back(module);
+    } else {
+        for (unsigned i = 0; i < names.size(); ++i) {
+            modules.push_back(i);
+        }
+    }
+
+    for (unsigned i = 0; i < modules.size(); ++i) {
+        ColumnQuery moduleQuery(query);
+        moduleQuery.setModule(modules[i]);
+
+        ColumnQuery::Values pcs;
+        moduleQuery.distinct(COLUMN_RELPC, pcs, ThreadCount);
+
+        ColumnQuery::Values::const_iterator it;
+        for (it = pcs.begin(); it != pcs.end(); ++it) {
+            std::cout << names[modules[i]] << "\t0x" << std::hex << std::setw(8)
+                      << std::setfill('0') << *it << std::dec << std::setfill(' ') << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, (char**) argv, " tracecolumns");
+
+    if (ColumnDir.empty()) {
+        std::cerr << "Specify a column directory with -columns" << std::endl;
+        return -1;
+    }
+
+    if (!TraceFiles.empty()) {
+        return exportTrace();
+    }
+
+    return queryCoverage();
+}